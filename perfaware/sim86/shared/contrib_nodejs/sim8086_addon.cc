@@ -103,12 +103,15 @@ typedef void (*sim86_decode8086instruction_t)(u32 SourceSize, u8 *Source, instru
 typedef char const * (*sim86_registernamefromoperand_t)(register_access *RegAccess);
 typedef char const * (*sim86_mnemonicfromoperationtype_t)(operation_type Type);
 typedef void (*sim86_get8086instructiontable_t)(instruction_table *Dest);
+typedef u32 (*sim86_decodemany8086instructioncolumns_t)(u32 SourceSize, u8 *Source, instruction_columns *Dest,
+                                                        decode_range_result *Result);
 
 internal sim86_get_version_t Dll_Sim86_GetVersion;
 internal sim86_decode8086instruction_t Dll_Sim86_Decode8086Instruction;
 internal sim86_registernamefromoperand_t Dll_Sim86_RegisterNameFromOperand;
 internal sim86_mnemonicfromoperationtype_t Dll_Sim86_MnemonicFromOperationType;
 internal sim86_get8086instructiontable_t Dll_Sim86_Get8086InstructionTable;
+internal sim86_decodemany8086instructioncolumns_t Dll_Sim86_DecodeMany8086InstructionColumns;
 
 
 
@@ -135,6 +138,11 @@ LoadSim86(Napi::Env env) {
     Dll_Sim86_Get8086InstructionTable =
       (sim86_get8086instructiontable_t)GetProcAddress(sim86Library, "Sim86_Get8086InstructionTable");
 
+    // Only in version 5 and up. With an older dll this stays null and
+    // decode8086Columns throws, but everything else still works.
+    Dll_Sim86_DecodeMany8086InstructionColumns =
+      (sim86_decodemany8086instructioncolumns_t)GetProcAddress(sim86Library, "Sim86_DecodeMany8086InstructionColumns");
+
   } else {
     Napi::TypeError::New(env, "Could not load sim86_shared.dll").ThrowAsJavaScriptException();
   }
@@ -146,6 +154,7 @@ LoadSim86(Napi::Env env) {
     Dll_Sim86_RegisterNameFromOperand = Sim86_RegisterNameFromOperand;
     Dll_Sim86_MnemonicFromOperationType = Sim86_MnemonicFromOperationType;
     Dll_Sim86_Get8086InstructionTable = Sim86_Get8086InstructionTable;
+    Dll_Sim86_DecodeMany8086InstructionColumns = Sim86_DecodeMany8086InstructionColumns;
 
 #endif
 }
@@ -382,6 +391,147 @@ Napi::Object Sim86Decode8086Instruction(const Napi::CallbackInfo& info) {
 
 
 
+// Decodes a whole Uint8Array (or array of bytes) at once. Every field comes
+// back as a TypedArray with one entry per instruction, all sharing a single
+// ArrayBuffer, so nothing is allocated per instruction. Operand fields are a
+// pair of TypedArrays, [operand 0, operand 1].
+Napi::Object Sim86Decode8086Columns(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Object result = Napi::Object::New(env);
+
+  if (Dll_Sim86_DecodeMany8086InstructionColumns == nullptr ||
+      Dll_Sim86_GetVersion == nullptr || Dll_Sim86_GetVersion() < 5){
+    Napi::TypeError::New(env, "decode8086Columns needs sim86_shared version 5 or later").ThrowAsJavaScriptException();
+    return result;
+  }
+
+  if (info.Length() != 1){
+    Napi::TypeError::New(env, "Wrong number of arguments. Expecting Source").ThrowAsJavaScriptException();
+    return result;
+  }
+
+  u32 sourceSize = 0;
+  u8 *source = 0;
+  u8 *copied = 0;
+  if (info[0].IsTypedArray() && info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint8_array){
+    Napi::Uint8Array napi_source = info[0].As<Napi::Uint8Array>();
+    sourceSize = (u32)napi_source.ElementLength();
+    source = napi_source.Data();
+  } else if (info[0].IsArray()){
+    Napi::Array napi_source = info[0].As<Napi::Array>();
+    sourceSize = napi_source.Length();
+    copied = (u8*)calloc(sourceSize ? sourceSize : 1, sizeof(u8));
+    for(u32 i = 0; i < sourceSize; i++){
+      Napi::Value v = napi_source[i];
+      u32 n = v.IsNumber() ? v.As<Napi::Number>().Uint32Value() : 256;
+      if (n > 255){
+        free(copied);
+        Napi::Error::New(env, "Expected a Number in [0..255] as Array Item").ThrowAsJavaScriptException();
+        return result;
+      }
+      copied[i] = (u8)n;
+    }
+    source = copied;
+  } else {
+    Napi::TypeError::New(env, "Wrong argument. Expecting a Uint8Array or an array of bytes").ThrowAsJavaScriptException();
+    return result;
+  }
+
+  // Every instruction is at least one byte, so the source size is always
+  // enough room. Each column is laid out one after the other in the buffer,
+  // widest first so they all stay aligned.
+  u32 capacity = sourceSize ? sourceSize : 1;
+  size_t size4 = (size_t)capacity*4;
+  size_t size2 = (size_t)capacity*2;
+  size_t size1 = (size_t)capacity;
+  size_t addressAt = 0;
+  size_t displacementAt = addressAt + size4;
+  size_t immediateAt = displacementAt + 2*size4;
+  size_t explicitSegmentAt = immediateAt + 2*size4;
+  size_t sizeAt = explicitSegmentAt + 2*size2;
+  size_t opAt = sizeAt + size1;
+  size_t flagsAt = opAt + size1;
+  size_t segmentOverrideAt = flagsAt + size1;
+  size_t operandTypeAt = segmentOverrideAt + size1;
+  size_t registerIndexAt = operandTypeAt + 2*size1;
+  size_t registerOffsetAt = registerIndexAt + 2*size1;
+  size_t registerCountAt = registerOffsetAt + 2*size1;
+  size_t secondRegisterIndexAt = registerCountAt + 2*size1;
+  size_t operandFlagsAt = secondRegisterIndexAt + 2*size1;
+  size_t totalSize = operandFlagsAt + 2*size1;
+
+  Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, totalSize);
+  u8 *base = (u8*)buffer.Data();
+
+  instruction_columns columns = {};
+  columns.Capacity = capacity;
+  columns.Address = (u32*)(base + addressAt);
+  columns.Size = base + sizeAt;
+  columns.Op = base + opAt;
+  columns.Flags = base + flagsAt;
+  columns.SegmentOverride = base + segmentOverrideAt;
+  columns.OperandType = base + operandTypeAt;
+  columns.RegisterIndex = base + registerIndexAt;
+  columns.RegisterOffset = base + registerOffsetAt;
+  columns.RegisterCount = base + registerCountAt;
+  columns.SecondRegisterIndex = base + secondRegisterIndexAt;
+  columns.Displacement = (s32*)(base + displacementAt);
+  columns.Immediate = (s32*)(base + immediateAt);
+  columns.ExplicitSegment = (u16*)(base + explicitSegmentAt);
+  columns.OperandFlags = base + operandFlagsAt;
+
+  decode_range_result range = {};
+  u32 count = Dll_Sim86_DecodeMany8086InstructionColumns(sourceSize, source, &columns, &range);
+  free(copied);
+
+  result.Set("Count", count);
+  result.Set("ByteCount", range.ByteCount);
+  result.Set("Error", range.Error);
+  result.Set("ErrorOffset", range.ErrorOffset);
+
+  result.Set("Address", Napi::Uint32Array::New(env, count, buffer, addressAt));
+  result.Set("Size", Napi::Uint8Array::New(env, count, buffer, sizeAt));
+  result.Set("Op", Napi::Uint8Array::New(env, count, buffer, opAt));
+  result.Set("Flags", Napi::Uint8Array::New(env, count, buffer, flagsAt));
+  result.Set("SegmentOverride", Napi::Uint8Array::New(env, count, buffer, segmentOverrideAt));
+
+  // Operand 1 of every instruction starts capacity entries after operand 0
+  Napi::Array operandType = Napi::Array::New(env, 2);
+  Napi::Array registerIndex = Napi::Array::New(env, 2);
+  Napi::Array registerOffset = Napi::Array::New(env, 2);
+  Napi::Array registerCount = Napi::Array::New(env, 2);
+  Napi::Array secondRegisterIndex = Napi::Array::New(env, 2);
+  Napi::Array displacement = Napi::Array::New(env, 2);
+  Napi::Array immediate = Napi::Array::New(env, 2);
+  Napi::Array explicitSegment = Napi::Array::New(env, 2);
+  Napi::Array operandFlags = Napi::Array::New(env, 2);
+  for(u32 i = 0; i < 2; i++){
+    operandType[i] = Napi::Uint8Array::New(env, count, buffer, operandTypeAt + i*size1);
+    registerIndex[i] = Napi::Uint8Array::New(env, count, buffer, registerIndexAt + i*size1);
+    registerOffset[i] = Napi::Uint8Array::New(env, count, buffer, registerOffsetAt + i*size1);
+    registerCount[i] = Napi::Uint8Array::New(env, count, buffer, registerCountAt + i*size1);
+    secondRegisterIndex[i] = Napi::Uint8Array::New(env, count, buffer, secondRegisterIndexAt + i*size1);
+    displacement[i] = Napi::Int32Array::New(env, count, buffer, displacementAt + i*size4);
+    immediate[i] = Napi::Int32Array::New(env, count, buffer, immediateAt + i*size4);
+    explicitSegment[i] = Napi::Uint16Array::New(env, count, buffer, explicitSegmentAt + i*size2);
+    operandFlags[i] = Napi::Uint8Array::New(env, count, buffer, operandFlagsAt + i*size1);
+  }
+
+  result.Set("OperandType", operandType);
+  result.Set("RegisterIndex", registerIndex);
+  result.Set("RegisterOffset", registerOffset);
+  result.Set("RegisterCount", registerCount);
+  result.Set("SecondRegisterIndex", secondRegisterIndex);
+  result.Set("Displacement", displacement);
+  result.Set("Immediate", immediate);
+  result.Set("ExplicitSegment", explicitSegment);
+  result.Set("OperandFlags", operandFlags);
+
+  return result;
+}
+
+
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   LoadSim86(env);
   //TODO Where is the destructor?
@@ -402,6 +552,9 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
   exports.Set(Napi::String::New(env, "decode8086Instruction"),
       Napi::Function::New(env, Sim86Decode8086Instruction));
 
+  exports.Set(Napi::String::New(env, "decode8086Columns"),
+      Napi::Function::New(env, Sim86Decode8086Columns));
+
 
   return exports;
 }
@@ -60,4 +60,13 @@ while (offset < exampleDisassembly.length){
     console.log("--------------------------------------------------------------------------------");
 }
 
+if (addon.getVersion() >= 5){
+    let columns = addon.decode8086Columns(Uint8Array.from(exampleDisassembly));
+    console.log("Columns:", columns.Count, "instructions,", columns.ByteCount, "bytes");
+    for (let i = 0; i < columns.Count; i++){
+        console.log(columns.Address[i], addon.getMnemonicFromOperationType(columns.Op[i]),
+                    "Size:", columns.Size[i], "Operand types:", columns.OperandType[0][i], columns.OperandType[1][i]);
+    }
+}
+
 console.log("end");
@@ -8,7 +8,7 @@ from dataclasses import dataclass, fields
 
 ### public interface
 
-VERSION = 3
+VERSION = 5
 
 OperationType = IntEnum("OperationType", """
   none mov push pop xchg in out xlat lea lds les lahf sahf
@@ -32,6 +32,18 @@ ImmediateFlag = IntFlag("ImmediateFlag", """
   relative_jump_displacement
 """.split())
 
+MachineStopFlag = IntFlag("MachineStopFlag", """
+  on_ret on_hlt
+""".split())
+
+MachineStopReason = IntEnum("MachineStopReason", """
+  instruction_limit end_of_code ret hlt unrecognized unimplemented
+""".split(), start=0)
+
+MachineStepFlag = IntFlag("MachineStepFlag", """
+  branch_taken address_is_unaligned
+""".split())
+
 InstructionBitsUsage = IntEnum("InstructionBitsUsage", """
   end literal d s w v z mod reg rm sr disp data
   disp_always_w w_makes_data_w rm_reg_always_w
@@ -70,6 +82,60 @@ class Instruction:
   operands: list[typing.Union[EffectiveAddressExpression, RegisterAccess, Immediate]]
   segment_override: int
 
+@dataclass
+class InstructionColumns:
+  """Decoded instructions as parallel arrays. Each column is a memoryview straight onto the buffer
+  the library wrote into, so it can be wrapped without copying (numpy.frombuffer(columns.op, numpy.uint8)).
+  Operand columns are a pair of memoryviews, one for operand 0 and one for operand 1."""
+  count: int
+  byte_count: int
+  error: int
+  error_offset: int
+  address: memoryview
+  size: memoryview
+  op: memoryview
+  flags: memoryview
+  segment_override: memoryview
+  operand_type: list[memoryview]
+  register_index: list[memoryview]
+  register_offset: list[memoryview]
+  register_count: list[memoryview]
+  second_register_index: list[memoryview]
+  displacement: list[memoryview]
+  immediate: list[memoryview]
+  explicit_segment: list[memoryview]
+  operand_flags: list[memoryview]
+
+@dataclass
+class InstructionBoundaries:
+  """Where each instruction starts, found without decoding any of them. bits is a memoryview of u64s,
+  one bit per byte of the input, lowest bit first: bit N is set if an instruction starts N bytes in."""
+  count: int
+  byte_count: int
+  error: int
+  error_offset: int
+  bits: memoryview
+
+@dataclass
+class PackedInstructions:
+  """Decoded instructions in the library's 16-byte packed form. records is a memoryview of the raw bytes,
+  16 per instruction. Pass any 16-byte slice of it to unpack_8086_instruction to get the full instruction."""
+  count: int
+  byte_count: int
+  error: int
+  error_offset: int
+  records: memoryview
+
+@dataclass
+class MachineRun:
+  """What Machine.run did. If steps were asked for, steps is a memoryview of the raw step records, 56 bytes
+  per instruction: the 16-byte packed instruction (pass it to unpack_8086_instruction), the 16 registers
+  after it ran as u16s, then a u32 rep count, a u16 shift count and a u16 of MachineStepFlag."""
+  count: int
+  stop_reason: MachineStopReason
+  stop_address: int
+  steps: typing.Optional[memoryview]
+
 @dataclass
 class InstructionBits:
   usage: InstructionBitsUsage
@@ -105,6 +171,69 @@ def decode_8086_instruction(data: bytes, offset: int) -> Instruction:
   _decode_8086_instruction(length, ptr, ctypes.byref(decoded))
   return _make(decoded)
 
+def decode_8086_columns(data: bytes, offset: int = 0) -> InstructionColumns:
+  assert isinstance(data, bytes)
+  length = len(data) - offset
+  ptr = ctypes.cast(data, ctypes.POINTER(ctypes.c_ubyte))
+  ptr = ctypes.addressof(ptr.contents) + offset
+
+  # every instruction is at least one byte, so this is always enough room
+  capacity = max(length, 1)
+  columns = _instruction_columns(capacity)
+  for name, ctype in _instruction_columns._columns_:
+    count = capacity * 2 if name in _instruction_columns._operand_columns_ else capacity
+    storage = (ctype * count)()
+    columns._storage_[name] = storage
+    setattr(columns, name, ctypes.cast(storage, ctypes.POINTER(ctype)))
+
+  result = _decode_range_result()
+  count = _decode_many_8086_instruction_columns(length, ptr, ctypes.byref(columns), ctypes.byref(result))
+
+  def column(name):
+    storage = columns._storage_[name]
+    # ctypes arrays export explicit-endian formats that memoryview can't index, so recast to the native one
+    view = memoryview(storage).cast("B").cast(storage._type_._type_)
+    if name in _instruction_columns._operand_columns_:
+      return [view[0:count], view[capacity:capacity + count]]
+    return view[0:count]
+
+  return InstructionColumns(count, result.byte_count, result.error, result.error_offset,
+                            *[column(name) for name, _ in _instruction_columns._columns_])
+
+def scan_8086_boundaries(data: bytes, offset: int = 0) -> InstructionBoundaries:
+  assert isinstance(data, bytes)
+  length = len(data) - offset
+  ptr = ctypes.cast(data, ctypes.POINTER(ctypes.c_ubyte))
+  ptr = ctypes.addressof(ptr.contents) + offset
+
+  storage = (u64 * max((length + 63) // 64, 1))()
+  result = _decode_range_result()
+  count = _scan_8086_instruction_boundaries(length, ptr, storage, ctypes.byref(result))
+
+  bits = memoryview(storage).cast("B").cast("Q")
+  return InstructionBoundaries(count, result.byte_count, result.error, result.error_offset, bits)
+
+def decode_8086_packed(data: bytes, offset: int = 0) -> PackedInstructions:
+  assert isinstance(data, bytes)
+  length = len(data) - offset
+  ptr = ctypes.cast(data, ctypes.POINTER(ctypes.c_ubyte))
+  ptr = ctypes.addressof(ptr.contents) + offset
+
+  # every instruction is at least one byte, so this is always enough room
+  capacity = max(length, 1)
+  storage = (_packed_instruction * capacity)()
+  result = _decode_range_result()
+  count = _decode_many_8086_packed_instructions(length, ptr, capacity, storage, ctypes.byref(result))
+
+  records = memoryview(storage).cast("B")[0:count * ctypes.sizeof(_packed_instruction)]
+  return PackedInstructions(count, result.byte_count, result.error, result.error_offset, records)
+
+def unpack_8086_instruction(record: typing.Union[bytes, memoryview]) -> Instruction:
+  packed = _packed_instruction.from_buffer_copy(record)
+  decoded = _instruction()
+  _unpack_8086_instruction(ctypes.byref(packed), ctypes.byref(decoded))
+  return _make(decoded)
+
 def register_name_from_operand(register_access: RegisterAccess) -> str:
   access = _register_access(register_access.index, register_access.offset, register_access.count)
   return _register_name_from_operand(ctypes.byref(access)).decode("ascii")
@@ -117,12 +246,55 @@ def get_8086_instruction_table() -> InstructionTable:
   _get_8086_instruction_table(ctypes.byref(t))
   return _make(t)
 
+class Machine:
+  """A whole 8086 (1MB of memory and the registers) that runs inside the library. Registers are a list of
+  16 ints indexed the same as RegisterAccess.index, so ip is 13 and flags is 14."""
+  def __init__(self):
+    self._handle = _create_machine()
+    if not self._handle:
+      raise MemoryError("couldn't create a sim86 machine")
+    size = u32()
+    ptr = _get_machine_memory(self._handle, ctypes.byref(size))
+    # this is the machine's own memory, so writes through it are seen by the next run
+    self.memory = memoryview((u8 * size.value).from_address(ctypes.addressof(ptr.contents))).cast("B")
+
+  def close(self):
+    if getattr(self, "_handle", None):
+      self.memory.release()
+      _destroy_machine(self._handle)
+      self._handle = None
+
+  def __del__(self):
+    self.close()
+
+  def load(self, data: bytes, address: int = 0) -> int:
+    assert isinstance(data, bytes)
+    return _load_machine_bytes(self._handle, address, len(data), data)
+
+  def get_registers(self) -> list[int]:
+    registers = (u16 * 16)()
+    _get_machine_registers(self._handle, registers)
+    return list(registers)
+
+  def set_registers(self, registers: list[int]):
+    _set_machine_registers(self._handle, (u16 * 16)(*registers))
+
+  def run(self, max_instructions: int, one_past_last_byte: int = 0x100000,
+          stop_flags: MachineStopFlag = MachineStopFlag(0), record_steps: bool = False) -> MachineRun:
+    storage = (_machine_step * max(max_instructions, 1))() if record_steps else None
+    result = _machine_run_result()
+    count = _run_machine(self._handle, one_past_last_byte, max_instructions, stop_flags, storage, ctypes.byref(result))
+    steps = memoryview(storage).cast("B")[0:count * ctypes.sizeof(_machine_step)] if record_steps else None
+    return MachineRun(count, MachineStopReason(result.stop_reason), result.stop_address, steps)
+
 
 ### implementation details
 
 
 u8 = ctypes.c_ubyte
+u16 = ctypes.c_ushort
 u32 = ctypes.c_uint
+u64 = ctypes.c_ulonglong
 s32 = ctypes.c_int
 
 _operand_type = IntEnum("OperandType", """
@@ -179,6 +351,54 @@ class _instruction(ctypes.Structure):
     operands = [op._convert() for op in self.operands if op.type != _operand_type.none]
     return Instruction(self.address, self.size, OperationType(self.op), InstructionFlag(self.flags), operands, self.segment_override)
 
+class _decode_range_result(ctypes.Structure):
+  _fields_ = [("instruction_count", u32),
+              ("byte_count", u32),
+              ("error_offset", u32),
+              ("error", u32)]
+
+class _instruction_columns(ctypes.Structure):
+  _columns_ = [("address", u32),
+               ("size", u8),
+               ("op", u8),
+               ("flags", u8),
+               ("segment_override", u8),
+               ("operand_type", u8),
+               ("register_index", u8),
+               ("register_offset", u8),
+               ("register_count", u8),
+               ("second_register_index", u8),
+               ("displacement", s32),
+               ("immediate", s32),
+               ("explicit_segment", u16),
+               ("operand_flags", u8)]
+  _operand_columns_ = set(name for name, _ in _columns_[5:])
+  _fields_ = [("capacity", u32)] + [(name, ctypes.POINTER(ctype)) for name, ctype in _columns_]
+  def __init__(self, capacity):
+    super().__init__(capacity)
+    self._storage_ = {}
+
+class _packed_instruction(ctypes.Structure):
+  _fields_ = [("address", u32),
+              ("size", u8),
+              ("op", u8), # OperationType
+              ("flags", u8), # InstructionFlag
+              ("segment_override", u8),
+              ("operands", u16 * 2),
+              ("values", u16 * 2)]
+
+class _machine_run_result(ctypes.Structure):
+  _fields_ = [("instruction_count", u32),
+              ("stop_reason", u32), # MachineStopReason
+              ("stop_address", u32)]
+
+class _machine_step(ctypes.Structure):
+  _fields_ = [("instruction", _packed_instruction),
+              ("registers", u16 * 16),
+              ("rep_count", u32),
+              ("shift_count", u16),
+              ("flags", u16)] # MachineStepFlag
+
 class _instruction_bits(ctypes.Structure):
   _fields_ = [("usage", u8), # InstructionBitsUsage
               ("bit_count", u8),
@@ -205,9 +425,34 @@ _get_version = dll.Sim86_GetVersion
 _get_version.argtypes = []
 _get_version.restype = u32
 
+dll_version = _get_version()
+
+def _since(version, name, argtypes, restype=None):
+  # functions newer than the oldest library this works with are looked up the first time they're called,
+  # so an older dll still loads and can be used for everything it does have
+  function = None
+  def call(*args):
+    nonlocal function
+    if function is None:
+      if dll_version < version:
+        raise NotImplementedError(f"{name} needs sim86 library version {version}, the loaded one is version {dll_version}")
+      function = getattr(dll, name)
+      function.argtypes = argtypes
+      function.restype = restype
+    return function(*args)
+  return call
+
 _decode_8086_instruction = dll.Sim86_Decode8086Instruction
 _decode_8086_instruction.argtypes = [u32, ctypes.c_void_p, ctypes.POINTER(_instruction)]
 
+_decode_many_8086_instruction_columns = _since(5, "Sim86_DecodeMany8086InstructionColumns", [u32, ctypes.c_void_p, ctypes.POINTER(_instruction_columns), ctypes.POINTER(_decode_range_result)], u32)
+
+_decode_many_8086_packed_instructions = _since(5, "Sim86_DecodeMany8086PackedInstructions", [u32, ctypes.c_void_p, u32, ctypes.POINTER(_packed_instruction), ctypes.POINTER(_decode_range_result)], u32)
+
+_unpack_8086_instruction = _since(5, "Sim86_Unpack8086Instruction", [ctypes.POINTER(_packed_instruction), ctypes.POINTER(_instruction)])
+
+_scan_8086_instruction_boundaries = _since(5, "Sim86_Scan8086InstructionBoundaries", [u32, ctypes.c_void_p, ctypes.POINTER(u64), ctypes.POINTER(_decode_range_result)], u32)
+
 _register_name_from_operand = dll.Sim86_RegisterNameFromOperand
 _register_name_from_operand.argtypes = [ctypes.POINTER(_register_access)]
 _register_name_from_operand.restype = ctypes.c_char_p
@@ -219,6 +464,20 @@ _mnemonic_from_operation_type.restype = ctypes.c_char_p
 _get_8086_instruction_table = dll.Sim86_Get8086InstructionTable
 _get_8086_instruction_table.argtypes = [ctypes.POINTER(_instruction_table)]
 
+_create_machine = _since(5, "Sim86_CreateMachine", [], ctypes.c_void_p)
+
+_destroy_machine = _since(5, "Sim86_DestroyMachine", [ctypes.c_void_p])
+
+_load_machine_bytes = _since(5, "Sim86_LoadMachineBytes", [ctypes.c_void_p, u32, u32, ctypes.c_char_p], u32)
+
+_get_machine_memory = _since(5, "Sim86_GetMachineMemory", [ctypes.c_void_p, ctypes.POINTER(u32)], ctypes.POINTER(u8))
+
+_get_machine_registers = _since(5, "Sim86_GetMachineRegisters", [ctypes.c_void_p, ctypes.POINTER(u16)])
+
+_set_machine_registers = _since(5, "Sim86_SetMachineRegisters", [ctypes.c_void_p, ctypes.POINTER(u16)])
+
+_run_machine = _since(5, "Sim86_RunMachine", [ctypes.c_void_p, u32, u32, u32, ctypes.POINTER(_machine_step), ctypes.POINTER(_machine_run_result)], u32)
+
 ### helper function to convert ctypes -> dataclass
 
 def _make(obj):
@@ -19,6 +19,70 @@ example_disassembly = bytes([
     0xDE, 0xE1, 0xDC, 0xE0, 0xDA, 0xE3, 0xD8,
 ])
 
+def decode_one_at_a_time(data):
+  decoded = []
+  offset = 0
+  while offset < len(data):
+    instruction = sim86.decode_8086_instruction(data, offset)
+    if instruction.op == sim86.OperationType.none:
+      break
+    instruction.address = offset
+    decoded.append(instruction)
+    offset += instruction.size
+  return decoded
+
+def test_columns(expected):
+  columns = sim86.decode_8086_columns(example_disassembly)
+  assert columns.count == len(expected)
+  assert columns.byte_count == len(example_disassembly)
+  assert columns.error == 0
+  for index, instruction in enumerate(expected):
+    assert columns.address[index] == instruction.address
+    assert columns.size[index] == instruction.size
+    assert columns.op[index] == instruction.op
+    assert columns.flags[index] == instruction.flags
+  print(f"Columns: {columns.count} instructions match")
+
+def test_boundaries(expected):
+  boundaries = sim86.scan_8086_boundaries(example_disassembly)
+  assert boundaries.count == len(expected)
+  assert boundaries.byte_count == len(example_disassembly)
+  starts = set(instruction.address for instruction in expected)
+  for offset in range(len(example_disassembly)):
+    is_start = (boundaries.bits[offset // 64] >> (offset % 64)) & 1
+    assert bool(is_start) == (offset in starts)
+  print(f"Boundaries: {boundaries.count} instruction starts match")
+
+def test_packed(expected):
+  packed = sim86.decode_8086_packed(example_disassembly)
+  assert packed.count == len(expected)
+  for index, instruction in enumerate(expected):
+    unpacked = sim86.unpack_8086_instruction(packed.records[16*index:16*(index + 1)])
+    assert unpacked == instruction
+  print(f"Packed: {packed.count} instructions round-trip")
+
+def test_machine():
+  # mov cx, 5 / add ax, cx / loop $-2 / hlt sums 5+4+3+2+1 into ax
+  program = bytes([0xB9, 0x05, 0x00, 0x01, 0xC8, 0xE2, 0xFC, 0xF4])
+  machine = sim86.Machine()
+  assert machine.load(program) == len(program)
+  assert bytes(machine.memory[0:len(program)]) == program
+
+  run = machine.run(1000, len(program), sim86.MachineStopFlag.on_hlt, record_steps=True)
+  assert run.stop_reason == sim86.MachineStopReason.hlt
+  assert run.count == 12
+  assert len(run.steps) == 56*run.count
+  registers = machine.get_registers()
+  assert registers[1] == 15 # ax
+  assert registers[3] == 0 # cx
+  assert registers[13] == len(program) # ip
+
+  registers[1] = 1234
+  machine.set_registers(registers)
+  assert machine.get_registers()[1] == 1234
+  machine.close()
+  print(f"Machine: {run.count} instructions, ax = 15")
+
 if __name__ == "__main__":
   version = sim86.get_version()
   print(f"Sim86 Version: {version}")
@@ -36,3 +100,10 @@ if __name__ == "__main__":
     else:
       print("unrecognized instruction")
       break
+
+  if sim86.dll_version >= 5:
+    expected = decode_one_at_a_time(example_disassembly)
+    test_columns(expected)
+    test_boundaries(expected)
+    test_packed(expected)
+    test_machine()
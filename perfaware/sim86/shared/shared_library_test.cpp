@@ -66,5 +66,35 @@ int main(void)
         }
     }
     
+    // NOTE: The same bytes can also be decoded in a single call, which is much cheaper when calling
+    // through a foreign function interface
+    instruction Batch[256];
+    decode_range_result Range;
+    u32 BatchCount = Sim86_DecodeMany8086Instructions(sizeof(ExampleDisassembly), ExampleDisassembly,
+                                                      sizeof(Batch) / sizeof(Batch[0]), Batch, &Range);
+    printf("Batch decode: %u instructions, %u bytes", BatchCount, Range.ByteCount);
+    if(Range.Error)
+    {
+        printf(", error %u at offset %u", Range.Error, Range.ErrorOffset);
+    }
+    printf("\n");
+    
+    // NOTE: Code can also be run, on a machine that lives inside the library. This sums 5+4+3+2+1 into ax.
+    u8 ExampleProgram[] = {0xB9, 0x05, 0x00, 0x01, 0xC8, 0xE2, 0xFC, 0xF4};
+    sim86_machine *Machine = Sim86_CreateMachine();
+    if(Machine)
+    {
+        Sim86_LoadMachineBytes(Machine, 0, sizeof(ExampleProgram), ExampleProgram);
+        
+        machine_run_result Run;
+        Sim86_RunMachine(Machine, sizeof(ExampleProgram), 1000, MachineStop_OnHlt, 0, &Run);
+        
+        u16 Registers[16];
+        Sim86_GetMachineRegisters(Machine, Registers);
+        printf("Machine: %u instructions, stop reason %u, ax = %u\n", Run.InstructionCount, Run.StopReason, Registers[1]);
+        
+        Sim86_DestroyMachine(Machine);
+    }
+    
     return 0;
 }
@@ -10,7 +10,9 @@ typedef long long s64;
 
 typedef s32 b32;
 
-static u32 const SIM86_VERSION = 4;
+typedef double f64;
+
+static u32 const SIM86_VERSION = 5;
 typedef u32 register_index;
 
 typedef struct register_access register_access;
@@ -19,6 +21,12 @@ typedef struct effective_address_expression effective_address_expression;
 typedef struct immediate immediate;
 typedef struct instruction_operand instruction_operand;
 typedef struct instruction instruction;
+typedef struct decode_range_result decode_range_result;
+typedef struct instruction_columns instruction_columns;
+typedef struct packed_instruction packed_instruction;
+typedef struct sim86_machine sim86_machine;
+typedef struct machine_step machine_step;
+typedef struct machine_run_result machine_run_result;
 
 typedef enum operation_type : u32
 {
@@ -224,6 +232,99 @@ struct instruction
 
     register_index SegmentOverride;
 };
+
+enum decode_range_error
+{
+    DecodeRange_OK,
+    DecodeRange_Unrecognized,
+    DecodeRange_Truncated,
+};
+struct decode_range_result
+{
+    u32 InstructionCount;
+    u32 ByteCount;
+    u32 ErrorOffset;
+    u32 Error;
+};
+
+struct instruction_columns
+{
+    u32 Capacity;
+
+    u32 *Address;
+    u8 *Size;
+    u8 *Op;
+    u8 *Flags;
+    u8 *SegmentOverride;
+
+    u8 *OperandType;
+    u8 *RegisterIndex;
+    u8 *RegisterOffset;
+    u8 *RegisterCount;
+    u8 *SecondRegisterIndex;
+    s32 *Displacement;
+    s32 *Immediate;
+    u16 *ExplicitSegment;
+    u8 *OperandFlags;
+};
+
+enum packed_operand_bits
+{
+    PackedOperand_TypeMask = 0x3,
+    PackedOperand_Flag = 0x4,
+    PackedOperand_SignExtended = 0x8,
+
+    PackedOperand_RegisterShift = 4,
+    PackedOperand_SecondRegisterShift = 8,
+    PackedOperand_RegisterOffsetShift = 12,
+    PackedOperand_RegisterCountShift = 13,
+};
+struct packed_instruction
+{
+    u32 Address;
+    u8 Size;
+    u8 Op;
+    u8 Flags;
+    u8 SegmentOverride;
+    u16 Operands[2];
+    u16 Values[2];
+};
+
+enum machine_stop_flag
+{
+    MachineStop_OnRet = 0x1,
+    MachineStop_OnHlt = 0x2,
+};
+
+enum machine_stop_reason
+{
+    MachineStopped_InstructionLimit,
+    MachineStopped_EndOfCode,
+    MachineStopped_Ret,
+    MachineStopped_Hlt,
+    MachineStopped_Unrecognized,
+    MachineStopped_Unimplemented,
+};
+struct machine_run_result
+{
+    u32 InstructionCount;
+    u32 StopReason;
+    u32 StopAddress;
+};
+
+enum machine_step_flag
+{
+    MachineStep_BranchTaken = 0x1,
+    MachineStep_AddressIsUnaligned = 0x2,
+};
+struct machine_step
+{
+    packed_instruction Instruction;
+    u16 Registers[16];
+    u32 RepCount;
+    u16 ShiftCount;
+    u16 Flags;
+};
 enum instruction_bits_usage : u8
 {
     Bits_End,
@@ -277,9 +378,26 @@ extern "C"
 #endif
     u32 Sim86_GetVersion(void);
     void Sim86_Decode8086Instruction(u32 SourceSize, u8 *Source, instruction *Dest);
+    u32 Sim86_DecodeMany8086Instructions(u32 SourceSize, u8 *Source, u32 DestCount, instruction *Dest,
+                                         decode_range_result *Result);
+    u32 Sim86_DecodeMany8086InstructionColumns(u32 SourceSize, u8 *Source, instruction_columns *Dest,
+                                               decode_range_result *Result);
+    u32 Sim86_DecodeMany8086PackedInstructions(u32 SourceSize, u8 *Source, u32 DestCount, packed_instruction *Dest,
+                                               decode_range_result *Result);
+    void Sim86_Unpack8086Instruction(packed_instruction *Source, instruction *Dest);
+    u32 Sim86_Scan8086InstructionBoundaries(u32 SourceSize, u8 *Source, u64 *Boundaries,
+                                            decode_range_result *Result);
     char const *Sim86_RegisterNameFromOperand(register_access *RegAccess);
     char const *Sim86_MnemonicFromOperationType(operation_type Type);
     void Sim86_Get8086InstructionTable(instruction_table *Dest);
+    sim86_machine *Sim86_CreateMachine(void);
+    void Sim86_DestroyMachine(sim86_machine *Machine);
+    u32 Sim86_LoadMachineBytes(sim86_machine *Machine, u32 Address, u32 SourceSize, u8 *Source);
+    u8 *Sim86_GetMachineMemory(sim86_machine *Machine, u32 *Size);
+    void Sim86_GetMachineRegisters(sim86_machine *Machine, u16 *Dest);
+    void Sim86_SetMachineRegisters(sim86_machine *Machine, u16 *Source);
+    u32 Sim86_RunMachine(sim86_machine *Machine, u32 OnePastLastByte, u32 MaxInstructions, u32 StopFlags,
+                         machine_step *Steps, machine_run_result *Result);
 #ifdef __cplusplus
 }
 #endif
@@ -23,26 +23,57 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include "sim86_instruction.h"
 #include "sim86_instruction_table.h"
 #include "sim86_memory.h"
 #include "sim86_decode.h"
+#include "sim86_length.h"
+#include "sim86_decode_memo.h"
+#include "sim86_state.h"
 #include "sim86_execute.h"
 #include "sim86_cycles.h"
+#include "sim86_bus.h"
 #include "sim86_text.h"
+#include "sim86_platform.h"
+#include "sim86_microops.h"
+#include "sim86_block_cache.h"
+#include "sim86_parallel_decode.h"
+#include "sim86_bench.h"
+#include "sim86_trace_format.h"
+#include "sim86_trace.h"
+#include "sim86_snapshot.h"
+#include "sim86_profile.h"
+#include "sim86_loops.h"
+#include "sim86_jit.h"
 
 #include "sim86_instruction.cpp"
 #include "sim86_instruction_table.cpp"
 #include "sim86_memory.cpp"
 #include "sim86_decode.cpp"
+#include "sim86_length.cpp"
+#include "sim86_decode_memo.cpp"
 #include "sim86_execute.cpp"
 #include "sim86_cycles.cpp"
+#include "sim86_bus.cpp"
 #include "sim86_text_table.cpp"
 #include "sim86_text.cpp"
+#include "sim86_text_exec.cpp"
+#include "sim86_platform.cpp"
+#include "sim86_microops.cpp"
+#include "sim86_block_cache.cpp"
+#include "sim86_parallel_decode.cpp"
+#include "sim86_bench.cpp"
+#include "sim86_trace.cpp"
+#include "sim86_snapshot.cpp"
+#include "sim86_profile.cpp"
+#include "sim86_loops.cpp"
+#include "sim86_jit.cpp"
 
 enum sim_flags
 {
@@ -51,8 +82,41 @@ enum sim_flags
     SimFlag_DumpMemory = 0x4,
     SimFlag_ExplainClocks = 0x8,
     SimFlag_NoRegisterDiffs = 0x10,
+    SimFlag_ReferenceDecode = 0x20,
+    SimFlag_DecodeBench = 0x40,
+    SimFlag_SpecializedDecode = 0x80,
+    SimFlag_NoBlockCache = 0x100,
+    SimFlag_BlockStats = 0x200,
+    SimFlag_MicroOps = 0x400,
+    SimFlag_LazyFlags = 0x800,
+    SimFlag_Bench = 0x1000,
+    SimFlag_Trace = 0x2000,
+    SimFlag_Profile = 0x4000,
+    SimFlag_Jit = 0x8000,
+    SimFlag_JitAll = 0x10000, // NOTE: Compiles every block the first time it is entered, instead of waiting for it to get hot
+    SimFlag_JitCheck = 0x20000,
+    SimFlag_BusClocks = 0x40000,
+    SimFlag_LoopAnalysis = 0x80000,
+    SimFlag_MapMemory = 0x100000,
+    SimFlag_MapShared = 0x200000,
+    SimFlag_DecodeMemo = 0x400000,
 };
 
+static decode_mode DecodeModeFrom(u32 SimFlags)
+{
+    decode_mode Result = DecodeMode_Lookup;
+    if(SimFlags & SimFlag_ReferenceDecode)
+    {
+        Result = DecodeMode_Reference;
+    }
+    else if(SimFlags & SimFlag_SpecializedDecode)
+    {
+        Result = DecodeMode_Specialized;
+    }
+    
+    return Result;
+}
+
 static u32 LoadMemoryFromFile(char *FileName, segmented_access SegMem, u32 AtOffset)
 {
     u32 Result = 0;
@@ -93,30 +157,162 @@ static segmented_access AllocateMemoryPow2(u32 SizePow2)
     return Result;
 }
 
-static void PrintEstimatedClocks(timing_state State, instruction Instruction, u32 SimFlags,
-                                 instruction_clock_interval *Accum)
+static u32 LoadOrMapMemoryFromFile(char *FileName, u32 SimFlags, b32 Clear, segmented_access *Memory, mapped_file *Mapping)
 {
-    instruction_timing Timing = EstimateInstructionClocks(State, Instruction);
+    /* NOTE: With -map or -mapshared, *Memory is pointed straight at a mapping of the file instead, so
+       nothing has to be read or cleared. The mapping is the same size as *Memory was, and anything past
+       the end of the file starts out zero. With -mapshared, only the file's own bytes get written back,
+       so the file never changes size, and ReleaseMappedMemory warns about anything written past its end.
+       If the file can't be mapped, it is read into *Memory the usual way, after zeroing it first if Clear
+       is set. */
+    u32 Result = 0;
+    
+    *Mapping = {};
+    if(SimFlags & (SimFlag_MapMemory|SimFlag_MapShared))
+    {
+        *Mapping = MapFile(FileName, GetHighestAddress(*Memory) + 1, (SimFlags & SimFlag_MapShared));
+        if(Mapping->Memory)
+        {
+            Memory->Memory = Mapping->Memory;
+            Result = Mapping->FileSize;
+        }
+        else if(SimFlags & SimFlag_MapShared)
+        {
+            fprintf(stderr, "WARNING: Unable to map %s, so its final memory state will not be written back to it.\n", FileName);
+        }
+    }
+    
+    if(!Mapping->Memory)
+    {
+        if(Clear)
+        {
+            memset(Memory->Memory, 0, GetHighestAddress(*Memory) + 1);
+        }
+        Result = LoadMemoryFromFile(FileName, *Memory, 0);
+    }
+    
+    return Result;
+}
+
+static void ReleaseMappedMemory(char const *FileName, mapped_file *Mapping)
+{
+    // NOTE: Only the file's own bytes go back to it. Everything past its end started out zero, so any
+    // byte there that isn't zero anymore is a write the file will never see.
+    if(Mapping->Shared)
+    {
+        u32 LostCount = 0;
+        u32 FirstLost = 0;
+        for(u32 Address = Mapping->FileSize; Address < Mapping->Size; ++Address)
+        {
+            if(Mapping->Memory[Address])
+            {
+                if(!LostCount)
+                {
+                    FirstLost = Address;
+                }
+                ++LostCount;
+            }
+        }
+        
+        if(LostCount)
+        {
+            fprintf(stderr, "WARNING: %u bytes written past the end of %s (%u bytes), starting at %05x, were not written back to it.\n",
+                    LostCount, FileName, Mapping->FileSize, FirstLost);
+        }
+    }
+    
+    // NOTE: For -mapshared, this is where the final memory state gets written back to the file
+    if(!FlushMappedFile(Mapping))
+    {
+        fprintf(stderr, "ERROR: Unable to write the final memory state back to %s.\n", FileName);
+    }
+    
+    UnmapFile(Mapping);
+}
+
+// NOTE: The estimate is always added into Accum, even when there is no Out to print it to.
+// If the instruction's static timing was cached, pass it in as Static so it doesn't get looked up again.
+static instruction_clock_interval PrintEstimatedClocks(timing_state State, instruction Instruction, static_timing *Static,
+                                                       u32 SimFlags, instruction_clock_interval *Accum, text_buffer *Out)
+{
+    instruction_timing Timing = ApplyDynamicTiming(State, Static ? *Static : GetStaticTiming(Instruction));
     instruction_clock_interval Clocks = ExpectedClocksFrom(State, Instruction, Timing);
     Accum->Min += Clocks.Min;
     Accum->Max += Clocks.Max;
     
-    if(Accum->Min != Accum->Max)
+    if(Out)
+    {
+        PrintClockStep(Clocks, *Accum, Out);
+        if(SimFlags & SimFlag_ExplainClocks)
+        {
+            ExplainTiming(Timing, Clocks, Out);
+        }
+    }
+    
+    return Clocks;
+}
+
+static void PrintDisAsmLine(instruction Instruction, u32 SimFlags, timing_state Timing,
+                            instruction_clock_interval *TimeAccum, text_buffer *Out)
+{
+    PrintInstruction(Instruction, Out);
+    if(SimFlags & SimFlag_ShowClocks)
     {
-        fprintf(stdout, "Clocks: +[%u,%u] = [%u,%u]", Clocks.Min, Clocks.Max, Accum->Min, Accum->Max);
+        EmitString(Out, " ; ");
+        PrintEstimatedClocks(Timing, Instruction, 0, SimFlags, TimeAccum, Out);
     }
-    else
+    EmitChar(Out, '\n');
+}
+
+static u32 DecodeAll8086(instruction_table Table, u32 DisAsmByteCount, segmented_access DisAsmStart, decode_mode Mode,
+                         decode_memo *Memo = 0)
+{
+    u32 Result = 0;
+    
+    segmented_access At = DisAsmStart;
+    u32 Count = DisAsmByteCount;
+    while(Count)
     {
-        fprintf(stdout, "Clocks: +%u = %u", Clocks.Min, Accum->Min);
+        instruction Instruction = Memo ? DecodeInstructionMemoized(Memo, At) : DecodeInstruction(Table, At, Mode);
+        if(!Instruction.Op || (Instruction.Size > Count))
+        {
+            break;
+        }
+        
+        At = MoveBaseBy(At, Instruction.Size);
+        Count -= Instruction.Size;
+        ++Result;
     }
     
-    if(SimFlags & SimFlag_ExplainClocks)
+    return Result;
+}
+
+static f64 SecondsPerDecodePass(instruction_table Table, u32 DisAsmByteCount, segmented_access DisAsmStart,
+                                decode_mode Mode, decode_memo *Memo)
+{
+    // NOTE: Passes are repeated until there is enough time for the OS timer to measure. With a memo, it
+    // is emptied before every pass, so each pass pays for filling it the same way one disassembly does.
+    u64 MinTime = GetOSTimerFreq() / 50;
+    u64 PassCount = 0;
+    u64 StartTime = ReadOSTimer();
+    u64 Elapsed = 0;
+    while(Elapsed < MinTime)
     {
-        ExplainTiming(Timing, Clocks, stdout);
+        if(Memo)
+        {
+            ResetDecodeMemo(Memo);
+        }
+        DecodeAll8086(Table, DisAsmByteCount, DisAsmStart, Mode, Memo);
+        ++PassCount;
+        Elapsed = ReadOSTimer() - StartTime;
     }
+    
+    f64 Result = SecondsFromOSTime(Elapsed) / (f64)PassCount;
+    return Result;
 }
 
-static void DisAsm8086(u32 DisAsmByteCount, segmented_access DisAsmStart, u32 SimFlags, timing_state Timing)
+static void DisAsm8086(u32 DisAsmByteCount, segmented_access DisAsmStart, u32 SimFlags, timing_state Timing,
+                       u32 ThreadCount, text_buffer *Out)
 {
     segmented_access At = DisAsmStart;
     
@@ -127,52 +323,325 @@ static void DisAsm8086(u32 DisAsmByteCount, segmented_access DisAsmStart, u32 Si
     Timing.AssumeBranchTaken = true;
     instruction_clock_interval TimeAccum = {};
     
-    u32 Count = DisAsmByteCount;
-    while(Count)
+    decode_mode Mode = DecodeModeFrom(SimFlags);
+    
+    // NOTE: With -memo, instructions go through the decode memo, which has to see them in order on
+    // one thread, so the image isn't split up
+    decode_memo *Memo = (SimFlags & SimFlag_DecodeMemo) ? AllocateDecodeMemo(Table, Mode) : 0;
+    
+    // NOTE: Large images are decoded on several threads at once. Printing still happens here, in order,
+    // so the output is exactly what decoding one instruction at a time would have printed.
+    parallel_decode Decode = {};
+    if(!Memo && (ThreadCount > 1) && (DisAsmByteCount >= 2*PARALLEL_DECODE_MIN_CHUNK_SIZE))
+    {
+        Decode = DecodeInParallel(Table, DisAsmStart, DisAsmByteCount, Mode, ThreadCount);
+    }
+    
+    if(Decode.Chunks)
     {
-        instruction Instruction = DecodeInstruction(Table, At);
-        if(Instruction.Op)
+        u32 Count = DisAsmByteCount;
+        b32 Stopped = false;
+        for(u32 ChunkIndex = 0; !Stopped && (ChunkIndex < Decode.ChunkCount); ++ChunkIndex)
         {
-            if(Count >= Instruction.Size)
+            decode_chunk *Chunk = Decode.Chunks + ChunkIndex;
+            for(u32 Index = 0; Index < Chunk->Count; ++Index)
             {
-                At = MoveBaseBy(At, Instruction.Size);
-                Count -= Instruction.Size;
+                instruction Instruction = UnpackInstruction(Chunk->First[Index]);
+                if(Count >= Instruction.Size)
+                {
+                    Count -= Instruction.Size;
+                }
+                else
+                {
+                    FlushText(Out);
+                    fprintf(stderr, "ERROR: Instruction extends outside disassembly region\n");
+                    Stopped = true;
+                    break;
+                }
+                
+                PrintDisAsmLine(Instruction, SimFlags, Timing, &TimeAccum, Out);
+            }
+            
+            if(!Stopped && (Chunk->Stop == DecodeRange_Unrecognized))
+            {
+                FlushText(Out);
+                fprintf(stderr, "ERROR: Unrecognized binary in instruction stream.\n");
+                Stopped = true;
+            }
+        }
+        
+        FreeParallelDecode(&Decode);
+    }
+    else
+    {
+        u32 Count = DisAsmByteCount;
+        while(Count)
+        {
+            instruction Instruction = Memo ? DecodeInstructionMemoized(Memo, At) : DecodeInstruction(Table, At, Mode);
+            if(Instruction.Op)
+            {
+                if(Count >= Instruction.Size)
+                {
+                    At = MoveBaseBy(At, Instruction.Size);
+                    Count -= Instruction.Size;
+                }
+                else
+                {
+                    FlushText(Out);
+                    fprintf(stderr, "ERROR: Instruction extends outside disassembly region\n");
+                    break;
+                }
+                
+                PrintDisAsmLine(Instruction, SimFlags, Timing, &TimeAccum, Out);
             }
             else
             {
-                fprintf(stderr, "ERROR: Instruction extends outside disassembly region\n");
+                FlushText(Out);
+                fprintf(stderr, "ERROR: Unrecognized binary in instruction stream.\n");
+                break;
+            }
+        }
+    }
+    
+    if(Memo)
+    {
+        // NOTE: The hit rate is from the disassembly itself. The speedup compares whole passes over the
+        // image with and without the memo, with printing left out of both.
+        decode_memo_stats Stats = Memo->Stats;
+        f64 PlainSeconds = SecondsPerDecodePass(Table, DisAsmByteCount, DisAsmStart, Mode, 0);
+        f64 MemoSeconds = SecondsPerDecodePass(Table, DisAsmByteCount, DisAsmStart, Mode, Memo);
+        
+        f64 HitPercent = Stats.Lookups ? (100.0*(f64)Stats.Hits / (f64)Stats.Lookups) : 0;
+        f64 Speedup = (MemoSeconds > 0) ? (PlainSeconds / MemoSeconds) : 0;
+        EmitFormatted(Out, "; Decode memo: %llu lookups, %llu hits (%.1f%%), %llu not memoizable, %llu bypassed\n",
+                      Stats.Lookups, Stats.Hits, HitPercent, Stats.Uncacheable, Stats.Bypassed);
+        EmitFormatted(Out, "; Decode memo: %.3fus per pass without, %.3fus with (%.2fx)\n",
+                      1000000.0*PlainSeconds, 1000000.0*MemoSeconds, Speedup);
+        
+        FreeDecodeMemo(Memo);
+    }
+}
+
+static u32 ScanAll8086(instruction_table Table, u32 DisAsmByteCount, segmented_access DisAsmStart, u64 *Boundaries)
+{
+    u32 Result = 0;
+    
+    u32 Address = GetAbsoluteAddressOf(DisAsmStart);
+    if(Boundaries && ((u64)Address + DisAsmByteCount <= (u64)DisAsmStart.Mask + 1))
+    {
+        decode_range_result Scan = ScanInstructionBoundaries(Table, DisAsmByteCount, DisAsmStart.Memory + Address, Boundaries);
+        Result = Scan.InstructionCount;
+    }
+    
+    return Result;
+}
+
+static void BenchDecode8086(u32 DisAsmByteCount, segmented_access DisAsmStart, text_buffer *Out)
+{
+    instruction_table Table = Get8086InstructionTable();
+    
+    // NOTE: Built up front so they don't get counted against the first pass
+    GetInstructionLookup(Table);
+    GetLengthTable(Table);
+    
+    // NOTE: The last one isn't a decode mode, it's the length pre-scan, which only finds where the
+    // instructions are. It's here to show how much of decoding is just finding them. The one before
+    // it is the lookup decoder behind the decode memo, which is emptied before every pass.
+    decode_mode Modes[] = {DecodeMode_Reference, DecodeMode_Lookup, DecodeMode_Specialized};
+    char const *ModeNames[] = {"reference", "lookup", "specialized", "memo", "prescan"};
+    decode_memo *Memo = AllocateDecodeMemo(Table, DecodeMode_Lookup);
+    u64 *Boundaries = (u64 *)malloc(((DisAsmByteCount + 63) / 64)*sizeof(u64));
+    
+    for(u32 ModeIndex = 0; ModeIndex < ArrayCount(ModeNames); ++ModeIndex)
+    {
+        // NOTE: Decode the whole image over and over until enough time has passed to get a stable number
+        u64 MinTime = GetOSTimerFreq() / 2;
+        u64 InstructionCount = 0;
+        u64 PassCount = 0;
+        u64 StartTime = ReadOSTimer();
+        u64 Elapsed = 0;
+        while(Elapsed < MinTime)
+        {
+            u32 Decoded = 0;
+            if(ModeIndex < ArrayCount(Modes))
+            {
+                Decoded = DecodeAll8086(Table, DisAsmByteCount, DisAsmStart, Modes[ModeIndex]);
+            }
+            else if(ModeIndex == ArrayCount(Modes))
+            {
+                if(Memo)
+                {
+                    ResetDecodeMemo(Memo);
+                    Decoded = DecodeAll8086(Table, DisAsmByteCount, DisAsmStart, DecodeMode_Lookup, Memo);
+                }
+            }
+            else
+            {
+                Decoded = ScanAll8086(Table, DisAsmByteCount, DisAsmStart, Boundaries);
+            }
+            if(!Decoded)
+            {
                 break;
             }
             
-            PrintInstruction(Instruction, stdout);
-            if(SimFlags & SimFlag_ShowClocks)
+            InstructionCount += Decoded;
+            ++PassCount;
+            Elapsed = ReadOSTimer() - StartTime;
+        }
+        
+        f64 Seconds = SecondsFromOSTime(Elapsed);
+        f64 PerSecond = (Seconds > 0) ? ((f64)InstructionCount / Seconds) : 0;
+        EmitFormatted(Out, "%10s: %llu instructions in %llu passes, %.3fs, %.0f instructions/s\n",
+                      ModeNames[ModeIndex], InstructionCount, PassCount, Seconds, PerSecond);
+    }
+    
+    FreeDecodeMemo(Memo);
+    free(Boundaries);
+}
+
+// NOTE: Checkpoints are snapshots taken every Interval instructions. Each one is appended to Dest as
+// a delta against the one before it, after a base image of memory as it was when the run started.
+struct checkpointer
+{
+    snapshot_store *Store;
+    u64 Interval;
+    FILE *Dest;
+    snapshot *Previous;
+    b32 Failed;
+};
+
+static void Checkpoint(checkpointer *Checkpoints, segmented_access MainMemory, register_state_8086 *Registers,
+                       u64 InstructionCount)
+{
+    // NOTE: Every delta is against the one before it, so once a checkpoint can't be taken or written,
+    // none of the ones after it could be rebuilt from the file either. Checkpointing just stops there.
+    if(!Checkpoints->Failed)
+    {
+        snapshot *Snapshot = TakeSnapshot(Checkpoints->Store, MainMemory, Registers, InstructionCount);
+        if(Snapshot)
+        {
+            if(Checkpoints->Dest && !WriteSnapshotDelta(Checkpoints->Dest, Checkpoints->Previous, Snapshot))
             {
-                printf(" ; ");
-                PrintEstimatedClocks(Timing, Instruction, SimFlags, &TimeAccum);
+                Checkpoints->Failed = true;
             }
-            printf("\n");
+            
+            ReleaseSnapshot(Checkpoints->Previous);
+            Checkpoints->Previous = Snapshot;
         }
         else
         {
-            fprintf(stderr, "ERROR: Unrecognized binary in instruction stream.\n");
-            break;
+            Checkpoints->Failed = true;
         }
     }
 }
 
-static b32 IsRet(operation_type Op)
+// NOTE: Optional extras that watch a run. Any of them can be 0.
+struct run_hooks
 {
-    b32 Result = ((Op == Op_ret) ||
-                  (Op == Op_retf));
-    return Result;
-}
+    trace_writer *Trace;
+    checkpointer *Checkpoints;
+    address_profile *Profile;
+    
+    // NOTE: Not something that watches, but where the run starts. Memory and registers are restored from it
+    // before the first instruction, and instructions are counted on from where it was taken.
+    snapshot *Resume;
+};
 
-static void Run8086(u32 OnePastLastByte, segmented_access MainMemory, u32 SimFlags, timing_state Timing)
+struct run_stats
 {
+    u64 InstructionCount;
+    u64 Clocks; // NOTE: Only counted with SimFlag_ShowClocks, and only the minimum when the estimate is a range
+};
+
+static run_stats Run8086(u32 OnePastLastByte, segmented_access MainMemory, u32 SimFlags, timing_state Timing,
+                         block_cache *Cache, run_hooks Hooks, text_buffer *Out, u64 InstructionBudget = 0)
+{
+    run_stats Result = {};
+    
+    trace_writer *Trace = Hooks.Trace;
+    checkpointer *Checkpoints = Hooks.Checkpoints;
+    address_profile *Profile = Hooks.Profile;
+    
     instruction_table Table = Get8086InstructionTable();
     register_state_8086 Registers = {};
     instruction_clock_interval TimeAccum = {};
+    decode_mode Mode = DecodeModeFrom(SimFlags);
+    
+    // NOTE: With -lazyflags, the status flags are only computed when something looks at them.
+    // Printing the register differences counts, so this only saves work when they are not printed.
+    lazy_flags LazyFlagsState = {};
+    lazy_flags *LazyFlags = (SimFlags & SimFlag_LazyFlags) ? &LazyFlagsState : 0;
+    
+    // NOTE: If there is a cache, instructions are fetched out of it, so loop bodies only get decoded once.
+    // Writes to main memory go through the cache's code watch, so self-modifying code still gets re-decoded.
+    // If the cache was allocated with micro-ops, those are what get executed.
+    if(Cache)
+    {
+        MainMemory.Watch = &Cache->Watch;
+    }
+    
+    // NOTE: With -jit, blocks that get hot are run as compiled code instead of one instruction at a time.
+    // Nothing that needs to see every instruction can watch a compiled block, so the JIT stays off when
+    // any of that is on. Compiled code assumes there is at least 64K of memory to work with.
+    jit_cache *Jit = 0;
+    if(Cache && !(SimFlags & SimFlag_ShowClocks) && !Trace && !Checkpoints && !Profile &&
+       (GetHighestAddress(MainMemory) >= 0xffff))
+    {
+        Jit = Cache->Jit;
+    }
+    b32 JitCheck = (SimFlags & SimFlag_JitCheck);
     
+    // NOTE: When tracing, every instruction gets a binary record instead of a line of text, and turning
+    // the records back into text is left to sim86_replay. When profiling, the profile is printed at the
+    // end instead. Either way, only the final registers are still printed, and the same goes for the JIT.
+    write_span TraceWrites = {};
+    text_buffer *StepOut = (Trace || Profile || Jit) ? 0 : Out;
+    b32 ChainMicroOps = (!StepOut && !Trace && !Profile && !Checkpoints &&
+                         !(SimFlags & (SimFlag_ShowClocks|SimFlag_StopOnRet)));
+    if(Profile)
+    {
+        Profile->Assume8088 = Timing.Assume8088;
+    }
+    if(Trace)
+    {
+        MainMemory.Writes = &TraceWrites;
+    }
+    
+    if(Hooks.Resume)
+    {
+        // NOTE: When checkpointing, restoring through the checkpoint store means the first checkpoint
+        // shares all its pages with the one being resumed from
+        snapshot_store *Store = Checkpoints ? Checkpoints->Store : AllocateSnapshotStore(GetHighestAddress(MainMemory) + 1);
+        if(Store)
+        {
+            RestoreSnapshot(Store, Hooks.Resume, MainMemory, &Registers);
+            Result.InstructionCount = Hooks.Resume->InstructionCount;
+        }
+        if(!Checkpoints)
+        {
+            FreeSnapshotStore(Store);
+        }
+    }
+    
+    if(Checkpoints)
+    {
+        MainMemory.Dirty = &Checkpoints->Store->Dirty;
+        Checkpoint(Checkpoints, MainMemory, &Registers, Result.InstructionCount);
+    }
+    
+    // NOTE: With -busclocks, every instruction is also run through the prefetch queue model, and its
+    // clocks are printed next to the estimate from the manual's tables so the two can be compared.
+    // The queue starts fetching at CS:IP, masked the same way the loop below masks its fetches, which
+    // is only known once a resumed run has its registers back.
+    bus_interface BusState = {};
+    bus_interface *Bus = 0;
+    if((SimFlags & SimFlag_ShowClocks) && (SimFlags & SimFlag_BusClocks))
+    {
+        BusState = MakeBusInterface(Timing.Assume8088, GetAbsoluteAddressOf(0xffff, Registers.cs, Registers.ip, 0));
+        Bus = &BusState;
+    }
+    
+    // NOTE: With no Out, nothing is printed at all, which is how -bench runs the simulator
     for(;;)
     {
         segmented_access At = MainMemory;
@@ -180,9 +649,26 @@ static void Run8086(u32 OnePastLastByte, segmented_access MainMemory, u32 SimFla
         At.SegmentBase = Registers.cs;
         At.SegmentOffset = Registers.ip;
         
-        if(GetAbsoluteAddressOf(At) < OnePastLastByte)
+        if((GetAbsoluteAddressOf(At) < OnePastLastByte) &&
+           (!InstructionBudget || (Result.InstructionCount < InstructionBudget)))
         {
-            instruction Instruction = DecodeInstruction(Table, At);
+            // NOTE: Compiled blocks only get a look in at the start of a block. Anything left over after
+            // a block stops early is picked up by the interpreter from wherever the block left off.
+            if(Jit && !ContinuesCurrentBlock(Cache, GetAbsoluteAddressOf(At)))
+            {
+                u64 Limit = InstructionBudget ? (InstructionBudget - Result.InstructionCount) : 0;
+                u32 Executed = RunJitBlock(Jit, Cache, Table, At, OnePastLastByte, Mode, MainMemory,
+                                           &Registers, LazyFlags, Limit, JitCheck);
+                if(Executed)
+                {
+                    Result.InstructionCount += Executed;
+                    continue;
+                }
+            }
+            
+            instruction Instruction = (Cache ?
+                                       FetchInstruction(Cache, Table, At, OnePastLastByte, Mode) :
+                                       DecodeInstruction(Table, At, Mode));
             if(Instruction.Op)
             {
                 register_state_8086 PrevRegisters = Registers;
@@ -190,38 +676,136 @@ static void Run8086(u32 OnePastLastByte, segmented_access MainMemory, u32 SimFla
                 if((SimFlags & SimFlag_StopOnRet) &&
                    IsRet(Instruction.Op))
                 {
-                    fprintf(stdout, "STOPONRET: Return encountered at address %u.\n", Instruction.Address);
+                    if(Out)
+                    {
+                        EmitString(Out, "STOPONRET: Return encountered at address ");
+                        EmitU32(Out, Instruction.Address);
+                        EmitString(Out, ".\n");
+                    }
                     break;
                 }
                 
+                micro_op *MicroOp = Cache ? Cache->FetchedMicroOp : 0;
+                trace_record *Record = Trace ? BeginTraceRecord(Trace, At, Instruction.Size) : 0;
+                TraceWrites = {};
+                
+                // NOTE: When nothing has to look at each instruction as it goes, micro-ops run the rest
+                // of the block in one chain
+                u32 ChainCount = 1;
+                if(MicroOp && ChainMicroOps)
+                {
+                    ChainCount += GetFetchedRemaining(Cache);
+                    if(InstructionBudget && (ChainCount > (InstructionBudget - Result.InstructionCount)))
+                    {
+                        ChainCount = (u32)(InstructionBudget - Result.InstructionCount);
+                    }
+                }
+                
+                u32 RunCount = 1;
                 Registers.ip += Instruction.Size;
-                exec_result Exec = ExecInstruction(MainMemory, &Registers, Instruction);
+                exec_result Exec = (MicroOp ?
+                                    ExecMicroOps(MainMemory, &Registers, MicroOp, ChainCount, &RunCount, LazyFlags) :
+                                    ExecInstruction(MainMemory, &Registers, Instruction, LazyFlags));
                 
                 if(!Exec.Unimplemented)
                 {
-                    PrintInstruction(Instruction, stdout);
-                    printf(" ; ");
-                    if(SimFlags & SimFlag_ShowClocks)
+                    ++Result.InstructionCount;
+                    if(RunCount > 1)
+                    {
+                        SkipFetched(Cache, RunCount - 1);
+                        Result.InstructionCount += RunCount - 1;
+                    }
+                    
+                    if(StepOut)
+                    {
+                        PrintInstruction(Instruction, StepOut);
+                        EmitString(StepOut, " ; ");
+                    }
+                    instruction_clock_interval Clocks = {};
+                    static_timing *Static = Cache ? Cache->FetchedTiming : 0;
+                    b32 NeedsClocks = ((SimFlags & SimFlag_ShowClocks) || Record ||
+                                       (Profile && ProfileNeedsClocks(Exec, Static)));
+                    if(NeedsClocks || Profile)
                     {
                         UpdateTimingForExec(&Timing, Exec);
-                        PrintEstimatedClocks(Timing, Instruction, SimFlags, &TimeAccum);
-                        fprintf(stdout, " | ");
                     }
-                    if(!(SimFlags & SimFlag_NoRegisterDiffs))
+                    if(NeedsClocks)
+                    {
+                        text_buffer *ClocksOut = (SimFlags & SimFlag_ShowClocks) ? StepOut : 0;
+                        Clocks = PrintEstimatedClocks(Timing, Instruction, Static, SimFlags, &TimeAccum, ClocksOut);
+                        if(ClocksOut)
+                        {
+                            EmitString(ClocksOut, " | ");
+                        }
+                    }
+                    if(Bus)
+                    {
+                        b32 Jumped = ((Registers.cs != PrevRegisters.cs) ||
+                                      (Registers.ip != (u16)(PrevRegisters.ip + Instruction.Size)));
+                        segmented_access Next = At;
+                        Next.SegmentBase = Registers.cs;
+                        Next.SegmentOffset = Registers.ip;
+                        u32 NextAddress = GetAbsoluteAddressOf(Next);
+                        bus_clocks BusClocks = SimulateBusTiming(Bus, Timing, Instruction, Static,
+                                                                 Jumped, NextAddress);
+                        if(StepOut)
+                        {
+                            PrintBusStep(BusClocks, Bus->Now, (SimFlags & SimFlag_ExplainClocks), StepOut);
+                            EmitString(StepOut, " | ");
+                        }
+                    }
+                    if(Record)
+                    {
+                        if(LazyFlags)
+                        {
+                            MaterializeFlags(&Registers, LazyFlags);
+                        }
+                        EndTraceRecord(Trace, Record, MainMemory, &Registers, Clocks, TraceWrites);
+                    }
+                    if(Profile)
+                    {
+                        ProfileInstruction(Profile, GetAbsoluteAddressOf(At), Instruction, Static,
+                                           Cache ? Cache->Stats.Flushes : 0, Exec, NeedsClocks ? &Clocks : 0);
+                    }
+                    if(Checkpoints && ((Result.InstructionCount % Checkpoints->Interval) == 0))
+                    {
+                        if(LazyFlags)
+                        {
+                            MaterializeFlags(&Registers, LazyFlags);
+                        }
+                        Checkpoint(Checkpoints, MainMemory, &Registers, Result.InstructionCount);
+                    }
+                    if(StepOut)
                     {
-                        PrintRegisterDifference(&PrevRegisters, &Registers, stdout);
+                        if(!(SimFlags & SimFlag_NoRegisterDiffs))
+                        {
+                            if(LazyFlags)
+                            {
+                                MaterializeFlags(&Registers, LazyFlags);
+                            }
+                            PrintRegisterDifference(&PrevRegisters, &Registers, StepOut);
+                        }
+                        EmitChar(StepOut, '\n');
                     }
-                    printf("\n");
                 }
                 else
                 {
-                    printf("ERROR: Unimplemented instruction (%s).\n", GetMnemonic(Instruction.Op));
+                    if(Out)
+                    {
+                        EmitString(Out, "ERROR: Unimplemented instruction (");
+                        EmitString(Out, GetMnemonic(Instruction.Op));
+                        EmitString(Out, ").\n");
+                    }
                     break;
                 }
             }
             else
             {
-                fprintf(stderr, "ERROR: Unrecognized binary in instruction stream.\n");
+                if(Out)
+                {
+                    FlushText(Out);
+                    fprintf(stderr, "ERROR: Unrecognized binary in instruction stream.\n");
+                }
                 break;
             }
         }
@@ -231,23 +815,437 @@ static void Run8086(u32 OnePastLastByte, segmented_access MainMemory, u32 SimFla
         }
     }
     
-    printf("\n");
-    printf("Final registers:\n");
-    PrintRegisters(&Registers, stdout);
-    printf("\n");
+    Result.Clocks = TimeAccum.Min;
+    
+    if(Out)
+    {
+        if(LazyFlags)
+        {
+            MaterializeFlags(&Registers, LazyFlags);
+        }
+        
+        EmitString(Out, "\nFinal registers:\n");
+        PrintRegisters(&Registers, Out);
+        EmitChar(Out, '\n');
+        
+        if(Profile)
+        {
+            PrintProfile(Profile, MainMemory, Out);
+        }
+        
+        if(Bus)
+        {
+            EmitFormatted(Out, "Bus: %llu clocks (%llu waiting on the prefetch queue, %llu waiting for the bus)\n\n",
+                          Bus->Now, Bus->TotalQueueWait, Bus->TotalBusWait);
+        }
+        
+        if(Checkpoints)
+        {
+            snapshot_store *Store = Checkpoints->Store;
+            EmitFormatted(Out, "Checkpoints: %llu taken, %llu pages copied\n\n",
+                          Store->SnapshotCount, Store->PagesCopied);
+        }
+        
+        if(Cache && (SimFlags & SimFlag_BlockStats))
+        {
+            block_cache_stats Stats = Cache->Stats;
+            EmitFormatted(Out, "Block cache: %llu instructions fetched, %llu decoded in %llu blocks (%llu invalidated, %llu flushes)\n\n",
+                          Stats.InstructionsFetched, Stats.InstructionsDecoded, Stats.BlocksDecoded,
+                          Stats.BlocksInvalidated, Stats.Flushes);
+        }
+        
+        if(Jit && (SimFlags & SimFlag_BlockStats))
+        {
+            jit_stats Stats = Jit->Stats;
+            EmitFormatted(Out, "JIT: %llu blocks compiled, %llu instructions run in %llu block runs (%llu side exits, %llu resets)\n\n",
+                          Stats.BlocksCompiled, Stats.InstructionsRun, Stats.BlockRuns, Stats.SideExits, Stats.Resets);
+        }
+        
+        if(Jit && JitCheck)
+        {
+            EmitFormatted(Out, "JIT check: %llu blocks checked, %llu mismatches\n\n",
+                          Jit->Stats.BlocksChecked, Jit->Stats.CheckFailures);
+        }
+    }
+    
+    return Result;
+}
+
+static block_cache *AllocateBlockCacheFor(u32 SimFlags, u32 MemorySize)
+{
+    block_cache *Result = 0;
+    if(!(SimFlags & SimFlag_NoBlockCache))
+    {
+        // NOTE: Micro-ops and static timings live in the cache, so -microops does nothing with -noblockcache,
+        // and anything that estimates clocks looks every instruction's timing up again each time it runs.
+        u32 JitHotThreshold = 0;
+        if(SimFlags & SimFlag_Jit)
+        {
+            JitHotThreshold = (SimFlags & SimFlag_JitAll) ? 1 : JIT_DEFAULT_HOT_THRESHOLD;
+        }
+        
+        Result = AllocateBlockCache(MemorySize, (SimFlags & SimFlag_MicroOps), (SimFlags & (SimFlag_ShowClocks|SimFlag_Trace|SimFlag_Profile)),
+                                    JitHotThreshold);
+    }
+    
+    return Result;
+}
+
+static void PrintBenchHeader(text_buffer *Out)
+{
+    EmitString(Out, "File,Instructions,Clocks,"
+               "Decode ns min,Decode ns avg,Decode ns max,"
+               "Exec ns min,Exec ns avg,Exec ns max,"
+               "Instructions/s,Clocks/s\n");
+}
+
+static void Bench8086(char const *FileName, u32 OnePastLastByte, segmented_access MainMemory, u32 SimFlags,
+                      timing_state Timing, u64 InstructionBudget, u32 RepeatCount, u64 CPUTimerFreq, text_buffer *Out)
+{
+    // NOTE: Each wave keeps going until it has gone this long without finding a faster test
+    u32 SecondsToTry = 1;
+    
+    u32 MemorySize = MainMemory.Mask + 1;
+    u8 *Image = (u8 *)malloc(MemorySize);
+    block_cache *Cache = AllocateBlockCacheFor(SimFlags, MemorySize);
+    if(Image)
+    {
+        memcpy(Image, MainMemory.Memory, MemorySize);
+        
+        instruction_table Table = Get8086InstructionTable();
+        GetInstructionLookup(Table); // NOTE: Built up front so it doesn't get counted against the first test
+        decode_mode Mode = DecodeModeFrom(SimFlags);
+        
+        // NOTE: One untimed run establishes how many instructions a run is, and how many clocks
+        // they would have taken on the real thing
+        run_stats Reference = Run8086(OnePastLastByte, MainMemory, SimFlags|SimFlag_ShowClocks, Timing, Cache, {}, 0, InstructionBudget);
+        
+        // NOTE: Runs write to memory, so every run has to start from what was loaded. A run always
+        // changes the same bytes, so only the range the reference run changed needs to be put back.
+        u32 FirstDirty = 0;
+        u32 OnePastLastDirty = 0;
+        for(u32 Address = 0; Address < MemorySize; ++Address)
+        {
+            if(MainMemory.Memory[Address] != Image[Address])
+            {
+                if(FirstDirty == OnePastLastDirty)
+                {
+                    FirstDirty = Address;
+                }
+                OnePastLastDirty = Address + 1;
+            }
+        }
+        
+        // NOTE: Putting the bytes back doesn't go through the code watch, so if the program modifies
+        // itself, the block cache has to be flushed between runs too
+        b32 FlushBetweenRuns = (Cache && Cache->Watch.CodeWriteCount);
+        
+        memcpy(MainMemory.Memory, Image, MemorySize);
+        u32 DecodeCount = DecodeAll8086(Table, OnePastLastByte, MainMemory, Mode);
+        
+        if(Reference.InstructionCount && DecodeCount)
+        {
+            // NOTE: Unless told otherwise, small programs are repeated enough times per test to
+            // simulate at least this many instructions, so one test is long enough to be worth timing
+            u64 MinInstructionsPerTest = 100000;
+            u64 DecodeRepeat = RepeatCount ? RepeatCount : (MinInstructionsPerTest / DecodeCount) + 1;
+            u64 ExecRepeat = RepeatCount ? RepeatCount : (MinInstructionsPerTest / Reference.InstructionCount) + 1;
+            
+            repetition_tester DecodeTester = {};
+            NewTestWave(&DecodeTester, DecodeRepeat*DecodeCount, CPUTimerFreq, SecondsToTry);
+            while(IsTesting(&DecodeTester))
+            {
+                BeginTime(&DecodeTester);
+                for(u64 RepeatIndex = 0; RepeatIndex < DecodeRepeat; ++RepeatIndex)
+                {
+                    CountInstructions(&DecodeTester, DecodeAll8086(Table, OnePastLastByte, MainMemory, Mode));
+                }
+                EndTime(&DecodeTester);
+            }
+            
+            // NOTE: The block cache is kept between runs, so this measures steady-state simulation, the
+            // way a long-running program would see it. Decoding on its own is what the first wave measured.
+            // Putting the dirty bytes back is included in the time, since runs are too short to time one by one.
+            repetition_tester ExecTester = {};
+            NewTestWave(&ExecTester, ExecRepeat*Reference.InstructionCount, CPUTimerFreq, SecondsToTry);
+            while(IsTesting(&ExecTester))
+            {
+                BeginTime(&ExecTester);
+                for(u64 RepeatIndex = 0; RepeatIndex < ExecRepeat; ++RepeatIndex)
+                {
+                    memcpy(MainMemory.Memory + FirstDirty, Image + FirstDirty, OnePastLastDirty - FirstDirty);
+                    if(FlushBetweenRuns)
+                    {
+                        FlushBlockCache(Cache);
+                    }
+                    
+                    run_stats Stats = Run8086(OnePastLastByte, MainMemory, SimFlags, Timing, Cache, {}, 0, InstructionBudget);
+                    CountInstructions(&ExecTester, Stats.InstructionCount);
+                }
+                EndTime(&ExecTester);
+            }
+            
+            if((DecodeTester.Mode == TestMode_Completed) && (ExecTester.Mode == TestMode_Completed))
+            {
+                repetition_test_results Decode = DecodeTester.Results;
+                repetition_test_results Exec = ExecTester.Results;
+                
+                f64 BestExecNS = NanosecondsPerInstruction(Exec.Min, CPUTimerFreq);
+                f64 InstructionsPerSecond = BestExecNS ? (1000000000.0 / BestExecNS) : 0;
+                f64 ClocksPerSecond = InstructionsPerSecond*((f64)Reference.Clocks / (f64)Reference.InstructionCount);
+                
+                EmitFormatted(Out, "%s,%llu,%llu,%f,%f,%f,%f,%f,%f,%.0f,%.0f\n",
+                              FileName, Reference.InstructionCount, Reference.Clocks,
+                              NanosecondsPerInstruction(Decode.Min, CPUTimerFreq),
+                              NanosecondsPerInstruction(Decode.Total, CPUTimerFreq),
+                              NanosecondsPerInstruction(Decode.Max, CPUTimerFreq),
+                              BestExecNS,
+                              NanosecondsPerInstruction(Exec.Total, CPUTimerFreq),
+                              NanosecondsPerInstruction(Exec.Max, CPUTimerFreq),
+                              InstructionsPerSecond, ClocksPerSecond);
+            }
+        }
+        else
+        {
+            FlushText(Out);
+            fprintf(stderr, "ERROR: Nothing to benchmark in %s.\n", FileName);
+        }
+        
+        memcpy(MainMemory.Memory, Image, MemorySize);
+        free(Image);
+    }
+    
+    if(Cache)
+    {
+        FreeBlockCache(Cache);
+    }
+}
+
+// NOTE: -batch runs each image on a machine of its own, with the images handed out to a pool of threads.
+// Every machine starts from zeroed memory and fresh registers, and the only thing they share is the
+// read-only decode and clock tables. Each image's text is collected in memory and written out in
+// command-line order once the whole batch has run.
+struct batch_job
+{
+    char const *FileName;
+    u32 SimFlags;
+    timing_state Timing;
+    
+    text_buffer Out;
+};
+
+struct batch_worker
+{
+    batch_job *Jobs;
+    u32 JobCount;
+    u32 volatile *NextJob;
+    
+    segmented_access Memory;
+};
+
+static void PrintClocksWarning(text_buffer *Out)
+{
+    EmitString(Out,
+               "\n"
+               "WARNING: Clocks reported by this utility are strictly from the 8086 manual.\n"
+               "They will be inaccurate, both because the manual clocks are estimates, and because\n"
+               "some of the entries in the manual look highly suspicious and are probably typos.\n"
+               "\n");
+}
+
+static void CloseTrace(trace_writer *Trace, char const *TraceFileName, text_buffer *Out)
+{
+    if(!CloseTraceWriter(Trace))
+    {
+        FlushText(Out);
+        fprintf(stderr, "ERROR: Unable to write all of trace file %s.\n", TraceFileName);
+    }
+}
+
+static void DumpMemory(segmented_access Memory, u32 DumpIndex, u8 *PreviousDump, text_buffer *Out)
+{
+    /* NOTE: The first dump is all of memory, byte for byte. Every dump after it is a snapshot delta
+       (see sim86_snapshot.h) holding only the pages that changed since the dump before it, so applying
+       them in order to the first one gives back each dump in turn. PreviousDump is where the last dump
+       is kept to compare against. Without it, every dump is a full one. */
+    u32 MemorySize = GetHighestAddress(Memory) + 1;
+    b32 Full = ((DumpIndex == 0) || !PreviousDump);
+    
+    char DumpFileName[256];
+    sprintf(DumpFileName, Full ? "sim86_memory_%u.data" : "sim86_memory_%u.delta", DumpIndex);
+    
+    b32 Written = false;
+    FILE *DumpFile = fopen(DumpFileName, "wb");
+    if(DumpFile)
+    {
+        Written = (Full ?
+                   (fwrite(Memory.Memory, MemorySize, 1, DumpFile) == 1) :
+                   WriteMemoryDelta(DumpFile, PreviousDump, Memory.Memory, MemorySize));
+        if(fclose(DumpFile) != 0)
+        {
+            Written = false;
+        }
+    }
+    
+    if(!Written)
+    {
+        FlushText(Out);
+        fprintf(stderr, "ERROR: Unable to write memory dump %s.\n", DumpFileName);
+    }
+    
+    if(PreviousDump)
+    {
+        memcpy(PreviousDump, Memory.Memory, MemorySize);
+    }
+}
+
+static void RunBatchWorker(void *Param)
+{
+    batch_worker *Worker = (batch_worker *)Param;
+    segmented_access Memory = Worker->Memory;
+    u32 MemorySize = GetHighestAddress(Memory) + 1;
+    
+    // NOTE: Jobs are taken one at a time, so a few long-running images don't hold up the rest of a thread's share.
+    // A worker that didn't get any memory takes nothing, and the others pick up the slack.
+    while(IsValid(Memory))
+    {
+        u32 JobIndex = AtomicAddU32(Worker->NextJob, 1);
+        if(JobIndex >= Worker->JobCount)
+        {
+            break;
+        }
+        
+        batch_job *Job = Worker->Jobs + JobIndex;
+        text_buffer *Out = &Job->Out;
+        *Out = AllocateTextBuffer(0, 1 << 12);
+        
+        if(Job->SimFlags & SimFlag_ShowClocks)
+        {
+            PrintClocksWarning(Out);
+        }
+        
+        // NOTE: Mapped jobs run on their own mapping, and leave the worker's memory alone
+        segmented_access JobMemory = Memory;
+        mapped_file Mapping = {};
+        u32 BytesRead = LoadOrMapMemoryFromFile((char *)Job->FileName, Job->SimFlags, true, &JobMemory, &Mapping);
+        
+        EmitString(Out, "--- ");
+        EmitString(Out, Job->FileName);
+        EmitString(Out, " execution ---\n");
+        block_cache *Cache = AllocateBlockCacheFor(Job->SimFlags, MemorySize);
+        
+        address_profile Profile = {};
+        if(Job->SimFlags & SimFlag_Profile)
+        {
+            Profile = AllocateProfile(MemorySize);
+        }
+        
+        run_hooks Hooks = {};
+        Hooks.Profile = Profile.AddressCount ? &Profile : 0;
+        Run8086(BytesRead, JobMemory, Job->SimFlags, Job->Timing, Cache, Hooks, Out);
+        
+        FreeProfile(&Profile);
+        if(Cache)
+        {
+            FreeBlockCache(Cache);
+        }
+        
+        ReleaseMappedMemory(Job->FileName, &Mapping);
+    }
+}
+
+static void RunBatch(batch_job *Jobs, u32 JobCount, segmented_access MainMemory, u32 MemoryPow2,
+                     u32 ThreadCount, text_buffer *Out)
+{
+    u32 WorkerCount = ThreadCount;
+    if(WorkerCount > JobCount)
+    {
+        WorkerCount = JobCount;
+    }
+    if(WorkerCount > MAX_PLATFORM_THREADS)
+    {
+        WorkerCount = MAX_PLATFORM_THREADS;
+    }
+    if(WorkerCount < 1)
+    {
+        WorkerCount = 1;
+    }
+    
+    // NOTE: The calling thread's worker runs on main memory, which is known to be good, so every job gets run
+    // even if none of the other machines could be allocated
+    u32 volatile NextJob = 0;
+    batch_worker Workers[MAX_PLATFORM_THREADS];
+    for(u32 WorkerIndex = 0; WorkerIndex < WorkerCount; ++WorkerIndex)
+    {
+        batch_worker *Worker = Workers + WorkerIndex;
+        Worker->Jobs = Jobs;
+        Worker->JobCount = JobCount;
+        Worker->NextJob = &NextJob;
+        Worker->Memory = WorkerIndex ? AllocateMemoryPow2(MemoryPow2) : MainMemory;
+    }
+    
+    RunOnThreads(WorkerCount, RunBatchWorker, Workers, sizeof(batch_worker));
+    
+    FlushText(Out);
+    for(u32 JobIndex = 0; JobIndex < JobCount; ++JobIndex)
+    {
+        batch_job *Job = Jobs + JobIndex;
+        fwrite(Job->Out.Data, 1, Job->Out.Used, Out->Dest);
+        FreeTextBuffer(&Job->Out);
+    }
+    
+    for(u32 WorkerIndex = 1; WorkerIndex < WorkerCount; ++WorkerIndex)
+    {
+        segmented_access Memory = Workers[WorkerIndex].Memory;
+        if(IsValid(Memory))
+        {
+            free(Memory.Memory);
+        }
+    }
 }
 
 int main(int ArgCount, char **Args)
 {
+    // NOTE: If the table ever has more encodings for one first byte than the lookup has room for, the
+    // lookup can't be built, and everything would quietly decode the slow way. That needs fixing here.
+    if(!GetInstructionLookup(Get8086InstructionTable()))
+    {
+        fprintf(stderr, "ERROR: The 8086 table needs more than %u decode candidates per byte (MAX_DECODE_CANDIDATES).\n",
+                MAX_DECODE_CANDIDATES);
+        return 1;
+    }
+    
     b32 Execute = false;
     u32 DumpIndex = 0;
     u32 SimFlags = 0;
+    b32 PrintedBenchHeader = false;
+    u64 CPUTimerFreq = 0;
+    u64 BenchBudget = 1000000; // NOTE: Some listings never stop on their own, so -bench runs are capped by default
+    u32 BenchRepeat = 0;
+    u32 ThreadCount = GetProcessorCount();
+    trace_writer Trace = {};
+    char const *TraceFileName = 0;
+    u64 CheckpointInterval = 0;
+    u32 CheckpointIndex = 0;
+    char const *RestoreFileName = 0;
+    u64 RestoreInstructionCount = 0;
+    u8 *PreviousDump = 0;
+    b32 Batch = false;
     
     timing_state Timing = {};
     
     u32 MainMemPow2 = 20;
     u32 MainMemSize = (1 << MainMemPow2);
     segmented_access MainMemory = AllocateMemoryPow2(MainMemPow2);
+    
+    // NOTE: Everything that goes to stdout is collected here and written out in large pieces
+    text_buffer Out = AllocateTextBuffer(stdout, 1 << 20);
+    
+    // NOTE: With -batch, executed images are queued up here and run together, either when an image
+    // comes along that can't be batched or when the command line runs out
+    u32 BatchJobCount = 0;
+    batch_job *BatchJobs = (batch_job *)calloc(ArgCount, sizeof(batch_job));
+    
     if(IsValid(MainMemory))
     {
         if(ArgCount > 1)
@@ -272,6 +1270,10 @@ int main(int ArgCount, char **Args)
                 {
                     Timing.Assume8088 = true;
                 }
+                else if(strcmp(FileName, "-busclocks") == 0)
+                {
+                    SimFlags |= SimFlag_ShowClocks|SimFlag_BusClocks;
+                }
                 else if(strcmp(FileName, "-disasm") == 0)
                 {
                     Execute = false;
@@ -279,56 +1281,283 @@ int main(int ArgCount, char **Args)
                 else if(strcmp(FileName, "-dump") == 0)
                 {
                     SimFlags |= SimFlag_DumpMemory;
+                    if(!PreviousDump)
+                    {
+                        PreviousDump = (u8 *)malloc(MainMemSize);
+                    }
                 }
                 else if(strcmp(FileName, "-stoponret") == 0)
                 {
                     SimFlags |= SimFlag_StopOnRet;
                 }
+                else if(strcmp(FileName, "-slowdecode") == 0)
+                {
+                    SimFlags |= SimFlag_ReferenceDecode;
+                }
+                else if(strcmp(FileName, "-specializeddecode") == 0)
+                {
+                    SimFlags |= SimFlag_SpecializedDecode;
+                }
+                else if(strcmp(FileName, "-noblockcache") == 0)
+                {
+                    SimFlags |= SimFlag_NoBlockCache;
+                }
+                else if(strcmp(FileName, "-blockstats") == 0)
+                {
+                    SimFlags |= SimFlag_BlockStats;
+                }
+                else if(strcmp(FileName, "-microops") == 0)
+                {
+                    SimFlags |= SimFlag_MicroOps;
+                }
+                else if(strcmp(FileName, "-lazyflags") == 0)
+                {
+                    SimFlags |= SimFlag_LazyFlags;
+                }
+                else if(strcmp(FileName, "-memo") == 0)
+                {
+                    SimFlags |= SimFlag_DecodeMemo;
+                }
+                else if(strcmp(FileName, "-decodebench") == 0)
+                {
+                    SimFlags |= SimFlag_DecodeBench;
+                }
+                else if((strcmp(FileName, "-threads") == 0) && ((ArgIndex + 1) < ArgCount))
+                {
+                    ThreadCount = (u32)strtoul(Args[++ArgIndex], 0, 10);
+                }
+                else if(strcmp(FileName, "-bench") == 0)
+                {
+                    SimFlags |= SimFlag_Bench;
+                }
+                else if((strcmp(FileName, "-benchbudget") == 0) && ((ArgIndex + 1) < ArgCount))
+                {
+                    BenchBudget = strtoull(Args[++ArgIndex], 0, 10);
+                }
+                else if((strcmp(FileName, "-benchrepeat") == 0) && ((ArgIndex + 1) < ArgCount))
+                {
+                    BenchRepeat = (u32)strtoul(Args[++ArgIndex], 0, 10);
+                }
+                else if(strcmp(FileName, "-batch") == 0)
+                {
+                    Batch = true;
+                }
+                else if(strcmp(FileName, "-jit") == 0)
+                {
+                    SimFlags |= SimFlag_Jit;
+                }
+                else if(strcmp(FileName, "-jitall") == 0)
+                {
+                    SimFlags |= SimFlag_Jit|SimFlag_JitAll;
+                }
+                else if(strcmp(FileName, "-jitcheck") == 0)
+                {
+                    SimFlags |= SimFlag_Jit|SimFlag_JitAll|SimFlag_JitCheck;
+                }
+                else if(strcmp(FileName, "-profile") == 0)
+                {
+                    SimFlags |= SimFlag_Profile;
+                }
+                else if(strcmp(FileName, "-map") == 0)
+                {
+                    SimFlags |= SimFlag_MapMemory;
+                }
+                else if(strcmp(FileName, "-mapshared") == 0)
+                {
+                    SimFlags |= SimFlag_MapShared;
+                }
+                else if(strcmp(FileName, "-loops") == 0)
+                {
+                    SimFlags |= SimFlag_LoopAnalysis;
+                }
+                else if((strcmp(FileName, "-checkpoint") == 0) && ((ArgIndex + 1) < ArgCount))
+                {
+                    CheckpointInterval = strtoull(Args[++ArgIndex], 0, 10);
+                }
+                else if((strcmp(FileName, "-restore") == 0) && ((ArgIndex + 2) < ArgCount))
+                {
+                    RestoreFileName = Args[++ArgIndex];
+                    RestoreInstructionCount = strtoull(Args[++ArgIndex], 0, 10);
+                }
+                else if((strcmp(FileName, "-trace") == 0) && ((ArgIndex + 1) < ArgCount))
+                {
+                    CloseTrace(&Trace, TraceFileName, &Out);
+                    TraceFileName = Args[++ArgIndex];
+                    Trace = OpenTraceWriter(TraceFileName);
+                    if(Trace.Dest)
+                    {
+                        SimFlags |= SimFlag_Trace;
+                    }
+                    else
+                    {
+                        FlushText(&Out);
+                        fprintf(stderr, "ERROR: Unable to open trace file %s.\n", TraceFileName);
+                    }
+                }
+                else if(Batch && Execute && BatchJobs && !CheckpointInterval && !RestoreFileName &&
+                        !(SimFlags & (SimFlag_Bench|SimFlag_DecodeBench|SimFlag_Trace|SimFlag_LoopAnalysis|
+                                      SimFlag_DumpMemory)))
+                {
+                    // NOTE: Dumps are deltas against the dump before them, so images that dump memory
+                    // have to run in order, and are never batched
+                    batch_job *Job = BatchJobs + BatchJobCount++;
+                    Job->FileName = FileName;
+                    Job->SimFlags = SimFlags;
+                    Job->Timing = Timing;
+                }
                 else
                 {
-                    if(SimFlags & SimFlag_ShowClocks)
+                    if(BatchJobCount)
                     {
-                        fprintf(stdout,
-                                "\n"
-                                "WARNING: Clocks reported by this utility are strictly from the 8086 manual.\n"
-                                "They will be inaccurate, both because the manual clocks are estimates, and because\n"
-                                "some of the entries in the manual look highly suspicious and are probably typos.\n"
-                                "\n");
+                        RunBatch(BatchJobs, BatchJobCount, MainMemory, MainMemPow2, ThreadCount, &Out);
+                        BatchJobCount = 0;
                     }
                     
-                    u32 BytesRead = LoadMemoryFromFile(FileName, MainMemory, 0);
-                    if(Execute)
+                    if((SimFlags & SimFlag_ShowClocks) && !(SimFlags & SimFlag_Bench))
                     {
-                        printf("--- %s execution ---\n", FileName);
-                        Run8086(BytesRead, MainMemory, SimFlags, Timing);
+                        PrintClocksWarning(&Out);
                     }
-                    else
+                    
+                    segmented_access Memory = MainMemory;
+                    mapped_file Mapping = {};
+                    u32 BytesRead = LoadOrMapMemoryFromFile(FileName, SimFlags, false, &Memory, &Mapping);
+                    if(SimFlags & SimFlag_Bench)
                     {
-                        printf("; %s disassembly:\n", FileName);
-                        printf("bits 16\n");
-                        DisAsm8086(BytesRead, MainMemory, SimFlags, Timing);
+                        if(!PrintedBenchHeader)
+                        {
+                            PrintBenchHeader(&Out);
+                            PrintedBenchHeader = true;
+                            CPUTimerFreq = EstimateCPUTimerFreq();
+                        }
+                        Bench8086(FileName, BytesRead, Memory, SimFlags, Timing, BenchBudget, BenchRepeat, CPUTimerFreq, &Out);
                     }
-                    
-                    if(SimFlags & SimFlag_DumpMemory)
+                    else if(SimFlags & SimFlag_DecodeBench)
+                    {
+                        EmitString(&Out, "--- ");
+                        EmitString(&Out, FileName);
+                        EmitString(&Out, " decode benchmark ---\n");
+                        BenchDecode8086(BytesRead, Memory, &Out);
+                    }
+                    else if(SimFlags & SimFlag_LoopAnalysis)
                     {
-                        char DumpFileName[256];
-                        sprintf(DumpFileName, "sim86_memory_%u.data", DumpIndex);
-                        FILE *DumpFile = fopen(DumpFileName, "wb");
-                        if(DumpFile)
+                        EmitString(&Out, "--- ");
+                        EmitString(&Out, FileName);
+                        EmitString(&Out, " loop analysis ---\n");
+                        loop_analysis Analysis = AnalyzeLoops(Get8086InstructionTable(), Memory, BytesRead, DecodeModeFrom(SimFlags));
+                        PrintLoopAnalysis(&Analysis, Memory, &Out);
+                        FreeLoopAnalysis(&Analysis);
+                    }
+                    else if(Execute)
+                    {
+                        EmitString(&Out, "--- ");
+                        EmitString(&Out, FileName);
+                        EmitString(&Out, " execution ---\n");
+                        
+                        // NOTE: With -restore, the run picks up from a checkpoint instead of the start of the
+                        // image. The image is still loaded first, but the checkpoint has all of memory in it.
+                        snapshot *Resume = 0;
+                        if(RestoreFileName)
+                        {
+                            Resume = ReadCheckpoint(RestoreFileName, RestoreInstructionCount, MainMemSize);
+                            if(Resume)
+                            {
+                                EmitFormatted(&Out, "Resuming at instruction %llu from %s\n",
+                                              Resume->InstructionCount, RestoreFileName);
+                            }
+                            else
+                            {
+                                FlushText(&Out);
+                                fprintf(stderr, "ERROR: No checkpoint at or before instruction %llu could be read from %s.\n",
+                                        RestoreInstructionCount, RestoreFileName);
+                            }
+                        }
+                        
+                        if(!RestoreFileName || Resume)
                         {
-                            fwrite(MainMemory.Memory, MainMemSize, 1, DumpFile);
-                            fclose(DumpFile);
+                            block_cache *Cache = AllocateBlockCacheFor(SimFlags, MainMemSize);
+                            
+                            checkpointer Checkpoints = {};
+                            char CheckpointFileName[256] = {};
+                            if(CheckpointInterval)
+                            {
+                                sprintf(CheckpointFileName, "sim86_checkpoints_%u.data", CheckpointIndex++);
+                                Checkpoints.Store = AllocateSnapshotStore(MainMemSize);
+                                Checkpoints.Interval = CheckpointInterval;
+                                Checkpoints.Dest = fopen(CheckpointFileName, "wb");
+                                Checkpoints.Failed = !Checkpoints.Dest;
+                            }
+                            
+                            address_profile Profile = {};
+                            if(SimFlags & SimFlag_Profile)
+                            {
+                                Profile = AllocateProfile(MainMemSize);
+                            }
+                            
+                            run_hooks Hooks = {};
+                            if(Trace.Dest)
+                            {
+                                BeginTraceSection(&Trace);
+                                Hooks.Trace = &Trace;
+                            }
+                            Hooks.Checkpoints = Checkpoints.Store ? &Checkpoints : 0;
+                            Hooks.Profile = Profile.AddressCount ? &Profile : 0;
+                            Hooks.Resume = Resume;
+                            Run8086(BytesRead, Memory, SimFlags, Timing, Cache, Hooks, &Out);
+                            
+                            FreeProfile(&Profile);
+                            
+                            if(Checkpoints.Store)
+                            {
+                                ReleaseSnapshot(Checkpoints.Previous);
+                                FreeSnapshotStore(Checkpoints.Store);
+                            }
+                            if(Checkpoints.Dest && (fclose(Checkpoints.Dest) != 0))
+                            {
+                                Checkpoints.Failed = true;
+                            }
+                            if(CheckpointInterval && (!Checkpoints.Store || Checkpoints.Failed))
+                            {
+                                FlushText(&Out);
+                                fprintf(stderr, "ERROR: Unable to take or write every checkpoint to %s.\n", CheckpointFileName);
+                            }
+                            if(Cache)
+                            {
+                                FreeBlockCache(Cache);
+                            }
                         }
                         
-                        ++DumpIndex;
+                        ReleaseSnapshot(Resume);
+                    }
+                    else
+                    {
+                        EmitString(&Out, "; ");
+                        EmitString(&Out, FileName);
+                        EmitString(&Out, " disassembly:\nbits 16\n");
+                        DisAsm8086(BytesRead, Memory, SimFlags, Timing, ThreadCount, &Out);
                     }
+                    
+                    FlushText(&Out);
+                    
+                    if(SimFlags & SimFlag_DumpMemory)
+                    {
+                        DumpMemory(Memory, DumpIndex++, PreviousDump, &Out);
+                    }
+                    
+                    ReleaseMappedMemory(FileName, &Mapping);
                 }
             }
+            
+            if(BatchJobCount)
+            {
+                RunBatch(BatchJobs, BatchJobCount, MainMemory, MainMemPow2, ThreadCount, &Out);
+            }
         }
         else
         {
             fprintf(stderr, "USAGE: %s [8086 machine code file] ...\n", Args[0]);
         }
+        
+        CloseTrace(&Trace, TraceFileName, &Out);
     }
     else
     {
@@ -22,6 +22,8 @@ typedef long long s64;
 
 typedef s32 b32;
 
+typedef double f64;
+
 #define ArrayCount(Array) (sizeof(Array) / sizeof((Array)[0]))
 
-static u32 const SIM86_VERSION = 4;
+static u32 const SIM86_VERSION = 5;
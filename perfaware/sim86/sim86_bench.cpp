@@ -0,0 +1,128 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static void Error(repetition_tester *Tester, char const *Message)
+{
+    Tester->Mode = TestMode_Error;
+    fprintf(stderr, "ERROR: %s\n", Message);
+}
+
+static void NewTestWave(repetition_tester *Tester, u64 TargetInstructionCount, u64 CPUTimerFreq, u32 SecondsToTry)
+{
+    *Tester = {};
+    Tester->Mode = TestMode_Testing;
+    Tester->TargetInstructionCount = TargetInstructionCount;
+    Tester->CPUTimerFreq = CPUTimerFreq;
+    Tester->Results.Min.E[RepValue_CPUTimer] = (u64)-1;
+    
+    if(!CPUTimerFreq)
+    {
+        Error(Tester, "Unable to estimate the CPU timer frequency");
+    }
+    
+    Tester->TryForTime = SecondsToTry*CPUTimerFreq;
+    Tester->TestsStartedAt = ReadCPUTimer();
+}
+
+static void BeginTime(repetition_tester *Tester)
+{
+    ++Tester->OpenBlockCount;
+    
+    repetition_value *Accum = &Tester->AccumulatedOnThisTest;
+    Accum->E[RepValue_CPUTimer] -= ReadCPUTimer();
+}
+
+static void EndTime(repetition_tester *Tester)
+{
+    repetition_value *Accum = &Tester->AccumulatedOnThisTest;
+    Accum->E[RepValue_CPUTimer] += ReadCPUTimer();
+    
+    ++Tester->CloseBlockCount;
+}
+
+static void CountInstructions(repetition_tester *Tester, u64 InstructionCount)
+{
+    repetition_value *Accum = &Tester->AccumulatedOnThisTest;
+    Accum->E[RepValue_InstructionCount] += InstructionCount;
+}
+
+static b32 IsTesting(repetition_tester *Tester)
+{
+    if(Tester->Mode == TestMode_Testing)
+    {
+        repetition_value Accum = Tester->AccumulatedOnThisTest;
+        u64 CurrentTime = ReadCPUTimer();
+        
+        if(Tester->OpenBlockCount) // NOTE: Tests that had no timing blocks are not counted
+        {
+            if(Tester->OpenBlockCount != Tester->CloseBlockCount)
+            {
+                Error(Tester, "Unbalanced BeginTime/EndTime");
+            }
+            
+            // NOTE: Every test has to simulate exactly the same thing, or the times aren't comparable
+            if(Accum.E[RepValue_InstructionCount] != Tester->TargetInstructionCount)
+            {
+                Error(Tester, "Processed instruction count mismatch");
+            }
+            
+            if(Tester->Mode == TestMode_Testing)
+            {
+                repetition_test_results *Results = &Tester->Results;
+                
+                Accum.E[RepValue_TestCount] = 1;
+                for(u32 EIndex = 0; EIndex < ArrayCount(Accum.E); ++EIndex)
+                {
+                    Results->Total.E[EIndex] += Accum.E[EIndex];
+                }
+                
+                if(Results->Max.E[RepValue_CPUTimer] < Accum.E[RepValue_CPUTimer])
+                {
+                    Results->Max = Accum;
+                }
+                
+                if(Results->Min.E[RepValue_CPUTimer] > Accum.E[RepValue_CPUTimer])
+                {
+                    Results->Min = Accum;
+                    
+                    // NOTE: Whenever there is a new minimum time, the clock is reset to the full trial time
+                    Tester->TestsStartedAt = CurrentTime;
+                }
+                
+                Tester->OpenBlockCount = 0;
+                Tester->CloseBlockCount = 0;
+                Tester->AccumulatedOnThisTest = {};
+            }
+        }
+        
+        if((CurrentTime - Tester->TestsStartedAt) > Tester->TryForTime)
+        {
+            Tester->Mode = TestMode_Completed;
+        }
+    }
+    
+    b32 Result = (Tester->Mode == TestMode_Testing);
+    return Result;
+}
+
+static f64 NanosecondsPerInstruction(repetition_value Value, u64 CPUTimerFreq)
+{
+    // NOTE: Total holds the sum of every test, so dividing by the total instruction count gives the average
+    f64 Result = 0;
+    if(Value.E[RepValue_InstructionCount] && CPUTimerFreq)
+    {
+        f64 Seconds = (f64)Value.E[RepValue_CPUTimer] / (f64)CPUTimerFreq;
+        Result = (1000000000.0*Seconds) / (f64)Value.E[RepValue_InstructionCount];
+    }
+    
+    return Result;
+}
@@ -0,0 +1,67 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: This is the repetition tester from part 3, cut down to what -bench needs. Each test is timed
+// with the CPU timer, and a wave keeps running tests until it goes SecondsToTry without a new minimum.
+
+enum test_mode : u32
+{
+    TestMode_Uninitialized,
+    TestMode_Testing,
+    TestMode_Completed,
+    TestMode_Error,
+};
+
+enum repetition_value_type
+{
+    RepValue_TestCount,
+    
+    RepValue_CPUTimer,
+    RepValue_InstructionCount,
+    
+    RepValue_Count,
+};
+
+struct repetition_value
+{
+    u64 E[RepValue_Count];
+};
+
+struct repetition_test_results
+{
+    repetition_value Total;
+    repetition_value Min;
+    repetition_value Max;
+};
+
+struct repetition_tester
+{
+    u64 TargetInstructionCount;
+    u64 CPUTimerFreq;
+    u64 TryForTime;
+    u64 TestsStartedAt;
+    
+    test_mode Mode;
+    u32 OpenBlockCount;
+    u32 CloseBlockCount;
+    
+    repetition_value AccumulatedOnThisTest;
+    repetition_test_results Results;
+};
+
+static void NewTestWave(repetition_tester *Tester, u64 TargetInstructionCount, u64 CPUTimerFreq, u32 SecondsToTry);
+static void BeginTime(repetition_tester *Tester);
+static void EndTime(repetition_tester *Tester);
+static void CountInstructions(repetition_tester *Tester, u64 InstructionCount);
+static b32 IsTesting(repetition_tester *Tester);
+
+static f64 NanosecondsPerInstruction(repetition_value Value, u64 CPUTimerFreq);
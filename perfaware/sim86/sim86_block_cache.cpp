@@ -0,0 +1,353 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static block_cache *AllocateBlockCache(u32 MemorySize, b32 LowerMicroOps, b32 CacheTimings, u32 JitHotThreshold)
+{
+    u32 MaxBlockCount = 4096;
+    u32 SlotCount = 2*MaxBlockCount;
+    u32 MaxInstructionCount = 8*MaxBlockCount;
+    u32 ChunkCount = MemorySize >> CODE_WATCH_CHUNK_SHIFT;
+    u32 MaxMicroOpCount = LowerMicroOps ? MaxInstructionCount : 0;
+    u32 MaxTimingCount = CacheTimings ? MaxInstructionCount : 0;
+    
+    u64 TotalSize = (sizeof(block_cache) +
+                     SlotCount*sizeof(u32) +
+                     MaxBlockCount*sizeof(decoded_block) +
+                     MaxInstructionCount*sizeof(instruction) +
+                     MaxMicroOpCount*sizeof(micro_op) +
+                     MaxTimingCount*sizeof(static_timing) +
+                     ChunkCount*sizeof(u32) +
+                     ((ChunkCount + 7) / 8));
+    
+    block_cache *Cache = (block_cache *)calloc(1, TotalSize);
+    if(Cache)
+    {
+        u8 *At = (u8 *)(Cache + 1);
+        
+        Cache->Instructions = (instruction *)At;
+        At += MaxInstructionCount*sizeof(instruction);
+        Cache->MaxInstructionCount = MaxInstructionCount;
+        
+        if(MaxMicroOpCount)
+        {
+            Cache->MicroOps = (micro_op *)At;
+            At += MaxMicroOpCount*sizeof(micro_op);
+        }
+        
+        if(MaxTimingCount)
+        {
+            Cache->Timings = (static_timing *)At;
+            At += MaxTimingCount*sizeof(static_timing);
+        }
+        
+        Cache->Blocks = (decoded_block *)At;
+        At += MaxBlockCount*sizeof(decoded_block);
+        Cache->MaxBlockCount = MaxBlockCount;
+        
+        Cache->Slots = (u32 *)At;
+        At += SlotCount*sizeof(u32);
+        Cache->SlotCount = SlotCount;
+        
+        Cache->Watch.Generation = (u32 *)At;
+        At += ChunkCount*sizeof(u32);
+        Cache->Watch.HasCode = At;
+        Cache->Watch.ChunkCount = ChunkCount;
+        
+        if(JitHotThreshold)
+        {
+            Cache->Jit = AllocateJitCache(MaxBlockCount, JitHotThreshold);
+        }
+    }
+    
+    return Cache;
+}
+
+static void FreeBlockCache(block_cache *Cache)
+{
+    FreeJitCache(Cache->Jit);
+    free(Cache);
+}
+
+static b32 EndsBlock(operation_type Op)
+{
+    b32 Result = false;
+    
+    switch(Op)
+    {
+        case Op_call:
+        case Op_jmp:
+        case Op_ret:
+        case Op_retf:
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jne:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
+        case Op_int:
+        case Op_int3:
+        case Op_into:
+        case Op_iret:
+        {
+            Result = true;
+        } break;
+        
+        default: {} break;
+    }
+    
+    return Result;
+}
+
+static void WatchCode(code_watch *Watch, u32 FirstAddress, u32 OnePastLastAddress)
+{
+    u32 FirstChunk = FirstAddress >> CODE_WATCH_CHUNK_SHIFT;
+    u32 LastChunk = (OnePastLastAddress - 1) >> CODE_WATCH_CHUNK_SHIFT;
+    for(u32 Chunk = FirstChunk; (Chunk <= LastChunk) && (Chunk < Watch->ChunkCount); ++Chunk)
+    {
+        Watch->HasCode[Chunk >> 3] |= (1 << (Chunk & 7));
+    }
+}
+
+static u64 SumGenerations(code_watch *Watch, u32 FirstAddress, u32 OnePastLastAddress)
+{
+    u64 Result = 0;
+    
+    u32 FirstChunk = FirstAddress >> CODE_WATCH_CHUNK_SHIFT;
+    u32 LastChunk = (OnePastLastAddress - 1) >> CODE_WATCH_CHUNK_SHIFT;
+    for(u32 Chunk = FirstChunk; (Chunk <= LastChunk) && (Chunk < Watch->ChunkCount); ++Chunk)
+    {
+        Result += Watch->Generation[Chunk];
+    }
+    
+    return Result;
+}
+
+static u32 *GetBlockSlot(block_cache *Cache, u32 Address)
+{
+    // NOTE: Open addressing with linear probing. There are twice as many slots as blocks, so there
+    // is always an empty slot to stop on.
+    u32 Mask = Cache->SlotCount - 1;
+    u32 SlotIndex = (Address * 2654435761u) & Mask;
+    
+    u32 *Result = Cache->Slots + SlotIndex;
+    while(*Result && (Cache->Blocks[*Result - 1].Address != Address))
+    {
+        SlotIndex = (SlotIndex + 1) & Mask;
+        Result = Cache->Slots + SlotIndex;
+    }
+    
+    return Result;
+}
+
+static void FlushBlockCache(block_cache *Cache)
+{
+    // NOTE: The code watch bits are left alone. Chunks that used to have code in them will keep
+    // bumping their generations on writes, which is harmless.
+    for(u32 SlotIndex = 0; SlotIndex < Cache->SlotCount; ++SlotIndex)
+    {
+        Cache->Slots[SlotIndex] = 0;
+    }
+    
+    Cache->BlockCount = 0;
+    Cache->InstructionCount = 0;
+    Cache->CurrentBlock = 0;
+    ++Cache->Stats.Flushes;
+}
+
+static decoded_block *DecodeBlock(block_cache *Cache, instruction_table Table, segmented_access At,
+                                  u32 OnePastLastByte, decode_mode Mode)
+{
+    if((Cache->BlockCount >= Cache->MaxBlockCount) ||
+       ((Cache->InstructionCount + BLOCK_CACHE_MAX_BLOCK_INSTRUCTIONS) > Cache->MaxInstructionCount))
+    {
+        FlushBlockCache(Cache);
+    }
+    
+    decoded_block *Block = Cache->Blocks + Cache->BlockCount;
+    *Block = {};
+    Block->Address = GetAbsoluteAddressOf(At);
+    Block->OnePastLastAddress = Block->Address;
+    Block->FirstInstruction = Cache->InstructionCount;
+    
+    while(Block->InstructionCount < BLOCK_CACHE_MAX_BLOCK_INSTRUCTIONS)
+    {
+        u32 Address = GetAbsoluteAddressOf(At);
+        
+        // NOTE: Anything that would read past the end of the segment is left out of the block,
+        // so that the bytes a block was decoded from are always one contiguous range.
+        if((Address >= OnePastLastByte) ||
+           ((Address + Table.MaxInstructionByteCount) > (At.Mask + 1)))
+        {
+            break;
+        }
+        
+        instruction Instruction = DecodeInstruction(Table, At, Mode);
+        if(!Instruction.Op)
+        {
+            break;
+        }
+        
+        u32 InstructionIndex = Block->FirstInstruction + Block->InstructionCount++;
+        Cache->Instructions[InstructionIndex] = Instruction;
+        if(Cache->MicroOps)
+        {
+            Cache->MicroOps[InstructionIndex] = LowerToMicroOp(Cache->Instructions + InstructionIndex);
+        }
+        if(Cache->Timings)
+        {
+            Cache->Timings[InstructionIndex] = GetStaticTiming(Instruction);
+        }
+        At.SegmentOffset += Instruction.Size;
+        Block->OnePastLastAddress = Address + Instruction.Size;
+        
+        if(EndsBlock(Instruction.Op))
+        {
+            break;
+        }
+    }
+    
+    if(Block->InstructionCount)
+    {
+        // NOTE: Decoding always looks at the second byte of an instruction, even when the instruction
+        // is only one byte long, so the byte after the block counts as part of it too.
+        u32 WatchEnd = Block->OnePastLastAddress + 1;
+        WatchCode(&Cache->Watch, Block->Address, WatchEnd);
+        Block->GenerationSum = SumGenerations(&Cache->Watch, Block->Address, WatchEnd);
+        
+        *GetBlockSlot(Cache, Block->Address) = ++Cache->BlockCount;
+        Cache->InstructionCount += Block->InstructionCount;
+        
+        ++Cache->Stats.BlocksDecoded;
+        Cache->Stats.InstructionsDecoded += Block->InstructionCount;
+    }
+    else
+    {
+        Block = 0;
+    }
+    
+    return Block;
+}
+
+static decoded_block *FindBlock(block_cache *Cache, u32 Address)
+{
+    decoded_block *Result = 0;
+    
+    u32 BlockIndex = *GetBlockSlot(Cache, Address);
+    if(BlockIndex)
+    {
+        decoded_block *Block = Cache->Blocks + BlockIndex - 1;
+        if(Block->GenerationSum == SumGenerations(&Cache->Watch, Block->Address, Block->OnePastLastAddress + 1))
+        {
+            Result = Block;
+        }
+        else
+        {
+            ++Cache->Stats.BlocksInvalidated;
+        }
+    }
+    
+    return Result;
+}
+
+static b32 ContinuesCurrentBlock(block_cache *Cache, u32 Address)
+{
+    decoded_block *Block = Cache->CurrentBlock;
+    b32 Result = (Block &&
+                  (Cache->ValidatedAtWriteCount == Cache->Watch.CodeWriteCount) &&
+                  (Cache->NextIndex < Block->InstructionCount) &&
+                  (Cache->Instructions[Block->FirstInstruction + Cache->NextIndex].Address == Address));
+    return Result;
+}
+
+static decoded_block *EnterBlock(block_cache *Cache, instruction_table Table, segmented_access At,
+                                 u32 OnePastLastByte, decode_mode Mode)
+{
+    decoded_block *Block = FindBlock(Cache, GetAbsoluteAddressOf(At));
+    if(!Block)
+    {
+        Block = DecodeBlock(Cache, Table, At, OnePastLastByte, Mode);
+    }
+    
+    Cache->CurrentBlock = Block;
+    Cache->NextIndex = 0;
+    Cache->ValidatedAtWriteCount = Cache->Watch.CodeWriteCount;
+    
+    return Block;
+}
+
+static instruction FetchInstruction(block_cache *Cache, instruction_table Table, segmented_access At,
+                                    u32 OnePastLastByte, decode_mode Mode)
+{
+    instruction Result = {};
+    
+    decoded_block *Block = Cache->CurrentBlock;
+    if(!ContinuesCurrentBlock(Cache, GetAbsoluteAddressOf(At)))
+    {
+        Block = EnterBlock(Cache, Table, At, OnePastLastByte, Mode);
+    }
+    
+    ++Cache->Stats.InstructionsFetched;
+    Cache->FetchedMicroOp = 0;
+    Cache->FetchedTiming = 0;
+    if(Block)
+    {
+        u32 InstructionIndex = Block->FirstInstruction + Cache->NextIndex++;
+        Result = Cache->Instructions[InstructionIndex];
+        if(Cache->MicroOps)
+        {
+            Cache->FetchedMicroOp = Cache->MicroOps + InstructionIndex;
+        }
+        if(Cache->Timings)
+        {
+            Cache->FetchedTiming = Cache->Timings + InstructionIndex;
+        }
+    }
+    else
+    {
+        // NOTE: Whatever could not be put in a block (unrecognized bytes, instructions that wrap the
+        // segment) is decoded directly, so that the caller sees exactly what the decoder would return.
+        Result = DecodeInstruction(Table, At, Mode);
+    }
+    
+    return Result;
+}
+
+static u32 GetFetchedRemaining(block_cache *Cache)
+{
+    u32 Result = 0;
+    if(Cache->CurrentBlock)
+    {
+        Result = Cache->CurrentBlock->InstructionCount - Cache->NextIndex;
+    }
+    
+    return Result;
+}
+
+static void SkipFetched(block_cache *Cache, u32 Count)
+{
+    Cache->NextIndex += Count;
+    Cache->Stats.InstructionsFetched += Count;
+}
@@ -0,0 +1,81 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+#define BLOCK_CACHE_MAX_BLOCK_INSTRUCTIONS 32
+
+struct decoded_block
+{
+    u32 Address;
+    u32 OnePastLastAddress;
+    u64 GenerationSum; // NOTE: Sum of the code_watch generations of every chunk the block covers, when it was decoded
+    
+    u32 FirstInstruction; // NOTE: Index into the cache's instruction pool
+    u32 InstructionCount;
+};
+
+struct block_cache_stats
+{
+    u64 BlocksDecoded;
+    u64 BlocksInvalidated;
+    u64 InstructionsDecoded;
+    u64 InstructionsFetched;
+    u64 Flushes;
+};
+
+struct jit_cache;
+
+struct block_cache
+{
+    code_watch Watch;
+    
+    u32 SlotCount; // NOTE: Must be a power of two
+    u32 *Slots; // NOTE: Block index + 1 for each hash slot, 0 when empty
+    
+    u32 MaxBlockCount;
+    u32 BlockCount;
+    decoded_block *Blocks;
+    
+    u32 MaxInstructionCount;
+    u32 InstructionCount;
+    instruction *Instructions;
+    micro_op *MicroOps; // NOTE: Parallel to Instructions, only present if the cache was asked to lower them
+    static_timing *Timings; // NOTE: Parallel to Instructions, only present if the cache was asked to time them
+    
+    // NOTE: Where the last fetch left off, so that straight-line code doesn't have to hash at all
+    decoded_block *CurrentBlock;
+    u32 NextIndex;
+    u32 ValidatedAtWriteCount;
+    
+    // NOTE: The micro-op for the instruction most recently returned by FetchInstruction, or 0 if there isn't one
+    micro_op *FetchedMicroOp;
+    static_timing *FetchedTiming; // NOTE: Same, for the instruction's static timing
+    
+    jit_cache *Jit; // NOTE: Only present if the cache was asked to compile hot blocks
+    
+    block_cache_stats Stats;
+};
+
+// NOTE: A JitHotThreshold of 0 means no JIT. Otherwise, blocks are compiled once they have been entered that many times.
+static block_cache *AllocateBlockCache(u32 MemorySize, b32 LowerMicroOps = false, b32 CacheTimings = false,
+                                       u32 JitHotThreshold = 0);
+static void FreeBlockCache(block_cache *Cache);
+static void FlushBlockCache(block_cache *Cache);
+static b32 ContinuesCurrentBlock(block_cache *Cache, u32 Address);
+static decoded_block *EnterBlock(block_cache *Cache, instruction_table Table, segmented_access At,
+                                 u32 OnePastLastByte, decode_mode Mode);
+static instruction FetchInstruction(block_cache *Cache, instruction_table Table, segmented_access At,
+                                    u32 OnePastLastByte, decode_mode Mode);
+
+// NOTE: For running more than one of a block's instructions at a time: how many come after the one
+// FetchInstruction just returned, and a way to mark that Count of them were run without being fetched
+static u32 GetFetchedRemaining(block_cache *Cache);
+static void SkipFetched(block_cache *Cache, u32 Count);
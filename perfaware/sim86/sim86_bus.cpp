@@ -0,0 +1,161 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static bus_interface MakeBusInterface(b32 Is8088, u32 StartAddress)
+{
+    bus_interface Result = {};
+    
+    Result.QueueSize = Is8088 ? 4 : 6;
+    Result.FetchWidth = Is8088 ? 1 : 2;
+    Result.FetchAddress = StartAddress;
+    
+    return Result;
+}
+
+static u32 NextFetchSize(bus_interface *Bus)
+{
+    // NOTE: The 8086 fetches words from even addresses, so after a jump to an odd address it fetches
+    // a single byte to get lined up again
+    u32 Result = Bus->FetchWidth;
+    if(Bus->FetchAddress & 1)
+    {
+        Result = 1;
+    }
+    
+    return Result;
+}
+
+static void RunBusUntil(bus_interface *Bus, u64 Time)
+{
+    // NOTE: Does all the fetching the BIU would have started before Time. A fetch that starts before
+    // Time but isn't done until after it is left in progress. The EU always gets the bus first for
+    // anything it asks for at Time itself.
+    for(;;)
+    {
+        if(Bus->PendingBytes && (Bus->BusFreeAt <= Time))
+        {
+            Bus->QueueCount += Bus->PendingBytes;
+            Bus->FetchAddress += Bus->PendingBytes;
+            Bus->PendingBytes = 0;
+        }
+        
+        u32 FetchSize = NextFetchSize(Bus);
+        if(!Bus->PendingBytes && (Bus->BusFreeAt < Time) && ((Bus->QueueCount + FetchSize) <= Bus->QueueSize))
+        {
+            Bus->PendingBytes = FetchSize;
+            Bus->BusFreeAt += BUS_CYCLE_CLOCKS;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+static void WakeBus(bus_interface *Bus, u64 Time)
+{
+    // NOTE: If the bus has been sitting idle (because the queue was full), the soonest it can start
+    // anything new is now
+    if(!Bus->PendingBytes && (Bus->BusFreeAt < Time))
+    {
+        Bus->BusFreeAt = Time;
+    }
+}
+
+static u64 TakeQueueByte(bus_interface *Bus, u64 Time, bus_clocks *Result)
+{
+    RunBusUntil(Bus, Time);
+    while(Bus->QueueCount == 0)
+    {
+        if(!Bus->PendingBytes)
+        {
+            WakeBus(Bus, Time);
+            Bus->PendingBytes = NextFetchSize(Bus);
+            Bus->BusFreeAt += BUS_CYCLE_CLOCKS;
+        }
+        
+        Result->QueueWait += (u32)(Bus->BusFreeAt - Time);
+        Time = Bus->BusFreeAt;
+        RunBusUntil(Bus, Time);
+    }
+    
+    --Bus->QueueCount;
+    WakeBus(Bus, Time);
+    
+    return Time;
+}
+
+static u64 RunTransfer(bus_interface *Bus, u64 Time, bus_clocks *Result)
+{
+    // NOTE: A fetch that already has the bus gets to finish first
+    RunBusUntil(Bus, Time);
+    if(Bus->BusFreeAt > Time)
+    {
+        Result->BusWait += (u32)(Bus->BusFreeAt - Time);
+        Time = Bus->BusFreeAt;
+        RunBusUntil(Bus, Time);
+    }
+    
+    Time += BUS_CYCLE_CLOCKS;
+    Bus->BusFreeAt = Time;
+    
+    return Time;
+}
+
+static bus_clocks SimulateBusTiming(bus_interface *Bus, timing_state State, instruction Instruction,
+                                    static_timing *Static, b32 Jumped, u32 NextAddress)
+{
+    bus_clocks Result = {};
+    
+    instruction_timing Timing = ApplyDynamicTiming(State, Static ? *Static : GetStaticTiming(Instruction));
+    
+    u32 CyclesPerTransfer = 1;
+    if((Instruction.Flags & Inst_Wide) && ((Bus->FetchWidth == 1) || State.AssumeAddressUnanaligned))
+    {
+        CyclesPerTransfer = 2;
+    }
+    
+    u32 TransferClocks = BUS_CYCLE_CLOCKS*Timing.Transfers;
+    u32 ExecClocks = (Timing.Base.Min > TransferClocks) ? (Timing.Base.Min - TransferClocks) : 0;
+    
+    u64 Time = Bus->Now;
+    for(u32 ByteIndex = 0; ByteIndex < Instruction.Size; ++ByteIndex)
+    {
+        Time = TakeQueueByte(Bus, Time, &Result);
+    }
+    
+    Time += Timing.EAClocks;
+    for(u32 CycleIndex = 0; CycleIndex < Timing.Transfers*CyclesPerTransfer; ++CycleIndex)
+    {
+        Time = RunTransfer(Bus, Time, &Result);
+    }
+    
+    Time += ExecClocks;
+    RunBusUntil(Bus, Time);
+    
+    if(Jumped)
+    {
+        // NOTE: Whatever was prefetched is from the wrong place. A fetch that is already on the bus
+        // still has to finish, but what it brings in is thrown away too.
+        Bus->QueueCount = 0;
+        Bus->PendingBytes = 0;
+        Bus->FetchAddress = NextAddress;
+        WakeBus(Bus, Time);
+    }
+    
+    Result.Clocks = (u32)(Time - Bus->Now);
+    Bus->Now = Time;
+    Bus->TotalQueueWait += Result.QueueWait;
+    Bus->TotalBusWait += Result.BusWait;
+    
+    return Result;
+}
@@ -0,0 +1,56 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: The bus timing model splits the processor the way the manual does, into an execution unit (EU)
+   that runs instructions and a bus interface unit (BIU) that does all the memory traffic. The BIU keeps
+   a prefetch queue topped up with the bytes that come after the current instruction, using every bus
+   cycle the EU doesn't need for its own reads and writes. The EU takes instruction bytes out of the queue,
+   and when the queue is empty it has to sit and wait for the next fetch to come in. Anything that sends
+   ip somewhere other than the next instruction throws the queue away.
+   
+   Every bus cycle is 4 clocks. The 8086 moves a word per bus cycle and has a 6-byte queue. The 8088 moves
+   a byte per bus cycle and has a 4-byte queue, which it can drain much faster than it can fill, and that
+   is where most of its time goes. The clocks from the manual are taken to be EU clocks plus 4 clocks per
+   transfer, so the transfers are pulled out and put on the bus instead. This is still a model, not a
+   cycle-exact reproduction of the real chip: there are no wait states, the EU takes all of an
+   instruction's bytes before it starts, and its data transfers all happen right after the EA calculation.
+   The manual's clocks for jumps already allow for some refilling of the queue, so with the flush on top of
+   that, jumps come out a little slower than they really are. */
+
+#define BUS_CYCLE_CLOCKS 4
+
+struct bus_clocks
+{
+    u32 Clocks; // NOTE: From the end of the previous instruction to the end of this one
+    u32 QueueWait; // NOTE: Clocks the EU spent waiting for instruction bytes
+    u32 BusWait; // NOTE: Clocks the EU spent waiting for a fetch to get off the bus before a transfer
+};
+
+struct bus_interface
+{
+    u32 QueueSize;
+    u32 FetchWidth; // NOTE: Bytes per fetch when the address is aligned
+    
+    u32 QueueCount;
+    u32 FetchAddress; // NOTE: Where the next fetch comes from
+    
+    u64 Now; // NOTE: When the EU finished the last instruction
+    u64 BusFreeAt; // NOTE: When the bus cycle in progress is done. Nothing is in progress once this has passed.
+    u32 PendingBytes; // NOTE: What the fetch in progress will add to the queue when it is done
+    
+    u64 TotalQueueWait;
+    u64 TotalBusWait;
+};
+
+static bus_interface MakeBusInterface(b32 Is8088, u32 StartAddress);
+static bus_clocks SimulateBusTiming(bus_interface *Bus, timing_state State, instruction Instruction,
+                                    static_timing *Static, b32 Jumped, u32 NextAddress);
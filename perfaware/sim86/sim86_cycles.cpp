@@ -10,24 +10,311 @@
    
    ======================================================================== */
 
-static instruction_timing ClockRangeTransfers(u32 MinClocks, u32 MaxClocks, u32 Transfers, u32 EAClocks = 0)
+enum clock_shape
 {
-    instruction_timing Result = {};
+    // NOTE: One bit per operand_type
+    ClockShape_None = (1 << Operand_None),
+    ClockShape_Register = (1 << Operand_Register),
+    ClockShape_Memory = (1 << Operand_Memory),
+    ClockShape_Immediate = (1 << Operand_Immediate),
+    
+    ClockShape_Any = 0xf,
+};
+
+enum clock_form
+{
+    // NOTE: One bit per form index (Wide + 2*Far)
+    ClockForm_Byte = 0x5,
+    ClockForm_Word = 0xa,
+    ClockForm_Near = 0x3,
+    ClockForm_Far = 0xc,
+    
+    ClockForm_Any = 0xf,
+};
+
+static clock_rule ClockRangeTransfers(u32 MinClocks, u32 MaxClocks, u32 Transfers)
+{
+    clock_rule Result = {};
     
     Result.Base.Min = MinClocks;
     Result.Base.Max = MaxClocks;
-    Result.Transfers = Transfers;
-    Result.EAClocks = EAClocks;
+    Result.Transfers = (u16)Transfers;
     
     return Result;
 }
 
-static instruction_timing ClocksTransfers(u32 Clocks, u32 Transfers, u32 EAClocks = 0)
+static clock_rule ClocksTransfers(u32 Clocks, u32 Transfers)
+{
+    clock_rule Result = ClockRangeTransfers(Clocks, Clocks, Transfers);
+    return Result;
+}
+
+static clock_rule ClockRangeTransfersEA(u32 MinClocks, u32 MaxClocks, u32 Transfers)
+{
+    clock_rule Result = ClockRangeTransfers(MinClocks, MaxClocks, Transfers);
+    Result.IncludesEA = true;
+    return Result;
+}
+
+static clock_rule ClocksTransfersEA(u32 Clocks, u32 Transfers)
 {
-    instruction_timing Result = ClockRangeTransfers(Clocks, Clocks, Transfers, EAClocks);
+    clock_rule Result = ClockRangeTransfersEA(Clocks, Clocks, Transfers);
     return Result;
 }
 
+static clock_rule Taken(clock_rule Rule, u32 TakenClocks)
+{
+    Rule.TakenClocks = (u16)(TakenClocks - Rule.Base.Min);
+    return Rule;
+}
+
+static clock_rule PerShift(clock_rule Rule, u32 ShiftClocks)
+{
+    Rule.ShiftClocks = (u16)ShiftClocks;
+    return Rule;
+}
+
+static clock_rule Repeated(clock_rule Rule, u32 RepBase, u32 RepClocks, u32 RepTransfers)
+{
+    Rule.RepBase = (u16)RepBase;
+    Rule.RepClocks = (u16)RepClocks;
+    Rule.RepTransfers = (u16)RepTransfers;
+    return Rule;
+}
+
+static void SetClocks(clock_table *Table, operation_type Op, u32 Shape0, u32 Shape1, clock_rule Rule,
+                      u32 Form = ClockForm_Any)
+{
+    // NOTE: Later calls overwrite earlier ones wherever they overlap, so a general rule can be given first
+    // and then refined for specific shapes.
+    for(u32 Type0 = 0; Type0 < 4; ++Type0)
+    {
+        for(u32 Type1 = 0; Type1 < 4; ++Type1)
+        {
+            for(u32 FormIndex = 0; FormIndex < 4; ++FormIndex)
+            {
+                if((Shape0 & (1 << Type0)) && (Shape1 & (1 << Type1)) && (Form & (1 << FormIndex)))
+                {
+                    Table->Rules[Op][Type0][Type1][FormIndex] = Rule;
+                }
+            }
+        }
+    }
+}
+
+static void SetClocks(clock_table *Table, operation_type Op, clock_rule Rule)
+{
+    SetClocks(Table, Op, ClockShape_Any, ClockShape_Any, Rule);
+}
+
+static clock_table *BuildClockTable(clock_table *Table)
+{
+    /* TODO(casey): This routine is designed to return the results of the cycles table in the 8086 users manual.
+       Based on some of the entries in the table, it is HIGHLY LIKELY that some of the entries are typos.
+       Please do not use this as an actual reference for the behavior of an 8086. Without a more accurate
+       reference manual, these numbers are VERY suspect. */
+    
+    u32 const R = ClockShape_Register;
+    u32 const M = ClockShape_Memory;
+    u32 const I = ClockShape_Immediate;
+    u32 const Any = ClockShape_Any;
+    
+    operation_type Simple2[] = {Op_cbw, Op_clc, Op_cld, Op_cli, Op_cmc, Op_hlt, Op_lock, Op_rep, Op_stc, Op_std, Op_sti, Op_segment};
+    for(u32 Index = 0; Index < ArrayCount(Simple2); ++Index)
+    {
+        SetClocks(Table, Simple2[Index], ClocksTransfers(2, 0));
+    }
+    
+    operation_type Simple4[] = {Op_aaa, Op_aas, Op_daa, Op_das, Op_lahf, Op_sahf};
+    for(u32 Index = 0; Index < ArrayCount(Simple4); ++Index)
+    {
+        SetClocks(Table, Simple4[Index], ClocksTransfers(4, 0));
+    }
+    
+    SetClocks(Table, Op_cwd, ClocksTransfers(5, 0));
+    SetClocks(Table, Op_aad, ClocksTransfers(60, 0));
+    SetClocks(Table, Op_aam, ClocksTransfers(83, 0));
+    
+    operation_type Arithmetic[] = {Op_adc, Op_add, Op_and, Op_xor, Op_or, Op_sub, Op_sbb};
+    for(u32 Index = 0; Index < ArrayCount(Arithmetic); ++Index)
+    {
+        operation_type Op = Arithmetic[Index];
+        SetClocks(Table, Op, R, R, ClocksTransfers(3, 0));
+        SetClocks(Table, Op, R, M, ClocksTransfersEA(9, 1));
+        SetClocks(Table, Op, M, R, ClocksTransfersEA(16, 2));
+        SetClocks(Table, Op, R, I, ClocksTransfers(4, 0));
+        SetClocks(Table, Op, M, I, ClocksTransfersEA(17, 2));
+    }
+    
+    SetClocks(Table, Op_call, Any, Any, ClocksTransfers(19, 1), ClockForm_Near);
+    SetClocks(Table, Op_call, Any, Any, ClocksTransfers(28, 2), ClockForm_Far);
+    SetClocks(Table, Op_call, R, Any, ClocksTransfers(16, 1));
+    SetClocks(Table, Op_call, M, Any, ClocksTransfersEA(21, 2), ClockForm_Near);
+    SetClocks(Table, Op_call, M, Any, ClocksTransfersEA(37, 4), ClockForm_Far);
+    
+    SetClocks(Table, Op_cmp, R, R, ClocksTransfers(3, 0));
+    SetClocks(Table, Op_cmp, R, M, ClocksTransfersEA(9, 1));
+    SetClocks(Table, Op_cmp, M, R, ClocksTransfersEA(9, 1));
+    SetClocks(Table, Op_cmp, R, I, ClocksTransfers(4, 0));
+    SetClocks(Table, Op_cmp, M, I, ClocksTransfersEA(10, 1));
+    
+    SetClocks(Table, Op_cmps, Repeated(ClocksTransfers(22, 2), 9, 22, 2));
+    
+    operation_type IncDec[] = {Op_dec, Op_inc};
+    for(u32 Index = 0; Index < ArrayCount(IncDec); ++Index)
+    {
+        operation_type Op = IncDec[Index];
+        SetClocks(Table, Op, R, Any, ClocksTransfers(3, 0), ClockForm_Byte);
+        SetClocks(Table, Op, R, Any, ClocksTransfers(2, 0), ClockForm_Word);
+        SetClocks(Table, Op, M, Any, ClocksTransfersEA(15, 2));
+    }
+    
+    SetClocks(Table, Op_div, R, Any, ClockRangeTransfers(80, 90, 0), ClockForm_Byte);
+    SetClocks(Table, Op_div, R, Any, ClockRangeTransfers(144, 162, 0), ClockForm_Word);
+    SetClocks(Table, Op_div, M, Any, ClockRangeTransfersEA(86, 96, 1), ClockForm_Byte);
+    SetClocks(Table, Op_div, M, Any, ClockRangeTransfersEA(150, 168, 1), ClockForm_Word);
+    
+    SetClocks(Table, Op_esc, I, M, ClocksTransfersEA(8, 1));
+    SetClocks(Table, Op_esc, I, R, ClocksTransfers(2, 0));
+    
+    SetClocks(Table, Op_idiv, R, Any, ClockRangeTransfers(101, 112, 0), ClockForm_Byte);
+    SetClocks(Table, Op_idiv, R, Any, ClockRangeTransfers(165, 184, 0), ClockForm_Word);
+    SetClocks(Table, Op_idiv, M, Any, ClockRangeTransfersEA(107, 118, 1), ClockForm_Byte);
+    SetClocks(Table, Op_idiv, M, Any, ClockRangeTransfersEA(171, 190, 1), ClockForm_Word);
+    
+    SetClocks(Table, Op_imul, R, Any, ClockRangeTransfers(80, 98, 0), ClockForm_Byte);
+    SetClocks(Table, Op_imul, R, Any, ClockRangeTransfers(128, 154, 0), ClockForm_Word);
+    SetClocks(Table, Op_imul, M, Any, ClockRangeTransfersEA(86, 104, 1), ClockForm_Byte);
+    SetClocks(Table, Op_imul, M, Any, ClockRangeTransfersEA(134, 160, 1), ClockForm_Word);
+    
+    SetClocks(Table, Op_in, R, I, ClocksTransfers(10, 1));
+    SetClocks(Table, Op_in, R, R, ClocksTransfers(8, 1));
+    
+    // NOTE: INT 3 written out as INT takes a clock longer. That depends on the immediate, so it is
+    // added in by GetStaticTiming.
+    SetClocks(Table, Op_int, ClocksTransfers(51, 5));
+    SetClocks(Table, Op_int3, ClocksTransfers(52, 5));
+    SetClocks(Table, Op_into, ClockRangeTransfers(4, 53, 5));
+    SetClocks(Table, Op_iret, ClocksTransfers(24, 3));
+    
+    operation_type ConditionalJumps[] =
+    {
+        Op_je, Op_jl, Op_jle, Op_jb, Op_jbe, Op_jp, Op_jo, Op_js,
+        Op_jne, Op_jnl, Op_jg, Op_jnb, Op_ja, Op_jnp, Op_jno, Op_jns,
+    };
+    for(u32 Index = 0; Index < ArrayCount(ConditionalJumps); ++Index)
+    {
+        SetClocks(Table, ConditionalJumps[Index], Taken(ClocksTransfers(4, 0), 16));
+    }
+    
+    SetClocks(Table, Op_jcxz, Taken(ClocksTransfers(6, 0), 18));
+    
+    SetClocks(Table, Op_jmp, M, Any, ClocksTransfersEA(24, 2), ClockForm_Far);
+    SetClocks(Table, Op_jmp, M, Any, ClocksTransfersEA(18, 1), ClockForm_Near);
+    SetClocks(Table, Op_jmp, I, Any, ClocksTransfers(15, 0));
+    SetClocks(Table, Op_jmp, R, Any, ClocksTransfers(11, 0));
+    
+    SetClocks(Table, Op_lds, ClocksTransfersEA(16, 2));
+    SetClocks(Table, Op_lea, ClocksTransfersEA(2, 0));
+    SetClocks(Table, Op_les, ClocksTransfersEA(16, 2));
+    
+    SetClocks(Table, Op_lods, Repeated(ClocksTransfers(12, 1), 9, 13, 1));
+    
+    SetClocks(Table, Op_loop, Taken(ClocksTransfers(5, 0), 17));
+    SetClocks(Table, Op_loopz, Taken(ClocksTransfers(6, 0), 18));
+    SetClocks(Table, Op_loopnz, Taken(ClocksTransfers(5, 0), 19));
+    
+    /* TODO(casey): These numbers are what the manual claims, but it seems absurd that the 8086 somehow
+       _didn't_ have to do the effective address calculation when it was moving an accumulator. I
+       am fairly certain it is a misprint, and EA _should_ be included. Unfortunately I have no way
+       of testing this myself. */
+    /* NOTE: The accumulator forms (10 clocks, 1 transfer, no EA) aren't told apart from the general
+       ones, so memory moves always use the general timings below. */
+    SetClocks(Table, Op_mov, M, R, ClocksTransfersEA(9, 1));
+    SetClocks(Table, Op_mov, R, M, ClocksTransfersEA(8, 1));
+    SetClocks(Table, Op_mov, R, R, ClocksTransfers(2, 0));
+    SetClocks(Table, Op_mov, R, I, ClocksTransfers(4, 0));
+    SetClocks(Table, Op_mov, M, I, ClocksTransfersEA(10, 1));
+    
+    SetClocks(Table, Op_movs, Repeated(ClocksTransfers(18, 2), 9, 17, 2));
+    
+    SetClocks(Table, Op_mul, R, Any, ClockRangeTransfers(70, 77, 0), ClockForm_Byte);
+    SetClocks(Table, Op_mul, R, Any, ClockRangeTransfers(118, 133, 0), ClockForm_Word);
+    SetClocks(Table, Op_mul, M, Any, ClockRangeTransfersEA(76, 83, 1), ClockForm_Byte);
+    SetClocks(Table, Op_mul, M, Any, ClockRangeTransfersEA(124, 139, 1), ClockForm_Word);
+    
+    operation_type NegNot[] = {Op_neg, Op_not};
+    for(u32 Index = 0; Index < ArrayCount(NegNot); ++Index)
+    {
+        SetClocks(Table, NegNot[Index], R, Any, ClocksTransfers(3, 0));
+        SetClocks(Table, NegNot[Index], M, Any, ClocksTransfersEA(16, 2));
+    }
+    
+    SetClocks(Table, Op_out, I, R, ClocksTransfers(10, 1));
+    SetClocks(Table, Op_out, R, R, ClocksTransfers(8, 1));
+    
+    SetClocks(Table, Op_pop, R, Any, ClocksTransfers(8, 1));
+    SetClocks(Table, Op_pop, M, Any, ClocksTransfersEA(17, 2));
+    
+    SetClocks(Table, Op_popf, ClocksTransfers(8, 1));
+    
+    /* TODO(casey): It seems suspicious that push takes one less clock to push a segment register,
+       but pop doens't take one less clock to pop it. It's _possible_ that the 8086 worked that way,
+       but, it's also possible this is another misprint. */
+    /* NOTE: Segment registers aren't told apart here either, so every register push takes 11. */
+    SetClocks(Table, Op_push, R, Any, ClocksTransfers(11, 1));
+    SetClocks(Table, Op_push, M, Any, ClocksTransfers(16, 2));
+    
+    SetClocks(Table, Op_pushf, ClocksTransfers(10, 1));
+    
+    SetClocks(Table, Op_ret, ClocksTransfers(8, 1));
+    SetClocks(Table, Op_ret, I, Any, ClocksTransfers(12, 1));
+    
+    SetClocks(Table, Op_retf, ClocksTransfers(18, 2));
+    SetClocks(Table, Op_retf, I, Any, ClocksTransfers(17, 2));
+    
+    operation_type Shifts[] = {Op_rcl, Op_rcr, Op_rol, Op_ror, Op_shl, Op_sar, Op_shr};
+    for(u32 Index = 0; Index < ArrayCount(Shifts); ++Index)
+    {
+        operation_type Op = Shifts[Index];
+        SetClocks(Table, Op, R, I, ClocksTransfers(2, 0));
+        SetClocks(Table, Op, R, R, PerShift(ClocksTransfers(8, 0), 4));
+        SetClocks(Table, Op, M, I, ClocksTransfersEA(15, 2));
+        SetClocks(Table, Op, M, R, PerShift(ClocksTransfersEA(20, 2), 4));
+    }
+    
+    SetClocks(Table, Op_scas, Repeated(ClocksTransfers(15, 1), 9, 15, 1));
+    SetClocks(Table, Op_stos, Repeated(ClocksTransfers(11, 1), 9, 10, 1));
+    
+    // NOTE: TEST with an immediate is a clock faster into the accumulator, which isn't told apart either
+    SetClocks(Table, Op_test, R, R, ClocksTransfers(3, 0));
+    SetClocks(Table, Op_test, R, M, ClocksTransfersEA(9, 1));
+    SetClocks(Table, Op_test, R, I, ClocksTransfers(5, 0));
+    SetClocks(Table, Op_test, M, I, ClocksTransfersEA(11, 0));
+    
+    SetClocks(Table, Op_wait, Repeated(ClocksTransfers(3, 0), 3, 5, 0));
+    
+    // NOTE: Exchanging with the accumulator is a clock faster, but is timed the same as the other registers
+    SetClocks(Table, Op_xchg, M, R, ClocksTransfersEA(17, 2));
+    SetClocks(Table, Op_xchg, R, R, ClocksTransfers(4, 0));
+    
+    SetClocks(Table, Op_xlat, ClocksTransfers(11, 1));
+    
+    return Table;
+}
+
+static clock_table GlobalClockTable;
+
+static clock_table *GetClockTable(void)
+{
+    /* NOTE: The table is built once, the first time it is asked for, and then only read from. A function-local
+       static is initialized exactly once even when several threads get here at the same time, so clocks can
+       be estimated from multiple threads without any setup first. */
+    
+    static clock_table *Table = BuildClockTable(&GlobalClockTable);
+    return Table;
+}
+
 static u32 CalculateEAClocksFrom(instruction Instruction, u32 OperandIndex)
 {
     u32 Result = 0;
@@ -74,412 +361,68 @@ static u32 CalculateEAClocksFrom(instruction Instruction, u32 OperandIndex)
     
     return Result;
 }
+
+static static_timing GetStaticTiming(instruction Instruction)
+{
+    static_timing Result = {};
     
-static instruction_timing EstimateInstructionClocks(timing_state State, instruction Instruction)
+    u32 Type0 = Instruction.Operands[0].Type;
+    u32 Type1 = Instruction.Operands[1].Type;
+    u32 Form = ((Instruction.Flags & Inst_Wide) ? 1 : 0) + ((Instruction.Flags & Inst_Far) ? 2 : 0);
+    Result.Rule = GetClockTable()->Rules[Instruction.Op][Type0][Type1][Form];
+    
+    if(Result.Rule.IncludesEA)
+    {
+        if(Type0 == Operand_Memory) Result.EAClocks = CalculateEAClocksFrom(Instruction, 0);
+        if(Type1 == Operand_Memory) Result.EAClocks = CalculateEAClocksFrom(Instruction, 1);
+    }
+    
+    if((Instruction.Op == Op_int) && (Instruction.Operands[0].Immediate.Value == 3))
+    {
+        Result.Rule.Base.Min += 1;
+        Result.Rule.Base.Max += 1;
+    }
+    
+    return Result;
+}
+
+static instruction_timing ApplyDynamicTiming(timing_state State, static_timing Static)
 {
-    /* TODO(casey): This routine is designed to return the results of the cycles table in the 8086 users manual.
-       Based on some of the entries in the table, it is HIGHLY LIKELY that some of the entries are typos.
-       Please do not use this as an actual reference for the behavior of an 8086. Without a more accurate
-       reference manual, these numbers are VERY suspect. */
+    clock_rule Rule = Static.Rule;
     
     instruction_timing Result = {};
-
-    b32 UsedAccumulator = false;
-    b32 UsedSegReg = false;
-
-    b32 Register0 = OperandIsType(Instruction, 0, Operand_Register);
-    b32 Register1 = OperandIsType(Instruction, 1, Operand_Register);
-    b32 Memory0 = OperandIsType(Instruction, 0, Operand_Memory);
-    b32 Memory1 = OperandIsType(Instruction, 1, Operand_Memory);
-    b32 Immediate0 = OperandIsType(Instruction, 0, Operand_Immediate);
-    b32 Immediate1 = OperandIsType(Instruction, 1, Operand_Immediate);
-    
-    b32 Far = (Instruction.Flags & Inst_Far);
-    b32 Wide = (Instruction.Flags & Inst_Wide);
-    
-    u32 EA = 0;
-    if(Memory0) EA = CalculateEAClocksFrom(Instruction, 0);
-    if(Memory1) EA = CalculateEAClocksFrom(Instruction, 1);
-    
-    // NOTE(casey): These have to be passed in
-    b32 Taken = State.AssumeBranchTaken;
-    u32 Rep = State.AssumeRepCount;
-    u32 CL = State.AssumeShiftCount;
-    
-    switch(Instruction.Op)
+    Result.Base = Rule.Base;
+    Result.Transfers = Rule.Transfers;
+    Result.EAClocks = Static.EAClocks;
+    
+    if(State.AssumeBranchTaken)
     {
-        case Op_cbw:
-        case Op_clc:
-        case Op_cld:
-        case Op_cli:
-        case Op_cmc:
-        case Op_hlt:
-        case Op_lock:
-        case Op_rep:
-        case Op_stc:
-        case Op_std:
-        case Op_sti:
-        case Op_segment:
-        {
-            Result = ClocksTransfers(2, 0);
-        } break;
-        
-        case Op_aaa:
-        case Op_aas:
-        case Op_daa:
-        case Op_das:
-        case Op_lahf:
-        case Op_sahf:
-        {
-            Result = ClocksTransfers(4, 0);
-        } break;
-        
-        case Op_cwd: {Result = ClocksTransfers(5, 0);} break;
-        case Op_aad: {Result = ClocksTransfers(60, 0);} break;
-        case Op_aam: {Result = ClocksTransfers(83, 0);} break;
-        
-        case Op_adc:
-        case Op_add:
-        case Op_and:
-        case Op_xor:
-        case Op_or:
-        case Op_sub:
-        case Op_sbb:
-        {
-            if(Register0 && Register1)     {Result = ClocksTransfers(3, 0);}
-            if(Register0 && Memory1)       {Result = ClocksTransfers(9, 1, EA);}
-            if(Memory0 && Register1)       {Result = ClocksTransfers(16, 2, EA);}
-            if(Register0 && Immediate1)    {Result = ClocksTransfers(4, 0);}
-            if(Memory0 && Immediate1)      {Result = ClocksTransfers(17, 2, EA);}
-        } break;
-        
-        case Op_call:
-        {
-            if(Memory0)
-            {
-                if(Far)
-                {
-                    Result = ClocksTransfers(37, 4, EA);
-                }
-                else
-                {
-                    Result = ClocksTransfers(21, 2, EA);
-                }
-            }
-            else if(Register0)
-            {
-                Result = ClocksTransfers(16, 1);
-            }
-            else
-            {
-                if(Far)
-                {
-                    Result = ClocksTransfers(28, 2);
-                }
-                else
-                {
-                    Result = ClocksTransfers(19, 1);
-                }
-            }
-        } break;
-        
-        case Op_cmp:
-        {
-            if(Register0 && Register1)     {Result = ClocksTransfers(3, 0);}
-            if(Register0 && Memory1)       {Result = ClocksTransfers(9, 1, EA);}
-            if(Memory0 && Register1)       {Result = ClocksTransfers(9, 1, EA);}
-            if(Register0 && Immediate1)    {Result = ClocksTransfers(4, 0);}
-            if(Memory0 && Immediate1)      {Result = ClocksTransfers(10, 1, EA);}
-        } break;
-        
-        case Op_cmps:
-        {
-            if(Rep)
-            {
-                Result = ClocksTransfers(9 + 22*Rep, 2*Rep);
-            }
-            else
-            {
-                Result = ClocksTransfers(22, 2);
-            }
-        } break;
-        
-        case Op_dec:
-        case Op_inc:
-        {
-            if(Register0 && !Wide) {Result = ClocksTransfers(3, 0);}
-            if(Register0 && Wide)  {Result = ClocksTransfers(2, 0);}
-            if(Memory0)            {Result = ClocksTransfers(15, 2, EA);}
-        } break;
-        
-        case Op_div:
-        {
-            if(Register0 && !Wide) {Result = ClockRangeTransfers(80, 90, 0);}
-            if(Register0 && Wide)  {Result = ClockRangeTransfers(144, 162, 0);}
-            if(Memory0 && !Wide)   {Result = ClockRangeTransfers(86, 96, 1, EA);}
-            if(Memory0 && Wide)    {Result = ClockRangeTransfers(150, 168, 1, EA);}
-        } break;
-        
-        case Op_esc:
-        {
-            if(Immediate0 && Memory1)   {Result = ClocksTransfers(8, 1, EA);}
-            if(Immediate0 && Register1) {Result = ClocksTransfers(2, 0);}
-        } break;
-        
-        case Op_idiv:
-        {
-            if(Register0 && !Wide) {Result = ClockRangeTransfers(101, 112, 0);}
-            if(Register0 && Wide)  {Result = ClockRangeTransfers(165, 184, 0);}
-            if(Memory0 && !Wide)   {Result = ClockRangeTransfers(107, 118, 1, EA);}
-            if(Memory0 && Wide)    {Result = ClockRangeTransfers(171, 190, 1, EA);}
-        } break;
-        
-        case Op_imul:
-        {
-            if(Register0 && !Wide) {Result = ClockRangeTransfers(80, 98, 0);}
-            if(Register0 && Wide)  {Result = ClockRangeTransfers(128, 154, 0);}
-            if(Memory0 && !Wide)   {Result = ClockRangeTransfers(86, 104, 1, EA);}
-            if(Memory0 && Wide)    {Result = ClockRangeTransfers(134, 160, 1, EA);}
-        } break;
-        
-        case Op_in:
-        {
-            if(Register0 && Immediate1) {Result = ClocksTransfers(10, 1);}
-            if(Register0 && Register1)  {Result = ClocksTransfers(8, 1);}
-        } break;
-        
-        case Op_int:
-        {
-            if(Instruction.Operands[0].Immediate.Value == 3)
-            {
-                Result = ClocksTransfers(52, 5);
-            }
-            else
-            {
-                Result = ClocksTransfers(51, 5);
-            }
-        } break;
-        
-        case Op_int3: {Result = ClocksTransfers(52, 5);} break;
-        case Op_into: {Result = ClockRangeTransfers(4, 53, 5);} break;
-        case Op_iret: {Result = ClocksTransfers(24, 3);} break;
-        
-        case Op_je:
-        case Op_jl:
-        case Op_jle:
-        case Op_jb:
-        case Op_jbe:
-        case Op_jp:
-        case Op_jo:
-        case Op_js:
-        case Op_jne:
-        case Op_jnl:
-        case Op_jg:
-        case Op_jnb:
-        case Op_ja:
-        case Op_jnp:
-        case Op_jno:
-        case Op_jns:
-        {
-            Result = ClocksTransfers(Taken ? 16 : 4, 0);
-        } break;
-        
-        case Op_jcxz:
-        {
-            Result = ClocksTransfers(Taken ? 18 : 6, 0);
-        } break;
-        
-        case Op_jmp:
-        {
-            if(Memory0 && Far)  {Result = ClocksTransfers(24, 2, EA);}
-            if(Memory0 && !Far) {Result = ClocksTransfers(18, 1, EA);}
-            if(Immediate0)      {Result = ClocksTransfers(15, 0);}
-            if(Register0)       {Result = ClocksTransfers(11, 0);}
-        } break;
-        
-        case Op_lds: {Result = ClocksTransfers(16, 2, EA);} break;
-        case Op_lea: {Result = ClocksTransfers(2, 0, EA);} break;
-        case Op_les: {Result = ClocksTransfers(16, 2, EA);} break;
-        
-        case Op_lods:
-        {
-            if(Rep)
-            {
-                Result = ClocksTransfers(9 + 13*Rep, Rep);
-            }
-            else
-            {
-                Result = ClocksTransfers(12, 1);
-            }
-        } break;
-        
-        case Op_loop:   {Result = ClocksTransfers(Taken ? 17 : 5, 0);} break;
-        case Op_loopz:  {Result = ClocksTransfers(Taken ? 18 : 6, 0);} break;
-        case Op_loopnz: {Result = ClocksTransfers(Taken ? 19 : 5, 0);} break;
-        
-        case Op_mov:
-        {
-            /* TODO(casey): These numbers are what the manual claims, but it seems absurd that the 8086 somehow
-               _didn't_ have to do the effective address calculation when it was moving an accumulator. I
-               am fairly certain it is a misprint, and EA _should_ be included. Unfortunately I have no way
-               of testing this myself. */
-               
-            if(Memory0 && Register1)
-            {
-                if(UsedAccumulator)
-                {
-                    Result = ClocksTransfers(10, 1);
-                }
-                else
-                {
-                    Result = ClocksTransfers(9, 1, EA);
-                }
-            }
-            
-            if(Register0 && Memory1)
-            {
-                if(UsedAccumulator)
-                {
-                    Result = ClocksTransfers(10, 1);
-                }
-                else
-                {
-                    Result = ClocksTransfers(8, 1, EA);
-                }
-            }
-            
-            if(Register0 && Register1)  {Result = ClocksTransfers(2, 0);}
-            if(Register0 && Immediate1) {Result = ClocksTransfers(4, 0);}
-            if(Memory0 && Immediate1)   {Result = ClocksTransfers(10, 1, EA);}
-        } break;
-        
-        case Op_movs:
-        {
-            if(Rep)
-            {
-                Result = ClocksTransfers(9 + 17*Rep, 2*Rep);
-            }
-            else
-            {
-                Result = ClocksTransfers(18, 2);
-            }
-        } break;
-        
-        case Op_mul:
-        {
-            if(Register0 && !Wide) {Result = ClockRangeTransfers(70, 77, 0);}
-            if(Register0 && Wide)  {Result = ClockRangeTransfers(118, 133, 0);}
-            if(Memory0 && !Wide)   {Result = ClockRangeTransfers(76, 83, 1, EA);}
-            if(Memory0 && Wide)    {Result = ClockRangeTransfers(124, 139, 1, EA);}
-        } break;
-        
-        case Op_neg:
-        case Op_not:
-        {
-            if(Register0) {Result = ClocksTransfers(3, 0);}
-            if(Memory0)   {Result = ClocksTransfers(16, 2, EA);}
-        } break;
-        
-        case Op_out:
-        {
-            if(Immediate0 && Register1) {Result = ClocksTransfers(10, 1);}
-            if(Register0 && Register1)  {Result = ClocksTransfers(8, 1);}
-        } break;
-        
-        case Op_pop:
-        {
-            if(Register0) {Result = ClocksTransfers(8, 1);}
-            if(Memory0)   {Result = ClocksTransfers(17, 2, EA);}
-        } break;
-        
-        case Op_popf: {Result = ClocksTransfers(8, 1);} break;
-        
-        case Op_push:
-        {
-            /* TODO(casey): It seems suspicious that push takes one less clock to push a segment register,
-               but pop doens't take one less clock to pop it. It's _possible_ that the 8086 worked that way,
-               but, it's also possible this is another misprint. */
-            if(Register0) {Result = ClocksTransfers(UsedSegReg ? 10 : 11, 1);}
-            if(Memory0)   {Result = ClocksTransfers(16, 2);}
-        } break;
-        
-        case Op_pushf: {Result = ClocksTransfers(10, 1);} break;
-        
-        case Op_ret:
-        {
-            Result = ClocksTransfers(Immediate0 ? 12 : 8, 1);
-        } break;
-        
-        case Op_retf:
-        {
-            Result = ClocksTransfers(Immediate0 ? 17 : 18, 2);
-        } break;
-        
-        case Op_rcl:
-        case Op_rcr:
-        case Op_rol:
-        case Op_ror:
-        case Op_shl:
-        case Op_sar:
-        case Op_shr:
-        {
-            if(Register0 && Immediate1) {Result = ClocksTransfers(2, 0);}
-            if(Register0 && Register1)  {Result = ClocksTransfers(8 + 4*CL, 0);}
-            if(Memory0 && Immediate1)   {Result = ClocksTransfers(15, 2, EA);}
-            if(Memory0 && Register1)    {Result = ClocksTransfers(20 + 4*CL, 2, EA);}
-        } break;
-        
-        case Op_scas:
-        {
-            if(Rep)
-            {
-                Result = ClocksTransfers(9 + 15*Rep, Rep);
-            }
-            else
-            {
-                Result = ClocksTransfers(15, 1);
-            }
-        } break;
-        
-        case Op_stos:
-        {
-            if(Rep)
-            {
-                Result = ClocksTransfers(9 + 10*Rep, Rep);
-            }
-            else
-            {
-                Result = ClocksTransfers(11, 1);
-            }
-        } break;
-        
-        case Op_test:
-        {
-            if(Register0 && Register1)     {Result = ClocksTransfers(3, 0);}
-            if(Register0 && Memory1)       {Result = ClocksTransfers(9, 1, EA);}
-            if(Register0 && Immediate1)    {Result = ClocksTransfers(UsedAccumulator ? 4 : 5, 0);}
-            if(Memory0 && Immediate1)      {Result = ClocksTransfers(11, 0, EA);}
-        } break;
-        
-        case Op_wait: {Result = ClocksTransfers(3 + 5*Rep, 0);} break;
-        
-        case Op_xchg:
-        {
-            if(Memory0 && Register1)      {Result = ClocksTransfers(17, 2, EA);}
-            if(Register0 && Register1)    {Result = ClocksTransfers(UsedAccumulator ? 3 : 4, 0);}
-        } break;
-        
-        case Op_xlat: {Result = ClocksTransfers(11, 1);} break;
-        
-        case Op_None:
-        case Op_Count:
-        {
-        } break;
+        Result.Base.Min += Rule.TakenClocks;
+        Result.Base.Max += Rule.TakenClocks;
+    }
+    
+    if(Rule.ShiftClocks)
+    {
+        u32 ShiftClocks = Rule.ShiftClocks*State.AssumeShiftCount;
+        Result.Base.Min += ShiftClocks;
+        Result.Base.Max += ShiftClocks;
+    }
+    
+    if(Rule.RepClocks && State.AssumeRepCount)
+    {
+        Result.Base.Min = Result.Base.Max = Rule.RepBase + Rule.RepClocks*State.AssumeRepCount;
+        Result.Transfers = Rule.RepTransfers*State.AssumeRepCount;
     }
     
     return Result;
 }
 
+static instruction_timing EstimateInstructionClocks(timing_state State, instruction Instruction)
+{
+    instruction_timing Result = ApplyDynamicTiming(State, GetStaticTiming(Instruction));
+    return Result;
+}
+
 static void UpdateTimingForExec(timing_state *State, exec_result Exec)
 {
     State->AssumeBranchTaken = Exec.BranchTaken;
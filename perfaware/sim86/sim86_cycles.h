@@ -10,16 +10,41 @@
    
    ======================================================================== */
 
-struct instruction_clock_interval
+struct instruction_timing
 {
-    u32 Min;
-    u32 Max;
+    instruction_clock_interval Base;
+    u32 Transfers;
+    u32 EAClocks;
 };
 
-struct instruction_timing
+// NOTE: One entry of the cycles table in the 8086 manual, for a single (op, operand shapes, width/far) combination.
+// Everything that depends on what the instruction did when it executed is kept separate, so it can be added
+// in afterward.
+struct clock_rule
 {
     instruction_clock_interval Base;
-    u32 Transfers;
+    u16 Transfers;
+    u16 IncludesEA;
+    
+    u16 TakenClocks; // NOTE: Added when the branch is taken
+    u16 ShiftClocks; // NOTE: Added per bit shifted when the count is in CL
+    
+    // NOTE: With a REP count, the op takes RepBase + RepClocks*Count clocks (and RepTransfers*Count transfers)
+    // instead of Base. RepClocks is 0 for ops that don't repeat.
+    u16 RepBase;
+    u16 RepClocks;
+    u16 RepTransfers;
+};
+
+struct clock_table
+{
+    clock_rule Rules[Op_Count][4][4][4]; // NOTE: [Op][Operand 0 type][Operand 1 type][Wide + 2*Far]
+};
+
+// NOTE: The part of an instruction's timing that is the same every time it executes
+struct static_timing
+{
+    clock_rule Rule;
     u32 EAClocks;
 };
 
@@ -32,6 +57,9 @@ struct timing_state
     u32 AssumeShiftCount;
 };
 
+static clock_table *GetClockTable(void);
+static static_timing GetStaticTiming(instruction Instruction);
+static instruction_timing ApplyDynamicTiming(timing_state State, static_timing Static);
 static instruction_timing EstimateInstructionClocks(timing_state State, instruction Instruction);
 static void UpdateTimingForExec(timing_state *State, exec_result Exec);
 static instruction_clock_interval ExpectedClocksFrom(timing_state State, instruction Instruction, instruction_timing Timing);
@@ -49,9 +49,7 @@ static u32 ParseDataValue(segmented_access *Access, b32 Exists, b32 Wide, b32 Si
     {
         if(Wide)
         {
-            u8 D0 = *AccessMemory(*Access, 0);
-            u8 D1 = *AccessMemory(*Access, 1);
-            Result = (D1 << 8) | D0;
+            Result = ReadMemoryU16(*Access);
             Access->SegmentOffset += 2;
         }
         else
@@ -68,6 +66,132 @@ static u32 ParseDataValue(segmented_access *Access, b32 Exists, b32 Wide, b32 Si
     return Result;
 }
 
+static instruction FinishDecode(decode_context *Context, operation_type Op, b32 *Has, u32 *Bits,
+                                segmented_access At, u32 StartingAddress)
+{
+    // NOTE: This is everything that happens once the bits of an encoding have been matched and pulled out,
+    // shared by TryDecode and the specialized decoders.
+    
+    instruction Dest = {};
+    
+    u32 Mod = Bits[Bits_MOD];
+    u32 RM = Bits[Bits_RM];
+    u32 W = Bits[Bits_W];
+    b32 S = Bits[Bits_S];
+    b32 D = Bits[Bits_D];
+    
+    b32 HasDirectAddress = ((Mod == 0b00) && (RM == 0b110));
+    Has[Bits_Disp] = ((Has[Bits_Disp]) || (Mod == 0b10) || (Mod == 0b01) || HasDirectAddress);
+
+    b32 DisplacementIsW = ((Bits[Bits_DispAlwaysW]) || (Mod == 0b10) || HasDirectAddress);
+    b32 DataIsW = ((Bits[Bits_WMakesDataW]) && !S && W);
+    
+    Bits[Bits_Disp] |= ParseDataValue(&At, Has[Bits_Disp], DisplacementIsW, (!DisplacementIsW));
+    Bits[Bits_Data] |= ParseDataValue(&At, Has[Bits_Data], DataIsW, S);
+    
+    Dest.Op = Op;
+    Dest.Flags = Context->AdditionalFlags;
+    Dest.Address = StartingAddress;
+    Dest.Size = GetAbsoluteAddressOf(At) - StartingAddress;
+    Dest.SegmentOverride = Context->DefaultSegment;
+    
+    if(W)
+    {
+        Dest.Flags |= Inst_Wide;
+    }
+
+    if(Bits[Bits_Far])
+    {
+        Dest.Flags |= Inst_Far;
+    }
+    
+    if(Bits[Bits_Z])
+    {
+        Dest.Flags |= Inst_RepNE;
+    }
+    
+    u32 Disp = Bits[Bits_Disp];
+    s16 Displacement = (s16)Disp;
+    
+    instruction_operand *RegOperand = &Dest.Operands[D ? 0 : 1];
+    instruction_operand *ModOperand = &Dest.Operands[D ? 1 : 0];
+    
+    if(Has[Bits_SR])
+    {
+        *RegOperand = RegisterOperand(Register_es + (Bits[Bits_SR] & 0x3), 2);
+    }
+    
+    if(Has[Bits_REG])
+    {
+        *RegOperand = GetRegOperand(Bits[Bits_REG], W);
+    }
+    
+    if(Has[Bits_MOD])
+    {
+        if(Mod == 0b11)
+        {
+            *ModOperand = GetRegOperand(RM, W || (Bits[Bits_RMRegAlwaysW]));
+        }
+        else
+        {
+            register_mapping_8086 IntelTerm0[8] = { Register_b,  Register_b, Register_bp, Register_bp, Register_si, Register_di, Register_bp, Register_b};
+            register_mapping_8086 IntelTerm1[8] = {Register_si, Register_di, Register_si, Register_di};
+            
+            u32 I = RM&0x7;
+            register_mapping_8086 Term0 = IntelTerm0[I];
+            register_mapping_8086 Term1 = IntelTerm1[I];
+            if((Mod == 0b00) && (RM == 0b110))
+            {
+                Term0 = {};
+                Term1 = {};
+            }
+            
+            *ModOperand = EffectiveAddressOperand(RegisterAccess(Term0, 0, 2), RegisterAccess(Term1, 0, 2), Displacement);
+        }
+    }
+    
+    if(Has[Bits_Data] && Has[Bits_Disp] && !Has[Bits_MOD])
+    {
+        Dest.Operands[0] = IntersegmentAddressOperand(Bits[Bits_Data], Bits[Bits_Disp]);
+    }
+    else
+    {
+        //
+        // NOTE(casey): Because there are some strange opcodes that do things like have an immediate as
+        // a _destination_ ("out", for example), I define immediates and other "additional operands" to
+        // go in "whatever slot was not used by the reg and mod fields".
+        //
+        
+        instruction_operand *LastOperand = &Dest.Operands[0];
+        if(LastOperand->Type)
+        {
+            LastOperand = &Dest.Operands[1];
+        }
+        
+        if(Bits[Bits_RelJMPDisp])
+        {
+            *LastOperand = ImmediateOperand(Displacement, Immediate_RelativeJumpDisplacement);
+        }
+        else if(Has[Bits_Data])
+        {
+            *LastOperand = ImmediateOperand(Bits[Bits_Data]);
+        }
+        else if(Has[Bits_V])
+        {
+            if(Bits[Bits_V])
+            {
+                *LastOperand = RegisterOperand(Register_c, 1);
+            }
+            else
+            {
+                *LastOperand = ImmediateOperand(1);
+            }
+        }
+    }
+    
+    return Dest;
+}
+
 static instruction TryDecode(decode_context *Context, instruction_encoding *Inst, segmented_access At)
 {
     instruction Dest = {};
@@ -123,132 +247,285 @@ static instruction TryDecode(decode_context *Context, instruction_encoding *Inst
     
     if(Valid)
     {
-        u32 Mod = Bits[Bits_MOD];
-        u32 RM = Bits[Bits_RM];
-        u32 W = Bits[Bits_W];
-        b32 S = Bits[Bits_S];
-        b32 D = Bits[Bits_D];
-        
-        b32 HasDirectAddress = ((Mod == 0b00) && (RM == 0b110));
-        Has[Bits_Disp] = ((Has[Bits_Disp]) || (Mod == 0b10) || (Mod == 0b01) || HasDirectAddress);
+        Dest = FinishDecode(Context, Inst->Op, Has, Bits, At, StartingAddress);
+    }
+    
+    return Dest;
+}
 
-        b32 DisplacementIsW = ((Bits[Bits_DispAlwaysW]) || (Mod == 0b10) || HasDirectAddress);
-        b32 DataIsW = ((Bits[Bits_WMakesDataW]) && !S && W);
-        
-        Bits[Bits_Disp] |= ParseDataValue(&At, Has[Bits_Disp], DisplacementIsW, (!DisplacementIsW));
-        Bits[Bits_Data] |= ParseDataValue(&At, Has[Bits_Data], DataIsW, S);
-        
-        Dest.Op = Inst->Op;
-        Dest.Flags = Context->AdditionalFlags;
-        Dest.Address = StartingAddress;
-        Dest.Size = GetAbsoluteAddressOf(At) - StartingAddress;
-        Dest.SegmentOverride = Context->DefaultSegment;
-        
-        if(W)
-        {
-            Dest.Flags |= Inst_Wide;
-        }
+//
+// NOTE: Specialized decoders. The instruction table is expanded a second time as constexpr data, and each
+// encoding gets its own instantiation of TryDecodeSpecialized, where everything TryDecode would work out by
+// walking the instruction_bits array (which bytes hold which fields, what the literal bits must be, which
+// fields are implied) is a compile-time constant. What is left for the compiler to emit is a byte compare
+// or two and a handful of shifts and masks per encoding.
+//
 
-        if(Bits[Bits_Far])
-        {
-            Dest.Flags |= Inst_Far;
-        }
-        
-        if(Bits[Bits_Z])
-        {
-            Dest.Flags |= Inst_RepNE;
-        }
-        
-        u32 Disp = Bits[Bits_Disp];
-        s16 Displacement = (s16)Disp;
-        
-        instruction_operand *RegOperand = &Dest.Operands[D ? 0 : 1];
-        instruction_operand *ModOperand = &Dest.Operands[D ? 1 : 0];
-        
-        if(Has[Bits_SR])
-        {
-            *RegOperand = RegisterOperand(Register_es + (Bits[Bits_SR] & 0x3), 2);
-        }
-        
-        if(Has[Bits_REG])
+static constexpr instruction_encoding SpecializedTable8086[] =
+{
+#include "sim86_instruction_table.inl"
+};
+
+struct decode_field
+{
+    u8 ByteIndex;
+    u8 BitShift;
+    u8 BitMask;
+    u8 DestShift;
+};
+
+struct decode_layout
+{
+    operation_type Op;
+    b32 Valid;
+    
+    u32 ByteCount;
+    u8 LiteralMask[2];
+    u8 LiteralValue[2];
+    
+    b32 Has[Bits_Count];
+    u32 ImplicitBits[Bits_Count];
+    u32 FieldCount[Bits_Count];
+    decode_field Fields[Bits_Count][2];
+};
+
+static constexpr decode_layout DecodeLayoutFor(instruction_encoding Inst)
+{
+    decode_layout Result = {};
+    Result.Op = Inst.Op;
+    Result.Valid = true;
+    
+    u32 BitsConsumed = 0;
+    for(u32 BitsIndex = 0; BitsIndex < ArrayCount(Inst.Bits); ++BitsIndex)
+    {
+        instruction_bits TestBits = Inst.Bits[BitsIndex];
+        if(TestBits.Usage == Bits_End)
         {
-            *RegOperand = GetRegOperand(Bits[Bits_REG], W);
+            break;
         }
         
-        if(Has[Bits_MOD])
+        if(TestBits.BitCount != 0)
         {
-            if(Mod == 0b11)
+            u32 ByteIndex = BitsConsumed / 8;
+            u32 BitShift = 8 - (BitsConsumed % 8) - TestBits.BitCount;
+            u32 BitMask = ~(0xff << TestBits.BitCount) & 0xff;
+            BitsConsumed += TestBits.BitCount;
+            
+            if((ByteIndex >= ArrayCount(Result.LiteralMask)) || (BitsConsumed > 8*(ByteIndex + 1)))
+            {
+                // NOTE: Either a field straddles a byte boundary (TryDecode asserts on that too), or the encoding
+                // has more than two bytes of bit fields, which nothing in the 8086 table does.
+                Result.Valid = false;
+            }
+            else if(TestBits.Usage == Bits_Literal)
+            {
+                Result.LiteralMask[ByteIndex] |= (u8)(BitMask << BitShift);
+                Result.LiteralValue[ByteIndex] |= (u8)(TestBits.Value << BitShift);
+            }
+            else if(Result.FieldCount[TestBits.Usage] < ArrayCount(Result.Fields[0]))
             {
-                *ModOperand = GetRegOperand(RM, W || (Bits[Bits_RMRegAlwaysW]));
+                decode_field *Field = &Result.Fields[TestBits.Usage][Result.FieldCount[TestBits.Usage]++];
+                Field->ByteIndex = (u8)ByteIndex;
+                Field->BitShift = (u8)BitShift;
+                Field->BitMask = (u8)BitMask;
+                Field->DestShift = TestBits.Shift;
+                Result.Has[TestBits.Usage] = true;
             }
             else
             {
-                register_mapping_8086 IntelTerm0[8] = { Register_b,  Register_b, Register_bp, Register_bp, Register_si, Register_di, Register_bp, Register_b};
-                register_mapping_8086 IntelTerm1[8] = {Register_si, Register_di, Register_si, Register_di};
-                
-                u32 I = RM&0x7;
-                register_mapping_8086 Term0 = IntelTerm0[I];
-                register_mapping_8086 Term1 = IntelTerm1[I];
-                if((Mod == 0b00) && (RM == 0b110))
-                {
-                    Term0 = {};
-                    Term1 = {};
-                }
-                
-                *ModOperand = EffectiveAddressOperand(RegisterAccess(Term0, 0, 2), RegisterAccess(Term1, 0, 2), Displacement);
+                Result.Valid = false;
             }
         }
-        
-        if(Has[Bits_Data] && Has[Bits_Disp] && !Has[Bits_MOD])
+        else if(TestBits.Usage != Bits_Literal)
         {
-            Dest.Operands[0] = IntersegmentAddressOperand(Bits[Bits_Data], Bits[Bits_Disp]);
+            Result.ImplicitBits[TestBits.Usage] |= ((u32)TestBits.Value << TestBits.Shift);
+            Result.Has[TestBits.Usage] = true;
         }
-        else
+    }
+    
+    Result.ByteCount = (BitsConsumed + 7) / 8;
+    
+    return Result;
+}
+
+template<u32 EncodingIndex>
+static instruction TryDecodeSpecialized(decode_context *Context, segmented_access At)
+{
+    static constexpr decode_layout Layout = DecodeLayoutFor(SpecializedTable8086[EncodingIndex]);
+    static_assert(Layout.Valid, "Instruction encoding cannot be specialized");
+    
+    instruction Dest = {};
+    
+    u32 StartingAddress = GetAbsoluteAddressOf(At);
+    
+    u8 Bytes[2] = {};
+    if(Layout.ByteCount > 1)
+    {
+        u16 Leading = ReadMemoryU16(At);
+        Bytes[0] = (u8)(Leading & 0xff);
+        Bytes[1] = (u8)(Leading >> 8);
+    }
+    else
+    {
+        Bytes[0] = *AccessMemory(At, 0);
+    }
+    
+    if(((Bytes[0] & Layout.LiteralMask[0]) == Layout.LiteralValue[0]) &&
+       ((Bytes[1] & Layout.LiteralMask[1]) == Layout.LiteralValue[1]))
+    {
+        b32 Has[Bits_Count];
+        u32 Bits[Bits_Count];
+        for(u32 Usage = 0; Usage < Bits_Count; ++Usage)
         {
-            //
-            // NOTE(casey): Because there are some strange opcodes that do things like have an immediate as
-            // a _destination_ ("out", for example), I define immediates and other "additional operands" to
-            // go in "whatever slot was not used by the reg and mod fields".
-            //
-            
-            instruction_operand *LastOperand = &Dest.Operands[0];
-            if(LastOperand->Type)
+            u32 Value = Layout.ImplicitBits[Usage];
+            for(u32 FieldIndex = 0; FieldIndex < Layout.FieldCount[Usage]; ++FieldIndex)
             {
-                LastOperand = &Dest.Operands[1];
+                decode_field Field = Layout.Fields[Usage][FieldIndex];
+                Value |= ((Bytes[Field.ByteIndex] >> Field.BitShift) & Field.BitMask) << Field.DestShift;
             }
             
-            if(Bits[Bits_RelJMPDisp])
-            {
-                *LastOperand = ImmediateOperand(Displacement, Immediate_RelativeJumpDisplacement);
-            }
-            else if(Has[Bits_Data])
-            {
-                *LastOperand = ImmediateOperand(Bits[Bits_Data]);
-            }
-            else if(Has[Bits_V])
+            Has[Usage] = Layout.Has[Usage];
+            Bits[Usage] = Value;
+        }
+        
+        At.SegmentOffset += Layout.ByteCount;
+        Dest = FinishDecode(Context, Layout.Op, Has, Bits, At, StartingAddress);
+    }
+    
+    return Dest;
+}
+
+typedef instruction specialized_decoder(decode_context *Context, segmented_access At);
+
+// NOTE: __COUNTER__ numbers the encodings in the same order the table was written in, so that entry N here
+// is the decoder for entry N in InstructionTable8086.
+enum {SpecializedDecoderCounterBase = __COUNTER__ + 1};
+static specialized_decoder *SpecializedDecoders8086[] =
+{
+#define INST(Mnemonic, ...) TryDecodeSpecialized<__COUNTER__ - SpecializedDecoderCounterBase>,
+#define INSTALT INST
+#include "sim86_instruction_table.inl"
+};
+static_assert(ArrayCount(SpecializedDecoders8086) == ArrayCount(SpecializedTable8086), "Mismatched specialized decoder count");
+
+static b32 CouldMatchLeadingBytes(instruction_encoding *Inst, u8 FirstByte, u32 ModRMReg)
+{
+    // NOTE: This walks the encoding the same way TryDecode does, but only checks the literal bits that
+    // land in the first byte, or in the ModRM.reg position of the second byte. Anything that passes here
+    // still has to go through TryDecode, so this only has to be conservative, not exact.
+    
+    b32 Result = true;
+    
+    u32 BitsConsumed = 0;
+    for(u32 BitsIndex = 0; Result && (BitsIndex < ArrayCount(Inst->Bits)); ++BitsIndex)
+    {
+        instruction_bits TestBits = Inst->Bits[BitsIndex];
+        if((TestBits.Usage == Bits_End) || (BitsConsumed >= 16))
+        {
+            break;
+        }
+        
+        if(TestBits.BitCount != 0)
+        {
+            u32 ByteIndex = BitsConsumed / 8;
+            u32 Shift = 8 - (BitsConsumed % 8) - TestBits.BitCount;
+            u32 FieldMask = ~(0xff << TestBits.BitCount) & 0xff;
+            
+            if(TestBits.Usage == Bits_Literal)
             {
-                if(Bits[Bits_V])
+                if(ByteIndex == 0)
                 {
-                    *LastOperand = RegisterOperand(Register_c, 1);
+                    Result = (((FirstByte >> Shift) & FieldMask) == TestBits.Value);
                 }
                 else
                 {
-                    *LastOperand = ImmediateOperand(1);
+                    u32 KnownBits = (FieldMask << Shift) & 0x38;
+                    Result = ((((ModRMReg << 3) ^ (TestBits.Value << Shift)) & KnownBits) == 0);
                 }
             }
+            
+            BitsConsumed += TestBits.BitCount;
         }
     }
     
-    return Dest;
+    return Result;
+}
+
+static instruction_lookup GlobalInstructionLookup;
+
+static instruction_lookup *BuildInstructionLookup(instruction_lookup *Lookup, instruction_table Table)
+{
+    // NOTE: Returns 0 if some first byte has more candidates than there is room for. Dropping one would
+    // make the lookup decoder disagree with the reference decoder, so there is no lookup at all instead.
+    
+    instruction_lookup *Result = Lookup;
+    
+    for(u32 FirstByte = 0; Result && (FirstByte < ArrayCount(Lookup->Candidates)); ++FirstByte)
+    {
+        for(u32 ModRMReg = 0; Result && (ModRMReg < ArrayCount(Lookup->Candidates[0])); ++ModRMReg)
+        {
+            decode_candidates *Candidates = &Lookup->Candidates[FirstByte][ModRMReg];
+            
+            // NOTE: Candidates are kept in table order, so that the first one that decodes is
+            // the same one the reference decoder would have picked.
+            for(u32 Index = 0; Index < Table.EncodingCount; ++Index)
+            {
+                if(CouldMatchLeadingBytes(Table.Encodings + Index, (u8)FirstByte, ModRMReg))
+                {
+                    if(Candidates->Count < ArrayCount(Candidates->EncodingIndex))
+                    {
+                        Candidates->EncodingIndex[Candidates->Count++] = (u8)Index;
+                    }
+                    else
+                    {
+                        Result = 0;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    
+    Lookup->Encodings = Table.Encodings;
+    Lookup->EncodingCount = Table.EncodingCount;
+    
+    return Result;
+}
+
+static instruction_lookup *GetInstructionLookup(instruction_table Table)
+{
+    /* NOTE: The lookup is built for the 8086 table the first time anything asks for it, and only read
+       from after that. A function-local static is initialized exactly once even when several threads get
+       here at the same time, so decoding from multiple threads doesn't need any setup first.
+       
+       Any other table gets 0, as does the 8086 table if its lookup couldn't be built, and DecodeInstruction
+       falls back to trying every encoding. */
+    
+    static instruction_lookup *Lookup8086 = BuildInstructionLookup(&GlobalInstructionLookup, Get8086InstructionTable());
+    
+    instruction_lookup *Result = 0;
+    if(Lookup8086 &&
+       (Lookup8086->Encodings == Table.Encodings) &&
+       (Lookup8086->EncodingCount == Table.EncodingCount))
+    {
+        Result = Lookup8086;
+    }
+    
+    return Result;
 }
 
-static instruction DecodeInstruction(instruction_table Table, segmented_access At)
+static instruction DecodeInstruction(instruction_table Table, segmented_access At, decode_mode Mode)
 {
-    /* TODO(casey): Hmm. It seems like this is a very inefficient way to parse
-       instructions, isn't it? For every instruction, we check every entry in the
-       table until we find a match. Is this bad design? Or did the person who wrote
-       it know what they were doing, and has a plan for how it can be optimized
-       later? Only time will tell... :) */
+    /* NOTE: The reference mode is the original "check every entry in the table" decoder. It is kept
+       around because it is trivially correct with respect to the table, so it is useful to check the
+       lookup mode against, and to benchmark against. */
+    
+    instruction_lookup *Lookup = (Mode != DecodeMode_Reference) ? GetInstructionLookup(Table) : 0;
+    
+    // NOTE: The specialized decoders are compiled from the built-in table, so they can only stand in for it
+    b32 Specialized = ((Mode == DecodeMode_Specialized) &&
+                       (Table.Encodings == InstructionTable8086) &&
+                       (Table.EncodingCount == ArrayCount(SpecializedDecoders8086)));
     
     decode_context Context = {};
     instruction Result = {};
@@ -258,18 +535,49 @@ static instruction DecodeInstruction(instruction_table Table, segmented_access A
     while(TotalSize < Table.MaxInstructionByteCount)
     {
         Result = {};
-        for(u32 Index = 0; Index < Table.EncodingCount; ++Index)
+        if(Lookup)
+        {
+            u16 Leading = ReadMemoryU16(At);
+            u8 FirstByte = (u8)(Leading & 0xff);
+            u8 ModRMReg = (Leading >> 11) & 0x7;
+            decode_candidates *Candidates = &Lookup->Candidates[FirstByte][ModRMReg];
+            for(u32 CandidateIndex = 0; CandidateIndex < Candidates->Count; ++CandidateIndex)
+            {
+                u32 EncodingIndex = Candidates->EncodingIndex[CandidateIndex];
+                if(Specialized)
+                {
+                    Result = SpecializedDecoders8086[EncodingIndex](&Context, At);
+                }
+                else
+                {
+                    Result = TryDecode(&Context, Table.Encodings + EncodingIndex, At);
+                }
+                
+                if(Result.Op)
+                {
+                    break;
+                }
+            }
+        }
+        else
         {
-            instruction_encoding Inst = Table.Encodings[Index];
-            Result = TryDecode(&Context, &Inst, At);
-            if(Result.Op)
+            for(u32 Index = 0; Index < Table.EncodingCount; ++Index)
             {
-                At.SegmentOffset += Result.Size;
-                TotalSize += Result.Size;
-                break;
+                instruction_encoding Inst = Table.Encodings[Index];
+                Result = TryDecode(&Context, &Inst, At);
+                if(Result.Op)
+                {
+                    break;
+                }
             }
         }
         
+        if(Result.Op)
+        {
+            At.SegmentOffset += Result.Size;
+            TotalSize += Result.Size;
+        }
+        
         if(Result.Op == Op_lock)
         {
             Context.AdditionalFlags |= Inst_Lock;
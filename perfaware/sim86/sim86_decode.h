@@ -32,4 +32,30 @@ enum register_mapping_8086
     Register_count,
 };
 
-static instruction DecodeInstruction(instruction_table Table, segmented_access At);
+enum decode_mode
+{
+    DecodeMode_Lookup, // NOTE: Goes straight to the candidate encodings for the first byte (and ModRM.reg, where needed)
+    DecodeMode_Reference, // NOTE: Tries every encoding in the table, in order, for every instruction
+    DecodeMode_Specialized, // NOTE: Like DecodeMode_Lookup, but with per-encoding decoders generated at compile time
+};
+
+// NOTE: With the ModRM.reg bits taken into account, every first byte in the current 8086 table narrows
+// down to a single encoding. The extra slot is headroom for table entries that overlap more than that.
+#define MAX_DECODE_CANDIDATES 2
+
+struct decode_candidates
+{
+    u8 Count;
+    u8 EncodingIndex[MAX_DECODE_CANDIDATES];
+};
+
+struct instruction_lookup
+{
+    instruction_encoding *Encodings;
+    u32 EncodingCount;
+    
+    decode_candidates Candidates[256][8]; // NOTE: [first byte][ModRM.reg of the second byte]
+};
+
+static instruction_lookup *GetInstructionLookup(instruction_table Table);
+static instruction DecodeInstruction(instruction_table Table, segmented_access At, decode_mode Mode = DecodeMode_Lookup);
@@ -0,0 +1,174 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static decode_memo *AllocateDecodeMemo(instruction_table Table, decode_mode Mode)
+{
+    // NOTE: Keys come from the length table, so there is no memo for tables that don't have one
+    decode_memo *Result = 0;
+    length_table *Lengths = GetLengthTable(Table);
+    if(Lengths)
+    {
+        Result = (decode_memo *)calloc(1, sizeof(decode_memo));
+        if(Result)
+        {
+            Result->Table = Table;
+            Result->Mode = Mode;
+            Result->Lengths = Lengths;
+            Result->Generation = 1;
+            Result->BypassLength = DECODE_MEMO_MIN_BYPASS;
+        }
+    }
+    
+    return Result;
+}
+
+static void ResetDecodeMemo(decode_memo *Memo)
+{
+    ++Memo->Generation;
+    Memo->Stats = {};
+    Memo->Filling = false;
+    Memo->ProbeLookups = 0;
+    Memo->ProbeRepeats = 0;
+    Memo->BypassLeft = 0;
+    Memo->BypassLength = DECODE_MEMO_MIN_BYPASS;
+}
+
+static void FreeDecodeMemo(decode_memo *Memo)
+{
+    free(Memo);
+}
+
+static void EndDecodeMemoProbe(decode_memo *Memo)
+{
+    Memo->Filling = (Memo->ProbeRepeats >= (DECODE_MEMO_PROBE_LOOKUPS / 4));
+    if(Memo->Filling)
+    {
+        Memo->BypassLength = DECODE_MEMO_MIN_BYPASS;
+    }
+    else
+    {
+        Memo->BypassLeft = Memo->BypassLength;
+        if(Memo->BypassLength < DECODE_MEMO_MAX_BYPASS)
+        {
+            Memo->BypassLength *= 2;
+        }
+    }
+    
+    Memo->ProbeLookups = 0;
+    Memo->ProbeRepeats = 0;
+}
+
+static decode_memo_slot LookUpDecodeMemo(decode_memo *Memo, segmented_access At)
+{
+    decode_memo_slot Result = {};
+    
+    if(Memo->BypassLeft)
+    {
+        --Memo->BypassLeft;
+        ++Memo->Stats.Bypassed;
+    }
+    else
+    {
+        // NOTE: Enough bytes for the longest instruction that can be keyed. Away from the end of the segment
+        // and of memory they can be read all at once, otherwise they are read one at a time so they wrap
+        // exactly the way the decoder would see them.
+        u32 WindowSize = DECODE_MEMO_MAX_PREFIXES + 6;
+        u8 Bytes[DECODE_MEMO_MAX_PREFIXES + 6];
+        static_assert(sizeof(Bytes) == sizeof(u64), "The decode memo's keys are expected to fit in a u64");
+        u32 Address = GetAbsoluteAddressOf(At);
+        if((At.SegmentOffset <= (0x10000 - WindowSize)) && ((Address + WindowSize) <= (GetHighestAddress(At) + 1)))
+        {
+            memcpy(Bytes, At.Memory + Address, WindowSize);
+        }
+        else
+        {
+            for(u32 Index = 0; Index < WindowSize; ++Index)
+            {
+                Bytes[Index] = *AccessMemory(At, (u16)Index);
+            }
+        }
+        
+        u32 PrefixCount = 0;
+        u32 Length = Memo->Lengths->Lengths[Bytes[0] | (Bytes[1] << 8)];
+        while((Length == LENGTH_PREFIX) && (PrefixCount < DECODE_MEMO_MAX_PREFIXES))
+        {
+            ++PrefixCount;
+            Length = Memo->Lengths->Lengths[Bytes[PrefixCount] | (Bytes[PrefixCount + 1] << 8)];
+        }
+        
+        ++Memo->Stats.Lookups;
+        
+        if(Length && (Length != LENGTH_PREFIX))
+        {
+            // NOTE: Bytes past the end of the instruction aren't part of it, so they are masked out of the key.
+            // The length only depends on the bytes that are in the key, so equal keys always have equal sizes.
+            u32 Size = PrefixCount + Length;
+            assert(Size <= WindowSize);
+            u64 Key = 0;
+            memcpy(&Key, Bytes, sizeof(Key));
+            if(Size < WindowSize)
+            {
+                Key &= ((u64)1 << (8*Size)) - 1;
+            }
+            
+            u64 Hash = (Key*0x9E3779B97F4A7C15ull) >> (64 - DECODE_MEMO_SIZE_POW2);
+            decode_memo_key *Entry = Memo->Keys + Hash;
+            if((Entry->Generation == Memo->Generation) && (Entry->Key == Key))
+            {
+                ++Memo->ProbeRepeats;
+            }
+            else
+            {
+                Entry->Key = Key;
+                Entry->Generation = Memo->Generation;
+                Entry->HasInstruction = false;
+            }
+            
+            Result.Entry = Entry;
+            Result.Instruction = Memo->Instructions + Hash;
+            Result.Size = Size;
+        }
+        else
+        {
+            ++Memo->Stats.Uncacheable;
+        }
+        
+        if(++Memo->ProbeLookups == DECODE_MEMO_PROBE_LOOKUPS)
+        {
+            EndDecodeMemoProbe(Memo);
+        }
+    }
+    
+    return Result;
+}
+
+static instruction DecodeInstructionMemoized(decode_memo *Memo, segmented_access At)
+{
+    decode_memo_slot Slot = LookUpDecodeMemo(Memo, At);
+    b32 Hit = (Slot.Entry && Slot.Entry->HasInstruction);
+    
+    // NOTE: Result isn't cleared first, since it's always one or the other, and clearing an instruction
+    // costs about as much as a hit does.
+    instruction Result = Hit ? *Slot.Instruction : DecodeInstruction(Memo->Table, At, Memo->Mode);
+    if(Hit)
+    {
+        ++Memo->Stats.Hits;
+        Result.Address = GetAbsoluteAddressOf(At);
+    }
+    else if(Slot.Entry && Memo->Filling && Result.Op && (Result.Size == Slot.Size))
+    {
+        Slot.Entry->HasInstruction = true;
+        *Slot.Instruction = Result;
+    }
+    
+    return Result;
+}
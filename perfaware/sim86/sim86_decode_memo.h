@@ -0,0 +1,91 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: The decode memo sits in front of DecodeInstruction and remembers what it decoded, keyed by the
+   bytes of the instruction itself rather than where it was. Images that repeat the same byte sequences
+   (data tables, unrolled code, padding) then only pay for decoding each distinct instruction once, and
+   every other copy is a hash lookup plus a copy with the Address fixed up.
+   
+   The length table says how long an instruction is from its first two bytes, so the key is exactly the
+   instruction's bytes: up to two prefixes (the prefix context) and up to six bytes after them, which is
+   the longest 8086 instruction. Anything longer, or anything that doesn't decode, skips the memo.
+   
+   The memo is direct-mapped, so a colliding instruction just replaces whatever was there. The keys are
+   kept apart from the decoded instructions, so a miss only touches the small key array until it has
+   something to store. Resetting the memo bumps a generation number instead of clearing the entries.
+   
+   It only pays off on images where the same instructions come back within a few thousand instructions
+   of each other, so most lookups hit: an image of listing 42 repeated 200 times gets 90% hits and
+   decodes about twice as fast with it. On an image of mostly distinct instructions, like any of the
+   single listings, every lookup is a miss that costs more than decoding would have.
+   
+   So the memo probes before it commits. It starts out only storing keys, which is cheap, and counts how
+   many lookups are repeats. Every DECODE_MEMO_PROBE_LOOKUPS lookups it checks that count. With at least
+   a quarter repeats, misses store their instructions from then on. With fewer, the memo is bypassed for
+   the next DECODE_MEMO_MIN_BYPASS instructions, doubling each time a probe fails, up to
+   DECODE_MEMO_MAX_BYPASS. The bypass starts short because nothing can repeat until the first copy of
+   whatever repeats has gone by. Images without repeats end up within a few percent of plain decoding,
+   apart from the first probes, which cost a small listing about 10%. */
+
+#define DECODE_MEMO_SIZE_POW2 12
+#define DECODE_MEMO_MAX_PREFIXES 2
+#define DECODE_MEMO_PROBE_LOOKUPS 64
+#define DECODE_MEMO_MIN_BYPASS 256
+#define DECODE_MEMO_MAX_BYPASS 4096
+
+struct decode_memo_key
+{
+    u64 Key; // NOTE: The instruction's bytes, first byte lowest, and zero past the end of it
+    u32 Generation; // NOTE: Only valid if it matches the memo's
+    b32 HasInstruction; // NOTE: Keys stored while the memo was only probing have no instruction with them
+};
+
+struct decode_memo_stats
+{
+    u64 Lookups;
+    u64 Hits;
+    u64 Uncacheable; // NOTE: Decoded straight through, because they couldn't have been keyed
+    u64 Bypassed; // NOTE: Decoded straight through, because the last probe found too few repeats
+};
+
+struct decode_memo
+{
+    instruction_table Table;
+    decode_mode Mode;
+    length_table *Lengths;
+    
+    u32 Generation;
+    decode_memo_stats Stats;
+    
+    b32 Filling; // NOTE: Whether misses store what they decoded, or only their keys
+    u32 ProbeLookups;
+    u32 ProbeRepeats;
+    u32 BypassLeft;
+    u32 BypassLength; // NOTE: Doubles every time a probe finds too few repeats, up to DECODE_MEMO_MAX_BYPASS
+    
+    decode_memo_key Keys[1 << DECODE_MEMO_SIZE_POW2];
+    instruction Instructions[1 << DECODE_MEMO_SIZE_POW2];
+};
+
+// NOTE: Where an instruction goes in the memo. Entry is 0 when the instruction wasn't looked up, either
+// because it can't be keyed or because the memo is being bypassed.
+struct decode_memo_slot
+{
+    decode_memo_key *Entry;
+    instruction *Instruction;
+    u32 Size;
+};
+
+static decode_memo *AllocateDecodeMemo(instruction_table Table, decode_mode Mode);
+static void ResetDecodeMemo(decode_memo *Memo);
+static void FreeDecodeMemo(decode_memo *Memo);
+static instruction DecodeInstructionMemoized(decode_memo *Memo, segmented_access At);
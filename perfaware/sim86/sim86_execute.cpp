@@ -57,6 +57,7 @@ static u16 GetRegisterValueU16(register_state_8086 *Registers, u32 Index)
 static void WriteU8(segmented_access Memory, u16 Offset, u8 Value)
 {
     *AccessMemory(Memory, Offset) = Value;
+    NoteWrite(Memory, Offset);
 }
 
 static u8 ReadU8(segmented_access Memory, u16 Offset)
@@ -67,13 +68,12 @@ static u8 ReadU8(segmented_access Memory, u16 Offset)
 
 static void WriteU16(segmented_access Memory, u16 Offset, u16 Value)
 {
-    WriteU8(Memory, Offset + 0, (Value & 0xff));
-    WriteU8(Memory, Offset + 1, ((Value >> 8) & 0xff));
+    WriteMemoryU16(Memory, Offset, Value);
 }
 
 static u16 ReadU16(segmented_access Memory, u16 Offset)
 {
-    u16 Result = (u16)ReadU8(Memory, Offset) | ((u16)ReadU8(Memory, Offset + 1) << 8);
+    u16 Result = ReadMemoryU16(Memory, Offset);
     return Result;
 }
 
@@ -151,52 +151,158 @@ static u16 ParityFlagOf(u16 x)
     return ((~y & 0x1) << 2);
 }
 
-static void UpdateCommonFlags(register_state_8086 *Registers, u32 MaskedResult, u32 WWidth)
-{
-    Registers->flags &= ~(Flag_SF | Flag_ZF | Flag_PF);
-    Registers->flags |= (MaskedResult & SignBitFor(WWidth)) ? Flag_SF : 0;
-    Registers->flags |= (MaskedResult == 0) ? Flag_ZF : 0;
-    Registers->flags |= ParityFlagOf(MaskedResult);
-}
+#define FLAG_MASK_STATUS (Flag_CF | Flag_PF | Flag_AF | Flag_ZF | Flag_SF | Flag_OF)
 
-static void UpdateArithFlags(register_state_8086 *Registers, u32 UnmaskedResult, u32 MaskedResult, u32 WWidth, b32 OF = false, b32 AF = false)
+static u16 ComputeStatusFlags(lazy_flags *Pending, u32 Wanted)
 {
+    // NOTE: Only the flags in Wanted are computed, so that something like a JNE doesn't have to pay
+    // for the parity and overflow of the compare in front of it.
+    
+    u32 WWidth = Pending->WWidth;
+    u32 V0 = Pending->V0;
+    u32 V1 = Pending->V1;
+    u32 R = Pending->Result;
+    
     u32 SignBit = SignBitFor(WWidth);
-    b32 CF = (UnmaskedResult & (SignBit << 1));
+    b32 IsLog = (Pending->Op == FlagsOp_Log);
+    u32 MaskedResult = IsLog ? R : (R & WidthMaskFor(WWidth));
     
-    Registers->flags &= ~(Flag_OF | Flag_CF | Flag_AF);
-    Registers->flags |= CF ? Flag_CF : 0;
-    Registers->flags |= OF ? Flag_OF : 0;
-    Registers->flags |= AF ? Flag_AF : 0;
+    u16 Result = 0;
+    if(!IsLog)
+    {
+        if(Wanted & Flag_CF)
+        {
+            Result |= (R & (SignBit << 1)) ? Flag_CF : 0;
+        }
+        
+        if(Pending->Op == FlagsOp_Add)
+        {
+            if(Wanted & Flag_OF) {Result |= ((~(V0 ^ V1) & (V0 ^ R)) & SignBit) ? Flag_OF : 0;}
+            if(Wanted & Flag_AF) {Result |= (((V0 & 0xf) + (V1 & 0xf)) & 0x10) ? Flag_AF : 0;}
+        }
+        else if(Pending->Op == FlagsOp_Sub)
+        {
+            if(Wanted & Flag_OF) {Result |= (((V0 ^ V1) & (V0 ^ R)) & SignBit) ? Flag_OF : 0;}
+            if(Wanted & Flag_AF) {Result |= (((V0 & 0xf) - (V1 & 0xf)) & 0x10) ? Flag_AF : 0;}
+        }
+    }
+    
+    if(Wanted & Flag_SF) {Result |= (MaskedResult & SignBit) ? Flag_SF : 0;}
+    if(Wanted & Flag_ZF) {Result |= (MaskedResult == 0) ? Flag_ZF : 0;}
+    if(Wanted & Flag_PF) {Result |= ParityFlagOf(MaskedResult);}
+    
+    return Result;
+}
 
-    UpdateCommonFlags(Registers, MaskedResult, WWidth);
+static void MaterializeFlags(register_state_8086 *Registers, lazy_flags *LazyFlags)
+{
+    if(LazyFlags->Op)
+    {
+        Registers->flags &= ~FLAG_MASK_STATUS;
+        Registers->flags |= ComputeStatusFlags(LazyFlags, FLAG_MASK_STATUS);
+        LazyFlags->Op = FlagsOp_None;
+    }
 }
 
-static void UpdateLogFlags(register_state_8086 *Registers, u16 MaskedResult, u32 WWidth)
+static u16 TestFlag(register_state_8086 *Registers, lazy_flags *LazyFlags, flags_register_bit Flag)
 {
-    Registers->flags &= ~(Flag_OF | Flag_CF | Flag_AF);
-    UpdateCommonFlags(Registers, MaskedResult, WWidth);
+    u16 Result = ((LazyFlags && LazyFlags->Op) ?
+                  ComputeStatusFlags(LazyFlags, Flag) :
+                  (Registers->flags & Flag));
+    return Result;
 }
 
-static void WriteLogOpResult(register_state_8086 *Registers, segmented_access Dest, u16 UnmaskedResult, u32 WWidth)
+static void ProduceFlags(register_state_8086 *Registers, lazy_flags *LazyFlags, flags_op Op, u32 V0, u32 V1, u32 Result, u32 WWidth)
 {
-    u16 MaskedResult = UnmaskedResult & WidthMaskFor(WWidth);
-    UpdateLogFlags(Registers, MaskedResult, WWidth);
-    WriteN(Dest, 0, MaskedResult, WWidth);
+    // NOTE: Every flag-producing op replaces all six status flags, so whatever was pending before is
+    // simply overwritten. Without lazy flags, the record is materialized on the spot, so both modes
+    // compute the flags with exactly the same code.
+    lazy_flags Pending = {Op, WWidth, V0, V1, Result};
+    if(LazyFlags)
+    {
+        *LazyFlags = Pending;
+    }
+    else
+    {
+        MaterializeFlags(Registers, &Pending);
+    }
 }
 
-static void WriteArithOpResult(register_state_8086 *Registers, segmented_access Dest, u32 UnmaskedResult, u32 WWidth,
-                               b32 OF = false, b32 AF = false)
+static void WriteFlagsOpResult(register_state_8086 *Registers, lazy_flags *LazyFlags, segmented_access Dest,
+                               flags_op Op, u32 V0, u32 V1, u32 UnmaskedResult, u32 WWidth)
 {
-    /* TODO(casey): I didn't like how this came out. Unlike the other writeback functions, AFAICT this one required
-       me to pass in OF and AF since they get computed differently. I assume this is because I don't quite "get" how
-       the ALU is supposed to work, and actually it is simpler than that if you know the right approach.
-    */
+    ProduceFlags(Registers, LazyFlags, Op, V0, V1, UnmaskedResult, WWidth);
+    WriteN(Dest, 0, UnmaskedResult & WidthMaskFor(WWidth), WWidth);
+}
+
+static b32 ObservesFlags(operation_type Op)
+{
+    // NOTE: Everything that reads the flags, or changes them other than through ProduceFlags.
+    // Anything not listed here as leaving the flags alone is assumed to look at them.
+    b32 Result = true;
     
-    u16 MaskedResult = UnmaskedResult & WidthMaskFor(WWidth);
-    UpdateArithFlags(Registers, UnmaskedResult, MaskedResult, WWidth, OF, AF);
+    switch(Op)
+    {
+        case Op_mov:
+        case Op_push:
+        case Op_pop:
+        case Op_xchg:
+        case Op_xlat:
+        case Op_lea:
+        case Op_lds:
+        case Op_les:
+        case Op_add:
+        case Op_inc:
+        case Op_sub:
+        case Op_dec:
+        case Op_neg:
+        case Op_cmp:
+        case Op_mul:
+        case Op_imul:
+        case Op_idiv:
+        case Op_cbw:
+        case Op_cwd:
+        case Op_not:
+        case Op_and:
+        case Op_test:
+        case Op_or:
+        case Op_xor:
+        case Op_hlt:
+        case Op_wait:
+        case Op_esc:
+        case Op_rep:
+        case Op_lock:
+        case Op_segment:
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jne:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
+        {
+            // NOTE: Conditional jumps do look at the flags, but they go through JumpConditionHolds,
+            // which knows how to read them while they are still pending.
+            Result = false;
+        } break;
+        
+        default: {} break;
+    }
     
-    WriteN(Dest, 0, MaskedResult, WWidth);
+    return Result;
 }
 
 static void WriteShiftOpResult(register_state_8086 *Registers, segmented_access Dest, u32 PriorValue, u32 UnmaskedResultS1, u32 WWidth)
@@ -236,6 +342,55 @@ static void ConditionalJump(exec_result *Result, register_state_8086 *Registers,
     Result->BranchTaken = ShouldJump;
 }
 
+static b32 JumpConditionHolds(operation_type Op, register_state_8086 *Registers, lazy_flags *LazyFlags = 0)
+{
+    // NOTE: This is shared by everything that executes conditional jumps and loops, so that they all
+    // agree on exactly when a jump is taken. Note that the loop instructions decrement CX as a side effect.
+    // Jumps only read the flags, so with lazy flags, just the ones each condition needs are computed
+    // and the rest stay pending.
+    
+#define CF TestFlag(Registers, LazyFlags, Flag_CF)
+#define PF TestFlag(Registers, LazyFlags, Flag_PF)
+#define ZF TestFlag(Registers, LazyFlags, Flag_ZF)
+#define SF TestFlag(Registers, LazyFlags, Flag_SF)
+#define OF TestFlag(Registers, LazyFlags, Flag_OF)
+    
+    b32 Result = false;
+    switch(Op)
+    {
+        case Op_je: {Result = (ZF == 1);} break;
+        case Op_jl: {Result = ((SF ^ OF) == 1);} break;
+        case Op_jle: {Result = (((SF ^ OF) | ZF) == 1);} break;
+        case Op_jb: {Result = (CF == 1);} break;
+        case Op_jbe: {Result = ((CF | ZF) == 1);} break;
+        case Op_jp: {Result = (PF == 1);} break;
+        case Op_jo: {Result = (OF == 1);} break;
+        case Op_js: {Result = (SF == 1);} break;
+        case Op_jne: {Result = (ZF == 0);} break;
+        case Op_jnl: {Result = ((SF ^ OF) == 0);} break;
+        case Op_jg: {Result = (((SF & OF) | ZF) == 0);} break;
+        case Op_jnb: {Result = (CF == 0);} break;
+        case Op_ja: {Result = ((CF | ZF) == 0);} break;
+        case Op_jnp: {Result = (PF == 0);} break;
+        case Op_jno: {Result = (OF == 0);} break;
+        case Op_jns: {Result = (SF == 0);} break;
+        case Op_loop: {Result = (--Registers->cx != 0);} break;
+        case Op_loopz: {Result = ((--Registers->cx != 0) && (ZF == 1));} break;
+        case Op_loopnz: {Result = ((--Registers->cx != 0) && (ZF == 0));} break;
+        case Op_jcxz: {Result = (Registers->cx != 0);} break;
+        
+        default: {} break;
+    }
+    
+#undef CF
+#undef PF
+#undef ZF
+#undef SF
+#undef OF
+    
+    return Result;
+}
+
 static segmented_access DetermineSegmentAccess(segmented_access Memory, instruction Instruction, register_state_8086 *Registers,
                                                u16 DefaultSegRegValue)
 {
@@ -284,6 +439,9 @@ static operand_access AccessOperand(segmented_access Memory, register_state_8086
                 u16 SegReg = (Source.Address.Terms[0].Register.Index == Register_bp) ? Registers->ss : Registers->ds;
                 
                 Result.Op.Memory = Memory.Memory;
+                Result.Op.Watch = Memory.Watch;
+                Result.Op.Writes = Memory.Writes;
+                Result.Op.Dirty = Memory.Dirty;
                 Result.Op.SegmentBase = DetermineSegmentAccess(Memory, Instruction, Registers, SegReg).SegmentBase;
                 for(u32 TermIndex = 0; TermIndex < ArrayCount(Source.Address.Terms); ++TermIndex)
                 {
@@ -305,23 +463,288 @@ static operand_access AccessOperand(segmented_access Memory, register_state_8086
     return Result;
 }
 
-static exec_result ExecInstruction(segmented_access Memory, register_state_8086 *Registers, instruction Instruction)
+static u8 *GetContiguousStringRange(segmented_access Segment, u16 Offset, u32 ElementCount, u32 WWidth, b32 Backward)
+{
+    // NOTE: Returns the lowest byte of the ElementCount elements a string op would step through starting
+    // at Offset, as long as they sit in one run of memory without wrapping around the end of the segment
+    // or the end of memory. Otherwise returns 0, and the op has to be done one element at a time.
+    u8 *Result = 0;
+    
+    s32 ByteCount = (s32)(ElementCount*WWidth);
+    s32 Low = Backward ? ((s32)Offset + (s32)WWidth - ByteCount) : (s32)Offset;
+    if((Low >= 0) && ((Low + ByteCount) <= 0x10000))
+    {
+        u32 Address = ((u32)Segment.SegmentBase << 4) + (u32)Low;
+        if((Address + ByteCount) <= (Segment.Mask + 1))
+        {
+            Result = Segment.Memory + Address;
+        }
+    }
+    
+    return Result;
+}
+
+static u16 ReadElement(u8 *At, u32 WWidth)
+{
+    u16 Result = (WWidth == 2) ? (u16)(At[0] | (At[1] << 8)) : At[0];
+    return Result;
+}
+
+static u16 ReadN(segmented_access Memory, u16 Offset, u32 Count)
+{
+    u16 Result = (Count == 2) ? ReadU16(Memory, Offset) : ReadU8(Memory, Offset);
+    return Result;
+}
+
+static void ExecStringInstruction(segmented_access Memory, register_state_8086 *Registers, instruction Instruction,
+                                  lazy_flags *LazyFlags, exec_result *Result)
+{
+    operation_type Op = Instruction.Op;
+    u32 WWidth = (Instruction.Flags & Inst_Wide) ? 2 : 1;
+    u16 WidthMask = WidthMaskFor(WWidth);
+    b32 Backward = (Registers->flags & Flag_DF);
+    u16 Step = Backward ? (u16)(0 - WWidth) : (u16)WWidth;
+    
+    // NOTE: Only the source can be given a segment override. The destination is always ES:DI.
+    segmented_access Source = DetermineSegmentAccess(Memory, Instruction, Registers, Registers->ds);
+    segmented_access Dest = SegmentFromRegister(Memory, Registers->es);
+    
+    // NOTE: The decoder copies the REP prefix's Z bit into Inst_RepNE, and it is set for F3 (REP/REPE/REPZ),
+    // which is also what PrintInstruction assumes. So for CMPS and SCAS, it means "repeat while equal".
+    b32 Rep = (Instruction.Flags & Inst_Rep);
+    b32 RepWhileEqual = (Instruction.Flags & Inst_RepNE);
+    b32 Compares = ((Op == Op_cmps) || (Op == Op_scas));
+    
+    u32 Count = Rep ? Registers->cx : 1;
+    u32 Done = 0;
+    b32 Finished = false;
+    
+    u16 Accumulator = Registers->ax & WidthMask;
+    u16 LastV0 = 0;
+    u16 LastV1 = 0;
+    
+    Result->AddressIsUnaligned = ((WWidth == 2) && ((Registers->si | Registers->di) & 1));
+    
+    if(Rep && Count)
+    {
+        // NOTE: When the whole repeat sits in contiguous memory, it is done in bulk instead of one simulated
+        // iteration at a time. Anything that wraps, or a MOVS that overlaps itself in the direction it copies
+        // (which replicates a pattern rather than moving a block), goes through the element loop below.
+        u32 ByteCount = Count*WWidth;
+        u8 *SourceRange = GetContiguousStringRange(Source, Registers->si, Count, WWidth, Backward);
+        u8 *DestRange = GetContiguousStringRange(Dest, Registers->di, Count, WWidth, Backward);
+        s32 ElementStride = Backward ? -(s32)WWidth : (s32)WWidth;
+        
+        switch(Op)
+        {
+            case Op_movs:
+            {
+                if(SourceRange && DestRange &&
+                   (((DestRange + ByteCount) <= SourceRange) ||
+                    ((SourceRange + ByteCount) <= DestRange) ||
+                    (!Backward && (DestRange <= SourceRange)) ||
+                    (Backward && (DestRange >= SourceRange))))
+                {
+                    memmove(DestRange, SourceRange, ByteCount);
+                    u32 DestAddress = (u32)(DestRange - Memory.Memory);
+                    NoteWriteRange(Memory, DestAddress, DestAddress + ByteCount);
+                    Done = Count;
+                    Finished = true;
+                }
+            } break;
+            
+            case Op_stos:
+            {
+                if(DestRange)
+                {
+                    if(WWidth == 1)
+                    {
+                        memset(DestRange, Accumulator, ByteCount);
+                    }
+                    else
+                    {
+                        for(u32 Index = 0; Index < Count; ++Index)
+                        {
+                            DestRange[2*Index + 0] = (u8)(Accumulator & 0xff);
+                            DestRange[2*Index + 1] = (u8)(Accumulator >> 8);
+                        }
+                    }
+                    
+                    u32 DestAddress = (u32)(DestRange - Memory.Memory);
+                    NoteWriteRange(Memory, DestAddress, DestAddress + ByteCount);
+                    Done = Count;
+                    Finished = true;
+                }
+            } break;
+            
+            case Op_lods:
+            {
+                // NOTE: Only the last element loaded survives, so that is the only one that needs reading
+                u16 LastOffset = (u16)(Registers->si + (Count - 1)*Step);
+                Accumulator = ReadN(Source, LastOffset, WWidth);
+                Done = Count;
+                Finished = true;
+            } break;
+            
+            case Op_scas:
+            {
+                if(DestRange)
+                {
+                    u8 *First = Backward ? (DestRange + ByteCount - WWidth) : DestRange;
+                    
+                    if((WWidth == 1) && !Backward && !RepWhileEqual)
+                    {
+                        // NOTE: REPNE SCASB going forward is exactly memchr
+                        u8 *Found = (u8 *)memchr(First, Accumulator, Count);
+                        Done = Found ? (u32)(Found - First) + 1 : Count;
+                    }
+                    else
+                    {
+                        while(Done < Count)
+                        {
+                            u16 Element = ReadElement(First + (s32)Done*ElementStride, WWidth);
+                            ++Done;
+                            if((Element == Accumulator) != (RepWhileEqual != 0))
+                            {
+                                break;
+                            }
+                        }
+                    }
+                    
+                    LastV0 = Accumulator;
+                    LastV1 = ReadElement(First + (s32)(Done - 1)*ElementStride, WWidth);
+                    Finished = true;
+                }
+            } break;
+            
+            case Op_cmps:
+            {
+                if(SourceRange && DestRange)
+                {
+                    u8 *FirstSource = Backward ? (SourceRange + ByteCount - WWidth) : SourceRange;
+                    u8 *FirstDest = Backward ? (DestRange + ByteCount - WWidth) : DestRange;
+                    
+                    u16 SourceElement = 0;
+                    u16 DestElement = 0;
+                    while(Done < Count)
+                    {
+                        SourceElement = ReadElement(FirstSource + (s32)Done*ElementStride, WWidth);
+                        DestElement = ReadElement(FirstDest + (s32)Done*ElementStride, WWidth);
+                        ++Done;
+                        if((SourceElement == DestElement) != (RepWhileEqual != 0))
+                        {
+                            break;
+                        }
+                    }
+                    
+                    LastV0 = SourceElement;
+                    LastV1 = DestElement;
+                    Finished = true;
+                }
+            } break;
+            
+            default: {} break;
+        }
+        
+        if(Finished)
+        {
+            if((Op == Op_movs) || (Op == Op_cmps) || (Op == Op_lods))
+            {
+                Registers->si += (u16)(Done*Step);
+            }
+            if((Op == Op_movs) || (Op == Op_cmps) || (Op == Op_stos) || (Op == Op_scas))
+            {
+                Registers->di += (u16)(Done*Step);
+            }
+        }
+    }
+    
+    while(!Finished && (Done < Count))
+    {
+        switch(Op)
+        {
+            case Op_movs:
+            {
+                WriteN(Dest, Registers->di, ReadN(Source, Registers->si, WWidth), WWidth);
+                Registers->si += Step;
+                Registers->di += Step;
+            } break;
+            
+            case Op_cmps:
+            {
+                LastV0 = ReadN(Source, Registers->si, WWidth);
+                LastV1 = ReadN(Dest, Registers->di, WWidth);
+                Registers->si += Step;
+                Registers->di += Step;
+            } break;
+            
+            case Op_scas:
+            {
+                LastV0 = Accumulator;
+                LastV1 = ReadN(Dest, Registers->di, WWidth);
+                Registers->di += Step;
+            } break;
+            
+            case Op_lods:
+            {
+                Accumulator = ReadN(Source, Registers->si, WWidth);
+                Registers->si += Step;
+            } break;
+            
+            case Op_stos:
+            {
+                WriteN(Dest, Registers->di, Accumulator, WWidth);
+                Registers->di += Step;
+            } break;
+            
+            default: {} break;
+        }
+        
+        ++Done;
+        if(Rep && Compares && ((LastV0 == LastV1) != (RepWhileEqual != 0)))
+        {
+            break;
+        }
+    }
+    
+    if(Op == Op_lods)
+    {
+        if(WWidth == 2)
+        {
+            Registers->ax = Accumulator;
+        }
+        else
+        {
+            Registers->al = (u8)Accumulator;
+        }
+    }
+    
+    if(Compares && Done)
+    {
+        u32 R = (u32)(LastV0 & WidthMask) - (u32)(LastV1 & WidthMask);
+        ProduceFlags(Registers, LazyFlags, FlagsOp_Sub, LastV0, LastV1, R, WWidth);
+    }
+    
+    if(Rep)
+    {
+        Registers->cx -= (u16)Done;
+        Result->RepCount = Done;
+    }
+}
+
+static exec_result ExecInstruction(segmented_access Memory, register_state_8086 *Registers, instruction Instruction,
+                                   lazy_flags *LazyFlags)
 {
     exec_result Result = {};
     
+    if(LazyFlags && ObservesFlags(Instruction.Op))
+    {
+        MaterializeFlags(Registers, LazyFlags);
+    }
+    
     u32 WWidth = (Instruction.Flags & Inst_Wide) ? 2 : 1;
     b32 IsFar = (Instruction.Flags & Inst_Far);
     
-    b32 CF = Registers->flags & Flag_CF;
-    b32 PF = Registers->flags & Flag_PF;
-    b32 AF = Registers->flags & Flag_AF;
-    b32 ZF = Registers->flags & Flag_ZF;
-    b32 SF = Registers->flags & Flag_SF;
-    b32 OF = Registers->flags & Flag_OF;
-    b32 IF = Registers->flags & Flag_IF;
-    b32 DF = Registers->flags & Flag_DF;
-    b32 TF = Registers->flags & Flag_TF;
-    
     segmented_access DefaultSegment = DetermineSegmentAccess(Memory, Instruction, Registers, Registers->ds);
     
     u32 IgnoredBytes = 0;
@@ -416,12 +839,9 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         
         case Op_add:
         {
-            u32 SignBit = SignBitFor(WWidth);
             u32 Mask = WidthMaskFor(WWidth);
             u32 R = (V0 & Mask) + (V1 & Mask);
-            b32 OF = (~(V0 ^ V1) & (V0 ^ R)) & SignBit;
-            b32 AF = ((V0 & 0xf) + (V1 & 0xf)) & 0x10;
-            WriteArithOpResult(Registers, Op0, R, WWidth, OF, AF);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Add, V0, V1, R, WWidth);
         } break;
         
         case Op_adc:
@@ -432,7 +852,7 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         case Op_inc:
         {
             u32 R = V0 + 1;
-            WriteArithOpResult(Registers, Op0, R, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, 1, R, WWidth);
         } break;
         
         case Op_aaa:
@@ -447,12 +867,9 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         
         case Op_sub:
         {
-            u32 SignBit = SignBitFor(WWidth);
             u32 WidthMask = WidthMaskFor(WWidth);
             u32 R = (V0 & WidthMask) - (V1 & WidthMask);
-            b32 OF = ((V0 ^ V1) & (V0 ^ R)) & SignBit;
-            b32 AF = ((V0 & 0xf) - (V1 & 0xf)) & 0x10;
-            WriteArithOpResult(Registers, Op0, R, WWidth, OF, AF);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Sub, V0, V1, R, WWidth);
         } break;
         
         case Op_sbb:
@@ -463,23 +880,20 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         case Op_dec:
         {
             u32 R = V0 - 1;
-            WriteArithOpResult(Registers, Op0, R, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, 1, R, WWidth);
         } break;
         
         case Op_neg:
         {
             u32 R = -V0;
-            WriteArithOpResult(Registers, Op0, R, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, 0, R, WWidth);
         } break;
         
         case Op_cmp:
         {
-            u32 SignBit = SignBitFor(WWidth);
             u32 WidthMask = WidthMaskFor(WWidth);
             u32 R = (V0 & WidthMask) - (V1 & WidthMask);
-            b32 OF = ((V0 ^ V1) & (V0 ^ R)) & SignBit;
-            b32 AF = ((V0 & 0xf) - (V1 & 0xf)) & 0x10;
-            UpdateArithFlags(Registers, R, R & WidthMaskFor(WWidth), WWidth, OF, AF);
+            ProduceFlags(Registers, LazyFlags, FlagsOp_Sub, V0, V1, R, WWidth);
         } break;
         
         case Op_aas:
@@ -495,7 +909,7 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         case Op_mul:
         {
             u32 R = V0*V1;
-            WriteArithOpResult(Registers, Op0, R, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, V1, R, WWidth);
         } break;
         
         case Op_imul:
@@ -505,7 +919,7 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
             {
                 R = (s32)(s8)V0 * (s32)(s8)V1;
             }
-            WriteArithOpResult(Registers, Op0, R, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, V1, R, WWidth);
         } break;
         
         case Op_aam:
@@ -522,7 +936,7 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
             else
             {
                 u32 R = V0/V1;
-                WriteArithOpResult(Registers, Op0, R, WWidth);
+                WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, V1, R, WWidth);
             }
         } break;
         
@@ -533,7 +947,7 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
             {
                 R = (s32)(s8)V0 / (s32)(s8)V1;
             }
-            WriteArithOpResult(Registers, Op0, R, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Arith, V0, V1, R, WWidth);
         } break;
         
         case Op_aad:
@@ -597,22 +1011,23 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         
         case Op_and:
         {
-            WriteLogOpResult(Registers, Op0, V0 & V1, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Log, V0, V1, (u16)(V0 & V1) & WidthMaskFor(WWidth), WWidth);
         } break;
         
         case Op_test:
         {
-            UpdateLogFlags(Registers, V0 & V1, WWidth);
+            // NOTE: Unlike AND, the flags are set from the result before it is masked to the operand width
+            ProduceFlags(Registers, LazyFlags, FlagsOp_Log, V0, V1, (u16)(V0 & V1), WWidth);
         } break;
         
         case Op_or:
         {
-            WriteLogOpResult(Registers, Op0, V0 | V1, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Log, V0, V1, (u16)(V0 | V1) & WidthMaskFor(WWidth), WWidth);
         } break;
         
         case Op_xor:
         {
-            WriteLogOpResult(Registers, Op0, V0 ^ V1, WWidth);
+            WriteFlagsOpResult(Registers, LazyFlags, Op0, FlagsOp_Log, V0, V1, (u16)(V0 ^ V1) & WidthMaskFor(WWidth), WWidth);
         } break;
         
         case Op_movs:
@@ -621,8 +1036,7 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         case Op_lods:
         case Op_stos:
         {
-            Result.RepCount = Registers->cx;
-            Result.Unimplemented = true;
+            ExecStringInstruction(Memory, Registers, Instruction, LazyFlags, &Result);
         } break;
         
         case Op_call:
@@ -662,103 +1076,27 @@ static exec_result ExecInstruction(segmented_access Memory, register_state_8086
         } break;
         
         case Op_je:
-        {
-            ConditionalJump(&Result, Registers, V0, ZF == 1);
-        } break;
-        
         case Op_jl:
-        {
-            ConditionalJump(&Result, Registers, V0, (SF ^ OF) == 1);
-        } break;
-        
         case Op_jle:
-        {
-            ConditionalJump(&Result, Registers, V0, ((SF ^ OF) | ZF) == 1);
-        } break;
-        
         case Op_jb:
-        {
-            ConditionalJump(&Result, Registers, V0, CF == 1);
-        } break;
-        
         case Op_jbe:
-        {
-            ConditionalJump(&Result, Registers, V0, (CF | ZF) == 1);
-        } break;
-        
         case Op_jp:
-        {
-            ConditionalJump(&Result, Registers, V0, PF == 1);
-        } break;
-        
         case Op_jo:
-        {
-            ConditionalJump(&Result, Registers, V0, OF == 1);
-        } break;
-        
         case Op_js:
-        {
-            ConditionalJump(&Result, Registers, V0, SF == 1);
-        } break;
-        
         case Op_jne:
-        {
-            ConditionalJump(&Result, Registers, V0, ZF == 0);
-        } break;
-        
         case Op_jnl:
-        {
-            ConditionalJump(&Result, Registers, V0, (SF ^ OF) == 0);
-        } break;
-        
         case Op_jg:
-        {
-            ConditionalJump(&Result, Registers, V0, ((SF & OF) | ZF) == 0);
-        } break;
-        
         case Op_jnb:
-        {
-            ConditionalJump(&Result, Registers, V0, CF == 0);
-        } break;
-        
         case Op_ja:
-        {
-            ConditionalJump(&Result, Registers, V0, (CF | ZF) == 0);
-        } break;
-        
         case Op_jnp:
-        {
-            ConditionalJump(&Result, Registers, V0, PF == 0);
-        } break;
-        
         case Op_jno:
-        {
-            ConditionalJump(&Result, Registers, V0, OF == 0);
-        } break;
-        
         case Op_jns:
-        {
-            ConditionalJump(&Result, Registers, V0, SF == 0);
-        } break;
-        
         case Op_loop:
-        {
-            ConditionalJump(&Result, Registers, V0, --Registers->cx != 0);
-        } break;
-        
         case Op_loopz:
-        {
-            ConditionalJump(&Result, Registers, V0, (--Registers->cx != 0) && (ZF == 1));
-        } break;
-        
         case Op_loopnz:
-        {
-            ConditionalJump(&Result, Registers, V0, (--Registers->cx != 0) && (ZF == 0));
-        } break;
-        
         case Op_jcxz:
         {
-            ConditionalJump(&Result, Registers, V0, Registers->cx != 0);
+            ConditionalJump(&Result, Registers, V0, JumpConditionHolds(Instruction.Op, Registers, LazyFlags));
         } break;
         
         case Op_int:
@@ -10,56 +10,6 @@
    
    ======================================================================== */
 
-enum flags_register_bit
-{
-    Flag_CF = (1 <<  0), // NOTE(casey): Carry
-    Flag_PF = (1 <<  2), // NOTE(casey): Parity
-    Flag_AF = (1 <<  4), // NOTE(casey): Aux carry
-    Flag_ZF = (1 <<  6), // NOTE(casey): Zero
-    Flag_SF = (1 <<  7), // NOTE(casey): Sign
-    Flag_TF = (1 <<  8), // NOTE(casey): Trap
-    Flag_IF = (1 <<  9), // NOTE(casey): Interrupt
-    Flag_DF = (1 << 10), // NOTE(casey): Direction
-    Flag_OF = (1 << 11), // NOTE(casey): Overflow
-};
-
-#define FLAG_MASK_8086 (Flag_CF | Flag_PF | Flag_AF | Flag_ZF | Flag_SF | Flag_TF | Flag_IF | Flag_DF | Flag_OF)
-
-// NOTE(casey): These are the flags that were in the 8080 (necessary to know for some instructions):
-#define FLAG_MASK_OLD_8080 (Flag_CF | Flag_PF | Flag_AF | Flag_ZF | Flag_SF)
-
-union register_state_8086
-{
-#define REG_16(i) union {struct{u8 i##l; u8 i##h;}; u16 i##x;}
-    
-    struct 
-    {
-        u16 Zero;
-        
-        REG_16(a);
-        REG_16(b);
-        REG_16(c);
-        REG_16(d);
-        u16 sp;
-        u16 bp;
-        u16 si;
-        u16 di;
-        u16 es;
-        u16 cs;
-        u16 ss;
-        u16 ds;
-        u16 ip;
-        u16 flags;
-    };
-    
-    u8 u8[Register_count][2];
-    u16 u16[Register_count];
-    
-#undef REG_16
-};
-#define FLAGS_REGISTER_8086 14
-static_assert((sizeof(register_state_8086) / sizeof(u16)) == Register_count, "Mismatched register sizes");
-
 struct exec_result
 {
     u32 ShiftCount;
@@ -69,6 +19,27 @@ struct exec_result
     b32 Unimplemented;
 };
 
+// NOTE: In lazy-flags mode, the status flags (CF, PF, AF, ZF, SF and OF) are not computed when an
+// instruction produces them. Only what they would be computed from is recorded, and Registers->flags
+// is brought up to date when something actually looks at it.
+enum flags_op
+{
+    FlagsOp_None,
+    FlagsOp_Add, // NOTE: Arithmetic with OF and AF computed for an add of V0 and V1
+    FlagsOp_Sub, // NOTE: Arithmetic with OF and AF computed for a subtract of V1 from V0
+    FlagsOp_Arith, // NOTE: Arithmetic with OF and AF cleared
+    FlagsOp_Log, // NOTE: Logical, Result is used as-is for SF/ZF/PF
+};
+
+struct lazy_flags
+{
+    flags_op Op;
+    u32 WWidth;
+    u32 V0;
+    u32 V1;
+    u32 Result; // NOTE: Unmasked for the arithmetic ops
+};
+
 struct operand_access
 {
     segmented_access Op;
@@ -76,4 +47,6 @@ struct operand_access
     b32 AddressIsUnaligned;
 };
 
-static exec_result ExecInstruction(segmented_access Memory, register_state_8086 *Registers, instruction Instruction);
+static void MaterializeFlags(register_state_8086 *Registers, lazy_flags *LazyFlags);
+static exec_result ExecInstruction(segmented_access Memory, register_state_8086 *Registers, instruction Instruction,
+                                   lazy_flags *LazyFlags = 0);
@@ -10,16 +10,17 @@
    
    ======================================================================== */
 
-static b32 OperandIsType(instruction Instruction, u32 Index, operand_type Type)
+static instruction_operand GetOperand(instruction Instruction, u32 Index)
 {
-    b32 Result = (Instruction.Operands[Index].Type == Type);
+    assert(Index < ArrayCount(Instruction.Operands));
+    instruction_operand Result = Instruction.Operands[Index];
     return Result;
 }
 
-static instruction_operand GetOperand(instruction Instruction, u32 Index)
+static b32 IsRet(operation_type Op)
 {
-    assert(Index < ArrayCount(Instruction.Operands));
-    instruction_operand Result = Instruction.Operands[Index];
+    b32 Result = ((Op == Op_ret) ||
+                  (Op == Op_retf));
     return Result;
 }
 
@@ -82,3 +83,177 @@ static instruction_operand ImmediateOperand(u32 Value, u32 Flags = 0)
     
     return Result;
 }
+
+static_assert(sizeof(packed_instruction) == 16, "Packed instructions are expected to be 16 bytes");
+
+static b32 PackValue(s32 Value, u16 *Bits, u16 *Dest)
+{
+    b32 Result = true;
+    
+    if((Value >= 0) && (Value <= 0xffff))
+    {
+        *Dest = (u16)Value;
+    }
+    else if((Value < 0) && (Value >= -0x8000))
+    {
+        *Dest = (u16)Value;
+        *Bits |= PackedOperand_SignExtended;
+    }
+    else
+    {
+        Result = false;
+    }
+    
+    return Result;
+}
+
+static b32 PackRegister(u32 Index, u32 Shift, u16 *Bits)
+{
+    b32 Result = (Index < 16);
+    *Bits |= (u16)((Index & 0xf) << Shift);
+    
+    return Result;
+}
+
+static b32 IsTermOfEffectiveAddress(effective_address_term Term)
+{
+    b32 Result = ((Term.Register.Offset == 0) && (Term.Register.Count == 2) && (Term.Scale == 1));
+    return Result;
+}
+
+static b32 IsTermOfIntersegmentAddress(effective_address_term Term)
+{
+    b32 Result = ((Term.Register.Index == 0) && (Term.Register.Offset == 0) &&
+                  (Term.Register.Count == 0) && (Term.Scale == 0));
+    return Result;
+}
+
+static b32 PackInstruction(instruction Instruction, packed_instruction *Dest)
+{
+    // NOTE: Returns false if Instruction has something in it that doesn't fit, which never happens for
+    // instructions that came from the decoder. Dest is filled in either way, but only round-trips if it fit.
+    packed_instruction Packed = {};
+    
+    b32 Fits = ((Instruction.Size <= 0xff) &&
+                (Instruction.Op <= 0xff) &&
+                (Instruction.Flags <= 0xff) &&
+                (Instruction.SegmentOverride <= 0xff));
+    
+    Packed.Address = Instruction.Address;
+    Packed.Size = (u8)Instruction.Size;
+    Packed.Op = (u8)Instruction.Op;
+    Packed.Flags = (u8)Instruction.Flags;
+    Packed.SegmentOverride = (u8)Instruction.SegmentOverride;
+    
+    for(u32 OperandIndex = 0; OperandIndex < ArrayCount(Instruction.Operands); ++OperandIndex)
+    {
+        instruction_operand Operand = Instruction.Operands[OperandIndex];
+        u16 *Bits = &Packed.Operands[OperandIndex];
+        u16 *Value = &Packed.Values[OperandIndex];
+        
+        *Bits |= (u16)(Operand.Type & PackedOperand_TypeMask);
+        switch(Operand.Type)
+        {
+            case Operand_None:
+            {
+            } break;
+            
+            case Operand_Register:
+            {
+                Fits = Fits && PackRegister(Operand.Register.Index, PackedOperand_RegisterShift, Bits);
+                Fits = Fits && (Operand.Register.Offset <= 1) && (Operand.Register.Count <= 3);
+                *Bits |= (u16)((Operand.Register.Offset & 0x1) << PackedOperand_RegisterOffsetShift);
+                *Bits |= (u16)((Operand.Register.Count & 0x3) << PackedOperand_RegisterCountShift);
+            } break;
+            
+            case Operand_Memory:
+            {
+                effective_address_expression Address = Operand.Address;
+                Fits = Fits && PackValue(Address.Displacement, Bits, Value);
+                if(Address.Flags == Address_ExplicitSegment)
+                {
+                    u32 OtherIndex = OperandIndex ^ 1;
+                    Fits = Fits && (Instruction.Operands[OtherIndex].Type == Operand_None);
+                    Fits = Fits && IsTermOfIntersegmentAddress(Address.Terms[0]) && IsTermOfIntersegmentAddress(Address.Terms[1]);
+                    Fits = Fits && (Address.ExplicitSegment <= 0xffff);
+                    *Bits |= PackedOperand_Flag;
+                    Packed.Values[OtherIndex] = (u16)Address.ExplicitSegment;
+                }
+                else
+                {
+                    Fits = Fits && (Address.Flags == 0) && (Address.ExplicitSegment == 0);
+                    Fits = Fits && IsTermOfEffectiveAddress(Address.Terms[0]) && IsTermOfEffectiveAddress(Address.Terms[1]);
+                    Fits = Fits && PackRegister(Address.Terms[0].Register.Index, PackedOperand_RegisterShift, Bits);
+                    Fits = Fits && PackRegister(Address.Terms[1].Register.Index, PackedOperand_SecondRegisterShift, Bits);
+                }
+            } break;
+            
+            case Operand_Immediate:
+            {
+                Fits = Fits && PackValue(Operand.Immediate.Value, Bits, Value);
+                Fits = Fits && ((Operand.Immediate.Flags & ~Immediate_RelativeJumpDisplacement) == 0);
+                if(Operand.Immediate.Flags & Immediate_RelativeJumpDisplacement)
+                {
+                    *Bits |= PackedOperand_Flag;
+                }
+            } break;
+            
+            default:
+            {
+                Fits = false;
+            } break;
+        }
+    }
+    
+    *Dest = Packed;
+    
+    return Fits;
+}
+
+static instruction UnpackInstruction(packed_instruction Packed)
+{
+    instruction Result = {};
+    
+    Result.Address = Packed.Address;
+    Result.Size = Packed.Size;
+    Result.Op = (operation_type)Packed.Op;
+    Result.Flags = Packed.Flags;
+    Result.SegmentOverride = Packed.SegmentOverride;
+    
+    for(u32 OperandIndex = 0; OperandIndex < ArrayCount(Result.Operands); ++OperandIndex)
+    {
+        u16 Bits = Packed.Operands[OperandIndex];
+        s32 Value = (Bits & PackedOperand_SignExtended) ? (s32)(s16)Packed.Values[OperandIndex] : (s32)Packed.Values[OperandIndex];
+        u32 Register = (Bits >> PackedOperand_RegisterShift) & 0xf;
+        
+        instruction_operand *Operand = Result.Operands + OperandIndex;
+        switch(Bits & PackedOperand_TypeMask)
+        {
+            case Operand_Register:
+            {
+                *Operand = RegisterOperand(Register, (Bits >> PackedOperand_RegisterCountShift) & 0x3);
+                Operand->Register.Offset = (Bits >> PackedOperand_RegisterOffsetShift) & 0x1;
+            } break;
+            
+            case Operand_Memory:
+            {
+                if(Bits & PackedOperand_Flag)
+                {
+                    *Operand = IntersegmentAddressOperand(Packed.Values[OperandIndex ^ 1], Value);
+                }
+                else
+                {
+                    u32 SecondRegister = (Bits >> PackedOperand_SecondRegisterShift) & 0xf;
+                    *Operand = EffectiveAddressOperand(RegisterAccess(Register, 0, 2), RegisterAccess(SecondRegister, 0, 2), Value);
+                }
+            } break;
+            
+            case Operand_Immediate:
+            {
+                *Operand = ImmediateOperand(Value, (Bits & PackedOperand_Flag) ? Immediate_RelativeJumpDisplacement : 0);
+            } break;
+        }
+    }
+    
+    return Result;
+}
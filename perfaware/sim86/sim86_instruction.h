@@ -20,6 +20,12 @@ typedef struct effective_address_expression effective_address_expression;
 typedef struct immediate immediate;
 typedef struct instruction_operand instruction_operand;
 typedef struct instruction instruction;
+typedef struct decode_range_result decode_range_result;
+typedef struct instruction_columns instruction_columns;
+typedef struct packed_instruction packed_instruction;
+typedef struct sim86_machine sim86_machine;
+typedef struct machine_step machine_step;
+typedef struct machine_run_result machine_run_result;
 
 typedef enum operation_type : u32
 {
@@ -107,3 +113,114 @@ struct instruction
     
     register_index SegmentOverride;
 };
+
+enum decode_range_error
+{
+    DecodeRange_OK,
+    DecodeRange_Unrecognized, // NOTE: The bytes at ErrorOffset are not an instruction
+    DecodeRange_Truncated, // NOTE: The instruction at ErrorOffset runs past the end of the source
+};
+struct decode_range_result
+{
+    u32 InstructionCount;
+    u32 ByteCount; // NOTE: Total size of the decoded instructions, i.e. where to resume decoding
+    u32 ErrorOffset; // NOTE: Only meaningful when Error is not DecodeRange_OK, and always equal to ByteCount when it isn't
+    u32 Error;
+};
+
+struct instruction_columns
+{
+    u32 Capacity; // NOTE: How many instructions each of the arrays below has room for
+    
+    // NOTE: One entry per instruction. Any of these can be null, in which case it is not filled in.
+    u32 *Address;
+    u8 *Size;
+    u8 *Op; // NOTE: operation_type
+    u8 *Flags; // NOTE: instruction_flag
+    u8 *SegmentOverride;
+    
+    // NOTE: Two entries per instruction, stored operand-major: operand 0 of every instruction, then
+    // operand 1 of every instruction (so operand N of instruction I is at [N*Capacity + I]).
+    // Memory operands put their first term's register in RegisterIndex and their second in
+    // SecondRegisterIndex. Memory terms always have an offset of 0, a count of 2 and a scale of 1.
+    u8 *OperandType; // NOTE: operand_type
+    u8 *RegisterIndex;
+    u8 *RegisterOffset;
+    u8 *RegisterCount;
+    u8 *SecondRegisterIndex;
+    s32 *Displacement;
+    s32 *Immediate;
+    u16 *ExplicitSegment;
+    u8 *OperandFlags; // NOTE: effective_address_flag for memory operands, immediate_flag for immediates
+};
+
+/* NOTE: packed_instruction holds everything in an instruction in 16 bytes instead of over 100, for
+   when a whole program's worth of decoded instructions needs to stay in cache. It can hold anything
+   the 8086 decoder produces, and UnpackInstruction gives back exactly the instruction that was packed.
+   
+   Each operand is a u16 of packed_operand_bits and a 16-bit value. The value is the displacement for
+   memory operands and the value for immediates. It is zero-extended unless PackedOperand_SignExtended
+   is set, so anything from -32768 to 65535 fits. Memory operands keep their two term registers, and
+   the terms always have an offset of 0, a count of 2 and a scale of 1, except for intersegment
+   addresses, which have no terms. An intersegment address is always the only operand, so its
+   explicit segment goes in the other operand's value. */
+enum packed_operand_bits
+{
+    PackedOperand_TypeMask = 0x3, // NOTE: operand_type
+    PackedOperand_Flag = 0x4, // NOTE: Address_ExplicitSegment for memory, Immediate_RelativeJumpDisplacement for immediates
+    PackedOperand_SignExtended = 0x8,
+    
+    PackedOperand_RegisterShift = 4, // NOTE: The register index, or the first term's register for memory
+    PackedOperand_SecondRegisterShift = 8, // NOTE: The second term's register for memory
+    PackedOperand_RegisterOffsetShift = 12,
+    PackedOperand_RegisterCountShift = 13,
+};
+struct packed_instruction
+{
+    u32 Address;
+    u8 Size;
+    u8 Op; // NOTE: operation_type
+    u8 Flags; // NOTE: instruction_flag
+    u8 SegmentOverride;
+    u16 Operands[2]; // NOTE: packed_operand_bits
+    u16 Values[2];
+};
+
+/* NOTE: A sim86_machine is a whole 8086 (1MB of memory and the registers) that a host program can load
+   and run through the shared library. Registers are read and written as 16 u16s indexed the same as
+   register_access Index, so ip is 13 and flags is 14. The last one is unused and always reads as zero. */
+enum machine_stop_flag
+{
+    MachineStop_OnRet = 0x1, // NOTE: Stop before executing a ret or retf, like -stoponret
+    MachineStop_OnHlt = 0x2, // NOTE: Stop after executing a hlt
+};
+
+enum machine_stop_reason
+{
+    MachineStopped_InstructionLimit,
+    MachineStopped_EndOfCode, // NOTE: The next instruction is at or past OnePastLastByte
+    MachineStopped_Ret,
+    MachineStopped_Hlt,
+    MachineStopped_Unrecognized, // NOTE: The bytes at StopAddress are not an instruction
+    MachineStopped_Unimplemented, // NOTE: The instruction at StopAddress can't be executed, and ip is left on it
+};
+struct machine_run_result
+{
+    u32 InstructionCount;
+    u32 StopReason; // NOTE: machine_stop_reason
+    u32 StopAddress; // NOTE: The absolute address of the next instruction to run
+};
+
+enum machine_step_flag
+{
+    MachineStep_BranchTaken = 0x1,
+    MachineStep_AddressIsUnaligned = 0x2,
+};
+struct machine_step
+{
+    packed_instruction Instruction; // NOTE: Address is the absolute address it ran from
+    u16 Registers[16]; // NOTE: After the instruction, indexed the same as register_access Index
+    u32 RepCount;
+    u16 ShiftCount;
+    u16 Flags; // NOTE: machine_step_flag
+};
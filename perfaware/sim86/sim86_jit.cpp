@@ -0,0 +1,1233 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_HOST_X64 1
+#else
+#define JIT_HOST_X64 0
+#endif
+
+static_assert(sizeof(flags_op) == sizeof(u32), "The JIT stores flags_op as a 32-bit value");
+
+enum host_register
+{
+    Host_rax = 0,
+    Host_rcx = 1,
+    Host_rdx = 2,
+    Host_rdi = 7,
+    Host_r8 = 8,
+    Host_r9 = 9,
+    Host_r10 = 10,
+    Host_r11 = 11,
+};
+
+// NOTE: These hold the jit_context fields for the whole block. Compiled code only ever uses registers that
+// both x64 calling conventions treat as scratch, so a block never has to save anything or touch the stack.
+#define JIT_REGISTERS Host_r8
+#define JIT_MEMORY Host_r9
+#define JIT_FLAGS Host_r10
+#define JIT_HAS_CODE Host_r11
+
+enum host_condition
+{
+    HostCondition_B = 0x2,
+    HostCondition_NB = 0x3,
+    HostCondition_Z = 0x4,
+    HostCondition_NZ = 0x5,
+    HostCondition_P = 0xa,
+    HostCondition_NP = 0xb,
+};
+
+enum host_alu_op
+{
+    HostALU_Add = 0,
+    HostALU_Or = 1,
+    HostALU_And = 4,
+    HostALU_Sub = 5,
+    HostALU_Xor = 6,
+    HostALU_Cmp = 7,
+};
+
+enum host_shift_op
+{
+    HostShift_Left = 4,
+    HostShift_Right = 5,
+    HostShift_RightSigned = 7,
+};
+
+struct host_address
+{
+    u32 Base;
+    u32 Index;
+    b32 Indexed;
+    s32 Displacement;
+};
+
+struct jit_emitter
+{
+    u8 *Base;
+    u32 Used;
+    u32 Capacity;
+    b32 Overflowed; // NOTE: Set if the block didn't fit, in which case nothing that was emitted can be used
+};
+
+// NOTE: What the most recent flag-producing instruction in the block left in the lazy_flags record,
+// as far as can be told at compile time
+struct jit_pending_flags
+{
+    flags_op Op;
+    u32 WWidth;
+};
+
+static host_address HostAddress(u32 Base, s32 Displacement)
+{
+    host_address Result = {};
+    Result.Base = Base;
+    Result.Displacement = Displacement;
+    return Result;
+}
+
+static host_address HostAddressIndexed(u32 Base, u32 Index)
+{
+    host_address Result = {};
+    Result.Base = Base;
+    Result.Index = Index;
+    Result.Indexed = true;
+    return Result;
+}
+
+#define PENDING_FLAGS(Field) HostAddress(JIT_FLAGS, (s32)offsetof(lazy_flags, Field))
+
+static host_address GuestRegister(register_access Access)
+{
+    host_address Result = HostAddress(JIT_REGISTERS, 2*Access.Index + Access.Offset);
+    return Result;
+}
+
+static host_address GuestRegister16(u32 Index)
+{
+    host_address Result = HostAddress(JIT_REGISTERS, 2*Index);
+    return Result;
+}
+
+//
+// NOTE: Host instruction encoding
+//
+
+static void JitByte(jit_emitter *Emit, u32 Value)
+{
+    if(Emit->Used < Emit->Capacity)
+    {
+        Emit->Base[Emit->Used++] = (u8)Value;
+    }
+    else
+    {
+        Emit->Overflowed = true;
+    }
+}
+
+static void JitU16(jit_emitter *Emit, u32 Value)
+{
+    JitByte(Emit, Value & 0xff);
+    JitByte(Emit, (Value >> 8) & 0xff);
+}
+
+static void JitU32(jit_emitter *Emit, u32 Value)
+{
+    JitU16(Emit, Value & 0xffff);
+    JitU16(Emit, Value >> 16);
+}
+
+static void JitOpcode(jit_emitter *Emit, u32 Opcode)
+{
+    if(Opcode > 0xff)
+    {
+        JitByte(Emit, Opcode >> 8);
+    }
+    JitByte(Emit, Opcode & 0xff);
+}
+
+static void JitRex(jit_emitter *Emit, b32 Wide, u32 Reg, u32 Index, u32 Base)
+{
+    u32 Rex = 0x40 | (Wide ? 0x8 : 0) | ((Reg & 8) >> 1) | ((Index & 8) >> 2) | ((Base & 8) >> 3);
+    if(Rex != 0x40)
+    {
+        JitByte(Emit, Rex);
+    }
+}
+
+static void JitMemoryForm(jit_emitter *Emit, u32 Prefix, b32 Wide, u32 Opcode, u32 Reg, host_address Address)
+{
+    // NOTE: Memory operands are always encoded as [Base + Index + disp32]. It isn't the shortest encoding,
+    // but it is the same shape for every base register, which keeps this simple.
+    if(Prefix)
+    {
+        JitByte(Emit, Prefix);
+    }
+    JitRex(Emit, Wide, Reg, Address.Indexed ? Address.Index : 0, Address.Base);
+    JitOpcode(Emit, Opcode);
+    
+    if(Address.Indexed || ((Address.Base & 7) == 4))
+    {
+        u32 Index = Address.Indexed ? Address.Index : 4; // NOTE: An index of 4 means no index
+        JitByte(Emit, 0x84 | ((Reg & 7) << 3));
+        JitByte(Emit, ((Index & 7) << 3) | (Address.Base & 7));
+    }
+    else
+    {
+        JitByte(Emit, 0x80 | ((Reg & 7) << 3) | (Address.Base & 7));
+    }
+    JitU32(Emit, (u32)Address.Displacement);
+}
+
+static void JitRegisterForm(jit_emitter *Emit, b32 Wide, u32 Opcode, u32 Reg, u32 RM)
+{
+    JitRex(Emit, Wide, Reg, 0, RM);
+    JitOpcode(Emit, Opcode);
+    JitByte(Emit, 0xc0 | ((Reg & 7) << 3) | (RM & 7));
+}
+
+static void JitLoad(jit_emitter *Emit, u32 Size, u32 Dest, host_address From)
+{
+    // NOTE: Everything narrower than 32 bits is zero-extended
+    switch(Size)
+    {
+        case 1: {JitMemoryForm(Emit, 0, false, 0x0fb6, Dest, From);} break;
+        case 2: {JitMemoryForm(Emit, 0, false, 0x0fb7, Dest, From);} break;
+        case 4: {JitMemoryForm(Emit, 0, false, 0x8b, Dest, From);} break;
+        default: {JitMemoryForm(Emit, 0, true, 0x8b, Dest, From);} break;
+    }
+}
+
+static void JitStore(jit_emitter *Emit, u32 Size, host_address To, u32 Source)
+{
+    switch(Size)
+    {
+        case 1: {JitMemoryForm(Emit, 0, false, 0x88, Source, To);} break;
+        case 2: {JitMemoryForm(Emit, 0x66, false, 0x89, Source, To);} break;
+        default: {JitMemoryForm(Emit, 0, false, 0x89, Source, To);} break;
+    }
+}
+
+static void JitStoreImmediate(jit_emitter *Emit, host_address To, u32 Value)
+{
+    JitMemoryForm(Emit, 0, false, 0xc7, 0, To);
+    JitU32(Emit, Value);
+}
+
+static void JitMoveImmediate(jit_emitter *Emit, u32 Dest, u32 Value)
+{
+    JitRex(Emit, false, 0, 0, Dest);
+    JitByte(Emit, 0xb8 + (Dest & 7));
+    JitU32(Emit, Value);
+}
+
+static void JitMove(jit_emitter *Emit, u32 Dest, u32 Source)
+{
+    JitRegisterForm(Emit, false, 0x89, Source, Dest);
+}
+
+static void JitMove64(jit_emitter *Emit, u32 Dest, u32 Source)
+{
+    JitRegisterForm(Emit, true, 0x89, Source, Dest);
+}
+
+static void JitALU(jit_emitter *Emit, host_alu_op Op, u32 Dest, u32 Source)
+{
+    JitRegisterForm(Emit, false, (Op << 3) | 1, Source, Dest);
+}
+
+static void JitALUImmediate(jit_emitter *Emit, host_alu_op Op, u32 Dest, u32 Value)
+{
+    JitRegisterForm(Emit, false, 0x81, Op, Dest);
+    JitU32(Emit, Value);
+}
+
+static void JitTest(jit_emitter *Emit, u32 A, u32 B)
+{
+    JitRegisterForm(Emit, false, 0x85, B, A);
+}
+
+static void JitTestImmediate(jit_emitter *Emit, u32 Reg, u32 Value)
+{
+    JitRegisterForm(Emit, false, 0xf7, 0, Reg);
+    JitU32(Emit, Value);
+}
+
+static void JitTestLowByte(jit_emitter *Emit, u32 Reg)
+{
+    // NOTE: Only valid for rax, rcx and rdx, since without a REX prefix 4-7 are the high byte registers
+    JitRegisterForm(Emit, false, 0x84, Reg, Reg);
+}
+
+static void JitShift(jit_emitter *Emit, host_shift_op Op, u32 Reg, u32 Count)
+{
+    JitRegisterForm(Emit, false, 0xc1, Op, Reg);
+    JitByte(Emit, Count);
+}
+
+static void JitNot(jit_emitter *Emit, u32 Reg)
+{
+    JitRegisterForm(Emit, false, 0xf7, 2, Reg);
+}
+
+static void JitNegate(jit_emitter *Emit, u32 Reg)
+{
+    JitRegisterForm(Emit, false, 0xf7, 3, Reg);
+}
+
+static void JitZeroExtend16(jit_emitter *Emit, u32 Reg)
+{
+    JitRegisterForm(Emit, false, 0x0fb7, Reg, Reg);
+}
+
+static void JitBitTest(jit_emitter *Emit, host_address Bits, u32 BitIndex)
+{
+    JitMemoryForm(Emit, 0, true, 0x0fa3, BitIndex, Bits);
+}
+
+static void JitAddToWord(jit_emitter *Emit, host_address To, u32 Value)
+{
+    JitMemoryForm(Emit, 0x66, false, 0x81, 0, To);
+    JitU16(Emit, Value);
+}
+
+static void JitDecrementWord(jit_emitter *Emit, host_address To)
+{
+    JitMemoryForm(Emit, 0x66, false, 0xff, 1, To);
+}
+
+static void JitCompareWordToZero(jit_emitter *Emit, host_address To)
+{
+    JitMemoryForm(Emit, 0x66, false, 0x83, 7, To);
+    JitByte(Emit, 0);
+}
+
+// NOTE: Jumps are emitted with a zero rel32 and return where it is, so it can be patched once the target is known
+static u32 JitJumpIf(jit_emitter *Emit, host_condition Condition)
+{
+    JitByte(Emit, 0x0f);
+    JitByte(Emit, 0x80 | Condition);
+    u32 Result = Emit->Used;
+    JitU32(Emit, 0);
+    return Result;
+}
+
+static u32 JitJump(jit_emitter *Emit)
+{
+    JitByte(Emit, 0xe9);
+    u32 Result = Emit->Used;
+    JitU32(Emit, 0);
+    return Result;
+}
+
+static void JitPatchJumpToHere(jit_emitter *Emit, u32 Patch)
+{
+    if((Patch + 4) <= Emit->Used)
+    {
+        u32 Relative = Emit->Used - (Patch + 4);
+        memcpy(Emit->Base + Patch, &Relative, sizeof(Relative));
+    }
+}
+
+static void JitReturn(jit_emitter *Emit)
+{
+    JitByte(Emit, 0xc3);
+}
+
+//
+// NOTE: 8086 semantics
+//
+
+static void JitExit(jit_emitter *Emit, u32 IPAdvance, u32 InstructionCount)
+{
+    if(IPAdvance & 0xffff)
+    {
+        JitAddToWord(Emit, GuestRegister16(Register_ip), IPAdvance & 0xffff);
+    }
+    JitMoveImmediate(Emit, Host_rax, InstructionCount);
+    JitReturn(Emit);
+}
+
+static void JitLoadRegisterOrImmediate(jit_emitter *Emit, u32 Dest, instruction_operand Operand)
+{
+    if(Operand.Type == Operand_Register)
+    {
+        JitLoad(Emit, Operand.Register.Count, Dest, GuestRegister(Operand.Register));
+    }
+    else
+    {
+        JitMoveImmediate(Emit, Dest, Operand.Immediate.Value);
+    }
+}
+
+static void JitEffectiveAddress(jit_emitter *Emit, effective_address_expression Address)
+{
+    // NOTE: Leaves the 16-bit segment offset in rdx. Clobbers rax.
+    JitMoveImmediate(Emit, Host_rdx, (u32)Address.Displacement);
+    for(u32 TermIndex = 0; TermIndex < ArrayCount(Address.Terms); ++TermIndex)
+    {
+        effective_address_term Term = Address.Terms[TermIndex];
+        if(Term.Register.Index)
+        {
+            JitLoad(Emit, Term.Register.Count, Host_rax, GuestRegister(Term.Register));
+            JitALU(Emit, HostALU_Add, Host_rdx, Host_rax);
+        }
+    }
+    JitZeroExtend16(Emit, Host_rdx);
+}
+
+static void JitGuestAddress(jit_emitter *Emit, instruction Instruction, effective_address_expression Address)
+{
+    // NOTE: Leaves the absolute address in rdx. Memory operands wrap at 64K, the same as in AccessOperand.
+    JitEffectiveAddress(Emit, Address);
+    
+    u32 Segment = Instruction.SegmentOverride;
+    if(!Segment)
+    {
+        Segment = (Address.Terms[0].Register.Index == Register_bp) ? Register_ss : Register_ds;
+    }
+    JitLoad(Emit, 2, Host_rax, GuestRegister16(Segment));
+    JitShift(Emit, HostShift_Left, Host_rax, 4);
+    JitALU(Emit, HostALU_Add, Host_rdx, Host_rax);
+    JitZeroExtend16(Emit, Host_rdx);
+}
+
+static void JitLoadGuestWord(jit_emitter *Emit, u32 Dest, u32 Temp)
+{
+    // NOTE: Reads the word at rdx the way ReadU16 does, with the second byte wrapping around to 0
+    JitLoad(Emit, 1, Dest, HostAddressIndexed(JIT_MEMORY, Host_rdx));
+    JitMove(Emit, Temp, Host_rdx);
+    JitALUImmediate(Emit, HostALU_Add, Temp, 1);
+    JitZeroExtend16(Emit, Temp);
+    JitLoad(Emit, 1, Temp, HostAddressIndexed(JIT_MEMORY, Temp));
+    JitShift(Emit, HostShift_Left, Temp, 8);
+    JitALU(Emit, HostALU_Or, Dest, Temp);
+}
+
+static void JitStoreGuest(jit_emitter *Emit, u32 WWidth)
+{
+    // NOTE: Writes rax to the address in rdx the way WriteN does. Clobbers both.
+    JitStore(Emit, 1, HostAddressIndexed(JIT_MEMORY, Host_rdx), Host_rax);
+    if(WWidth == 2)
+    {
+        JitShift(Emit, HostShift_Right, Host_rax, 8);
+        JitALUImmediate(Emit, HostALU_Add, Host_rdx, 1);
+        JitZeroExtend16(Emit, Host_rdx);
+        JitStore(Emit, 1, HostAddressIndexed(JIT_MEMORY, Host_rdx), Host_rax);
+    }
+}
+
+static void JitExitIfWritingCode(jit_emitter *Emit, u32 WWidth, u32 Offset, u32 InstructionIndex)
+{
+    // NOTE: If any byte about to be written at rdx is in a chunk the block cache is watching, the block
+    // leaves with ip on this instruction, so that the interpreter does the write. rdx is left alone.
+    u32 Exits[2];
+    u32 ExitCount = 0;
+    for(u32 ByteIndex = 0; ByteIndex < WWidth; ++ByteIndex)
+    {
+        JitMove(Emit, Host_rax, Host_rdx);
+        if(ByteIndex)
+        {
+            JitALUImmediate(Emit, HostALU_Add, Host_rax, ByteIndex);
+            JitZeroExtend16(Emit, Host_rax);
+        }
+        JitShift(Emit, HostShift_Right, Host_rax, CODE_WATCH_CHUNK_SHIFT);
+        JitBitTest(Emit, HostAddress(JIT_HAS_CODE, 0), Host_rax);
+        Exits[ExitCount++] = JitJumpIf(Emit, HostCondition_B);
+    }
+    
+    u32 Continue = JitJump(Emit);
+    for(u32 ExitIndex = 0; ExitIndex < ExitCount; ++ExitIndex)
+    {
+        JitPatchJumpToHere(Emit, Exits[ExitIndex]);
+    }
+    JitExit(Emit, Offset, InstructionIndex);
+    JitPatchJumpToHere(Emit, Continue);
+}
+
+static void JitProduceFlags(jit_emitter *Emit, flags_op Op, u32 WWidth, jit_pending_flags *Pending)
+{
+    // NOTE: V0 and V1 have already been stored, and the unmasked result is in rax
+    JitStore(Emit, 4, PENDING_FLAGS(Result), Host_rax);
+    JitStoreImmediate(Emit, PENDING_FLAGS(Op), Op);
+    JitStoreImmediate(Emit, PENDING_FLAGS(WWidth), WWidth);
+    
+    Pending->Op = Op;
+    Pending->WWidth = WWidth;
+}
+
+static b32 IsConditionalJump(operation_type Op)
+{
+    b32 Result = false;
+    
+    switch(Op)
+    {
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jne:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
+        {
+            Result = true;
+        } break;
+        
+        default: {} break;
+    }
+    
+    return Result;
+}
+
+static b32 IsCompilableOperand(instruction_operand Operand, u32 WWidth, b32 IsDest)
+{
+    b32 Result = false;
+    
+    switch(Operand.Type)
+    {
+        case Operand_Register:
+        {
+            // NOTE: Writing cs would change where the next instruction comes from, so that is left to the interpreter
+            register_access Register = Operand.Register;
+            Result = ((Register.Count >= 1) && (Register.Count <= 2) &&
+                      (Register.Index != Register_none) && (Register.Index < Register_ip) &&
+                      (!IsDest || ((Register.Count == WWidth) && (Register.Index != Register_cs))));
+        } break;
+        
+        case Operand_Memory:
+        {
+            // NOTE: Explicit segments only show up on far calls and jumps, which never get here anyway
+            effective_address_expression Address = Operand.Address;
+            Result = !(Address.Flags & Address_ExplicitSegment);
+            for(u32 TermIndex = 0; TermIndex < ArrayCount(Address.Terms); ++TermIndex)
+            {
+                effective_address_term Term = Address.Terms[TermIndex];
+                if(Term.Register.Index && ((Term.Scale != 1) || (Term.Register.Count != 2)))
+                {
+                    Result = false;
+                }
+            }
+        } break;
+        
+        case Operand_Immediate:
+        {
+            Result = !IsDest;
+        } break;
+        
+        default: {} break;
+    }
+    
+    return Result;
+}
+
+static b32 IsCompilable(instruction Instruction)
+{
+    b32 Result = false;
+    
+    u32 WWidth = (Instruction.Flags & Inst_Wide) ? 2 : 1;
+    instruction_operand Op0 = Instruction.Operands[0];
+    instruction_operand Op1 = Instruction.Operands[1];
+    
+    switch(Instruction.Op)
+    {
+        case Op_mov:
+        case Op_add:
+        case Op_sub:
+        case Op_cmp:
+        case Op_and:
+        case Op_or:
+        case Op_xor:
+        case Op_test:
+        {
+            Result = (IsCompilableOperand(Op0, WWidth, true) &&
+                      IsCompilableOperand(Op1, WWidth, false) &&
+                      !((Op0.Type == Operand_Memory) && (Op1.Type == Operand_Memory)));
+        } break;
+        
+        case Op_inc:
+        case Op_dec:
+        case Op_neg:
+        case Op_not:
+        {
+            Result = (IsCompilableOperand(Op0, WWidth, true) && (Op1.Type == Operand_None));
+        } break;
+        
+        case Op_lea:
+        {
+            Result = ((Op0.Type == Operand_Register) && IsCompilableOperand(Op0, WWidth, true) &&
+                      (Op1.Type == Operand_Memory) && IsCompilableOperand(Op1, WWidth, false));
+        } break;
+        
+        case Op_cbw:
+        case Op_cwd:
+        {
+            Result = true;
+        } break;
+        
+        default:
+        {
+            Result = (IsConditionalJump(Instruction.Op) && (Op0.Type == Operand_Immediate));
+        } break;
+    }
+    
+    // NOTE: The lock and rep prefixes are left to the interpreter, whatever they are attached to
+    if(Instruction.Flags & (Inst_Lock|Inst_Rep))
+    {
+        Result = false;
+    }
+    
+    return Result;
+}
+
+static void JitInstruction(jit_emitter *Emit, instruction Instruction, u32 Offset, u32 InstructionIndex,
+                           jit_pending_flags *Pending)
+{
+    // NOTE: Each of these has to do exactly what ExecInstruction does, down to the quirks: memory operands
+    // are always read as words, even for byte ops, and the flags record gets the same V0, V1 and unmasked
+    // result. Anything that could write to code checks for it before any state has changed.
+    operation_type Op = Instruction.Op;
+    u32 WWidth = (Instruction.Flags & Inst_Wide) ? 2 : 1;
+    u32 WidthMask = WidthMaskFor(WWidth);
+    instruction_operand Op0 = Instruction.Operands[0];
+    instruction_operand Op1 = Instruction.Operands[1];
+    b32 Op0IsMemory = (Op0.Type == Operand_Memory);
+    
+    switch(Op)
+    {
+        case Op_mov:
+        {
+            if(Op0IsMemory)
+            {
+                JitGuestAddress(Emit, Instruction, Op0.Address);
+                JitExitIfWritingCode(Emit, WWidth, Offset, InstructionIndex);
+                JitLoadRegisterOrImmediate(Emit, Host_rax, Op1);
+                JitStoreGuest(Emit, WWidth);
+            }
+            else
+            {
+                if(Op1.Type == Operand_Memory)
+                {
+                    JitGuestAddress(Emit, Instruction, Op1.Address);
+                    JitLoadGuestWord(Emit, Host_rax, Host_rcx);
+                }
+                else
+                {
+                    JitLoadRegisterOrImmediate(Emit, Host_rax, Op1);
+                }
+                JitStore(Emit, WWidth, GuestRegister(Op0.Register), Host_rax);
+            }
+        } break;
+        
+        case Op_add:
+        case Op_sub:
+        case Op_cmp:
+        case Op_and:
+        case Op_or:
+        case Op_xor:
+        case Op_test:
+        {
+            b32 Writes = ((Op != Op_cmp) && (Op != Op_test));
+            
+            // NOTE: V0 goes in rax and V1 in rcx
+            if(Op0IsMemory)
+            {
+                JitGuestAddress(Emit, Instruction, Op0.Address);
+                if(Writes)
+                {
+                    JitExitIfWritingCode(Emit, WWidth, Offset, InstructionIndex);
+                }
+                JitLoadGuestWord(Emit, Host_rax, Host_rcx);
+                JitLoadRegisterOrImmediate(Emit, Host_rcx, Op1);
+            }
+            else if(Op1.Type == Operand_Memory)
+            {
+                JitGuestAddress(Emit, Instruction, Op1.Address);
+                JitLoadGuestWord(Emit, Host_rcx, Host_rax);
+                JitLoadRegisterOrImmediate(Emit, Host_rax, Op0);
+            }
+            else
+            {
+                JitLoadRegisterOrImmediate(Emit, Host_rax, Op0);
+                JitLoadRegisterOrImmediate(Emit, Host_rcx, Op1);
+            }
+            
+            JitStore(Emit, 4, PENDING_FLAGS(V0), Host_rax);
+            JitStore(Emit, 4, PENDING_FLAGS(V1), Host_rcx);
+            
+            flags_op FlagsOp = FlagsOp_Log;
+            switch(Op)
+            {
+                case Op_add:
+                case Op_sub:
+                case Op_cmp:
+                {
+                    JitALUImmediate(Emit, HostALU_And, Host_rax, WidthMask);
+                    JitALUImmediate(Emit, HostALU_And, Host_rcx, WidthMask);
+                    if(Op == Op_add)
+                    {
+                        JitALU(Emit, HostALU_Add, Host_rax, Host_rcx);
+                        FlagsOp = FlagsOp_Add;
+                    }
+                    else
+                    {
+                        JitALU(Emit, HostALU_Sub, Host_rax, Host_rcx);
+                        FlagsOp = FlagsOp_Sub;
+                    }
+                } break;
+                
+                default:
+                {
+                    host_alu_op HostOp = ((Op == Op_or) ? HostALU_Or :
+                                          (Op == Op_xor) ? HostALU_Xor :
+                                          HostALU_And);
+                    JitALU(Emit, HostOp, Host_rax, Host_rcx);
+                    JitZeroExtend16(Emit, Host_rax);
+                    
+                    // NOTE: TEST sets the flags from the result before it is masked to the operand width
+                    if((Op != Op_test) && (WWidth == 1))
+                    {
+                        JitALUImmediate(Emit, HostALU_And, Host_rax, WidthMask);
+                    }
+                } break;
+            }
+            
+            JitProduceFlags(Emit, FlagsOp, WWidth, Pending);
+            
+            if(Writes)
+            {
+                if(Op0IsMemory)
+                {
+                    JitStoreGuest(Emit, WWidth);
+                }
+                else
+                {
+                    JitStore(Emit, WWidth, GuestRegister(Op0.Register), Host_rax);
+                }
+            }
+        } break;
+        
+        case Op_inc:
+        case Op_dec:
+        case Op_neg:
+        case Op_not:
+        {
+            if(Op0IsMemory)
+            {
+                JitGuestAddress(Emit, Instruction, Op0.Address);
+                JitExitIfWritingCode(Emit, WWidth, Offset, InstructionIndex);
+                JitLoadGuestWord(Emit, Host_rax, Host_rcx);
+            }
+            else
+            {
+                JitLoadRegisterOrImmediate(Emit, Host_rax, Op0);
+            }
+            
+            if(Op == Op_not)
+            {
+                // NOTE: NOT leaves the flags alone
+                JitNot(Emit, Host_rax);
+            }
+            else
+            {
+                JitStore(Emit, 4, PENDING_FLAGS(V0), Host_rax);
+                JitStoreImmediate(Emit, PENDING_FLAGS(V1), (Op == Op_neg) ? 0 : 1);
+                
+                if(Op == Op_inc)
+                {
+                    JitALUImmediate(Emit, HostALU_Add, Host_rax, 1);
+                }
+                else if(Op == Op_dec)
+                {
+                    JitALUImmediate(Emit, HostALU_Sub, Host_rax, 1);
+                }
+                else
+                {
+                    JitNegate(Emit, Host_rax);
+                }
+                
+                JitProduceFlags(Emit, FlagsOp_Arith, WWidth, Pending);
+            }
+            
+            if(Op0IsMemory)
+            {
+                JitStoreGuest(Emit, WWidth);
+            }
+            else
+            {
+                JitStore(Emit, WWidth, GuestRegister(Op0.Register), Host_rax);
+            }
+        } break;
+        
+        case Op_lea:
+        {
+            JitEffectiveAddress(Emit, Op1.Address);
+            JitStore(Emit, WWidth, GuestRegister(Op0.Register), Host_rdx);
+        } break;
+        
+        case Op_cbw:
+        {
+            JitLoad(Emit, 1, Host_rax, GuestRegister16(Register_a));
+            JitShift(Emit, HostShift_Left, Host_rax, 24);
+            JitShift(Emit, HostShift_RightSigned, Host_rax, 31);
+            JitStore(Emit, 1, HostAddress(JIT_REGISTERS, 2*Register_a + 1), Host_rax);
+        } break;
+        
+        case Op_cwd:
+        {
+            JitLoad(Emit, 2, Host_rax, GuestRegister16(Register_a));
+            JitShift(Emit, HostShift_Left, Host_rax, 16);
+            JitShift(Emit, HostShift_RightSigned, Host_rax, 31);
+            JitStore(Emit, 2, GuestRegister16(Register_d), Host_rax);
+        } break;
+        
+        default:
+        {
+            assert(!"Instruction was not checked with IsCompilable");
+        } break;
+    }
+}
+
+struct jump_test
+{
+    b32 Never; // NOTE: The jump is never taken, although a loop still decrements CX
+    u32 FlagMask; // NOTE: Otherwise, the jump is taken when (flags & FlagMask) == FlagValue...
+    u32 FlagValue;
+    b32 LoopsOnCX; // NOTE: ...and after decrementing CX, CX is not zero...
+    b32 TestsCX; // NOTE: ...or CX is not zero to begin with.
+};
+
+static jump_test JumpTestFor(operation_type Op)
+{
+    // NOTE: This has to agree exactly with JumpConditionHolds, which compares the flag bits it reads against
+    // 1 and 0 as they are. Only CF is bit 0, so any condition that needs another flag to be set never holds.
+    jump_test Result = {};
+    
+    switch(Op)
+    {
+        case Op_jb: {Result.FlagMask = Flag_CF; Result.FlagValue = Flag_CF;} break;
+        case Op_jbe: {Result.FlagMask = Flag_CF|Flag_ZF; Result.FlagValue = Flag_CF;} break;
+        case Op_jne: {Result.FlagMask = Flag_ZF;} break;
+        case Op_jnl: {Result.FlagMask = Flag_SF|Flag_OF;} break;
+        case Op_jg: {Result.FlagMask = Flag_ZF;} break;
+        case Op_jnb: {Result.FlagMask = Flag_CF;} break;
+        case Op_ja: {Result.FlagMask = Flag_CF|Flag_ZF;} break;
+        case Op_jnp: {Result.FlagMask = Flag_PF;} break;
+        case Op_jno: {Result.FlagMask = Flag_OF;} break;
+        case Op_jns: {Result.FlagMask = Flag_SF;} break;
+        case Op_loop: {Result.LoopsOnCX = true;} break;
+        case Op_loopz: {Result.LoopsOnCX = true; Result.Never = true;} break;
+        case Op_loopnz: {Result.LoopsOnCX = true; Result.FlagMask = Flag_ZF;} break;
+        case Op_jcxz: {Result.TestsCX = true;} break;
+        
+        default: {Result.Never = true;} break;
+    }
+    
+    return Result;
+}
+
+static void JitBranchUnlessFlag(jit_emitter *Emit, jit_pending_flags Pending, flags_register_bit Flag, b32 WantSet,
+                                u32 *NotTaken, u32 *NotTakenCount)
+{
+    // NOTE: Computes one flag from the record the way ComputeStatusFlags would, and jumps to the
+    // not-taken path if it isn't what the condition wants
+    u32 SignBit = SignBitFor(Pending.WWidth);
+    b32 IsLog = (Pending.Op == FlagsOp_Log);
+    
+    b32 AlwaysClear = false;
+    host_condition SetWhen = HostCondition_NZ;
+    switch(Flag)
+    {
+        case Flag_CF:
+        {
+            AlwaysClear = IsLog;
+            JitLoad(Emit, 4, Host_rax, PENDING_FLAGS(Result));
+            JitTestImmediate(Emit, Host_rax, SignBit << 1);
+        } break;
+        
+        case Flag_PF:
+        {
+            JitLoad(Emit, 4, Host_rax, PENDING_FLAGS(Result));
+            JitTestLowByte(Emit, Host_rax);
+            SetWhen = HostCondition_P;
+        } break;
+        
+        case Flag_ZF:
+        {
+            JitLoad(Emit, 4, Host_rax, PENDING_FLAGS(Result));
+            if(!IsLog)
+            {
+                JitALUImmediate(Emit, HostALU_And, Host_rax, WidthMaskFor(Pending.WWidth));
+            }
+            JitTest(Emit, Host_rax, Host_rax);
+            SetWhen = HostCondition_Z;
+        } break;
+        
+        case Flag_SF:
+        {
+            JitLoad(Emit, 4, Host_rax, PENDING_FLAGS(Result));
+            JitTestImmediate(Emit, Host_rax, SignBit);
+        } break;
+        
+        case Flag_OF:
+        {
+            AlwaysClear = ((Pending.Op != FlagsOp_Add) && (Pending.Op != FlagsOp_Sub));
+            JitLoad(Emit, 4, Host_rax, PENDING_FLAGS(V0));
+            JitLoad(Emit, 4, Host_rcx, PENDING_FLAGS(V1));
+            JitLoad(Emit, 4, Host_rdx, PENDING_FLAGS(Result));
+            JitALU(Emit, HostALU_Xor, Host_rcx, Host_rax);
+            if(Pending.Op == FlagsOp_Add)
+            {
+                JitNot(Emit, Host_rcx);
+            }
+            JitALU(Emit, HostALU_Xor, Host_rdx, Host_rax);
+            JitALU(Emit, HostALU_And, Host_rcx, Host_rdx);
+            JitTestImmediate(Emit, Host_rcx, SignBit);
+        } break;
+        
+        default: {} break;
+    }
+    
+    if(AlwaysClear)
+    {
+        if(WantSet)
+        {
+            NotTaken[(*NotTakenCount)++] = JitJump(Emit);
+        }
+    }
+    else
+    {
+        host_condition Fails = WantSet ? (host_condition)(SetWhen ^ 1) : SetWhen;
+        NotTaken[(*NotTakenCount)++] = JitJumpIf(Emit, Fails);
+    }
+}
+
+static void JitConditionalJump(jit_emitter *Emit, instruction Instruction, jit_pending_flags Pending,
+                               u32 EndOffset, u32 InstructionCount, b32 *ReadsIncomingFlags)
+{
+    jump_test Test = JumpTestFor(Instruction.Op);
+    
+    u32 NotTaken[8];
+    u32 NotTakenCount = 0;
+    
+    if(Test.LoopsOnCX)
+    {
+        JitDecrementWord(Emit, GuestRegister16(Register_c));
+        NotTaken[NotTakenCount++] = JitJumpIf(Emit, HostCondition_Z);
+    }
+    
+    if(Test.TestsCX)
+    {
+        JitCompareWordToZero(Emit, GuestRegister16(Register_c));
+        NotTaken[NotTakenCount++] = JitJumpIf(Emit, HostCondition_Z);
+    }
+    
+    if(!Test.Never && Test.FlagMask)
+    {
+        if(Pending.Op)
+        {
+            // NOTE: The flags came from earlier in this block, so they can be tested straight from the record
+            flags_register_bit Flags[] = {Flag_CF, Flag_PF, Flag_ZF, Flag_SF, Flag_OF};
+            for(u32 FlagIndex = 0; FlagIndex < ArrayCount(Flags); ++FlagIndex)
+            {
+                if(Test.FlagMask & Flags[FlagIndex])
+                {
+                    JitBranchUnlessFlag(Emit, Pending, Flags[FlagIndex], (Test.FlagValue & Flags[FlagIndex]),
+                                        NotTaken, &NotTakenCount);
+                }
+            }
+        }
+        else
+        {
+            *ReadsIncomingFlags = true;
+            JitLoad(Emit, 2, Host_rax, GuestRegister16(Register_flags));
+            JitALUImmediate(Emit, HostALU_And, Host_rax, Test.FlagMask);
+            JitALUImmediate(Emit, HostALU_Cmp, Host_rax, Test.FlagValue);
+            NotTaken[NotTakenCount++] = JitJumpIf(Emit, HostCondition_NZ);
+        }
+    }
+    
+    if(!Test.Never)
+    {
+        s8 Displacement = (s8)Instruction.Operands[0].Immediate.Value;
+        JitExit(Emit, EndOffset + Displacement, InstructionCount);
+    }
+    
+    for(u32 PatchIndex = 0; PatchIndex < NotTakenCount; ++PatchIndex)
+    {
+        JitPatchJumpToHere(Emit, NotTaken[PatchIndex]);
+    }
+    JitExit(Emit, EndOffset, InstructionCount);
+}
+
+static void CompileBlock(jit_cache *Jit, jit_block *Entry, instruction *Instructions, u32 InstructionCount,
+                         u32 BlockAddress)
+{
+    // NOTE: If nothing usable comes out of this, the block is never tried again (until the JIT is reset)
+    Entry->Uncompilable = true;
+    
+    // NOTE: Blocks share pages, so while this one is emitted, the ones before it on its first page can't
+    // be run. That's fine, since nothing compiled runs until this returns, and by then every page it could
+    // have touched is executable again, whether anything came of it or not. If the pages can't be made
+    // writable, the emitter has no room, so it overflows on the first byte.
+    u8 *Base = Jit->Code + Jit->CodeUsed;
+    b32 Writable = MakeCodeWritable(Base, JIT_MAX_BLOCK_CODE_SIZE);
+    
+    jit_emitter Emit = {};
+    Emit.Base = Base;
+    Emit.Capacity = Writable ? JIT_MAX_BLOCK_CODE_SIZE : 0;
+
+#if _WIN32
+    JitMove64(&Emit, Host_rax, Host_rcx);
+#else
+    JitMove64(&Emit, Host_rax, Host_rdi);
+#endif
+    JitLoad(&Emit, 8, JIT_REGISTERS, HostAddress(Host_rax, (s32)offsetof(jit_context, Registers)));
+    JitLoad(&Emit, 8, JIT_MEMORY, HostAddress(Host_rax, (s32)offsetof(jit_context, Memory)));
+    JitLoad(&Emit, 8, JIT_FLAGS, HostAddress(Host_rax, (s32)offsetof(jit_context, Flags)));
+    JitLoad(&Emit, 8, JIT_HAS_CODE, HostAddress(Host_rax, (s32)offsetof(jit_context, HasCode)));
+    
+    jit_pending_flags Pending = {};
+    b32 ReadsIncomingFlags = false;
+    u32 CompiledCount = 0;
+    u32 CompiledEndOffset = 0;
+    b32 Ended = false;
+    for(u32 Index = 0; !Ended && (Index < InstructionCount); ++Index)
+    {
+        instruction Instruction = Instructions[Index];
+        if(!IsCompilable(Instruction))
+        {
+            break;
+        }
+        
+        u32 Offset = Instruction.Address - BlockAddress;
+        u32 EndOffset = Offset + Instruction.Size;
+        if(IsConditionalJump(Instruction.Op))
+        {
+            JitConditionalJump(&Emit, Instruction, Pending, EndOffset, Index + 1, &ReadsIncomingFlags);
+            Ended = true;
+        }
+        else
+        {
+            JitInstruction(&Emit, Instruction, Offset, Index, &Pending);
+        }
+        
+        CompiledCount = Index + 1;
+        CompiledEndOffset = EndOffset;
+    }
+    
+    if(!Ended)
+    {
+        JitExit(&Emit, CompiledEndOffset, CompiledCount);
+    }
+    
+    b32 Executable = MakeCodeExecutable(Base, JIT_MAX_BLOCK_CODE_SIZE);
+    if(CompiledCount && !Emit.Overflowed && Executable)
+    {
+        Entry->Proc = (jit_block_proc *)(void *)Emit.Base;
+        Entry->InstructionCount = CompiledCount;
+        Entry->ReadsIncomingFlags = ReadsIncomingFlags;
+        Entry->Uncompilable = false;
+        
+        Jit->CodeUsed += (Emit.Used + 15) & ~15;
+        ++Jit->Stats.BlocksCompiled;
+    }
+}
+
+//
+// NOTE: Running compiled blocks
+//
+
+static jit_cache *AllocateJitCache(u32 BlockCount, u32 HotThreshold)
+{
+    jit_cache *Result = 0;
+    
+    // NOTE: On anything other than an x64 host, there is no JIT, and everything is interpreted as usual
+    if(JIT_HOST_X64)
+    {
+        u8 *Code = (u8 *)AllocateExecutableMemory(JIT_CODE_SIZE);
+        if(Code)
+        {
+            u64 TotalSize = sizeof(jit_cache) + BlockCount*sizeof(jit_block) + 2*JIT_MEMORY_WINDOW;
+            Result = (jit_cache *)calloc(1, TotalSize);
+            if(Result)
+            {
+                u8 *At = (u8 *)(Result + 1);
+                
+                Result->Blocks = (jit_block *)At;
+                At += BlockCount*sizeof(jit_block);
+                Result->BlockCount = BlockCount;
+                
+                Result->CheckBefore = At;
+                At += JIT_MEMORY_WINDOW;
+                Result->CheckAfter = At;
+                
+                Result->HotThreshold = HotThreshold;
+                Result->CodeSize = JIT_CODE_SIZE;
+                Result->Code = Code;
+            }
+            else
+            {
+                FreeExecutableMemory(Code, JIT_CODE_SIZE);
+            }
+        }
+    }
+    
+    return Result;
+}
+
+static void FreeJitCache(jit_cache *Jit)
+{
+    if(Jit)
+    {
+        FreeExecutableMemory(Jit->Code, Jit->CodeSize);
+        free(Jit);
+    }
+}
+
+static void ResetJit(jit_cache *Jit)
+{
+    memset(Jit->Blocks, 0, Jit->BlockCount*sizeof(jit_block));
+    Jit->CodeUsed = 0;
+    ++Jit->Stats.Resets;
+}
+
+static u32 RunCompiledBlock(jit_block *Entry, block_cache *Cache, u8 *Memory, register_state_8086 *Registers,
+                            lazy_flags *LazyFlags)
+{
+    // NOTE: Compiled code always leaves its flags pending, so without lazy flags they are materialized
+    // as soon as the block returns
+    lazy_flags LocalFlags = {};
+    lazy_flags *Flags = LazyFlags ? LazyFlags : &LocalFlags;
+    if(Entry->ReadsIncomingFlags)
+    {
+        MaterializeFlags(Registers, Flags);
+    }
+    
+    jit_context Context = {Registers, Memory, Flags, Cache->Watch.HasCode};
+    u32 Result = Entry->Proc(&Context);
+    
+    MaterializeFlags(Registers, &LocalFlags);
+    
+    return Result;
+}
+
+static u32 RunCheckedBlock(jit_cache *Jit, jit_block *Entry, block_cache *Cache, decoded_block *Block,
+                           segmented_access MainMemory, register_state_8086 *Registers, lazy_flags *LazyFlags)
+{
+    // NOTE: The block is run compiled, then everything it could have touched is put back and the same
+    // instructions are run through ExecInstruction. The interpreter's results are the ones that are kept.
+    register_state_8086 StartRegisters = *Registers;
+    lazy_flags StartFlags = LazyFlags ? *LazyFlags : lazy_flags{};
+    memcpy(Jit->CheckBefore, MainMemory.Memory, JIT_MEMORY_WINDOW);
+    
+    u32 Result = RunCompiledBlock(Entry, Cache, MainMemory.Memory, Registers, LazyFlags);
+    
+    register_state_8086 CompiledRegisters = *Registers;
+    if(LazyFlags)
+    {
+        lazy_flags CompiledFlags = *LazyFlags;
+        MaterializeFlags(&CompiledRegisters, &CompiledFlags);
+    }
+    memcpy(Jit->CheckAfter, MainMemory.Memory, JIT_MEMORY_WINDOW);
+    
+    *Registers = StartRegisters;
+    if(LazyFlags)
+    {
+        *LazyFlags = StartFlags;
+    }
+    memcpy(MainMemory.Memory, Jit->CheckBefore, JIT_MEMORY_WINDOW);
+    
+    for(u32 Index = 0; Index < Result; ++Index)
+    {
+        instruction Instruction = Cache->Instructions[Block->FirstInstruction + Index];
+        Registers->ip += Instruction.Size;
+        ExecInstruction(MainMemory, Registers, Instruction, LazyFlags);
+    }
+    
+    register_state_8086 InterpretedRegisters = *Registers;
+    if(LazyFlags)
+    {
+        lazy_flags InterpretedFlags = *LazyFlags;
+        MaterializeFlags(&InterpretedRegisters, &InterpretedFlags);
+    }
+    
+    ++Jit->Stats.BlocksChecked;
+    if((memcmp(&CompiledRegisters, &InterpretedRegisters, sizeof(InterpretedRegisters)) != 0) ||
+       (memcmp(Jit->CheckAfter, MainMemory.Memory, JIT_MEMORY_WINDOW) != 0))
+    {
+        ++Jit->Stats.CheckFailures;
+        fprintf(stderr, "JIT MISMATCH: Block at %u, %u instructions run\n", Block->Address, Result);
+    }
+    
+    return Result;
+}
+
+static u32 RunJitBlock(jit_cache *Jit, block_cache *Cache, instruction_table Table, segmented_access At,
+                       u32 OnePastLastByte, decode_mode Mode, segmented_access MainMemory,
+                       register_state_8086 *Registers, lazy_flags *LazyFlags, u64 InstructionLimit, b32 Check)
+{
+    // NOTE: Returns 0 if nothing was run, in which case the interpreter carries on from the start of the
+    // block. Otherwise the cache is left pointing at the first instruction that wasn't run.
+    u32 Result = 0;
+    
+    decoded_block *Block = EnterBlock(Cache, Table, At, OnePastLastByte, Mode);
+    if(Jit->SeenFlushCount != Cache->Stats.Flushes)
+    {
+        ResetJit(Jit);
+        Jit->SeenFlushCount = Cache->Stats.Flushes;
+    }
+    
+    if(Block)
+    {
+        jit_block *Entry = Jit->Blocks + (Block - Cache->Blocks);
+        if(!Entry->Proc && !Entry->Uncompilable && (++Entry->EntryCount >= Jit->HotThreshold))
+        {
+            if((Jit->CodeSize - Jit->CodeUsed) < JIT_MAX_BLOCK_CODE_SIZE)
+            {
+                ResetJit(Jit);
+            }
+            CompileBlock(Jit, Entry, Cache->Instructions + Block->FirstInstruction, Block->InstructionCount,
+                         Block->Address);
+        }
+        
+        if(Entry->Proc && (!InstructionLimit || (Entry->InstructionCount <= InstructionLimit)))
+        {
+            Result = (Check ?
+                      RunCheckedBlock(Jit, Entry, Cache, Block, MainMemory, Registers, LazyFlags) :
+                      RunCompiledBlock(Entry, Cache, MainMemory.Memory, Registers, LazyFlags));
+            Cache->NextIndex = Result;
+            
+            ++Jit->Stats.BlockRuns;
+            Jit->Stats.InstructionsRun += Result;
+            if(Result < Entry->InstructionCount)
+            {
+                ++Jit->Stats.SideExits;
+            }
+        }
+    }
+    
+    return Result;
+}
@@ -0,0 +1,82 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: The JIT translates decoded blocks that have been entered often enough into x86-64, and runs them
+// in place of the interpreter. A block is compiled from its first instruction up to the first one the
+// JIT doesn't handle, and the interpreter picks up from there. The 8086 registers stay in the caller's
+// register_state_8086 the whole time, and the flags are left pending in a lazy_flags record, exactly
+// the way ExecInstruction leaves them with -lazyflags, so both always agree on what the machine looks like.
+//
+// Compiled code only touches memory through memory operands, which wrap at 64K, so it never reaches past
+// the low 64K of main memory. A write to a chunk that has code in it leaves the block before the write
+// happens, so the interpreter does it and the block cache hears about it.
+
+#define JIT_CODE_SIZE (1 << 20)
+#define JIT_MAX_BLOCK_CODE_SIZE (1 << 13)
+#define JIT_DEFAULT_HOT_THRESHOLD 16
+#define JIT_MEMORY_WINDOW 0x10000
+
+struct jit_context
+{
+    register_state_8086 *Registers;
+    u8 *Memory;
+    lazy_flags *Flags;
+    u8 *HasCode; // NOTE: The block cache's code watch bits
+};
+
+// NOTE: Returns how many instructions were run. The 8086 ip is left pointing at the next one.
+typedef u32 jit_block_proc(jit_context *Context);
+
+struct jit_block
+{
+    jit_block_proc *Proc; // NOTE: 0 until the block has been compiled
+    u32 EntryCount;
+    u32 InstructionCount; // NOTE: How many of the decoded block's instructions were compiled, counting from the first
+    b32 ReadsIncomingFlags; // NOTE: Ends in a jump that tests flags produced before the block was entered
+    b32 Uncompilable;
+};
+
+struct jit_stats
+{
+    u64 BlocksCompiled;
+    u64 BlockRuns;
+    u64 InstructionsRun;
+    u64 SideExits;
+    u64 Resets;
+    u64 BlocksChecked;
+    u64 CheckFailures;
+};
+
+struct jit_cache
+{
+    u32 HotThreshold;
+    
+    u32 BlockCount;
+    jit_block *Blocks; // NOTE: Parallel to the block cache's decoded blocks
+    u64 SeenFlushCount; // NOTE: When the block cache flushes, block indices get reused, so everything compiled is thrown away
+    
+    u32 CodeSize;
+    u32 CodeUsed;
+    u8 *Code;
+    
+    // NOTE: Only used by -jitcheck
+    u8 *CheckBefore;
+    u8 *CheckAfter;
+    
+    jit_stats Stats;
+};
+
+static jit_cache *AllocateJitCache(u32 BlockCount, u32 HotThreshold);
+static void FreeJitCache(jit_cache *Jit);
+static u32 RunJitBlock(jit_cache *Jit, block_cache *Cache, instruction_table Table, segmented_access At,
+                       u32 OnePastLastByte, decode_mode Mode, segmented_access MainMemory,
+                       register_state_8086 *Registers, lazy_flags *LazyFlags, u64 InstructionLimit, b32 Check);
@@ -0,0 +1,244 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static u32 LengthFromLeadingBytes(instruction_encoding *Inst, u8 FirstByte, u8 SecondByte)
+{
+    // NOTE: This walks the encoding the same way TryDecode does, and works out the size the same way
+    // FinishDecode does, but never looks past the first two bytes, because no 8086 encoding has anything
+    // but displacement and data after those. Returns 0 if the two bytes don't match the encoding.
+    
+    b32 Has[Bits_Count] = {};
+    u32 Bits[Bits_Count] = {};
+    b32 Valid = true;
+    
+    u8 Leading[2] = {FirstByte, SecondByte};
+    u32 ByteCount = 0;
+    
+    u8 BitsPendingCount = 0;
+    u8 BitsPending = 0;
+    for(u32 BitsIndex = 0; Valid && (BitsIndex < ArrayCount(Inst->Bits)); ++BitsIndex)
+    {
+        instruction_bits TestBits = Inst->Bits[BitsIndex];
+        if(TestBits.Usage == Bits_End)
+        {
+            break;
+        }
+        
+        u32 ReadBits = TestBits.Value;
+        if(TestBits.BitCount != 0)
+        {
+            if(BitsPendingCount == 0)
+            {
+                assert(ByteCount < ArrayCount(Leading));
+                if(ByteCount >= ArrayCount(Leading))
+                {
+                    Valid = false;
+                    break;
+                }
+                
+                BitsPendingCount = 8;
+                BitsPending = Leading[ByteCount++];
+            }
+            
+            BitsPendingCount -= TestBits.BitCount;
+            ReadBits = BitsPending;
+            ReadBits >>= BitsPendingCount;
+            ReadBits &= ~(0xff << TestBits.BitCount);
+        }
+        
+        if(TestBits.Usage == Bits_Literal)
+        {
+            Valid = Valid && (ReadBits == TestBits.Value);
+        }
+        else
+        {
+            Bits[TestBits.Usage] |= (ReadBits << TestBits.Shift);
+            Has[TestBits.Usage] = true;
+        }
+    }
+    
+    u32 Result = 0;
+    if(Valid)
+    {
+        u32 Mod = Bits[Bits_MOD];
+        u32 RM = Bits[Bits_RM];
+        u32 W = Bits[Bits_W];
+        b32 S = Bits[Bits_S];
+        
+        b32 HasDirectAddress = ((Mod == 0b00) && (RM == 0b110));
+        b32 HasDisp = ((Has[Bits_Disp]) || (Mod == 0b10) || (Mod == 0b01) || HasDirectAddress);
+        
+        b32 DisplacementIsW = ((Bits[Bits_DispAlwaysW]) || (Mod == 0b10) || HasDirectAddress);
+        b32 DataIsW = ((Bits[Bits_WMakesDataW]) && !S && W);
+        
+        Result = ByteCount;
+        if(HasDisp)
+        {
+            Result += DisplacementIsW ? 2 : 1;
+        }
+        if(Has[Bits_Data])
+        {
+            Result += DataIsW ? 2 : 1;
+        }
+    }
+    
+    return Result;
+}
+
+static length_table GlobalLengthTable;
+
+static length_table *BuildLengthTable(length_table *Lengths, instruction_table Table)
+{
+    // NOTE: Encodings are tried in the same order the lookup decoder tries them, so the first one that
+    // matches is the one the decoder would have used. Without a lookup, there is no length table either.
+    
+    length_table *Result = 0;
+    
+    instruction_lookup *Lookup = GetInstructionLookup(Table);
+    if(Lookup)
+    {
+        for(u32 FirstByte = 0; FirstByte < 256; ++FirstByte)
+        {
+            for(u32 SecondByte = 0; SecondByte < 256; ++SecondByte)
+            {
+                u8 Length = 0;
+                
+                decode_candidates *Candidates = &Lookup->Candidates[FirstByte][(SecondByte >> 3) & 0x7];
+                for(u32 CandidateIndex = 0; CandidateIndex < Candidates->Count; ++CandidateIndex)
+                {
+                    instruction_encoding *Inst = Table.Encodings + Candidates->EncodingIndex[CandidateIndex];
+                    u32 Size = LengthFromLeadingBytes(Inst, (u8)FirstByte, (u8)SecondByte);
+                    if(Size)
+                    {
+                        b32 IsPrefix = ((Inst->Op == Op_lock) ||
+                                        (Inst->Op == Op_rep) ||
+                                        (Inst->Op == Op_segment));
+                        Length = IsPrefix ? LENGTH_PREFIX : (u8)Size;
+                        break;
+                    }
+                }
+                
+                Lengths->Lengths[FirstByte | (SecondByte << 8)] = Length;
+            }
+        }
+        
+        Lengths->MaxInstructionByteCount = Table.MaxInstructionByteCount;
+        Lengths->Encodings = Table.Encodings;
+        Lengths->EncodingCount = Table.EncodingCount;
+        Result = Lengths;
+    }
+    
+    return Result;
+}
+
+static length_table *GetLengthTable(instruction_table Table)
+{
+    /* NOTE: Like the instruction lookup, this is built for the 8086 table exactly once, the first time
+       anything asks for it, and only read from after that, so it is safe to scan from multiple threads
+       without any setup. Any other table gets 0. */
+    
+    static length_table *Lengths8086 = BuildLengthTable(&GlobalLengthTable, Get8086InstructionTable());
+    
+    length_table *Result = 0;
+    if(Lengths8086 &&
+       (Lengths8086->Encodings == Table.Encodings) &&
+       (Lengths8086->EncodingCount == Table.EncodingCount))
+    {
+        Result = Lengths8086;
+    }
+    
+    return Result;
+}
+
+static decode_range_result ScanInstructionBoundaries(instruction_table Table, u32 SourceSize, u8 *Source,
+                                                     u64 *Boundaries)
+{
+    length_table *Lengths = GetLengthTable(Table);
+    u32 MaxSize = Table.MaxInstructionByteCount;
+    
+    u32 BoundaryCount = (SourceSize + 63) / 64;
+    for(u32 Index = 0; Index < BoundaryCount; ++Index)
+    {
+        Boundaries[Index] = 0;
+    }
+    
+    decode_range_result Range = {};
+    
+    // NOTE: Without a length table nothing can be scanned, which looks the same as the first byte not decoding
+    if(!Lengths && SourceSize)
+    {
+        Range.Error = DecodeRange_Unrecognized;
+    }
+    
+    // NOTE: Anything past the end of Source reads as 0, which is what the library's guard buffer would have read
+    
+    u32 Offset = 0;
+    while(Lengths && (Offset < SourceSize))
+    {
+        u32 Start = Offset;
+        u32 Size = 0;
+        u8 Length = 0;
+        for(;;)
+        {
+            u32 At = Start + Size;
+            u16 Leading = 0;
+            if((At + 1) < SourceSize)
+            {
+                memcpy(&Leading, Source + At, sizeof(Leading));
+            }
+            else if(At < SourceSize)
+            {
+                Leading = Source[At];
+            }
+            
+            Length = Lengths->Lengths[Leading];
+            if(Length & LENGTH_PREFIX)
+            {
+                // NOTE: The decoder gives up on prefixes once it has read as many bytes as an instruction
+                // can have, and hands back what it has as an instruction of that size.
+                ++Size;
+                if(Size == MaxSize)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                Size += Length;
+                break;
+            }
+        }
+        
+        if(!Length || (Size > MaxSize))
+        {
+            Range.Error = DecodeRange_Unrecognized;
+        }
+        else if(Size > (SourceSize - Start))
+        {
+            Range.Error = DecodeRange_Truncated;
+        }
+        
+        if(Range.Error)
+        {
+            Range.ErrorOffset = Start;
+            break;
+        }
+        
+        Boundaries[Start >> 6] |= ((u64)1 << (Start & 63));
+        ++Range.InstructionCount;
+        Offset = Start + Size;
+    }
+    
+    Range.ByteCount = Offset;
+    
+    return Range;
+}
@@ -0,0 +1,40 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: The length pre-scan finds where every instruction in a run of code starts, without decoding
+   any of them. On the 8086, how long an instruction is depends only on its first two bytes: the opcode
+   says whether there is a ModRM byte and how big the immediate is, and the ModRM byte says how big the
+   displacement is. Prefixes are one byte each and just get added on to whatever follows them.
+   
+   So the whole decoder boils down to one 64K table of lengths indexed by the first two bytes, and the
+   scan is one table lookup and one add per instruction. The table is filled in by asking the decoder
+   about every pair of bytes, so the scan can never disagree with it about where instructions are. */
+
+#define LENGTH_PREFIX 0x80
+
+struct length_table
+{
+    instruction_encoding *Encodings;
+    u32 EncodingCount;
+    u32 MaxInstructionByteCount;
+    
+    u8 Lengths[256*256]; // NOTE: [first byte | (second byte << 8)]. 0 if nothing decodes, LENGTH_PREFIX for prefixes
+};
+
+static length_table *GetLengthTable(instruction_table Table);
+
+// NOTE: Boundaries gets one bit per byte of Source, (SourceSize + 63)/64 u64s in all. A bit is set
+// where an instruction starts. The scan stops at the first instruction that is unrecognized or runs
+// past the end of Source, exactly where decoding the same bytes would have stopped, and no bits are set
+// from there on. The result says where that was, just like decoding would.
+static decode_range_result ScanInstructionBoundaries(instruction_table Table, u32 SourceSize, u8 *Source,
+                                                     u64 *Boundaries);
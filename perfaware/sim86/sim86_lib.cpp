@@ -12,19 +12,33 @@
 
 #define assert(...)
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "sim86.h"
 
 #include "sim86_instruction.h"
 #include "sim86_instruction_table.h"
 #include "sim86_memory.h"
 #include "sim86_decode.h"
+#include "sim86_length.h"
+#include "sim86_state.h"
+#include "sim86_execute.h"
 
 #include "sim86_instruction.cpp"
 #include "sim86_instruction_table.cpp"
 #include "sim86_memory.cpp"
 #include "sim86_decode.cpp"
+#include "sim86_length.cpp"
+#include "sim86_execute.cpp"
 #include "sim86_text_table.cpp"
 
+struct sim86_machine
+{
+    segmented_access Memory;
+    register_state_8086 Registers;
+};
+
 extern "C" u32 Sim86_GetVersion(void)
 {
     u32 Result = SIM86_VERSION;
@@ -55,6 +69,191 @@ extern "C" void Sim86_Decode8086Instruction(u32 SourceSize, u8 *Source, instruct
     *Dest = DecodeInstruction(Table, At);
 }
 
+static void StoreColumns(instruction_columns *Columns, u32 Index, instruction *Instruction)
+{
+    // NOTE: Columns that were left null are skipped, so callers only pay for what they look at
+    if(Columns->Address) {Columns->Address[Index] = Instruction->Address;}
+    if(Columns->Size) {Columns->Size[Index] = (u8)Instruction->Size;}
+    if(Columns->Op) {Columns->Op[Index] = (u8)Instruction->Op;}
+    if(Columns->Flags) {Columns->Flags[Index] = (u8)Instruction->Flags;}
+    if(Columns->SegmentOverride) {Columns->SegmentOverride[Index] = (u8)Instruction->SegmentOverride;}
+    
+    for(u32 OperandIndex = 0; OperandIndex < ArrayCount(Instruction->Operands); ++OperandIndex)
+    {
+        instruction_operand *Operand = Instruction->Operands + OperandIndex;
+        
+        u8 RegisterIndex = 0;
+        u8 RegisterOffset = 0;
+        u8 RegisterCount = 0;
+        u8 SecondRegisterIndex = 0;
+        s32 Displacement = 0;
+        s32 Immediate = 0;
+        u16 ExplicitSegment = 0;
+        u8 OperandFlags = 0;
+        
+        switch(Operand->Type)
+        {
+            case Operand_None:
+            {
+            } break;
+            
+            case Operand_Register:
+            {
+                RegisterIndex = (u8)Operand->Register.Index;
+                RegisterOffset = (u8)Operand->Register.Offset;
+                RegisterCount = (u8)Operand->Register.Count;
+            } break;
+            
+            case Operand_Memory:
+            {
+                RegisterIndex = (u8)Operand->Address.Terms[0].Register.Index;
+                SecondRegisterIndex = (u8)Operand->Address.Terms[1].Register.Index;
+                Displacement = Operand->Address.Displacement;
+                ExplicitSegment = (u16)Operand->Address.ExplicitSegment;
+                OperandFlags = (u8)Operand->Address.Flags;
+            } break;
+            
+            case Operand_Immediate:
+            {
+                Immediate = Operand->Immediate.Value;
+                OperandFlags = (u8)Operand->Immediate.Flags;
+            } break;
+        }
+        
+        u32 At = OperandIndex*Columns->Capacity + Index;
+        if(Columns->OperandType) {Columns->OperandType[At] = (u8)Operand->Type;}
+        if(Columns->RegisterIndex) {Columns->RegisterIndex[At] = RegisterIndex;}
+        if(Columns->RegisterOffset) {Columns->RegisterOffset[At] = RegisterOffset;}
+        if(Columns->RegisterCount) {Columns->RegisterCount[At] = RegisterCount;}
+        if(Columns->SecondRegisterIndex) {Columns->SecondRegisterIndex[At] = SecondRegisterIndex;}
+        if(Columns->Displacement) {Columns->Displacement[At] = Displacement;}
+        if(Columns->Immediate) {Columns->Immediate[At] = Immediate;}
+        if(Columns->ExplicitSegment) {Columns->ExplicitSegment[At] = ExplicitSegment;}
+        if(Columns->OperandFlags) {Columns->OperandFlags[At] = OperandFlags;}
+    }
+}
+
+static decode_range_result DecodeRange(u32 SourceSize, u8 *Source, u32 DestCount, instruction *Dest,
+                                       instruction_columns *Columns, packed_instruction *Packed)
+{
+    // NOTE: Decodes instructions back to back until the source runs out, the destination fills up,
+    // or something can't be decoded. Each instruction's Address is its offset from Source.
+    
+    instruction_table Table = Get8086InstructionTable();
+    
+    decode_range_result Range = {};
+    
+    // NOTE: Each instruction is decoded through a 16-byte window, the same as Sim86_Decode8086Instruction.
+    // Everything that has a full window after it is decoded in place, so only the last few bytes need
+    // to be copied somewhere that can be safely over-read.
+    u32 WindowSize = 16;
+    assert(Table.MaxInstructionByteCount < WindowSize);
+    u32 TailOffset = (SourceSize > WindowSize) ? (SourceSize - WindowSize) : 0;
+    u8 GuardBuffer[32] = {};
+    for(u32 I = TailOffset; I < SourceSize; ++I)
+    {
+        GuardBuffer[I - TailOffset] = Source[I];
+    }
+    
+    while((Range.ByteCount < SourceSize) && (Range.InstructionCount < DestCount))
+    {
+        u32 Offset = Range.ByteCount;
+        u8 *At = (Offset < TailOffset) ? (Source + Offset) : (GuardBuffer + (Offset - TailOffset));
+        
+        instruction Instruction = DecodeInstruction(Table, FixedMemoryPow2(4, At));
+        if(!Instruction.Op)
+        {
+            Range.Error = DecodeRange_Unrecognized;
+        }
+        else if(Instruction.Size > (SourceSize - Offset))
+        {
+            Range.Error = DecodeRange_Truncated;
+        }
+        
+        if(Range.Error)
+        {
+            Range.ErrorOffset = Offset;
+            break;
+        }
+        
+        Instruction.Address = Offset;
+        if(Dest)
+        {
+            Dest[Range.InstructionCount] = Instruction;
+        }
+        if(Columns)
+        {
+            StoreColumns(Columns, Range.InstructionCount, &Instruction);
+        }
+        if(Packed)
+        {
+            PackInstruction(Instruction, Packed + Range.InstructionCount);
+        }
+        
+        ++Range.InstructionCount;
+        Range.ByteCount += Instruction.Size;
+    }
+    
+    return Range;
+}
+
+extern "C" u32 Sim86_DecodeMany8086Instructions(u32 SourceSize, u8 *Source, u32 DestCount, instruction *Dest,
+                                                decode_range_result *Result)
+{
+    decode_range_result Range = DecodeRange(SourceSize, Source, DestCount, Dest, 0, 0);
+    if(Result)
+    {
+        *Result = Range;
+    }
+    
+    return Range.InstructionCount;
+}
+
+extern "C" u32 Sim86_DecodeMany8086InstructionColumns(u32 SourceSize, u8 *Source, instruction_columns *Dest,
+                                                      decode_range_result *Result)
+{
+    decode_range_result Range = DecodeRange(SourceSize, Source, Dest->Capacity, 0, Dest, 0);
+    if(Result)
+    {
+        *Result = Range;
+    }
+    
+    return Range.InstructionCount;
+}
+
+extern "C" u32 Sim86_DecodeMany8086PackedInstructions(u32 SourceSize, u8 *Source, u32 DestCount, packed_instruction *Dest,
+                                                      decode_range_result *Result)
+{
+    decode_range_result Range = DecodeRange(SourceSize, Source, DestCount, 0, 0, Dest);
+    if(Result)
+    {
+        *Result = Range;
+    }
+    
+    return Range.InstructionCount;
+}
+
+extern "C" void Sim86_Unpack8086Instruction(packed_instruction *Source, instruction *Dest)
+{
+    *Dest = UnpackInstruction(*Source);
+}
+
+extern "C" u32 Sim86_Scan8086InstructionBoundaries(u32 SourceSize, u8 *Source, u64 *Boundaries,
+                                                  decode_range_result *Result)
+{
+    // NOTE: Boundaries needs room for one bit per byte of Source, which is (SourceSize + 63)/64 u64s.
+    // Bit N is set if an instruction starts N bytes in. Nothing is decoded, so this is much faster
+    // than decoding when all you need is to know where the instructions are.
+    instruction_table Table = Get8086InstructionTable();
+    decode_range_result Range = ScanInstructionBoundaries(Table, SourceSize, Source, Boundaries);
+    if(Result)
+    {
+        *Result = Range;
+    }
+    
+    return Range.InstructionCount;
+}
+
 extern "C" char const *Sim86_RegisterNameFromOperand(register_access *RegAccess)
 {
     char const *Result = GetRegName(*RegAccess);
@@ -70,4 +269,171 @@ extern "C" char const *Sim86_MnemonicFromOperationType(operation_type Type)
 extern "C" void Sim86_Get8086InstructionTable(instruction_table *Dest)
 {
     *Dest = Get8086InstructionTable();
-}
\ No newline at end of file
+}
+
+extern "C" sim86_machine *Sim86_CreateMachine(void)
+{
+    // NOTE: A machine starts out with all of its memory and registers zeroed, the same as sim86 -exec
+    sim86_machine *Result = (sim86_machine *)calloc(1, sizeof(sim86_machine));
+    if(Result)
+    {
+        u32 MemorySizePow2 = 20;
+        u8 *Memory = (u8 *)calloc(1, (size_t)1 << MemorySizePow2);
+        if(Memory)
+        {
+            Result->Memory = FixedMemoryPow2(MemorySizePow2, Memory);
+        }
+        else
+        {
+            free(Result);
+            Result = 0;
+        }
+    }
+    
+    return Result;
+}
+
+extern "C" void Sim86_DestroyMachine(sim86_machine *Machine)
+{
+    if(Machine)
+    {
+        free(Machine->Memory.Memory);
+        free(Machine);
+    }
+}
+
+extern "C" u32 Sim86_LoadMachineBytes(sim86_machine *Machine, u32 Address, u32 SourceSize, u8 *Source)
+{
+    // NOTE: Anything that would go past the end of memory is dropped, and the count of bytes that
+    // actually made it in is returned
+    u32 MemorySize = GetHighestAddress(Machine->Memory) + 1;
+    u32 Result = 0;
+    if(Address < MemorySize)
+    {
+        Result = ((MemorySize - Address) < SourceSize) ? (MemorySize - Address) : SourceSize;
+        for(u32 I = 0; I < Result; ++I)
+        {
+            Machine->Memory.Memory[Address + I] = Source[I];
+        }
+    }
+    
+    return Result;
+}
+
+extern "C" u8 *Sim86_GetMachineMemory(sim86_machine *Machine, u32 *Size)
+{
+    // NOTE: This is the machine's own memory, not a copy, so anything written here is seen by the next run
+    if(Size)
+    {
+        *Size = GetHighestAddress(Machine->Memory) + 1;
+    }
+    
+    return Machine->Memory.Memory;
+}
+
+extern "C" void Sim86_GetMachineRegisters(sim86_machine *Machine, u16 *Dest)
+{
+    for(u32 Index = 0; Index < 16; ++Index)
+    {
+        Dest[Index] = (Index < Register_count) ? Machine->Registers.u16[Index] : 0;
+    }
+}
+
+extern "C" void Sim86_SetMachineRegisters(sim86_machine *Machine, u16 *Source)
+{
+    // NOTE: Index 0 is the always-zero register and index 15 is unused, so whatever is there is ignored
+    for(u32 Index = 1; Index < Register_count; ++Index)
+    {
+        Machine->Registers.u16[Index] = Source[Index];
+    }
+}
+
+extern "C" u32 Sim86_RunMachine(sim86_machine *Machine, u32 OnePastLastByte, u32 MaxInstructions, u32 StopFlags,
+                                machine_step *Steps, machine_run_result *Result)
+{
+    // NOTE: Runs the same way sim86 -exec does, from cs:ip until ip goes to or past OnePastLastByte or
+    // MaxInstructions have run. If Steps is not null, it needs room for MaxInstructions entries, and
+    // gets one per instruction with the instruction and the registers after it ran.
+    instruction_table Table = Get8086InstructionTable();
+    segmented_access Memory = Machine->Memory;
+    register_state_8086 *Registers = &Machine->Registers;
+    
+    machine_run_result Run = {};
+    Run.StopReason = MachineStopped_InstructionLimit;
+    while(Run.InstructionCount < MaxInstructions)
+    {
+        segmented_access At = Memory;
+        At.Mask = 0xffff;
+        At.SegmentBase = Registers->cs;
+        At.SegmentOffset = Registers->ip;
+        Run.StopAddress = GetAbsoluteAddressOf(At);
+        
+        if(Run.StopAddress >= OnePastLastByte)
+        {
+            Run.StopReason = MachineStopped_EndOfCode;
+            break;
+        }
+        
+        instruction Instruction = DecodeInstruction(Table, At);
+        if(!Instruction.Op)
+        {
+            Run.StopReason = MachineStopped_Unrecognized;
+            break;
+        }
+        
+        // NOTE: Like -stoponret, a ret stops the run before it executes, so the machine is left at the ret
+        if((StopFlags & MachineStop_OnRet) && IsRet(Instruction.Op))
+        {
+            Run.StopReason = MachineStopped_Ret;
+            break;
+        }
+        
+        u16 PrevIP = Registers->ip;
+        Registers->ip += Instruction.Size;
+        exec_result Exec = ExecInstruction(Memory, Registers, Instruction);
+        if(Exec.Unimplemented)
+        {
+            Registers->ip = PrevIP;
+            Run.StopReason = MachineStopped_Unimplemented;
+            break;
+        }
+        
+        if(Steps)
+        {
+            machine_step *Step = Steps + Run.InstructionCount;
+            *Step = {};
+            PackInstruction(Instruction, &Step->Instruction);
+            Step->Instruction.Address = Run.StopAddress;
+            Sim86_GetMachineRegisters(Machine, Step->Registers);
+            Step->RepCount = Exec.RepCount;
+            Step->ShiftCount = (u16)Exec.ShiftCount;
+            Step->Flags = ((Exec.BranchTaken ? MachineStep_BranchTaken : 0) |
+                           (Exec.AddressIsUnaligned ? MachineStep_AddressIsUnaligned : 0));
+        }
+        
+        ++Run.InstructionCount;
+        
+        // NOTE: A hlt stops the run after it executes, so the next run picks up after it
+        if((StopFlags & MachineStop_OnHlt) && (Instruction.Op == Op_hlt))
+        {
+            Run.StopReason = MachineStopped_Hlt;
+            break;
+        }
+    }
+    
+    if(Run.StopReason == MachineStopped_InstructionLimit)
+    {
+        segmented_access At = Memory;
+        At.SegmentBase = Registers->cs;
+        At.SegmentOffset = Registers->ip;
+        At.Mask = 0xffff;
+        Run.StopAddress = GetAbsoluteAddressOf(At);
+    }
+    
+    if(Result)
+    {
+        *Result = Run;
+    }
+    
+    return Run.InstructionCount;
+}
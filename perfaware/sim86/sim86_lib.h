@@ -27,9 +27,26 @@ externc
 endif
 u32 Sim86_GetVersion(void);
 void Sim86_Decode8086Instruction(u32 SourceSize, u8 *Source, instruction *Dest);
+u32 Sim86_DecodeMany8086Instructions(u32 SourceSize, u8 *Source, u32 DestCount, instruction *Dest,
+                                     decode_range_result *Result);
+u32 Sim86_DecodeMany8086InstructionColumns(u32 SourceSize, u8 *Source, instruction_columns *Dest,
+                                           decode_range_result *Result);
+u32 Sim86_DecodeMany8086PackedInstructions(u32 SourceSize, u8 *Source, u32 DestCount, packed_instruction *Dest,
+                                           decode_range_result *Result);
+void Sim86_Unpack8086Instruction(packed_instruction *Source, instruction *Dest);
+u32 Sim86_Scan8086InstructionBoundaries(u32 SourceSize, u8 *Source, u64 *Boundaries,
+                                        decode_range_result *Result);
 char const *Sim86_RegisterNameFromOperand(register_access *RegAccess);
 char const *Sim86_MnemonicFromOperationType(operation_type Type);
 void Sim86_Get8086InstructionTable(instruction_table *Dest);
+sim86_machine *Sim86_CreateMachine(void);
+void Sim86_DestroyMachine(sim86_machine *Machine);
+u32 Sim86_LoadMachineBytes(sim86_machine *Machine, u32 Address, u32 SourceSize, u8 *Source);
+u8 *Sim86_GetMachineMemory(sim86_machine *Machine, u32 *Size);
+void Sim86_GetMachineRegisters(sim86_machine *Machine, u16 *Dest);
+void Sim86_SetMachineRegisters(sim86_machine *Machine, u16 *Source);
+u32 Sim86_RunMachine(sim86_machine *Machine, u32 OnePastLastByte, u32 MaxInstructions, u32 StopFlags,
+                     machine_step *Steps, machine_run_result *Result);
 ifdefcpp
 closebrace
 endif
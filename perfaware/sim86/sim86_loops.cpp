@@ -0,0 +1,270 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static b32 IsBackwardJump(instruction Instruction, u32 *Target)
+{
+    // NOTE: call also has a relative displacement, but it comes back, so it doesn't close a loop
+    b32 Result = false;
+    
+    if(Instruction.Op != Op_call)
+    {
+        for(u32 OperandIndex = 0; OperandIndex < ArrayCount(Instruction.Operands); ++OperandIndex)
+        {
+            instruction_operand Operand = Instruction.Operands[OperandIndex];
+            if((Operand.Type == Operand_Immediate) &&
+               (Operand.Immediate.Flags & Immediate_RelativeJumpDisplacement))
+            {
+                s64 Destination = (s64)Instruction.Address + Instruction.Size + Operand.Immediate.Value;
+                if((Destination >= 0) && (Destination <= Instruction.Address))
+                {
+                    *Target = (u32)Destination;
+                    Result = true;
+                }
+            }
+        }
+    }
+    
+    return Result;
+}
+
+static b32 FindInstructionIndex(u32 *Addresses, u32 Count, u32 Address, u32 *Index)
+{
+    // NOTE: Addresses are in increasing order, since they come straight out of a linear decode
+    b32 Result = false;
+    
+    u32 Low = 0;
+    u32 High = Count;
+    while(Low < High)
+    {
+        u32 Mid = Low + (High - Low) / 2;
+        if(Addresses[Mid] < Address)
+        {
+            Low = Mid + 1;
+        }
+        else
+        {
+            High = Mid;
+        }
+    }
+    
+    if((Low < Count) && (Addresses[Low] == Address))
+    {
+        *Index = Low;
+        Result = true;
+    }
+    
+    return Result;
+}
+
+static instruction DecodeAtAddress(instruction_table Table, segmented_access Image, u32 Address, decode_mode Mode)
+{
+    segmented_access At = Image;
+    At.SegmentBase = (u16)(Address >> 4);
+    At.SegmentOffset = (u16)(Address & 0xf);
+    
+    instruction Result = DecodeInstruction(Table, At, Mode);
+    return Result;
+}
+
+static void AddLoopClocks(loop_clocks *Dest, instruction Instruction, b32 Assume8088, b32 Taken)
+{
+    timing_state State = {};
+    State.Assume8088 = Assume8088;
+    State.AssumeBranchTaken = Taken;
+    
+    instruction_timing Timing = EstimateInstructionClocks(State, Instruction);
+    instruction_clock_interval Clocks = ExpectedClocksFrom(State, Instruction, Timing);
+    
+    Dest->Clocks.Min += Clocks.Min;
+    Dest->Clocks.Max += Clocks.Max;
+    Dest->EAClocks += Timing.EAClocks;
+    
+    // NOTE: Whatever ExpectedClocksFrom added on top of the base and EA clocks is the penalty for the transfers
+    Dest->TransferClocks += BUS_CYCLE_CLOCKS*Timing.Transfers + (Clocks.Min - (Timing.Base.Min + Timing.EAClocks));
+}
+
+static loop_analysis AnalyzeLoops(instruction_table Table, segmented_access Image, u32 ByteCount, decode_mode Mode)
+{
+    loop_analysis Result = {};
+    
+    // NOTE: Every instruction is at least one byte and every jump at least two, which bounds both arrays
+    u32 *Addresses = (u32 *)malloc((ByteCount + 1)*sizeof(u32));
+    u32 *BranchIndices = (u32 *)malloc((ByteCount/2 + 1)*sizeof(u32));
+    u32 *Targets = (u32 *)malloc((ByteCount/2 + 1)*sizeof(u32));
+    Result.Loops = (static_loop *)calloc(ByteCount/2 + 1, sizeof(static_loop));
+    
+    if(Addresses && BranchIndices && Targets && Result.Loops)
+    {
+        u32 BranchCount = 0;
+        
+        segmented_access At = Image;
+        u32 Count = ByteCount;
+        while(Count)
+        {
+            instruction Instruction = DecodeInstruction(Table, At, Mode);
+            if(!Instruction.Op)
+            {
+                Result.Stop = DecodeRange_Unrecognized;
+            }
+            else if(Instruction.Size > Count)
+            {
+                Result.Stop = DecodeRange_Truncated;
+            }
+            
+            if(Result.Stop)
+            {
+                Result.StopAddress = GetAbsoluteAddressOf(At);
+                break;
+            }
+            
+            u32 Target = 0;
+            if(IsBackwardJump(Instruction, &Target))
+            {
+                BranchIndices[BranchCount] = Result.InstructionCount;
+                Targets[BranchCount] = Target;
+                ++BranchCount;
+            }
+            
+            Addresses[Result.InstructionCount++] = Instruction.Address;
+            At = MoveBaseBy(At, Instruction.Size);
+            Count -= Instruction.Size;
+        }
+        
+        // NOTE: A jump into the middle of an instruction isn't a loop anyone can reason about, so those are skipped
+        u32 *FirstIndices = Targets;
+        for(u32 BranchIndex = 0; BranchIndex < BranchCount; ++BranchIndex)
+        {
+            u32 FirstIndex = 0;
+            if(FindInstructionIndex(Addresses, Result.InstructionCount, Targets[BranchIndex], &FirstIndex))
+            {
+                static_loop *Loop = Result.Loops + Result.LoopCount;
+                Loop->FirstAddress = Targets[BranchIndex];
+                Loop->BranchAddress = Addresses[BranchIndices[BranchIndex]];
+                Loop->InstructionCount = BranchIndices[BranchIndex] - FirstIndex + 1;
+                
+                FirstIndices[Result.LoopCount] = FirstIndex;
+                BranchIndices[Result.LoopCount] = BranchIndices[BranchIndex];
+                ++Result.LoopCount;
+            }
+        }
+        
+        for(u32 LoopIndex = 0; LoopIndex < Result.LoopCount; ++LoopIndex)
+        {
+            static_loop *Loop = Result.Loops + LoopIndex;
+            
+            // NOTE: Loops are in order of where their jumps are, so anything inside this one comes right before it
+            for(u32 InnerIndex = LoopIndex; InnerIndex > 0; --InnerIndex)
+            {
+                static_loop *Inner = Result.Loops + InnerIndex - 1;
+                if(Inner->BranchAddress < Loop->FirstAddress)
+                {
+                    break;
+                }
+                
+                if(Inner->FirstAddress >= Loop->FirstAddress)
+                {
+                    ++Loop->InnerLoopCount;
+                }
+            }
+            
+            u32 LastIndex = BranchIndices[LoopIndex];
+            for(u32 Index = FirstIndices[LoopIndex]; Index <= LastIndex; ++Index)
+            {
+                instruction Instruction = DecodeAtAddress(Table, Image, Addresses[Index], Mode);
+                b32 Taken = (Index == LastIndex);
+                AddLoopClocks(&Loop->Clocks8086, Instruction, false, Taken);
+                AddLoopClocks(&Loop->Clocks8088, Instruction, true, Taken);
+            }
+        }
+    }
+    
+    free(Addresses);
+    free(BranchIndices);
+    free(Targets);
+    
+    return Result;
+}
+
+static int CompareLoops(void const *AInit, void const *BInit)
+{
+    static_loop const *A = (static_loop const *)AInit;
+    static_loop const *B = (static_loop const *)BInit;
+    
+    // NOTE: Most clocks per iteration first, and lowest address first among equals
+    int Result = ((A->Clocks8086.Clocks.Min > B->Clocks8086.Clocks.Min) ? -1 :
+                  (A->Clocks8086.Clocks.Min < B->Clocks8086.Clocks.Min) ? 1 :
+                  (A->BranchAddress < B->BranchAddress) ? -1 :
+                  (A->BranchAddress > B->BranchAddress) ? 1 : 0);
+    return Result;
+}
+
+static void PrintLoopClocks(loop_clocks Clocks, text_buffer *Out)
+{
+    f64 Total = (f64)Clocks.Clocks.Min;
+    f64 EAPercent = Total ? 100.0*(f64)Clocks.EAClocks / Total : 0.0;
+    f64 TransferPercent = Total ? 100.0*(f64)Clocks.TransferClocks / Total : 0.0;
+    EmitFormatted(Out, "%9u%c %5.1f %6.1f",
+                  Clocks.Clocks.Min, (Clocks.Clocks.Min != Clocks.Clocks.Max) ? '*' : ' ',
+                  EAPercent, TransferPercent);
+}
+
+static void PrintLoopAnalysis(loop_analysis *Analysis, segmented_access Image, text_buffer *Out)
+{
+    qsort(Analysis->Loops, Analysis->LoopCount, sizeof(static_loop), CompareLoops);
+    
+    EmitFormatted(Out, "Loops: %u found in %u instructions, clocks are per iteration\n\n",
+                  Analysis->LoopCount, Analysis->InstructionCount);
+    if(Analysis->LoopCount)
+    {
+        EmitString(Out, " 8086 clks   EA%  Xfer%  8088 clks   EA%  Xfer%   8088-8086  Instrs  Inner    First   Branch  Instruction\n");
+    }
+    
+    instruction_table Table = Get8086InstructionTable();
+    b32 AnyRanges = false;
+    for(u32 LoopIndex = 0; LoopIndex < Analysis->LoopCount; ++LoopIndex)
+    {
+        static_loop *Loop = Analysis->Loops + LoopIndex;
+        
+        PrintLoopClocks(Loop->Clocks8086, Out);
+        PrintLoopClocks(Loop->Clocks8088, Out);
+        
+        s32 Difference = (s32)Loop->Clocks8088.Clocks.Min - (s32)Loop->Clocks8086.Clocks.Min;
+        EmitFormatted(Out, " %+11d %7u %6u  0x%05x  0x%05x  ",
+                      Difference, Loop->InstructionCount, Loop->InnerLoopCount, Loop->FirstAddress, Loop->BranchAddress);
+        
+        PrintInstruction(DecodeAtAddress(Table, Image, Loop->BranchAddress, DecodeMode_Lookup), Out);
+        EmitChar(Out, '\n');
+        
+        AnyRanges |= ((Loop->Clocks8086.Clocks.Min != Loop->Clocks8086.Clocks.Max) ||
+                      (Loop->Clocks8088.Clocks.Min != Loop->Clocks8088.Clocks.Max));
+    }
+    
+    if(AnyRanges)
+    {
+        EmitString(Out, "\n* The estimate is a range, and this is the low end of it\n");
+    }
+    
+    if(Analysis->Stop)
+    {
+        EmitFormatted(Out, "\nDecoding stopped at 0x%05x (%s), so anything after that was not looked at\n",
+                      Analysis->StopAddress,
+                      (Analysis->Stop == DecodeRange_Unrecognized) ? "unrecognized instruction" : "instruction runs past the end");
+    }
+    
+    EmitChar(Out, '\n');
+}
+
+static void FreeLoopAnalysis(loop_analysis *Analysis)
+{
+    free(Analysis->Loops);
+    *Analysis = {};
+}
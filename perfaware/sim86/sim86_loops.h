@@ -0,0 +1,52 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: Static loop analysis, for -loops. The image is decoded from the start the same way disassembly
+   decodes it, and every relative jump that goes backward to an instruction boundary is taken to close
+   a loop that runs from its target up through the jump. Nothing is executed.
+   
+   Each loop is costed as one pass through its body as straight-line code, using the same estimates
+   -showclocks prints: the jump that closes the loop is taken, every other branch in the body falls
+   through, and rep and shift counts are 0. A loop with loops inside it gets one pass through each of
+   them. Every loop is costed for both the 8086 and the 8088, whatever -8088 says. */
+
+struct loop_clocks
+{
+    instruction_clock_interval Clocks; // NOTE: Per iteration
+    u32 EAClocks;
+    u32 TransferClocks; // NOTE: 4 clocks per bus transfer, plus the penalty for words that go over the bus a byte at a time
+};
+
+struct static_loop
+{
+    u32 FirstAddress; // NOTE: Where the closing jump goes
+    u32 BranchAddress; // NOTE: The closing jump itself
+    u32 InstructionCount;
+    u32 InnerLoopCount;
+    
+    loop_clocks Clocks8086;
+    loop_clocks Clocks8088;
+};
+
+struct loop_analysis
+{
+    u32 InstructionCount;
+    u32 LoopCount;
+    static_loop *Loops;
+    
+    decode_range_error Stop; // NOTE: Not OK if decoding stopped before the end of the image
+    u32 StopAddress;
+};
+
+static loop_analysis AnalyzeLoops(instruction_table Table, segmented_access Image, u32 ByteCount, decode_mode Mode);
+static void PrintLoopAnalysis(loop_analysis *Analysis, segmented_access Image, text_buffer *Out);
+static void FreeLoopAnalysis(loop_analysis *Analysis);
@@ -49,12 +49,154 @@ static u8 *AccessMemory(segmented_access SegMem, u16 Offset)
     return Result;
 }
 
+static segmented_access SegmentOf(segmented_access SegMem)
+{
+    segmented_access Result = SegMem;
+    Result.SegmentOffset = 0;
+    return Result;
+}
+
+static b32 IsContiguousU16(segmented_access Segment, u16 EffectiveOffset, u32 Address)
+{
+    // NOTE: The second byte is right after the first unless the effective offset wraps around the segment,
+    // or the address wraps around the mask
+    b32 Result = ((EffectiveOffset != 0xffff) && (Address != Segment.Mask));
+    return Result;
+}
+
+static u16 ReadMemoryU16(segmented_access SegMem, u16 Offset)
+{
+    // NOTE: The 8086 is little-endian, and so is everything this is expected to run on
+    u16 Result = 0;
+    
+    segmented_access Segment = SegmentOf(SegMem);
+    u16 EffectiveOffset = (u16)(SegMem.SegmentOffset + Offset);
+    u32 Address = GetAbsoluteAddressOf(Segment, EffectiveOffset);
+    if(IsContiguousU16(Segment, EffectiveOffset, Address))
+    {
+        memcpy(&Result, SegMem.Memory + Address, sizeof(Result));
+    }
+    else
+    {
+        Result = (u16)(*AccessMemory(Segment, EffectiveOffset) |
+                       (*AccessMemory(Segment, (u16)(EffectiveOffset + 1)) << 8));
+    }
+    
+    return Result;
+}
+
+static void WriteMemoryU16(segmented_access SegMem, u16 Offset, u16 Value)
+{
+    segmented_access Segment = SegmentOf(SegMem);
+    u16 EffectiveOffset = (u16)(SegMem.SegmentOffset + Offset);
+    u32 Address = GetAbsoluteAddressOf(Segment, EffectiveOffset);
+    if(IsContiguousU16(Segment, EffectiveOffset, Address))
+    {
+        memcpy(SegMem.Memory + Address, &Value, sizeof(Value));
+        NoteWriteRange(SegMem, Address, Address + 2);
+    }
+    else
+    {
+        u16 HighOffset = (u16)(EffectiveOffset + 1);
+        *AccessMemory(Segment, EffectiveOffset) = (u8)(Value & 0xff);
+        NoteWrite(Segment, EffectiveOffset);
+        *AccessMemory(Segment, HighOffset) = (u8)(Value >> 8);
+        NoteWrite(Segment, HighOffset);
+    }
+}
+
 static b32 IsValid(segmented_access SegMem)
 {
     b32 Result = (SegMem.Mask != 0);
     return Result;
 }
 
+static void ExtendWriteSpan(write_span *Span, u32 FirstAddress, u32 OnePastLastAddress)
+{
+    if(Span->FirstAddress == Span->OnePastLastAddress)
+    {
+        Span->FirstAddress = FirstAddress;
+        Span->OnePastLastAddress = OnePastLastAddress;
+    }
+    else
+    {
+        if(Span->FirstAddress > FirstAddress) Span->FirstAddress = FirstAddress;
+        if(Span->OnePastLastAddress < OnePastLastAddress) Span->OnePastLastAddress = OnePastLastAddress;
+    }
+}
+
+static void NoteWrite(segmented_access SegMem, u16 Offset)
+{
+    code_watch *Watch = SegMem.Watch;
+    if(Watch)
+    {
+        u32 Chunk = GetAbsoluteAddressOf(SegMem, Offset) >> CODE_WATCH_CHUNK_SHIFT;
+        if((Chunk < Watch->ChunkCount) && (Watch->HasCode[Chunk >> 3] & (1 << (Chunk & 7))))
+        {
+            ++Watch->Generation[Chunk];
+            ++Watch->CodeWriteCount;
+        }
+    }
+    
+    if(SegMem.Writes)
+    {
+        u32 Address = GetAbsoluteAddressOf(SegMem, Offset);
+        ExtendWriteSpan(SegMem.Writes, Address, Address + 1);
+    }
+    
+    dirty_pages *Dirty = SegMem.Dirty;
+    if(Dirty)
+    {
+        u32 Page = GetAbsoluteAddressOf(SegMem, Offset) >> DIRTY_PAGE_SHIFT;
+        if(Page < Dirty->PageCount)
+        {
+            Dirty->Bits[Page >> 3] |= (1 << (Page & 7));
+        }
+    }
+}
+
+static void NoteWriteRange(segmented_access SegMem, u32 FirstAddress, u32 OnePastLastAddress)
+{
+    // NOTE: For bulk writes that bypass WriteU8. Each watched chunk the range touches counts as one write.
+    code_watch *Watch = SegMem.Watch;
+    if(Watch && (FirstAddress < OnePastLastAddress))
+    {
+        u32 FirstChunk = FirstAddress >> CODE_WATCH_CHUNK_SHIFT;
+        u32 LastChunk = (OnePastLastAddress - 1) >> CODE_WATCH_CHUNK_SHIFT;
+        for(u32 Chunk = FirstChunk; (Chunk <= LastChunk) && (Chunk < Watch->ChunkCount); ++Chunk)
+        {
+            if(Watch->HasCode[Chunk >> 3] & (1 << (Chunk & 7)))
+            {
+                ++Watch->Generation[Chunk];
+                ++Watch->CodeWriteCount;
+            }
+        }
+    }
+    
+    if(SegMem.Writes && (FirstAddress < OnePastLastAddress))
+    {
+        ExtendWriteSpan(SegMem.Writes, FirstAddress, OnePastLastAddress);
+    }
+    
+    if(SegMem.Dirty)
+    {
+        MarkDirtyPages(SegMem.Dirty, FirstAddress, OnePastLastAddress);
+    }
+}
+
+static void MarkDirtyPages(dirty_pages *Dirty, u32 FirstAddress, u32 OnePastLastAddress)
+{
+    if(FirstAddress < OnePastLastAddress)
+    {
+        u32 FirstPage = FirstAddress >> DIRTY_PAGE_SHIFT;
+        u32 LastPage = (OnePastLastAddress - 1) >> DIRTY_PAGE_SHIFT;
+        for(u32 Page = FirstPage; (Page <= LastPage) && (Page < Dirty->PageCount); ++Page)
+        {
+            Dirty->Bits[Page >> 3] |= (1 << (Page & 7));
+        }
+    }
+}
+
 static segmented_access FixedMemoryPow2(u32 SizePow2, u8 *Memory)
 {
     segmented_access Result = {};
@@ -10,12 +10,44 @@
    
    ======================================================================== */
 
+// NOTE: Code is watched in chunks of 64 bytes. A write to a chunk that has had instructions decoded
+// out of it bumps that chunk's generation, which is how decoded code finds out it is stale.
+#define CODE_WATCH_CHUNK_SHIFT 6
+
+struct code_watch
+{
+    u32 ChunkCount;
+    u8 *HasCode; // NOTE: One bit per chunk
+    u32 *Generation; // NOTE: One per chunk
+    u32 CodeWriteCount; // NOTE: Total number of writes that have landed on watched chunks
+};
+
+// NOTE: For snapshots, main memory is tracked in 4K pages. A write to a page sets that page's bit.
+#define DIRTY_PAGE_SHIFT 12
+
+struct dirty_pages
+{
+    u32 PageCount;
+    u8 *Bits; // NOTE: One bit per page
+};
+
+// NOTE: The span of main memory that has been written to since it was last cleared
+struct write_span
+{
+    u32 FirstAddress;
+    u32 OnePastLastAddress; // NOTE: Equal to FirstAddress when nothing has been written
+};
+
 struct segmented_access
 {
     u8 *Memory;
     u32 Mask;
     u16 SegmentBase;
     u16 SegmentOffset;
+    
+    code_watch *Watch; // NOTE: Optional, only present on accesses to main memory
+    write_span *Writes; // NOTE: Optional, only present on accesses to main memory when tracing
+    dirty_pages *Dirty; // NOTE: Optional, only present on accesses to main memory when taking snapshots
 };
 
 static u32 GetHighestAddress(segmented_access SegMem);
@@ -24,5 +56,15 @@ static segmented_access MoveBaseBy(segmented_access Access, s32 Offset);
 
 static u8 *AccessMemory(segmented_access SegMem, u16 Offset = 0);
 
+// NOTE: 16-bit accesses work on the effective offset, SegmentOffset + Offset, and wrap it around the segment
+// the way the 8086 does. They are done as one unaligned load or store whenever the second byte lands right
+// after the first, which is every case except an effective offset of 0xffff or a first byte at the very top
+// of the mask. Those go a byte at a time, with the second byte at effective offset 0 or address 0.
+static u16 ReadMemoryU16(segmented_access SegMem, u16 Offset = 0);
+static void WriteMemoryU16(segmented_access SegMem, u16 Offset, u16 Value);
+
 static b32 IsValid(segmented_access SegMem);
+static void NoteWrite(segmented_access SegMem, u16 Offset = 0);
+static void NoteWriteRange(segmented_access SegMem, u32 FirstAddress, u32 OnePastLastAddress);
+static void MarkDirtyPages(dirty_pages *Dirty, u32 FirstAddress, u32 OnePastLastAddress);
 static segmented_access FixedMemoryPow2(u32 SizePow2, u8 *Memory);
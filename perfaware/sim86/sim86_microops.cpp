@@ -0,0 +1,463 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+enum micro_operand_shape
+{
+    MicroShape_Other,
+    MicroShape_None,
+    MicroShape_Register,
+    MicroShape_Immediate,
+    MicroShape_Memory,
+};
+
+static micro_operand_shape ClassifyMicroOperand(micro_op *Op, instruction *Instruction, u32 OperandIndex, u32 WWidth)
+{
+    micro_operand_shape Result = MicroShape_Other;
+    
+    instruction_operand Operand = Instruction->Operands[OperandIndex];
+    switch(Operand.Type)
+    {
+        case Operand_None:
+        {
+            Result = MicroShape_None;
+        } break;
+        
+        case Operand_Register:
+        {
+            // NOTE: ExecInstruction writes WWidth bytes through a Count-sized window onto the register,
+            // which does odd things when they disagree (mov to a segment register, for example).
+            // Those are left to the generic path.
+            if(Operand.Register.Count == WWidth)
+            {
+                u8 ByteOffset = (u8)(2*(Operand.Register.Index % Register_count) + Operand.Register.Offset);
+                if(OperandIndex == 0)
+                {
+                    Op->Reg0 = ByteOffset;
+                }
+                else
+                {
+                    Op->Reg1 = ByteOffset;
+                }
+                
+                Result = MicroShape_Register;
+            }
+        } break;
+        
+        case Operand_Memory:
+        {
+            effective_address_expression Address = Operand.Address;
+            if(!(Address.Flags & Address_ExplicitSegment) &&
+               (Address.Terms[0].Scale == 1) &&
+               (Address.Terms[1].Scale == 1))
+            {
+                u32 Term0 = Address.Terms[0].Register.Index % Register_count;
+                u32 Term1 = Address.Terms[1].Register.Index % Register_count;
+                
+                Op->SegReg = ((Instruction->SegmentOverride) ? (u8)(Instruction->SegmentOverride % Register_count) :
+                              (Term0 == Register_bp) ? (u8)Register_ss : (u8)Register_ds);
+                Op->Term0 = (u8)Term0;
+                Op->Term1 = (u8)Term1;
+                Op->Disp = (u16)Address.Displacement;
+                
+                Result = MicroShape_Memory;
+            }
+        } break;
+        
+        case Operand_Immediate:
+        {
+            Op->Imm = Operand.Immediate.Value;
+            Result = MicroShape_Immediate;
+        } break;
+    }
+    
+    return Result;
+}
+
+static micro_op_kind BinaryMicroOpKind(micro_op_kind RRKind, micro_operand_shape Shape0, micro_operand_shape Shape1)
+{
+    u32 Offset = 0xffffffff;
+    if(Shape0 == MicroShape_Register)
+    {
+        if(Shape1 == MicroShape_Register) Offset = 0;
+        if(Shape1 == MicroShape_Immediate) Offset = 1;
+        if(Shape1 == MicroShape_Memory) Offset = 2;
+    }
+    else if(Shape0 == MicroShape_Memory)
+    {
+        if(Shape1 == MicroShape_Register) Offset = 3;
+        if(Shape1 == MicroShape_Immediate) Offset = 4;
+    }
+    
+    micro_op_kind Result = (Offset != 0xffffffff) ? (micro_op_kind)(RRKind + Offset) : MicroOp_Generic;
+    return Result;
+}
+
+static micro_op LowerToMicroOp(instruction *Instruction)
+{
+    micro_op Result = {};
+    Result.Instruction = Instruction;
+    Result.Kind = MicroOp_Generic;
+    Result.Size = (u8)Instruction->Size;
+    
+    u32 WWidth = (Instruction->Flags & Inst_Wide) ? 2 : 1;
+    Result.Width = (u8)WWidth;
+    
+    switch(Instruction->Op)
+    {
+        case Op_mov:
+        case Op_add:
+        case Op_sub:
+        case Op_cmp:
+        case Op_and:
+        case Op_or:
+        case Op_xor:
+        case Op_test:
+        {
+            micro_op_kind RRKind = MicroOp_Generic;
+            switch(Instruction->Op)
+            {
+                case Op_mov: {RRKind = MicroOp_mov_RR;} break;
+                case Op_add: {RRKind = MicroOp_add_RR;} break;
+                case Op_sub: {RRKind = MicroOp_sub_RR;} break;
+                case Op_cmp: {RRKind = MicroOp_cmp_RR;} break;
+                case Op_and: {RRKind = MicroOp_and_RR;} break;
+                case Op_or: {RRKind = MicroOp_or_RR;} break;
+                case Op_xor: {RRKind = MicroOp_xor_RR;} break;
+                case Op_test: {RRKind = MicroOp_test_RR;} break;
+                default: {} break;
+            }
+            
+            micro_operand_shape Shape0 = ClassifyMicroOperand(&Result, Instruction, 0, WWidth);
+            micro_operand_shape Shape1 = ClassifyMicroOperand(&Result, Instruction, 1, WWidth);
+            Result.Kind = BinaryMicroOpKind(RRKind, Shape0, Shape1);
+        } break;
+        
+        case Op_inc:
+        case Op_dec:
+        {
+            micro_operand_shape Shape0 = ClassifyMicroOperand(&Result, Instruction, 0, WWidth);
+            micro_operand_shape Shape1 = ClassifyMicroOperand(&Result, Instruction, 1, WWidth);
+            if(Shape1 == MicroShape_None)
+            {
+                b32 IsInc = (Instruction->Op == Op_inc);
+                if(Shape0 == MicroShape_Register)
+                {
+                    Result.Kind = IsInc ? MicroOp_inc_R : MicroOp_dec_R;
+                }
+                else if(Shape0 == MicroShape_Memory)
+                {
+                    Result.Kind = IsInc ? MicroOp_inc_M : MicroOp_dec_M;
+                }
+            }
+        } break;
+        
+        case Op_push:
+        case Op_pop:
+        {
+            // NOTE: The stack is always accessed a word at a time, regardless of the W bit
+            micro_operand_shape Shape0 = ClassifyMicroOperand(&Result, Instruction, 0, 2);
+            if(Shape0 == MicroShape_Register)
+            {
+                Result.Kind = (Instruction->Op == Op_push) ? MicroOp_push_R : MicroOp_pop_R;
+            }
+        } break;
+        
+        case Op_je:
+        case Op_jl:
+        case Op_jle:
+        case Op_jb:
+        case Op_jbe:
+        case Op_jp:
+        case Op_jo:
+        case Op_js:
+        case Op_jne:
+        case Op_jnl:
+        case Op_jg:
+        case Op_jnb:
+        case Op_ja:
+        case Op_jnp:
+        case Op_jno:
+        case Op_jns:
+        case Op_loop:
+        case Op_loopz:
+        case Op_loopnz:
+        case Op_jcxz:
+        {
+            if(ClassifyMicroOperand(&Result, Instruction, 0, WWidth) == MicroShape_Immediate)
+            {
+                Result.Kind = MicroOp_jump;
+            }
+        } break;
+        
+        default: {} break;
+    }
+    
+    return Result;
+}
+
+//
+// NOTE: Everything below here has to compute exactly what ExecInstruction would compute for the same
+// instruction, quirks included, so it is written in terms of the same helpers wherever possible.
+//
+
+static u32 ReadMicroReg(register_state_8086 *Registers, u32 ByteOffset, u32 WWidth)
+{
+    u8 *Reg = (u8 *)Registers + ByteOffset;
+    u32 Result = (WWidth == 2) ? *(u16 *)Reg : *Reg;
+    return Result;
+}
+
+static void WriteMicroReg(register_state_8086 *Registers, u32 ByteOffset, u32 WWidth, u32 Value)
+{
+    u8 *Reg = (u8 *)Registers + ByteOffset;
+    if(WWidth == 2)
+    {
+        *(u16 *)Reg = (u16)Value;
+    }
+    else
+    {
+        *Reg = (u8)Value;
+    }
+}
+
+static segmented_access MicroMemoryOperand(segmented_access Memory, register_state_8086 *Registers, micro_op *Op,
+                                           exec_result *Result)
+{
+    segmented_access Access = {};
+    Access.Memory = Memory.Memory;
+    Access.Watch = Memory.Watch;
+    Access.Writes = Memory.Writes;
+    Access.Dirty = Memory.Dirty;
+    Access.Mask = 0xffff;
+    Access.SegmentBase = Registers->u16[Op->SegReg];
+    Access.SegmentOffset = Op->Disp + Registers->u16[Op->Term0] + Registers->u16[Op->Term1];
+    
+    Result->AddressIsUnaligned |= (Access.SegmentOffset & 1);
+    
+    return Access;
+}
+
+static u32 MicroAdd(register_state_8086 *Registers, lazy_flags *LazyFlags, u32 V0, u32 V1, u32 WWidth)
+{
+    u32 Mask = WidthMaskFor(WWidth);
+    u32 R = (V0 & Mask) + (V1 & Mask);
+    ProduceFlags(Registers, LazyFlags, FlagsOp_Add, V0, V1, R, WWidth);
+    
+    u32 Result = R & Mask;
+    return Result;
+}
+
+static u32 MicroSub(register_state_8086 *Registers, lazy_flags *LazyFlags, u32 V0, u32 V1, u32 WWidth)
+{
+    u32 Mask = WidthMaskFor(WWidth);
+    u32 R = (V0 & Mask) - (V1 & Mask);
+    ProduceFlags(Registers, LazyFlags, FlagsOp_Sub, V0, V1, R, WWidth);
+    
+    u32 Result = R & Mask;
+    return Result;
+}
+
+static u32 MicroLog(register_state_8086 *Registers, lazy_flags *LazyFlags, u32 V0, u32 V1, u16 UnmaskedResult, u32 WWidth)
+{
+    u32 Result = UnmaskedResult & WidthMaskFor(WWidth);
+    ProduceFlags(Registers, LazyFlags, FlagsOp_Log, V0, V1, Result, WWidth);
+    return Result;
+}
+
+static u32 MicroTest(register_state_8086 *Registers, lazy_flags *LazyFlags, u32 V0, u32 V1, u32 WWidth)
+{
+    // NOTE: ExecInstruction does not mask the result of TEST before setting the flags, so neither does this
+    ProduceFlags(Registers, LazyFlags, FlagsOp_Log, V0, V1, (u16)(V0 & V1), WWidth);
+    return 0;
+}
+
+static u32 MicroIncDec(register_state_8086 *Registers, lazy_flags *LazyFlags, u32 V0, u32 R, u32 WWidth)
+{
+    ProduceFlags(Registers, LazyFlags, FlagsOp_Arith, V0, 1, R, WWidth);
+    
+    u32 Result = R & WidthMaskFor(WWidth);
+    return Result;
+}
+
+static exec_result ExecMicroOps(segmented_access Memory, register_state_8086 *Registers, micro_op *Op, u32 Count,
+                                u32 *RunCount, lazy_flags *LazyFlags)
+{
+    exec_result Result = {};
+    
+    u32 WWidth = Op->Width;
+    u32 Run = 0;
+    code_watch *Watch = Memory.Watch;
+    u32 CodeWriteCount = Watch ? Watch->CodeWriteCount : 0;
+    
+    // NOTE: An op goes on to the next one itself, so long as there is one, it isn't generic, and nothing
+    // has been written over code since the chain started (which could mean the ops after this one are stale)
+#define MICRO_OP_CHAINS \
+    ((++Run < Count) && (Op[1].Kind != MicroOp_Generic) && \
+     (!Watch || (Watch->CodeWriteCount == CodeWriteCount)))
+#define MICRO_OP_ADVANCE \
+    ++Op; \
+    Registers->ip += Op->Size; \
+    WWidth = Op->Width; \
+    Result = {}
+
+#if MICRO_OPS_THREADED
+    static void const *Handlers[] =
+    {
+#define MICRO_OP(Name) &&Handle_##Name,
+        MICRO_OP_KINDS
+#undef MICRO_OP
+    };
+    static_assert(ArrayCount(Handlers) == MicroOp_Count, "Missing micro-op handler");
+    
+    // NOTE: Every handler ends in its own indirect jump to the next op's handler, instead of all of them
+    // sharing one, so the branch predictor gets to learn which op tends to follow which
+    goto *Handlers[Op->Kind];
+#define MICRO_OP_HANDLER(Name) Handle_##Name:
+#define MICRO_OP_DONE \
+    if(MICRO_OP_CHAINS) \
+    { \
+        MICRO_OP_ADVANCE; \
+        goto *Handlers[Op->Kind]; \
+    } \
+    goto Done
+#else
+#define MICRO_OP_HANDLER(Name) case MicroOp_##Name:
+#define MICRO_OP_DONE break
+    for(;;)
+    {
+    switch(Op->Kind)
+    {
+#endif
+    
+    // NOTE: Shapes for ops that combine both operands into Op0. Expr is evaluated with V0 and V1 in scope,
+    // and its result is written back only if WriteBack is set.
+#define MICRO_OP_BINARY_HANDLERS(Name, Expr, WriteBack) \
+    MICRO_OP_HANDLER(Name##_RR) \
+    { \
+        u32 V0 = ReadMicroReg(Registers, Op->Reg0, WWidth); \
+        u32 V1 = ReadMicroReg(Registers, Op->Reg1, WWidth); \
+        u32 R = (Expr); \
+        if(WriteBack) WriteMicroReg(Registers, Op->Reg0, WWidth, R); \
+    } MICRO_OP_DONE; \
+    MICRO_OP_HANDLER(Name##_RI) \
+    { \
+        u32 V0 = ReadMicroReg(Registers, Op->Reg0, WWidth); \
+        u32 V1 = Op->Imm; \
+        u32 R = (Expr); \
+        if(WriteBack) WriteMicroReg(Registers, Op->Reg0, WWidth, R); \
+    } MICRO_OP_DONE; \
+    MICRO_OP_HANDLER(Name##_RM) \
+    { \
+        u32 V0 = ReadMicroReg(Registers, Op->Reg0, WWidth); \
+        u32 V1 = ReadU16(MicroMemoryOperand(Memory, Registers, Op, &Result), 0); \
+        u32 R = (Expr); \
+        if(WriteBack) WriteMicroReg(Registers, Op->Reg0, WWidth, R); \
+    } MICRO_OP_DONE; \
+    MICRO_OP_HANDLER(Name##_MR) \
+    { \
+        segmented_access Dest = MicroMemoryOperand(Memory, Registers, Op, &Result); \
+        u32 V0 = ReadU16(Dest, 0); \
+        u32 V1 = ReadMicroReg(Registers, Op->Reg1, WWidth); \
+        u32 R = (Expr); \
+        if(WriteBack) WriteN(Dest, 0, R, WWidth); \
+    } MICRO_OP_DONE; \
+    MICRO_OP_HANDLER(Name##_MI) \
+    { \
+        segmented_access Dest = MicroMemoryOperand(Memory, Registers, Op, &Result); \
+        u32 V0 = ReadU16(Dest, 0); \
+        u32 V1 = Op->Imm; \
+        u32 R = (Expr); \
+        if(WriteBack) WriteN(Dest, 0, R, WWidth); \
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_BINARY_HANDLERS(mov, ((void)V0, V1), true)
+    MICRO_OP_BINARY_HANDLERS(add, MicroAdd(Registers, LazyFlags, V0, V1, WWidth), true)
+    MICRO_OP_BINARY_HANDLERS(sub, MicroSub(Registers, LazyFlags, V0, V1, WWidth), true)
+    MICRO_OP_BINARY_HANDLERS(cmp, MicroSub(Registers, LazyFlags, V0, V1, WWidth), false)
+    MICRO_OP_BINARY_HANDLERS(and, MicroLog(Registers, LazyFlags, V0, V1, V0 & V1, WWidth), true)
+    MICRO_OP_BINARY_HANDLERS(or, MicroLog(Registers, LazyFlags, V0, V1, V0 | V1, WWidth), true)
+    MICRO_OP_BINARY_HANDLERS(xor, MicroLog(Registers, LazyFlags, V0, V1, V0 ^ V1, WWidth), true)
+    MICRO_OP_BINARY_HANDLERS(test, MicroTest(Registers, LazyFlags, V0, V1, WWidth), false)
+
+#undef MICRO_OP_BINARY_HANDLERS
+    
+    MICRO_OP_HANDLER(inc_R)
+    {
+        u32 V0 = ReadMicroReg(Registers, Op->Reg0, WWidth);
+        WriteMicroReg(Registers, Op->Reg0, WWidth, MicroIncDec(Registers, LazyFlags, V0, V0 + 1, WWidth));
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_HANDLER(inc_M)
+    {
+        segmented_access Dest = MicroMemoryOperand(Memory, Registers, Op, &Result);
+        u32 V0 = ReadU16(Dest, 0);
+        WriteN(Dest, 0, MicroIncDec(Registers, LazyFlags, V0, V0 + 1, WWidth), WWidth);
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_HANDLER(dec_R)
+    {
+        u32 V0 = ReadMicroReg(Registers, Op->Reg0, WWidth);
+        WriteMicroReg(Registers, Op->Reg0, WWidth, MicroIncDec(Registers, LazyFlags, V0, V0 - 1, WWidth));
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_HANDLER(dec_M)
+    {
+        segmented_access Dest = MicroMemoryOperand(Memory, Registers, Op, &Result);
+        u32 V0 = ReadU16(Dest, 0);
+        WriteN(Dest, 0, MicroIncDec(Registers, LazyFlags, V0, V0 - 1, WWidth), WWidth);
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_HANDLER(push_R)
+    {
+        Push(Memory, Registers, ReadMicroReg(Registers, Op->Reg0, 2));
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_HANDLER(pop_R)
+    {
+        WriteMicroReg(Registers, Op->Reg0, 2, Pop(Memory, Registers));
+    } MICRO_OP_DONE;
+    
+    MICRO_OP_HANDLER(jump)
+    {
+        ConditionalJump(&Result, Registers, Op->Imm, JumpConditionHolds(Op->Instruction->Op, Registers, LazyFlags));
+    } MICRO_OP_DONE;
+    
+    // NOTE: Generic ops only ever run at the start of a chain, and always end it, since ExecInstruction
+    // may do anything to ip, or may not be able to run the instruction at all
+    MICRO_OP_HANDLER(Generic)
+    {
+        Result = ExecInstruction(Memory, Registers, *Op->Instruction, LazyFlags);
+        ++Run;
+        goto Done;
+    }
+
+#if !MICRO_OPS_THREADED
+        default: {} break;
+    }
+    
+    if(!MICRO_OP_CHAINS)
+    {
+        goto Done;
+    }
+    MICRO_OP_ADVANCE;
+    }
+#endif
+    
+    Done:
+#undef MICRO_OP_HANDLER
+#undef MICRO_OP_DONE
+#undef MICRO_OP_CHAINS
+#undef MICRO_OP_ADVANCE
+    
+    *RunCount = Run;
+    return Result;
+}
@@ -0,0 +1,84 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: Computed goto is a GCC/Clang extension. Everywhere else, micro-ops are dispatched with a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define MICRO_OPS_THREADED 1
+#else
+#define MICRO_OPS_THREADED 0
+#endif
+
+// NOTE: Operand shapes are R(egister), I(mmediate) and M(emory). The binary ops must always list their
+// shapes in the order RR, RI, RM, MR, MI, because lowering picks the kind by offsetting from the RR one.
+#define MICRO_OP_BINARY(Name) \
+    MICRO_OP(Name##_RR) \
+    MICRO_OP(Name##_RI) \
+    MICRO_OP(Name##_RM) \
+    MICRO_OP(Name##_MR) \
+    MICRO_OP(Name##_MI)
+
+#define MICRO_OP_KINDS \
+    MICRO_OP(Generic) \
+    MICRO_OP_BINARY(mov) \
+    MICRO_OP_BINARY(add) \
+    MICRO_OP_BINARY(sub) \
+    MICRO_OP_BINARY(cmp) \
+    MICRO_OP_BINARY(and) \
+    MICRO_OP_BINARY(or) \
+    MICRO_OP_BINARY(xor) \
+    MICRO_OP_BINARY(test) \
+    MICRO_OP(inc_R) \
+    MICRO_OP(inc_M) \
+    MICRO_OP(dec_R) \
+    MICRO_OP(dec_M) \
+    MICRO_OP(push_R) \
+    MICRO_OP(pop_R) \
+    MICRO_OP(jump)
+
+enum micro_op_kind : u8
+{
+#define MICRO_OP(Name) MicroOp_##Name,
+    MICRO_OP_KINDS
+#undef MICRO_OP
+    
+    MicroOp_Count,
+};
+
+struct micro_op
+{
+    instruction *Instruction; // NOTE: What the op was lowered from, for the generic fallback
+    
+    u32 Imm;
+    u16 Disp;
+    
+    micro_op_kind Kind;
+    u8 Size; // NOTE: Of the instruction, so that a chain of ops can move ip along on its own
+    u8 Width;
+    
+    // NOTE: Register operands are byte offsets into register_state_8086
+    u8 Reg0;
+    u8 Reg1;
+    
+    // NOTE: Memory operands are register indices
+    u8 SegReg;
+    u8 Term0;
+    u8 Term1;
+};
+
+static micro_op LowerToMicroOp(instruction *Instruction);
+// NOTE: Runs Op, and then up to Count - 1 of the ops after it, as long as they keep going straight through
+// the block the way the run loop would have run them one at a time. ip has to have already been moved past
+// Op's instruction, and is moved past each one after it before it runs. The chain stops early before a
+// generic op, or after any op that writes over code. *RunCount says how many ran, and the result is the
+// last one's.
+static exec_result ExecMicroOps(segmented_access Memory, register_state_8086 *Registers, micro_op *Op, u32 Count,
+                                u32 *RunCount, lazy_flags *LazyFlags = 0);
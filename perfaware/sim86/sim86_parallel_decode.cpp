@@ -0,0 +1,317 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static segmented_access SeekTo(segmented_access Image, u32 Offset)
+{
+    // NOTE: MoveBaseBy can only move by as much as fits in a segment offset, so the whole paragraphs
+    // go straight into the base. This lands on the same base and offset as stepping through one
+    // instruction at a time would have.
+    segmented_access Result = Image;
+    Result.SegmentBase += (u16)(Offset >> 4);
+    Result = MoveBaseBy(Result, Offset & 0xf);
+    
+    return Result;
+}
+
+static packed_instruction DecodePackedInstruction(instruction_table Table, segmented_access At, decode_mode Mode)
+{
+    // NOTE: The full instruction only ever lives in locals here, so nothing but the 16 packed bytes
+    // gets written out to wherever the caller is keeping them. Anything the decoder produces should fit,
+    // but if something ever doesn't, it comes back with no Op, the same as bytes that didn't decode.
+    instruction Instruction = DecodeInstruction(Table, At, Mode);
+    
+    packed_instruction Result = {};
+    if(!PackInstruction(Instruction, &Result))
+    {
+        Result = {};
+    }
+    
+    return Result;
+}
+
+static void DecodeStream(decode_chunk *Chunk, decoded_stream *Stream, u32 Offset, decoded_stream *Primary)
+{
+    u32 PrimaryIndex = 0;
+    u32 PrimaryOffset = Chunk->FirstOffset;
+    
+    Stream->Count = 0;
+    Stream->Stop = DecodeRange_OK;
+    Stream->Synced = false;
+    Stream->SyncIndex = 0;
+    
+    while(Offset < Chunk->OnePastLastOffset)
+    {
+        if(Primary)
+        {
+            while((PrimaryIndex < Primary->Count) && (PrimaryOffset < Offset))
+            {
+                PrimaryOffset += Primary->Instructions[PrimaryIndex++].Size;
+            }
+            
+            if(PrimaryOffset == Offset)
+            {
+                Stream->Synced = true;
+                Stream->SyncIndex = PrimaryIndex;
+                break;
+            }
+        }
+        
+        if(Stream->Count == Stream->Capacity)
+        {
+            break;
+        }
+        
+        packed_instruction Instruction = DecodePackedInstruction(Chunk->Table, SeekTo(Chunk->Image, Offset), Chunk->Mode);
+        if(!Instruction.Op)
+        {
+            Stream->Stop = DecodeRange_Unrecognized;
+            break;
+        }
+        
+        Stream->Instructions[Stream->Count++] = Instruction;
+        Offset += Instruction.Size;
+    }
+    
+    Stream->OnePastLastOffset = Offset;
+}
+
+static void DecodeChunk(void *Param)
+{
+    decode_chunk *Chunk = (decode_chunk *)Param;
+    
+    DecodeStream(Chunk, &Chunk->Primary, Chunk->FirstOffset, 0);
+    for(u32 CandidateIndex = 0; CandidateIndex < Chunk->CandidateCount; ++CandidateIndex)
+    {
+        DecodeStream(Chunk, Chunk->Candidates + CandidateIndex, Chunk->FirstOffset + CandidateIndex + 1, &Chunk->Primary);
+    }
+}
+
+static void StitchChunk(decode_chunk *Chunk, u32 EntryOffset)
+{
+    decoded_stream *Primary = &Chunk->Primary;
+    decoded_stream *Stream = Primary;
+    
+    u32 Skip = EntryOffset - Chunk->FirstOffset;
+    if(Skip)
+    {
+        assert(Skip <= Chunk->CandidateCount);
+        decoded_stream *Candidate = Chunk->Candidates + Skip - 1;
+        
+        if(Candidate->Synced)
+        {
+            // NOTE: The primary stream has room for a full candidate in front of it, so the candidate's
+            // instructions can always be copied in right before the one it synced up on
+            packed_instruction *First = Primary->Instructions + Candidate->SyncIndex - Candidate->Count;
+            for(u32 Index = 0; Index < Candidate->Count; ++Index)
+            {
+                First[Index] = Candidate->Instructions[Index];
+            }
+            
+            Chunk->First = First;
+            Chunk->Count = Candidate->Count + (Primary->Count - Candidate->SyncIndex);
+            Chunk->OnePastLastStitchedOffset = Primary->OnePastLastOffset;
+            Chunk->Stop = Primary->Stop;
+            
+            Stream = 0;
+        }
+        else if((Candidate->Stop != DecodeRange_OK) ||
+                (Candidate->OnePastLastOffset >= Chunk->OnePastLastOffset))
+        {
+            // NOTE: The candidate never met the primary, but it did get all the way through the chunk
+            Stream = Candidate;
+        }
+        else
+        {
+            // NOTE: The candidate ran out of room before it met the primary. This doesn't happen on any
+            // real code, but if it does, the chunk just gets decoded again from the right place.
+            DecodeStream(Chunk, Primary, EntryOffset, 0);
+        }
+    }
+    
+    if(Stream)
+    {
+        Chunk->First = Stream->Instructions;
+        Chunk->Count = Stream->Count;
+        Chunk->OnePastLastStitchedOffset = Stream->OnePastLastOffset;
+        Chunk->Stop = Stream->Stop;
+    }
+}
+
+static u32 NextInstructionBoundary(u64 *Boundaries, u32 Offset, u32 OnePastLastOffset)
+{
+    // NOTE: Returns OnePastLastOffset if there are no more boundaries before it
+    u32 Result = OnePastLastOffset;
+    
+    while(Offset < OnePastLastOffset)
+    {
+        u64 Bits = Boundaries[Offset >> 6] >> (Offset & 63);
+        if(Bits)
+        {
+            while(!(Bits & 1))
+            {
+                Bits >>= 1;
+                ++Offset;
+            }
+            
+            if(Offset < OnePastLastOffset)
+            {
+                Result = Offset;
+            }
+            break;
+        }
+        
+        Offset = (Offset | 63) + 1;
+    }
+    
+    return Result;
+}
+
+static u32 BoundaryAtOrAfter(u64 *Boundaries, decode_range_result Scan, u32 Offset, u32 ByteCount)
+{
+    // NOTE: Where the scan stopped counts as a boundary too, so that the chunk it stopped in decodes up to
+    // there and stops the same way. Chunks that would start any later than that are left empty.
+    u32 Result = ByteCount;
+    if(Offset <= Scan.ByteCount)
+    {
+        Result = NextInstructionBoundary(Boundaries, Offset, Scan.ByteCount);
+    }
+    
+    return Result;
+}
+
+static parallel_decode DecodeInParallel(instruction_table Table, segmented_access Image, u32 ByteCount,
+                                        decode_mode Mode, u32 ThreadCount)
+{
+    parallel_decode Result = {};
+    
+    u32 ChunkCount = ByteCount / PARALLEL_DECODE_MIN_CHUNK_SIZE;
+    if(ChunkCount > ThreadCount)
+    {
+        ChunkCount = ThreadCount;
+    }
+    if(ChunkCount > MAX_PLATFORM_THREADS)
+    {
+        ChunkCount = MAX_PLATFORM_THREADS;
+    }
+    if(ChunkCount < 1)
+    {
+        ChunkCount = 1;
+    }
+    
+    u32 ChunkSize = (ByteCount + ChunkCount - 1) / ChunkCount;
+    u32 CandidateCount = Table.MaxInstructionByteCount - 1;
+    assert(CandidateCount <= ArrayCount(Result.Chunks[0].Candidates));
+    if(CandidateCount > ArrayCount(Result.Chunks[0].Candidates))
+    {
+        CandidateCount = ArrayCount(Result.Chunks[0].Candidates);
+    }
+    
+    /* NOTE: If the image sits in memory without wrapping around, the length pre-scan can say exactly
+       where every instruction starts, for a lot less than decoding it would cost. Then each chunk can
+       just start on the first instruction at or after where it would have started, and nothing has to
+       be decoded speculatively. Chunk ends move along with the starts, so a chunk can end up to one
+       instruction longer than ChunkSize. */
+    u64 *Boundaries = 0;
+    decode_range_result Scan = {};
+    u32 ImageAddress = GetAbsoluteAddressOf(Image);
+    if((ChunkCount > 1) && ((u64)ImageAddress + ByteCount <= (u64)Image.Mask + 1) && GetLengthTable(Table))
+    {
+        Boundaries = (u64 *)malloc(((ByteCount + 63) / 64)*sizeof(u64));
+        if(Boundaries)
+        {
+            Scan = ScanInstructionBoundaries(Table, ByteCount, Image.Memory + ImageAddress, Boundaries);
+            CandidateCount = 0;
+        }
+    }
+    
+    // NOTE: Every instruction is at least one byte, so a chunk can never have more instructions than bytes.
+    // The primary stream gets room for one candidate in front of it, for stitching.
+    u32 CandidateCapacity = PARALLEL_DECODE_MAX_CANDIDATE_INSTRUCTIONS;
+    u32 PrimaryCapacity = ChunkSize + (Boundaries ? Table.MaxInstructionByteCount : 0);
+    u64 InstructionCount = (u64)ChunkCount*(CandidateCapacity + PrimaryCapacity + CandidateCount*CandidateCapacity);
+    
+    u64 TotalSize = ChunkCount*sizeof(decode_chunk) + InstructionCount*sizeof(packed_instruction);
+    Result.Chunks = (decode_chunk *)calloc(1, TotalSize);
+    if(Result.Chunks)
+    {
+        Result.ChunkCount = ChunkCount;
+        
+        packed_instruction *NextInstruction = (packed_instruction *)(Result.Chunks + ChunkCount);
+        for(u32 ChunkIndex = 0; ChunkIndex < ChunkCount; ++ChunkIndex)
+        {
+            decode_chunk *Chunk = Result.Chunks + ChunkIndex;
+            Chunk->Table = Table;
+            Chunk->Mode = Mode;
+            Chunk->Image = Image;
+            Chunk->FirstOffset = ChunkIndex*ChunkSize;
+            Chunk->OnePastLastOffset = Chunk->FirstOffset + ChunkSize;
+            if(Chunk->OnePastLastOffset > ByteCount)
+            {
+                Chunk->OnePastLastOffset = ByteCount;
+            }
+            
+            if(Boundaries)
+            {
+                Chunk->FirstOffset = BoundaryAtOrAfter(Boundaries, Scan, Chunk->FirstOffset, ByteCount);
+                Chunk->OnePastLastOffset = BoundaryAtOrAfter(Boundaries, Scan, Chunk->OnePastLastOffset, ByteCount);
+            }
+            
+            // NOTE: The first chunk always starts on an instruction, so it has no use for candidates
+            Chunk->CandidateCount = ChunkIndex ? CandidateCount : 0;
+            
+            NextInstruction += CandidateCapacity;
+            Chunk->Primary.Instructions = NextInstruction;
+            Chunk->Primary.Capacity = PrimaryCapacity;
+            NextInstruction += PrimaryCapacity;
+            
+            for(u32 CandidateIndex = 0; CandidateIndex < Chunk->CandidateCount; ++CandidateIndex)
+            {
+                decoded_stream *Candidate = Chunk->Candidates + CandidateIndex;
+                Candidate->Instructions = NextInstruction;
+                Candidate->Capacity = CandidateCapacity;
+                NextInstruction += CandidateCapacity;
+            }
+        }
+        
+        RunOnThreads(ChunkCount, DecodeChunk, Result.Chunks, sizeof(decode_chunk));
+        
+        // NOTE: Each chunk picks up exactly where the one before it left off
+        u32 EntryOffset = 0;
+        decode_range_error Stop = DecodeRange_OK;
+        for(u32 ChunkIndex = 0; ChunkIndex < ChunkCount; ++ChunkIndex)
+        {
+            decode_chunk *Chunk = Result.Chunks + ChunkIndex;
+            if((Stop == DecodeRange_OK) && (EntryOffset < Chunk->OnePastLastOffset))
+            {
+                StitchChunk(Chunk, EntryOffset);
+                EntryOffset = Chunk->OnePastLastStitchedOffset;
+                Stop = Chunk->Stop;
+            }
+            else
+            {
+                Chunk->Count = 0;
+                Chunk->OnePastLastStitchedOffset = EntryOffset;
+                Chunk->Stop = Stop;
+            }
+        }
+    }
+    
+    free(Boundaries);
+    
+    return Result;
+}
+
+static void FreeParallelDecode(parallel_decode *Decode)
+{
+    free(Decode->Chunks);
+    *Decode = {};
+}
@@ -0,0 +1,70 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: Parallel decoding splits an image into one chunk per thread. Nobody knows where the
+   instruction stream crosses into a chunk until the chunk before it is done, so each chunk is decoded
+   from its first byte (the primary stream), and then again from each of the next few bytes (the
+   candidate streams) until they land on an instruction boundary of the primary stream. x86 code falls
+   back into step within a few instructions, so the candidates are short. Once every chunk is done,
+   the chunks are stitched together in order: whichever candidate starts where the previous chunk
+   actually ended is used up to the point where it met the primary, and the primary is used from there.
+   
+   When the length pre-scan can see the whole image, none of that guessing is needed: the chunks are
+   moved to start on real instruction boundaries, there are no candidates, and stitching is just
+   putting the primaries end to end. */
+
+#define PARALLEL_DECODE_MIN_CHUNK_SIZE 4096
+#define PARALLEL_DECODE_MAX_CANDIDATE_INSTRUCTIONS 64
+
+struct decoded_stream
+{
+    u32 Capacity;
+    u32 Count;
+    packed_instruction *Instructions; // NOTE: Packed, since a whole image's worth of these is kept around at once
+    
+    u32 OnePastLastOffset; // NOTE: Offset just past the last instruction that was decoded
+    decode_range_error Stop; // NOTE: Unrecognized if the stream ended on bytes that didn't decode
+    
+    // NOTE: Candidate streams only
+    b32 Synced; // NOTE: Whether it landed on a boundary of the primary stream
+    u32 SyncIndex; // NOTE: Index of the primary stream instruction it landed on
+};
+
+struct decode_chunk
+{
+    instruction_table Table;
+    decode_mode Mode;
+    segmented_access Image;
+    
+    u32 FirstOffset;
+    u32 OnePastLastOffset;
+    u32 CandidateCount;
+    
+    decoded_stream Primary;
+    decoded_stream Candidates[16]; // NOTE: [0] starts one byte into the chunk, [1] two bytes, and so on
+    
+    // NOTE: Filled in by stitching
+    packed_instruction *First;
+    u32 Count;
+    u32 OnePastLastStitchedOffset;
+    decode_range_error Stop;
+};
+
+struct parallel_decode
+{
+    u32 ChunkCount;
+    decode_chunk *Chunks;
+};
+
+static parallel_decode DecodeInParallel(instruction_table Table, segmented_access Image, u32 ByteCount,
+                                        decode_mode Mode, u32 ThreadCount);
+static void FreeParallelDecode(parallel_decode *Decode);
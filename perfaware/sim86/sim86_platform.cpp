@@ -0,0 +1,495 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+#if _WIN32
+
+#include <intrin.h>
+#include <windows.h>
+
+static u64 GetOSTimerFreq(void)
+{
+    LARGE_INTEGER Freq;
+    QueryPerformanceFrequency(&Freq);
+    return Freq.QuadPart;
+}
+
+static u64 ReadOSTimer(void)
+{
+    LARGE_INTEGER Value;
+    QueryPerformanceCounter(&Value);
+    return Value.QuadPart;
+}
+
+static u64 ReadCPUTimer(void)
+{
+    return __rdtsc();
+}
+
+static u32 GetProcessorCount(void)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return Info.dwNumberOfProcessors;
+}
+
+struct thread_start
+{
+    thread_proc *Proc;
+    void *Param;
+};
+
+static DWORD WINAPI ThreadStart(LPVOID Start)
+{
+    thread_start *Thread = (thread_start *)Start;
+    Thread->Proc(Thread->Param);
+    return 0;
+}
+
+static void RunOnThreads(u32 ThreadCount, thread_proc *Proc, void *Params, u64 ParamSize)
+{
+    assert(ThreadCount <= MAX_PLATFORM_THREADS);
+    
+    thread_start Starts[MAX_PLATFORM_THREADS];
+    HANDLE Threads[MAX_PLATFORM_THREADS];
+    
+    u32 StartedCount = 0;
+    for(u32 ThreadIndex = 1; (ThreadIndex < ThreadCount) && (ThreadIndex < MAX_PLATFORM_THREADS); ++ThreadIndex)
+    {
+        thread_start *Start = Starts + StartedCount;
+        Start->Proc = Proc;
+        Start->Param = (u8 *)Params + ThreadIndex*ParamSize;
+        
+        Threads[StartedCount] = CreateThread(0, 0, ThreadStart, Start, 0, 0);
+        if(Threads[StartedCount])
+        {
+            ++StartedCount;
+        }
+        else
+        {
+            // NOTE: If the thread couldn't be made, the work still has to get done
+            Proc(Start->Param);
+        }
+    }
+    
+    if(ThreadCount)
+    {
+        Proc(Params);
+    }
+    
+    for(u32 StartedIndex = 0; StartedIndex < StartedCount; ++StartedIndex)
+    {
+        WaitForSingleObject(Threads[StartedIndex], INFINITE);
+        CloseHandle(Threads[StartedIndex]);
+    }
+}
+
+static u32 AtomicAddU32(u32 volatile *Value, u32 Addend)
+{
+    u32 Result = (u32)InterlockedExchangeAdd((LONG volatile *)Value, (LONG)Addend);
+    return Result;
+}
+
+static void *AllocateExecutableMemory(u64 Size)
+{
+    void *Result = VirtualAlloc(0, Size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    return Result;
+}
+
+static b32 ProtectCode(void *Memory, u64 Size, DWORD Protection)
+{
+    // NOTE: VirtualProtect already covers every page the range touches, so there is nothing to round
+    DWORD OldProtection = 0;
+    b32 Result = VirtualProtect(Memory, Size, Protection, &OldProtection);
+    return Result;
+}
+
+static b32 MakeCodeWritable(void *Memory, u64 Size)
+{
+    b32 Result = ProtectCode(Memory, Size, PAGE_READWRITE);
+    return Result;
+}
+
+static b32 MakeCodeExecutable(void *Memory, u64 Size)
+{
+    b32 Result = ProtectCode(Memory, Size, PAGE_EXECUTE_READ);
+    if(Result)
+    {
+        FlushInstructionCache(GetCurrentProcess(), Memory, Size);
+    }
+    
+    return Result;
+}
+
+static void FreeExecutableMemory(void *Memory, u64 Size)
+{
+    if(Memory)
+    {
+        VirtualFree(Memory, 0, MEM_RELEASE);
+    }
+}
+
+static mapped_file MapFile(char const *FileName, u32 Size, b32 Shared)
+{
+    mapped_file Result = {};
+    
+    HANDLE File = CreateFileA(FileName, Shared ? (GENERIC_READ|GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, 0,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    LARGE_INTEGER FileSize = {};
+    if((File != INVALID_HANDLE_VALUE) && GetFileSizeEx(File, &FileSize))
+    {
+        // NOTE: A view can't be bigger than the file without growing it, so only files at least Size bytes long
+        // get a real view. Private mappings of smaller ones fail, and the caller reads them instead. Shared ones
+        // get read into zeroed memory, which FlushMappedFile writes back over just the file's own bytes.
+        if(FileSize.QuadPart >= Size)
+        {
+            HANDLE Mapping = CreateFileMappingA(File, 0, Shared ? PAGE_READWRITE : PAGE_WRITECOPY, 0, Size, 0);
+            if(Mapping)
+            {
+                Result.Memory = (u8 *)MapViewOfFile(Mapping, Shared ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, Size);
+                CloseHandle(Mapping);
+            }
+        }
+        else if(Shared)
+        {
+            u8 *Copy = (u8 *)VirtualAlloc(0, Size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+            DWORD BytesRead = 0;
+            if(Copy && ReadFile(File, Copy, (DWORD)FileSize.QuadPart, &BytesRead, 0) &&
+               (BytesRead == (DWORD)FileSize.QuadPart))
+            {
+                Result.Memory = Copy;
+                Result.WriteBackFileName = FileName;
+            }
+            else if(Copy)
+            {
+                VirtualFree(Copy, 0, MEM_RELEASE);
+            }
+        }
+    }
+    
+    if(File != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(File);
+    }
+    
+    if(Result.Memory)
+    {
+        Result.Size = Size;
+        Result.FileSize = (FileSize.QuadPart < Size) ? (u32)FileSize.QuadPart : Size;
+        Result.Shared = Shared;
+        Result.ViewSize = Result.WriteBackFileName ? 0 : Size;
+    }
+    
+    return Result;
+}
+
+static b32 FlushMappedFile(mapped_file *File)
+{
+    b32 Result = true;
+    if(File->Memory && File->WriteBackFileName)
+    {
+        Result = false;
+        HANDLE Dest = CreateFileA(File->WriteBackFileName, GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if(Dest != INVALID_HANDLE_VALUE)
+        {
+            DWORD BytesWritten = 0;
+            Result = (WriteFile(Dest, File->Memory, File->FileSize, &BytesWritten, 0) &&
+                      (BytesWritten == File->FileSize));
+            CloseHandle(Dest);
+        }
+    }
+    else if(File->Memory && File->Shared)
+    {
+        Result = FlushViewOfFile(File->Memory, File->Size);
+    }
+    
+    return Result;
+}
+
+static void UnmapFile(mapped_file *File)
+{
+    if(File->Memory && File->WriteBackFileName)
+    {
+        VirtualFree(File->Memory, 0, MEM_RELEASE);
+    }
+    else if(File->Memory)
+    {
+        UnmapViewOfFile(File->Memory);
+    }
+    
+    *File = {};
+}
+
+#else
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+static u64 GetOSTimerFreq(void)
+{
+    return 1000000;
+}
+
+static u64 ReadOSTimer(void)
+{
+    struct timeval Value;
+    gettimeofday(&Value, 0);
+    
+    u64 Result = GetOSTimerFreq()*(u64)Value.tv_sec + (u64)Value.tv_usec;
+    return Result;
+}
+
+static u64 ReadCPUTimer(void)
+{
+    // NOTE: Without __rdtsc, this falls back on the monotonic clock, which counts nanoseconds. That is
+    // still a thousand times finer than gettimeofday.
+#if defined(__x86_64__) || defined(__i386__)
+    u64 Result = __rdtsc();
+#else
+    struct timespec Value;
+    clock_gettime(CLOCK_MONOTONIC, &Value);
+    u64 Result = 1000000000ull*(u64)Value.tv_sec + (u64)Value.tv_nsec;
+#endif
+    return Result;
+}
+
+static u32 GetProcessorCount(void)
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 Result = (Count > 0) ? (u32)Count : 1;
+    return Result;
+}
+
+struct thread_start
+{
+    thread_proc *Proc;
+    void *Param;
+};
+
+static void *ThreadStart(void *Start)
+{
+    thread_start *Thread = (thread_start *)Start;
+    Thread->Proc(Thread->Param);
+    return 0;
+}
+
+static void RunOnThreads(u32 ThreadCount, thread_proc *Proc, void *Params, u64 ParamSize)
+{
+    assert(ThreadCount <= MAX_PLATFORM_THREADS);
+    
+    thread_start Starts[MAX_PLATFORM_THREADS];
+    pthread_t Threads[MAX_PLATFORM_THREADS];
+    
+    u32 StartedCount = 0;
+    for(u32 ThreadIndex = 1; (ThreadIndex < ThreadCount) && (ThreadIndex < MAX_PLATFORM_THREADS); ++ThreadIndex)
+    {
+        thread_start *Start = Starts + StartedCount;
+        Start->Proc = Proc;
+        Start->Param = (u8 *)Params + ThreadIndex*ParamSize;
+        
+        if(pthread_create(Threads + StartedCount, 0, ThreadStart, Start) == 0)
+        {
+            ++StartedCount;
+        }
+        else
+        {
+            // NOTE: If the thread couldn't be made, the work still has to get done
+            Proc(Start->Param);
+        }
+    }
+    
+    if(ThreadCount)
+    {
+        Proc(Params);
+    }
+    
+    for(u32 StartedIndex = 0; StartedIndex < StartedCount; ++StartedIndex)
+    {
+        pthread_join(Threads[StartedIndex], 0);
+    }
+}
+
+static u32 AtomicAddU32(u32 volatile *Value, u32 Addend)
+{
+    u32 Result = __sync_fetch_and_add(Value, Addend);
+    return Result;
+}
+
+static void *AllocateExecutableMemory(u64 Size)
+{
+    void *Result = mmap(0, Size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(Result == MAP_FAILED)
+    {
+        Result = 0;
+    }
+    
+    return Result;
+}
+
+static b32 ProtectCode(void *Memory, u64 Size, int Protection)
+{
+    // NOTE: mprotect wants the start on a page boundary, so the range is widened out to whole pages
+    u64 PageMask = (u64)sysconf(_SC_PAGESIZE) - 1;
+    u64 First = (u64)Memory & ~PageMask;
+    u64 OnePastLast = ((u64)Memory + Size + PageMask) & ~PageMask;
+    b32 Result = (mprotect((void *)First, OnePastLast - First, Protection) == 0);
+    return Result;
+}
+
+static b32 MakeCodeWritable(void *Memory, u64 Size)
+{
+    b32 Result = ProtectCode(Memory, Size, PROT_READ|PROT_WRITE);
+    return Result;
+}
+
+static b32 MakeCodeExecutable(void *Memory, u64 Size)
+{
+    b32 Result = ProtectCode(Memory, Size, PROT_READ|PROT_EXEC);
+    return Result;
+}
+
+static void FreeExecutableMemory(void *Memory, u64 Size)
+{
+    if(Memory)
+    {
+        munmap(Memory, Size);
+    }
+}
+
+static mapped_file MapFile(char const *FileName, u32 Size, b32 Shared)
+{
+    mapped_file Result = {};
+    
+    int File = open(FileName, Shared ? O_RDWR : O_RDONLY);
+    struct stat Stat;
+    if((File >= 0) && (fstat(File, &Stat) == 0))
+    {
+        u32 FileSize = ((u64)Stat.st_size < Size) ? (u32)Stat.st_size : Size;
+        
+        // NOTE: Pages that are entirely past the end of the file can't be touched in a file mapping, so the
+        // file goes over the front of a zeroed mapping of the full size instead. What's left of the last page
+        // the file is in reads as zero on its own. Shared or not, only the file's own length is mapped, so
+        // nothing ever changes its size, and nothing written past its end goes back to it.
+        // Writing back a shared page that the file ends in zeroes everything in it past the end, which could
+        // happen in the middle of a run. So shared mappings leave that page out, read the file's part of it
+        // into the zeroed mapping, and FlushMappedFile writes that part back by hand.
+        u32 ViewSize = FileSize;
+        if(Shared)
+        {
+            ViewSize &= ~((u32)sysconf(_SC_PAGESIZE) - 1);
+        }
+        
+        int Flags = (Shared ? MAP_SHARED : MAP_PRIVATE)|MAP_FIXED;
+        void *Memory = mmap(0, Size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if((Memory != MAP_FAILED) &&
+           ((ViewSize && (mmap(Memory, ViewSize, PROT_READ|PROT_WRITE, Flags, File, 0) == MAP_FAILED)) ||
+            ((ViewSize < FileSize) &&
+             (pread(File, (u8 *)Memory + ViewSize, FileSize - ViewSize, ViewSize) != (ssize_t)(FileSize - ViewSize)))))
+        {
+            munmap(Memory, Size);
+            Memory = MAP_FAILED;
+        }
+        
+        if(Memory != MAP_FAILED)
+        {
+            Result.Memory = (u8 *)Memory;
+            Result.Size = Size;
+            Result.FileSize = FileSize;
+            Result.Shared = Shared;
+            Result.ViewSize = ViewSize;
+            if(ViewSize < FileSize)
+            {
+                Result.WriteBackFileName = FileName;
+            }
+        }
+    }
+    
+    if(File >= 0)
+    {
+        close(File);
+    }
+    
+    return Result;
+}
+
+static b32 FlushMappedFile(mapped_file *File)
+{
+    b32 Result = true;
+    if(File->Memory && File->Shared)
+    {
+        Result = (!File->ViewSize || (msync(File->Memory, File->ViewSize, MS_SYNC) == 0));
+        if(File->WriteBackFileName)
+        {
+            u32 TailSize = File->FileSize - File->ViewSize;
+            int Dest = open(File->WriteBackFileName, O_WRONLY);
+            Result = (Result && (Dest >= 0) &&
+                      (pwrite(Dest, File->Memory + File->ViewSize, TailSize, File->ViewSize) == (ssize_t)TailSize) &&
+                      (fsync(Dest) == 0));
+            if(Dest >= 0)
+            {
+                close(Dest);
+            }
+        }
+    }
+    
+    return Result;
+}
+
+static void UnmapFile(mapped_file *File)
+{
+    if(File->Memory)
+    {
+        munmap(File->Memory, File->Size);
+    }
+    
+    *File = {};
+}
+
+#endif
+
+static f64 SecondsFromOSTime(u64 OSTime)
+{
+    f64 Result = (f64)OSTime / (f64)GetOSTimerFreq();
+    return Result;
+}
+
+static u64 EstimateCPUTimerFreq(void)
+{
+    u64 MillisecondsToWait = 100;
+    u64 OSFreq = GetOSTimerFreq();
+    
+    u64 CPUStart = ReadCPUTimer();
+    u64 OSStart = ReadOSTimer();
+    u64 OSElapsed = 0;
+    u64 OSWaitTime = OSFreq*MillisecondsToWait / 1000;
+    while(OSElapsed < OSWaitTime)
+    {
+        OSElapsed = ReadOSTimer() - OSStart;
+    }
+    
+    u64 CPUElapsed = ReadCPUTimer() - CPUStart;
+    
+    u64 Result = 0;
+    if(OSElapsed)
+    {
+        Result = OSFreq*CPUElapsed / OSElapsed;
+    }
+    
+    return Result;
+}
@@ -0,0 +1,64 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static u64 GetOSTimerFreq(void);
+static u64 ReadOSTimer(void);
+
+static f64 SecondsFromOSTime(u64 OSTime);
+
+// NOTE: The CPU's own timestamp counter, for timing things too short for the OS timer to see. Nothing
+// says how fast it ticks, so EstimateCPUTimerFreq measures that against the OS timer.
+static u64 ReadCPUTimer(void);
+static u64 EstimateCPUTimerFreq(void);
+
+// NOTE: Runs Proc once for each of the ThreadCount params (laid out ParamSize bytes apart), each on its
+// own thread, and returns when they have all finished. The first one runs on the calling thread.
+#define MAX_PLATFORM_THREADS 64
+typedef void thread_proc(void *Param);
+
+static u32 GetProcessorCount(void);
+static void RunOnThreads(u32 ThreadCount, thread_proc *Proc, void *Params, u64 ParamSize);
+
+// NOTE: Returns what Value was before Addend was added to it
+static u32 AtomicAddU32(u32 volatile *Value, u32 Addend);
+
+// NOTE: Memory that can be written and then run, for the JIT. Returns 0 if the OS won't hand any out.
+// It is never writable and executable at the same time: it starts out writable, and the two Make calls
+// switch every page that overlaps the given range back and forth. They return false if the OS refuses.
+static void *AllocateExecutableMemory(u64 Size);
+static b32 MakeCodeWritable(void *Memory, u64 Size);
+static b32 MakeCodeExecutable(void *Memory, u64 Size);
+static void FreeExecutableMemory(void *Memory, u64 Size);
+
+/* NOTE: A file mapped in as Size bytes of memory, with anything past the end of the file reading as zero.
+   Private mappings are copy-on-write, so the file is never changed. Shared mappings write back to the file's
+   own bytes, and FlushMappedFile makes sure they have all landed. Either way the file keeps its size: what
+   lands past its end is never written anywhere, and it is up to the caller to check for that before flushing.
+   Memory is 0 if the file couldn't be mapped. */
+struct mapped_file
+{
+    u8 *Memory;
+    u32 Size;
+    u32 FileSize; // NOTE: How much of the file is in the mapping, as it was before anything was written to it
+    b32 Shared;
+    
+    // NOTE: On Windows, a view can't go past the end of a file without growing it, so a shared mapping of a
+    // file smaller than Size is really a copy, and FlushMappedFile writes the file's part of it back to here.
+    // Elsewhere, only the last page the file ends in is a copy, from ViewSize on. The name has to stay good
+    // until the file is unmapped.
+    char const *WriteBackFileName;
+    u32 ViewSize;
+};
+
+static mapped_file MapFile(char const *FileName, u32 Size, b32 Shared);
+static b32 FlushMappedFile(mapped_file *File);
+static void UnmapFile(mapped_file *File);
@@ -0,0 +1,189 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static address_profile AllocateProfile(u32 AddressCount)
+{
+    address_profile Result = {};
+    
+    // NOTE: Most of this is never touched, since programs only execute out of a tiny part of
+    // memory, so most of it never gets paged in either.
+    Result.Counts = (address_counts *)calloc(AddressCount, sizeof(address_counts));
+    if(Result.Counts)
+    {
+        Result.AddressCount = AddressCount;
+    }
+    
+    return Result;
+}
+
+static void FreeProfile(address_profile *Profile)
+{
+    free(Profile->Counts);
+    *Profile = {};
+}
+
+static b32 ProfileNeedsClocks(exec_result Exec, static_timing *Static)
+{
+    b32 Result = (!Static || ((Exec.RepCount | Exec.ShiftCount) != 0));
+    return Result;
+}
+
+static u32 ProfileClocksFor(b32 Assume8088, b32 BranchTaken, b32 Unaligned, instruction Instruction, static_timing Static)
+{
+    timing_state State = {};
+    State.Assume8088 = Assume8088;
+    State.AssumeBranchTaken = BranchTaken;
+    State.AssumeAddressUnanaligned = Unaligned;
+    
+    u32 Result = ExpectedClocksFrom(State, Instruction, ApplyDynamicTiming(State, Static)).Min;
+    return Result;
+}
+
+static void SettleProfileClocks(address_counts *Counts)
+{
+    // NOTE: No instruction is both a branch and a word transfer, so no execution gets both extras
+    profile_clock_rates *Rates = &Counts->Rates;
+    Counts->Clocks += ((Counts->ExecutionCount - Counts->ClockedCount)*Rates->Plain +
+                       (Counts->BranchTakenCount - Counts->ClockedBranchTakenCount)*Rates->TakenExtra +
+                       (Counts->UnalignedCount - Counts->ClockedUnalignedCount)*Rates->UnalignedExtra);
+    
+    Counts->ClockedCount = Counts->ExecutionCount;
+    Counts->ClockedBranchTakenCount = Counts->BranchTakenCount;
+    Counts->ClockedUnalignedCount = Counts->UnalignedCount;
+}
+
+static void ProfileInstruction(address_profile *Profile, u32 Address, instruction Instruction,
+                               static_timing *Static, u64 CacheFlushes, exec_result Exec,
+                               instruction_clock_interval *Clocks)
+{
+    if(Address < Profile->AddressCount)
+    {
+        address_counts *Counts = Profile->Counts + Address;
+        u64 BranchTaken = (Exec.BranchTaken != 0);
+        u64 Unaligned = ((Exec.AddressIsUnaligned != 0) && ((Instruction.Flags & Inst_Wide) != 0));
+        
+        if(Clocks)
+        {
+            Counts->Clocks += Clocks->Min;
+            ++Counts->ClockedCount;
+            Counts->ClockedBranchTakenCount += BranchTaken;
+            Counts->ClockedUnalignedCount += Unaligned;
+        }
+        else if((Counts->Rates.Static != Static) || (Counts->Rates.CacheFlushes != CacheFlushes))
+        {
+            SettleProfileClocks(Counts);
+            
+            profile_clock_rates *Rates = &Counts->Rates;
+            Rates->Static = Static;
+            Rates->CacheFlushes = CacheFlushes;
+            Rates->Plain = ProfileClocksFor(Profile->Assume8088, false, false, Instruction, *Static);
+            Rates->TakenExtra = ProfileClocksFor(Profile->Assume8088, true, false, Instruction, *Static) - Rates->Plain;
+            Rates->UnalignedExtra = ProfileClocksFor(Profile->Assume8088, false, true, Instruction, *Static) - Rates->Plain;
+        }
+        
+        ++Counts->ExecutionCount;
+        Counts->BranchTakenCount += BranchTaken;
+        Counts->UnalignedCount += Unaligned;
+    }
+}
+
+struct profile_entry
+{
+    u64 Clocks;
+    u32 Address;
+};
+
+static int CompareProfileEntries(void const *AInit, void const *BInit)
+{
+    profile_entry const *A = (profile_entry const *)AInit;
+    profile_entry const *B = (profile_entry const *)BInit;
+    
+    // NOTE: Most clocks first, and lowest address first among equals, so the order is always the same
+    int Result = ((A->Clocks > B->Clocks) ? -1 :
+                  (A->Clocks < B->Clocks) ? 1 :
+                  (A->Address < B->Address) ? -1 :
+                  (A->Address > B->Address) ? 1 : 0);
+    return Result;
+}
+
+static void PrintProfile(address_profile *Profile, segmented_access MainMemory, text_buffer *Out)
+{
+    u32 EntryCount = 0;
+    u64 TotalClocks = 0;
+    u64 TotalCount = 0;
+    for(u32 Address = 0; Address < Profile->AddressCount; ++Address)
+    {
+        address_counts *Counts = Profile->Counts + Address;
+        if(Counts->ExecutionCount)
+        {
+            SettleProfileClocks(Counts);
+            ++EntryCount;
+            TotalClocks += Counts->Clocks;
+            TotalCount += Counts->ExecutionCount;
+        }
+    }
+    
+    profile_entry *Entries = (profile_entry *)malloc(EntryCount*sizeof(profile_entry) + 1);
+    if(Entries)
+    {
+        u32 EntryIndex = 0;
+        for(u32 Address = 0; Address < Profile->AddressCount; ++Address)
+        {
+            if(Profile->Counts[Address].ExecutionCount)
+            {
+                profile_entry *Entry = Entries + EntryIndex++;
+                Entry->Clocks = Profile->Counts[Address].Clocks;
+                Entry->Address = Address;
+            }
+        }
+        qsort(Entries, EntryCount, sizeof(profile_entry), CompareProfileEntries);
+        
+        EmitFormatted(Out, "Profile: %llu instructions executed from %u addresses, %llu clocks\n\n",
+                      TotalCount, EntryCount, TotalClocks);
+        EmitString(Out, "      Clocks      %  Cumul%         Count     Taken Unaligned  Address  Instruction\n");
+        
+        // NOTE: The instructions are decoded from memory as it is at the end of the run, so code that
+        // modified itself shows up as whatever it was modified into.
+        instruction_table Table = Get8086InstructionTable();
+        u64 CumulativeClocks = 0;
+        for(EntryIndex = 0; EntryIndex < EntryCount; ++EntryIndex)
+        {
+            profile_entry *Entry = Entries + EntryIndex;
+            u32 Address = Entry->Address;
+            address_counts *Counts = Profile->Counts + Address;
+            CumulativeClocks += Entry->Clocks;
+            
+            f64 Percent = TotalClocks ? 100.0*(f64)Entry->Clocks / (f64)TotalClocks : 0.0;
+            f64 CumulativePercent = TotalClocks ? 100.0*(f64)CumulativeClocks / (f64)TotalClocks : 0.0;
+            EmitFormatted(Out, "%12llu %6.2f %6.2f %13llu %9llu %9llu  0x%05x  ",
+                          Entry->Clocks, Percent, CumulativePercent, Counts->ExecutionCount,
+                          Counts->BranchTakenCount, Counts->UnalignedCount, Address);
+            
+            segmented_access At = MainMemory;
+            At.SegmentBase = (u16)(Address >> 4);
+            At.SegmentOffset = (u16)(Address & 0xf);
+            instruction Instruction = DecodeInstruction(Table, At, DecodeMode_Lookup);
+            if(Instruction.Op)
+            {
+                PrintInstruction(Instruction, Out);
+            }
+            else
+            {
+                EmitString(Out, "(not an instruction anymore)");
+            }
+            EmitChar(Out, '\n');
+        }
+        EmitChar(Out, '\n');
+        
+        free(Entries);
+    }
+}
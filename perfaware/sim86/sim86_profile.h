@@ -0,0 +1,70 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: What one execution of the instruction at an address costs, worked out from its cached static
+// timing the first time it runs. Without repeats or shifts, every execution costs Plain clocks, plus
+// TakenExtra if it was a branch that was taken, or UnalignedExtra if it moved a word to an odd address.
+struct profile_clock_rates
+{
+    // NOTE: Which cached timing these were worked out from. The block cache hands out the same
+    // timings again after it flushes, so the pointer alone doesn't say which decode it was.
+    static_timing *Static;
+    u64 CacheFlushes;
+    
+    u32 Plain;
+    u32 TakenExtra;
+    u32 UnalignedExtra;
+};
+
+// NOTE: Everything -profile knows about one address, kept together so counting an instruction
+// only touches one spot in memory.
+struct address_counts
+{
+    u64 ExecutionCount;
+    u64 BranchTakenCount;
+    u64 UnalignedCount; // NOTE: Executions that paid the penalty for moving a word to or from an odd address
+    
+    u64 Clocks; // NOTE: The minimum of the estimate, when the estimate is a range
+    u64 ClockedCount; // NOTE: How much of each of the three counts above is already in Clocks
+    u64 ClockedBranchTakenCount;
+    u64 ClockedUnalignedCount;
+    
+    profile_clock_rates Rates;
+};
+
+/* NOTE: Counters for -profile. There is one entry per address of main memory, indexed by the
+   absolute address of the instruction, so counting an instruction is just a few adds.
+   Working out the clocks as every instruction runs costs more than all the counting, so usually that
+   waits. Executions are counted against the rates for their address, and only turned into clocks when
+   the rates change (because the block cache decoded the instruction again, maybe because it was
+   overwritten) or when the profile is printed. Executions whose clocks depend on more than the counts
+   show (repeats and shift counts), or that have no cached timing to go by, are clocked as they run. */
+struct address_profile
+{
+    u32 AddressCount;
+    b32 Assume8088;
+    address_counts *Counts;
+};
+
+static address_profile AllocateProfile(u32 AddressCount);
+static void FreeProfile(address_profile *Profile);
+
+// NOTE: Returns true if the clocks for this execution have to be worked out now and passed to ProfileInstruction
+static b32 ProfileNeedsClocks(exec_result Exec, static_timing *Static);
+
+// NOTE: Clocks has to be passed if ProfileNeedsClocks said so, and can be 0 otherwise. Static is the
+// instruction's cached static timing, if there is one, and CacheFlushes is how many times the block
+// cache it came from has been flushed.
+static void ProfileInstruction(address_profile *Profile, u32 Address, instruction Instruction,
+                               static_timing *Static, u64 CacheFlushes, exec_result Exec,
+                               instruction_clock_interval *Clocks);
+static void PrintProfile(address_profile *Profile, segmented_access MainMemory, text_buffer *Out);
@@ -0,0 +1,471 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: sim86_replay reads the trace files written by "sim86 -exec -trace <file>". By default it prints
+   each record the way "sim86 -exec -showclocks" would have printed the instruction. It can also
+   summarize a trace, or find the first place two traces disagree.
+   
+   Like sim86.cpp, this is a unity build, so compiling this one file is all it takes. */
+
+#include "sim86.h"
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sim86_instruction.h"
+#include "sim86_instruction_table.h"
+#include "sim86_memory.h"
+#include "sim86_decode.h"
+#include "sim86_state.h"
+#include "sim86_text.h"
+#include "sim86_trace_format.h"
+
+#include "sim86_instruction.cpp"
+#include "sim86_instruction_table.cpp"
+#include "sim86_memory.cpp"
+#include "sim86_decode.cpp"
+#include "sim86_text_table.cpp"
+#include "sim86_text.cpp"
+
+#define REPLAY_BUFFER_RECORD_COUNT (1 << 16)
+
+struct trace_reader
+{
+    FILE *Source;
+    u32 Capacity;
+    u32 Count;
+    u32 Next;
+    trace_record *Records;
+    u64 RecordIndex; // NOTE: Counts instructions only, not section records
+};
+
+static b32 IsTraceSection(trace_record *Record)
+{
+    b32 Result = (Record->InstructionSize == 0);
+    return Result;
+}
+
+static trace_reader OpenTraceReader(char const *FileName)
+{
+    trace_reader Result = {};
+    
+    FILE *Source = fopen(FileName, "rb");
+    if(Source)
+    {
+        trace_file_header Header = {};
+        if((fread(&Header, sizeof(Header), 1, Source) == 1) &&
+           (Header.Magic == TRACE_MAGIC) &&
+           (Header.Version == TRACE_VERSION) &&
+           (Header.RecordSize == sizeof(trace_record)))
+        {
+            Result.Records = (trace_record *)malloc(REPLAY_BUFFER_RECORD_COUNT*sizeof(trace_record));
+            if(Result.Records)
+            {
+                Result.Source = Source;
+                Result.Capacity = REPLAY_BUFFER_RECORD_COUNT;
+            }
+        }
+        
+        if(!Result.Source)
+        {
+            fclose(Source);
+        }
+    }
+    
+    return Result;
+}
+
+static trace_record *NextTraceRecord(trace_reader *Reader)
+{
+    trace_record *Result = 0;
+    
+    if(Reader->Source)
+    {
+        if(Reader->Next == Reader->Count)
+        {
+            Reader->Count = (u32)fread(Reader->Records, sizeof(trace_record), Reader->Capacity, Reader->Source);
+            Reader->Next = 0;
+        }
+        
+        if(Reader->Next < Reader->Count)
+        {
+            Result = Reader->Records + Reader->Next++;
+            if(!IsTraceSection(Result))
+            {
+                ++Reader->RecordIndex;
+            }
+        }
+    }
+    
+    return Result;
+}
+
+static void CloseTraceReader(trace_reader *Reader)
+{
+    if(Reader->Source)
+    {
+        fclose(Reader->Source);
+    }
+    free(Reader->Records);
+    
+    *Reader = {};
+}
+
+struct replay_state
+{
+    register_state_8086 Registers;
+    instruction_clock_interval Clocks;
+};
+
+static register_state_8086 RegistersFromRecord(trace_record *Record)
+{
+    register_state_8086 Result = {};
+    memcpy(Result.u16 + 1, Record->Registers, sizeof(Record->Registers));
+    return Result;
+}
+
+static instruction DecodeTraceRecord(instruction_table Table, trace_record *Record)
+{
+    instruction Result = {};
+    
+    if(Record->InstructionSize <= ArrayCount(Record->InstructionBytes))
+    {
+        u8 Bytes[16] = {};
+        memcpy(Bytes, Record->InstructionBytes, sizeof(Record->InstructionBytes));
+        
+        Result = DecodeInstruction(Table, FixedMemoryPow2(4, Bytes), DecodeMode_Lookup);
+        Result.Address = Record->Address;
+    }
+    
+    return Result;
+}
+
+static void PrintTraceRecord(instruction_table Table, trace_record *Record, replay_state *State, b32 ShowWrites,
+                             text_buffer *Out)
+{
+    if(IsTraceSection(Record))
+    {
+        // NOTE: Each run starts over from zeroed registers and no clocks, unless sim86 resumed it with -restore.
+        // Then the first instruction shows every register the checkpoint had set.
+        *State = {};
+        EmitString(Out, "--- run ");
+        EmitU32(Out, Record->Address);
+        EmitString(Out, " ---\n");
+    }
+    else
+    {
+        instruction Instruction = DecodeTraceRecord(Table, Record);
+        if(Instruction.Op)
+        {
+            PrintInstruction(Instruction, Out);
+        }
+        else
+        {
+            EmitString(Out, "(");
+            EmitU32(Out, Record->InstructionSize);
+            EmitString(Out, "-byte instruction not recorded)");
+        }
+        EmitString(Out, " ; ");
+        
+        State->Clocks.Min += Record->Clocks.Min;
+        State->Clocks.Max += Record->Clocks.Max;
+        PrintClockStep(Record->Clocks, State->Clocks, Out);
+        EmitString(Out, " | ");
+        
+        register_state_8086 Registers = RegistersFromRecord(Record);
+        PrintRegisterDifference(&State->Registers, &Registers, Out);
+        State->Registers = Registers;
+        
+        if(ShowWrites && Record->WriteByteCount)
+        {
+            EmitString(Out, "mem:0x");
+            EmitHex(Out, Record->WriteAddress, 5);
+            EmitChar(Out, '+');
+            EmitU32(Out, Record->WriteByteCount);
+            EmitChar(Out, '=');
+            for(u32 ByteIndex = 0; (ByteIndex < Record->WriteByteCount) && (ByteIndex < ArrayCount(Record->WriteBytes)); ++ByteIndex)
+            {
+                EmitHex(Out, Record->WriteBytes[ByteIndex], 2);
+            }
+            if(Record->WriteByteCount > ArrayCount(Record->WriteBytes))
+            {
+                EmitString(Out, "...");
+            }
+            EmitChar(Out, ' ');
+        }
+        
+        EmitChar(Out, '\n');
+    }
+}
+
+static int ReplayTrace(trace_reader *Reader, b32 ShowWrites, text_buffer *Out)
+{
+    instruction_table Table = Get8086InstructionTable();
+    replay_state State = {};
+    
+    while(trace_record *Record = NextTraceRecord(Reader))
+    {
+        PrintTraceRecord(Table, Record, &State, ShowWrites, Out);
+    }
+    
+    return 0;
+}
+
+struct op_summary
+{
+    u64 Count;
+    u64 ClocksMin;
+    u64 ClocksMax;
+};
+
+static int SummarizeTrace(trace_reader *Reader, text_buffer *Out)
+{
+    instruction_table Table = Get8086InstructionTable();
+    
+    op_summary Ops[Op_Count] = {};
+    op_summary Total = {};
+    u64 UnrecordedCount = 0;
+    u64 BytesWritten = 0;
+    u32 LowestAddress = 0xffffffff;
+    u32 HighestAddress = 0;
+    u32 RunCount = 0;
+    
+    while(trace_record *Record = NextTraceRecord(Reader))
+    {
+        if(IsTraceSection(Record))
+        {
+            ++RunCount;
+            continue;
+        }
+        
+        instruction Instruction = DecodeTraceRecord(Table, Record);
+        op_summary *Op = Ops + Instruction.Op;
+        if(!Instruction.Op)
+        {
+            ++UnrecordedCount;
+        }
+        
+        ++Op->Count;
+        Op->ClocksMin += Record->Clocks.Min;
+        Op->ClocksMax += Record->Clocks.Max;
+        
+        ++Total.Count;
+        Total.ClocksMin += Record->Clocks.Min;
+        Total.ClocksMax += Record->Clocks.Max;
+        
+        BytesWritten += Record->WriteByteCount;
+        if(LowestAddress > Record->Address) LowestAddress = Record->Address;
+        if(HighestAddress < Record->Address) HighestAddress = Record->Address;
+    }
+    
+    EmitString(Out, "Runs: ");
+    EmitU32(Out, RunCount);
+    EmitString(Out, "\nInstructions: ");
+    EmitU64(Out, Total.Count);
+    EmitString(Out, "\nClocks: ");
+    EmitU64(Out, Total.ClocksMin);
+    if(Total.ClocksMax != Total.ClocksMin)
+    {
+        EmitString(Out, " to ");
+        EmitU64(Out, Total.ClocksMax);
+    }
+    EmitString(Out, "\nBytes written: ");
+    EmitU64(Out, BytesWritten);
+    if(Total.Count)
+    {
+        EmitString(Out, "\nCode executed from: 0x");
+        EmitHex(Out, LowestAddress, 5);
+        EmitString(Out, " to 0x");
+        EmitHex(Out, HighestAddress, 5);
+    }
+    if(UnrecordedCount)
+    {
+        EmitString(Out, "\nInstructions too long to record: ");
+        EmitU64(Out, UnrecordedCount);
+    }
+    EmitString(Out, "\n\n");
+    
+    // NOTE: Ops are listed from most to least executed
+    for(;;)
+    {
+        u32 BestOp = 0;
+        for(u32 OpIndex = 1; OpIndex < Op_Count; ++OpIndex)
+        {
+            if(Ops[OpIndex].Count > Ops[BestOp].Count)
+            {
+                BestOp = OpIndex;
+            }
+        }
+        
+        op_summary *Op = Ops + BestOp;
+        if(!Op->Count || !BestOp)
+        {
+            break;
+        }
+        
+        EmitPaddedString(Out, GetMnemonic((operation_type)BestOp), 8);
+        EmitFormatted(Out, "%12llu (%5.1f%%) %14llu clocks (%5.1f%%)\n",
+                      Op->Count, 100.0*(f64)Op->Count / (f64)Total.Count,
+                      Op->ClocksMin, Total.ClocksMin ? 100.0*(f64)Op->ClocksMin / (f64)Total.ClocksMin : 0.0);
+        
+        Op->Count = 0;
+    }
+    
+    return 0;
+}
+
+static int DiffTraces(trace_reader *ReaderA, trace_reader *ReaderB, text_buffer *Out)
+{
+    int Result = 0;
+    
+    instruction_table Table = Get8086InstructionTable();
+    replay_state StateA = {};
+    replay_state StateB = {};
+    
+    for(;;)
+    {
+        trace_record *A = NextTraceRecord(ReaderA);
+        trace_record *B = NextTraceRecord(ReaderB);
+        
+        if(A && B)
+        {
+            if(memcmp(A, B, sizeof(trace_record)) == 0)
+            {
+                // NOTE: Nothing gets printed here, but the states still have to follow along, so the
+                // first differing records print their register changes correctly.
+                if(IsTraceSection(A))
+                {
+                    StateA = {};
+                }
+                else
+                {
+                    StateA.Registers = RegistersFromRecord(A);
+                    StateA.Clocks.Min += A->Clocks.Min;
+                    StateA.Clocks.Max += A->Clocks.Max;
+                }
+                StateB = StateA;
+            }
+            else
+            {
+                EmitString(Out, "Traces differ at instruction ");
+                EmitU64(Out, ReaderA->RecordIndex - 1);
+                EmitString(Out, ":\n< ");
+                PrintTraceRecord(Table, A, &StateA, true, Out);
+                EmitString(Out, "> ");
+                PrintTraceRecord(Table, B, &StateB, true, Out);
+                Result = 1;
+                break;
+            }
+        }
+        else
+        {
+            if(A || B)
+            {
+                EmitString(Out, "Traces match for ");
+                EmitU64(Out, (A ? ReaderB : ReaderA)->RecordIndex);
+                EmitString(Out, " instructions, then the ");
+                EmitString(Out, A ? "second" : "first");
+                EmitString(Out, " trace ends.\n");
+                Result = 1;
+            }
+            else
+            {
+                EmitString(Out, "Traces match (");
+                EmitU64(Out, ReaderA->RecordIndex);
+                EmitString(Out, " instructions).\n");
+            }
+            break;
+        }
+    }
+    
+    return Result;
+}
+
+static b32 OpenForReplay(trace_reader *Reader, char const *FileName)
+{
+    *Reader = OpenTraceReader(FileName);
+    b32 Result = (Reader->Source != 0);
+    if(!Result)
+    {
+        fprintf(stderr, "ERROR: Unable to read trace file %s.\n", FileName);
+    }
+    
+    return Result;
+}
+
+int main(int ArgCount, char **Args)
+{
+    int Result = 2;
+    
+    b32 Summary = false;
+    b32 Diff = false;
+    b32 ShowWrites = false;
+    char const *FileNames[2] = {};
+    u32 FileCount = 0;
+    
+    for(int ArgIndex = 1; ArgIndex < ArgCount; ++ArgIndex)
+    {
+        char *Arg = Args[ArgIndex];
+        if(strcmp(Arg, "-summary") == 0)
+        {
+            Summary = true;
+        }
+        else if(strcmp(Arg, "-diff") == 0)
+        {
+            Diff = true;
+        }
+        else if(strcmp(Arg, "-writes") == 0)
+        {
+            ShowWrites = true;
+        }
+        else if(FileCount < ArrayCount(FileNames))
+        {
+            FileNames[FileCount++] = Arg;
+        }
+    }
+    
+    text_buffer Out = AllocateTextBuffer(stdout, 1 << 20);
+    trace_reader Readers[2] = {};
+    
+    if(Diff && (FileCount == 2))
+    {
+        if(OpenForReplay(&Readers[0], FileNames[0]) &&
+           OpenForReplay(&Readers[1], FileNames[1]))
+        {
+            Result = DiffTraces(&Readers[0], &Readers[1], &Out);
+        }
+    }
+    else if(!Diff && (FileCount == 1))
+    {
+        if(OpenForReplay(&Readers[0], FileNames[0]))
+        {
+            Result = Summary ? SummarizeTrace(&Readers[0], &Out) : ReplayTrace(&Readers[0], ShowWrites, &Out);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "USAGE: %s [-summary | -writes] [trace file]\n", Args[0]);
+        fprintf(stderr, "       %s -diff [trace file] [trace file]\n", Args[0]);
+    }
+    
+    FlushText(&Out);
+    FreeTextBuffer(&Out);
+    CloseTraceReader(&Readers[0]);
+    CloseTraceReader(&Readers[1]);
+    
+    return Result;
+}
@@ -0,0 +1,347 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+static snapshot_store *AllocateSnapshotStore(u32 MemorySize)
+{
+    u32 PageCount = MemorySize >> DIRTY_PAGE_SHIFT;
+    u32 BitsSize = (PageCount + 7) / 8;
+    
+    snapshot_store *Store = (snapshot_store *)calloc(1, sizeof(snapshot_store) + BitsSize);
+    if(Store)
+    {
+        Store->Dirty.PageCount = PageCount;
+        Store->Dirty.Bits = (u8 *)(Store + 1);
+    }
+    
+    return Store;
+}
+
+static void FreeSnapshotStore(snapshot_store *Store)
+{
+    if(Store)
+    {
+        ReleaseSnapshot(Store->Base);
+        free(Store);
+    }
+}
+
+static b32 IsPageDirty(dirty_pages *Dirty, u32 Page)
+{
+    b32 Result = (Dirty->Bits[Page >> 3] & (1 << (Page & 7)));
+    return Result;
+}
+
+static void ClearDirtyPages(dirty_pages *Dirty)
+{
+    memset(Dirty->Bits, 0, (Dirty->PageCount + 7) / 8);
+}
+
+static void SetBase(snapshot_store *Store, snapshot *Snapshot)
+{
+    ++Snapshot->RefCount;
+    ReleaseSnapshot(Store->Base);
+    Store->Base = Snapshot;
+    ClearDirtyPages(&Store->Dirty);
+}
+
+static snapshot *TakeSnapshot(snapshot_store *Store, segmented_access MainMemory, register_state_8086 *Registers,
+                              u64 InstructionCount)
+{
+    u32 PageCount = Store->Dirty.PageCount;
+    snapshot *Result = (snapshot *)calloc(1, sizeof(snapshot) + PageCount*sizeof(snapshot_page *));
+    if(Result)
+    {
+        Result->RefCount = 1;
+        Result->PageCount = PageCount;
+        Result->InstructionCount = InstructionCount;
+        Result->Registers = *Registers;
+        Result->Pages = (snapshot_page **)(Result + 1);
+        
+        // NOTE: A snapshot missing a page would restore as whatever memory happens to hold, so if any
+        // page can't be copied, there is no snapshot at all. The store is left as it was.
+        b32 Complete = true;
+        snapshot *Base = Store->Base;
+        for(u32 Page = 0; Complete && (Page < PageCount); ++Page)
+        {
+            snapshot_page *Shared = Base ? Base->Pages[Page] : 0;
+            if(Shared && !IsPageDirty(&Store->Dirty, Page))
+            {
+                ++Shared->RefCount;
+                Result->Pages[Page] = Shared;
+            }
+            else
+            {
+                snapshot_page *Copy = (snapshot_page *)malloc(sizeof(snapshot_page));
+                if(Copy)
+                {
+                    Copy->RefCount = 1;
+                    memcpy(Copy->Data, MainMemory.Memory + (Page << DIRTY_PAGE_SHIFT), SNAPSHOT_PAGE_SIZE);
+                    ++Store->PagesCopied;
+                }
+                Result->Pages[Page] = Copy;
+                Complete = (Copy != 0);
+            }
+        }
+        
+        if(Complete)
+        {
+            SetBase(Store, Result);
+            ++Store->SnapshotCount;
+        }
+        else
+        {
+            ReleaseSnapshot(Result);
+            Result = 0;
+        }
+    }
+    
+    return Result;
+}
+
+static void RestoreSnapshot(snapshot_store *Store, snapshot *Snapshot, segmented_access MainMemory,
+                            register_state_8086 *Registers)
+{
+    // NOTE: Putting pages back still has to go through the code watch, so decoded blocks that came from
+    // them get thrown out. It shouldn't count as writes for anything else, though.
+    segmented_access Notify = MainMemory;
+    Notify.Writes = 0;
+    Notify.Dirty = 0;
+    
+    snapshot *Base = Store->Base;
+    for(u32 Page = 0; Page < Snapshot->PageCount; ++Page)
+    {
+        snapshot_page *Source = Snapshot->Pages[Page];
+        if(Source &&
+           (!Base || (Base->Pages[Page] != Source) || IsPageDirty(&Store->Dirty, Page)))
+        {
+            u32 Address = Page << DIRTY_PAGE_SHIFT;
+            memcpy(MainMemory.Memory + Address, Source->Data, SNAPSHOT_PAGE_SIZE);
+            NoteWriteRange(Notify, Address, Address + SNAPSHOT_PAGE_SIZE);
+            ++Store->PagesCopied;
+        }
+    }
+    
+    *Registers = Snapshot->Registers;
+    SetBase(Store, Snapshot);
+}
+
+static void ReleaseSnapshot(snapshot *Snapshot)
+{
+    if(Snapshot && (--Snapshot->RefCount == 0))
+    {
+        for(u32 Page = 0; Page < Snapshot->PageCount; ++Page)
+        {
+            snapshot_page *SnapshotPage = Snapshot->Pages[Page];
+            if(SnapshotPage && (--SnapshotPage->RefCount == 0))
+            {
+                free(SnapshotPage);
+            }
+        }
+        
+        free(Snapshot);
+    }
+}
+
+static snapshot_delta_header MakeDeltaHeader(u64 InstructionCount, register_state_8086 *Registers)
+{
+    snapshot_delta_header Header = {};
+    Header.Magic = SNAPSHOT_FILE_MAGIC;
+    Header.Version = SNAPSHOT_FILE_VERSION;
+    Header.PageShift = DIRTY_PAGE_SHIFT;
+    Header.InstructionCount = InstructionCount;
+    if(Registers)
+    {
+        memcpy(Header.Registers, Registers->u16, sizeof(Registers->u16));
+    }
+    
+    return Header;
+}
+
+static b32 WriteSnapshotDelta(FILE *Dest, snapshot *From, snapshot *To)
+{
+    snapshot_delta_header Header = MakeDeltaHeader(To->InstructionCount, &To->Registers);
+    
+    // NOTE: Pages shared between the two snapshots are the same page, so comparing pointers is enough
+    for(u32 Page = 0; Page < To->PageCount; ++Page)
+    {
+        if(!From || (From->Pages[Page] != To->Pages[Page]))
+        {
+            ++Header.PageCount;
+        }
+    }
+    
+    b32 Result = (fwrite(&Header, sizeof(Header), 1, Dest) == 1);
+    for(u32 Page = 0; Result && (Page < To->PageCount); ++Page)
+    {
+        if(!From || (From->Pages[Page] != To->Pages[Page]))
+        {
+            snapshot_page *SnapshotPage = To->Pages[Page];
+            Result = (SnapshotPage &&
+                      (fwrite(&Page, sizeof(Page), 1, Dest) == 1) &&
+                      (fwrite(SnapshotPage->Data, SNAPSHOT_PAGE_SIZE, 1, Dest) == 1));
+        }
+    }
+    
+    return Result;
+}
+
+static b32 WriteMemoryDelta(FILE *Dest, u8 *From, u8 *To, u32 MemorySize)
+{
+    // NOTE: The same thing as WriteSnapshotDelta, for plain copies of memory with no registers. Without
+    // anything shared to go by, pages are compared byte for byte.
+    snapshot_delta_header Header = MakeDeltaHeader(0, 0);
+    
+    u32 PageCount = MemorySize >> DIRTY_PAGE_SHIFT;
+    for(u32 Page = 0; Page < PageCount; ++Page)
+    {
+        u32 Address = Page << DIRTY_PAGE_SHIFT;
+        if(!From || memcmp(From + Address, To + Address, SNAPSHOT_PAGE_SIZE))
+        {
+            ++Header.PageCount;
+        }
+    }
+    
+    b32 Result = (fwrite(&Header, sizeof(Header), 1, Dest) == 1);
+    for(u32 Page = 0; Result && (Page < PageCount); ++Page)
+    {
+        u32 Address = Page << DIRTY_PAGE_SHIFT;
+        if(!From || memcmp(From + Address, To + Address, SNAPSHOT_PAGE_SIZE))
+        {
+            Result = ((fwrite(&Page, sizeof(Page), 1, Dest) == 1) &&
+                      (fwrite(To + Address, SNAPSHOT_PAGE_SIZE, 1, Dest) == 1));
+        }
+    }
+    
+    return Result;
+}
+
+static snapshot *ReadSnapshotDelta(FILE *Source, snapshot *From, u32 PageCount)
+{
+    // NOTE: The snapshot that comes back shares every page the delta doesn't have with From, the same way
+    // TakeSnapshot shares the pages that weren't written. Anything wrong with the delta, including running
+    // out of file partway through it, gives back no snapshot at all.
+    snapshot *Result = 0;
+    
+    snapshot_delta_header Header = {};
+    if((fread(&Header, sizeof(Header), 1, Source) == 1) &&
+       (Header.Magic == SNAPSHOT_FILE_MAGIC) &&
+       (Header.Version == SNAPSHOT_FILE_VERSION) &&
+       (Header.PageShift == DIRTY_PAGE_SHIFT) &&
+       (Header.PageCount <= PageCount) &&
+       (!From || (From->PageCount == PageCount)))
+    {
+        Result = (snapshot *)calloc(1, sizeof(snapshot) + PageCount*sizeof(snapshot_page *));
+    }
+    
+    if(Result)
+    {
+        Result->RefCount = 1;
+        Result->PageCount = PageCount;
+        Result->InstructionCount = Header.InstructionCount;
+        memcpy(Result->Registers.u16, Header.Registers, sizeof(Result->Registers.u16));
+        Result->Pages = (snapshot_page **)(Result + 1);
+        
+        for(u32 Page = 0; From && (Page < PageCount); ++Page)
+        {
+            snapshot_page *Shared = From->Pages[Page];
+            if(Shared)
+            {
+                ++Shared->RefCount;
+            }
+            Result->Pages[Page] = Shared;
+        }
+        
+        b32 Complete = true;
+        for(u32 PageIndex = 0; Complete && (PageIndex < Header.PageCount); ++PageIndex)
+        {
+            u32 Page = 0;
+            snapshot_page *Copy = 0;
+            Complete = ((fread(&Page, sizeof(Page), 1, Source) == 1) && (Page < PageCount));
+            if(Complete)
+            {
+                Copy = (snapshot_page *)malloc(sizeof(snapshot_page));
+                Complete = (Copy && (fread(Copy->Data, SNAPSHOT_PAGE_SIZE, 1, Source) == 1));
+            }
+            
+            if(Complete)
+            {
+                snapshot_page *Replaced = Result->Pages[Page];
+                if(Replaced && (--Replaced->RefCount == 0))
+                {
+                    free(Replaced);
+                }
+                
+                Copy->RefCount = 1;
+                Result->Pages[Page] = Copy;
+            }
+            else
+            {
+                free(Copy);
+            }
+        }
+        
+        // NOTE: Every page has to have come from somewhere, or restoring wouldn't set all of memory
+        for(u32 Page = 0; Complete && (Page < PageCount); ++Page)
+        {
+            Complete = (Result->Pages[Page] != 0);
+        }
+        
+        if(!Complete)
+        {
+            ReleaseSnapshot(Result);
+            Result = 0;
+        }
+    }
+    
+    return Result;
+}
+
+static snapshot *ReadCheckpoint(char const *FileName, u64 InstructionCount, u32 MemorySize)
+{
+    // NOTE: Gives back the last checkpoint in the file that was taken at or before InstructionCount.
+    // Deltas are read in order, each one building on the last, until one is past InstructionCount or
+    // the file ends. A delta that is cut off by the end of the file counts as the end, since that is what a
+    // run that died partway through writing one leaves behind. Anything else wrong means no checkpoint.
+    snapshot *Result = 0;
+    
+    FILE *Source = fopen(FileName, "rb");
+    if(Source)
+    {
+        u32 PageCount = MemorySize >> DIRTY_PAGE_SHIFT;
+        for(;;)
+        {
+            snapshot *Next = ReadSnapshotDelta(Source, Result, PageCount);
+            if(!Next)
+            {
+                if(!feof(Source))
+                {
+                    ReleaseSnapshot(Result);
+                    Result = 0;
+                }
+                break;
+            }
+            
+            if(Next->InstructionCount > InstructionCount)
+            {
+                ReleaseSnapshot(Next);
+                break;
+            }
+            
+            ReleaseSnapshot(Result);
+            Result = Next;
+        }
+        
+        fclose(Source);
+    }
+    
+    return Result;
+}
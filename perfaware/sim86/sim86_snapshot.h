@@ -0,0 +1,73 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+/* NOTE: A snapshot is the registers plus one pointer per page of main memory. Pages are copy-on-write:
+   taking a snapshot only copies the pages that were written since the store's last snapshot or restore,
+   and shares all the others with that snapshot. Restoring likewise only copies the pages that could
+   differ. For this to work, main memory has to be accessed with Dirty pointing at the store's pages. */
+
+#define SNAPSHOT_PAGE_SIZE (1 << DIRTY_PAGE_SHIFT)
+
+#define SNAPSHOT_FILE_MAGIC 0x44363853 // NOTE: "S86D"
+#define SNAPSHOT_FILE_VERSION 1
+
+struct snapshot_page
+{
+    u32 RefCount;
+    u8 Data[SNAPSHOT_PAGE_SIZE];
+};
+
+struct snapshot
+{
+    u32 RefCount;
+    u32 PageCount;
+    u64 InstructionCount; // NOTE: How far into the run the snapshot was taken, for the caller's use
+    register_state_8086 Registers;
+    snapshot_page **Pages;
+};
+
+struct snapshot_store
+{
+    dirty_pages Dirty; // NOTE: Pages written since memory last matched Base
+    snapshot *Base; // NOTE: 0 until the first snapshot, in which case every page counts as dirty
+    
+    u64 SnapshotCount;
+    u64 PagesCopied;
+};
+
+// NOTE: A snapshot delta holds the pages that changed between two snapshots. Against no snapshot at all,
+// it holds every page, which is how the base image of a chain of checkpoints is written. A checkpoint file
+// is a base image followed by one delta per checkpoint, so any checkpoint in it can be rebuilt by reading
+// the deltas in order up to that one.
+struct snapshot_delta_header
+{
+    u32 Magic;
+    u32 Version;
+    u32 PageShift;
+    u32 PageCount; // NOTE: Number of pages that follow, each one a u32 page index and then the page
+    u64 InstructionCount;
+    u16 Registers[16];
+};
+
+static snapshot_store *AllocateSnapshotStore(u32 MemorySize);
+static void FreeSnapshotStore(snapshot_store *Store);
+
+static snapshot *TakeSnapshot(snapshot_store *Store, segmented_access MainMemory, register_state_8086 *Registers,
+                              u64 InstructionCount = 0);
+static void RestoreSnapshot(snapshot_store *Store, snapshot *Snapshot, segmented_access MainMemory,
+                            register_state_8086 *Registers);
+static void ReleaseSnapshot(snapshot *Snapshot);
+
+static b32 WriteSnapshotDelta(FILE *Dest, snapshot *From, snapshot *To);
+static b32 WriteMemoryDelta(FILE *Dest, u8 *From, u8 *To, u32 MemorySize);
+static snapshot *ReadSnapshotDelta(FILE *Source, snapshot *From, u32 PageCount);
+static snapshot *ReadCheckpoint(char const *FileName, u64 InstructionCount, u32 MemorySize);
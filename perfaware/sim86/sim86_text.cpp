@@ -10,7 +10,182 @@
    
    ======================================================================== */
 
-static void PrintEffectiveAddressExpression(effective_address_expression Address, FILE *Dest)
+// NOTE: If an allocation fails, text still goes out, just in smaller pieces
+static char GlobalFallbackText[64];
+
+static text_buffer AllocateTextBuffer(FILE *Dest, u32 Capacity)
+{
+    text_buffer Result = {};
+    Result.Dest = Dest;
+    Result.Capacity = Capacity;
+    Result.Data = (char *)malloc(Capacity);
+    if(!Result.Data)
+    {
+        Result.Capacity = sizeof(GlobalFallbackText);
+        Result.Data = GlobalFallbackText;
+    }
+    
+    return Result;
+}
+
+static void FlushText(text_buffer *Out)
+{
+    if(Out->Used && Out->Dest)
+    {
+        fwrite(Out->Data, 1, Out->Used, Out->Dest);
+        Out->Used = 0;
+    }
+}
+
+static void FreeTextBuffer(text_buffer *Out)
+{
+    if(Out->Data != GlobalFallbackText)
+    {
+        free(Out->Data);
+    }
+    
+    *Out = {};
+}
+
+static void GrowText(text_buffer *Out)
+{
+    // NOTE: If the buffer can't grow, what was collected so far is thrown away rather than overrunning it
+    u32 NewCapacity = 2*Out->Capacity;
+    char *NewData = 0;
+    if(NewCapacity > Out->Capacity)
+    {
+        if(Out->Data == GlobalFallbackText)
+        {
+            NewData = (char *)malloc(NewCapacity);
+            if(NewData)
+            {
+                memcpy(NewData, Out->Data, Out->Used);
+            }
+        }
+        else
+        {
+            NewData = (char *)realloc(Out->Data, NewCapacity);
+        }
+    }
+    
+    if(NewData)
+    {
+        Out->Capacity = NewCapacity;
+        Out->Data = NewData;
+    }
+    else
+    {
+        Out->Used = 0;
+    }
+}
+
+static void EmitChar(text_buffer *Out, char Value)
+{
+    if(Out->Used == Out->Capacity)
+    {
+        if(Out->Dest)
+        {
+            FlushText(Out);
+        }
+        else
+        {
+            GrowText(Out);
+        }
+    }
+    
+    Out->Data[Out->Used++] = Value;
+}
+
+static void EmitString(text_buffer *Out, char const *String)
+{
+    while(*String)
+    {
+        EmitChar(Out, *String++);
+    }
+}
+
+static void EmitPaddedString(text_buffer *Out, char const *String, u32 Width)
+{
+    u32 Length = (u32)strlen(String);
+    while(Length < Width)
+    {
+        EmitChar(Out, ' ');
+        ++Length;
+    }
+    
+    EmitString(Out, String);
+}
+
+static void EmitDigits(text_buffer *Out, u64 Value, u32 Base, u32 MinDigits)
+{
+    // NOTE: Digits come out least significant first, so they are built backwards and then copied
+    char Digits[24];
+    u32 DigitCount = 0;
+    do
+    {
+        Digits[DigitCount++] = "0123456789abcdef"[Value % Base];
+        Value /= Base;
+    } while(Value || (DigitCount < MinDigits));
+    
+    while(DigitCount)
+    {
+        EmitChar(Out, Digits[--DigitCount]);
+    }
+}
+
+static void EmitU64(text_buffer *Out, u64 Value)
+{
+    EmitDigits(Out, Value, 10, 1);
+}
+
+static void EmitU32(text_buffer *Out, u32 Value)
+{
+    EmitDigits(Out, Value, 10, 1);
+}
+
+static void EmitS32(text_buffer *Out, s32 Value, b32 AlwaysSign)
+{
+    // NOTE: The magnitude is taken in unsigned so that the most negative value survives
+    u32 Magnitude = (u32)Value;
+    if(Value < 0)
+    {
+        EmitChar(Out, '-');
+        Magnitude = 0 - Magnitude;
+    }
+    else if(AlwaysSign)
+    {
+        EmitChar(Out, '+');
+    }
+    
+    EmitDigits(Out, Magnitude, 10, 1);
+}
+
+static void EmitHex(text_buffer *Out, u32 Value, u32 MinDigits)
+{
+    EmitDigits(Out, Value, 16, MinDigits);
+}
+
+static void EmitFormatted(text_buffer *Out, char const *Format, ...)
+{
+    // NOTE: This is for the handful of lines that aren't worth a hand-written formatter (summaries, floats).
+    // Whatever is buffered goes out first so that everything stays in order.
+    va_list Args;
+    va_start(Args, Format);
+    if(Out->Dest)
+    {
+        FlushText(Out);
+        vfprintf(Out->Dest, Format, Args);
+    }
+    else
+    {
+        char Line[1024];
+        vsnprintf(Line, sizeof(Line), Format, Args);
+        EmitString(Out, Line);
+    }
+    va_end(Args);
+}
+
+static void PrintEffectiveAddressExpression(effective_address_expression Address, text_buffer *Out)
 {
     b32 HadTerms = false;
     
@@ -22,12 +197,13 @@ static void PrintEffectiveAddressExpression(effective_address_expression Address
         
         if(Reg.Index)
         {
-            fprintf(Dest, "%s", Separator);
+            EmitString(Out, Separator);
             if(Term.Scale != 1)
             {
-                fprintf(Dest, "%d*", Term.Scale);
+                EmitS32(Out, Term.Scale);
+                EmitChar(Out, '*');
             }
-            fprintf(Dest, "%s", GetRegName(Reg));
+            EmitString(Out, GetRegName(Reg));
             Separator = "+";
             
             HadTerms = true;
@@ -36,11 +212,11 @@ static void PrintEffectiveAddressExpression(effective_address_expression Address
     
     if(!HadTerms || (Address.Displacement != 0))
     {
-        fprintf(Dest, "%+d", Address.Displacement);
+        EmitS32(Out, Address.Displacement, true);
     }
 }
 
-static void PrintInstruction(instruction Instruction, FILE *Dest)
+static void PrintInstruction(instruction Instruction, text_buffer *Out)
 {
     u32 Flags = Instruction.Flags;
     u32 W = Flags & Inst_Wide;
@@ -54,18 +230,20 @@ static void PrintInstruction(instruction Instruction, FILE *Dest)
             Instruction.Operands[0] = Instruction.Operands[1];
             Instruction.Operands[1] = Temp;
         }
-        fprintf(Dest, "lock ");
+        EmitString(Out, "lock ");
     }
     
     char const *MnemonicSuffix = "";
     if(Flags & Inst_Rep)
     {
         u32 Z = Flags & Inst_RepNE;
-        fprintf(Dest, "%s ", Z ? "rep" : "repne");
+        EmitString(Out, Z ? "rep " : "repne ");
         MnemonicSuffix = W ? "w" : "b";
     }
     
-    fprintf(Dest, "%s%s ", GetMnemonic(Instruction.Op), MnemonicSuffix);
+    EmitString(Out, GetMnemonic(Instruction.Op));
+    EmitString(Out, MnemonicSuffix);
+    EmitChar(Out, ' ');
     
     char const *Separator = "";
     for(u32 OperandIndex = 0; OperandIndex < ArrayCount(Instruction.Operands); ++OperandIndex)
@@ -73,7 +251,7 @@ static void PrintInstruction(instruction Instruction, FILE *Dest)
         instruction_operand Operand = Instruction.Operands[OperandIndex];
         if(Operand.Type != Operand_None)
         {
-            fprintf(Dest, "%s", Separator);
+            EmitString(Out, Separator);
             Separator = ", ";
             
             switch(Operand.Type)
@@ -82,7 +260,7 @@ static void PrintInstruction(instruction Instruction, FILE *Dest)
                 
                 case Operand_Register:
                 {
-                    fprintf(Dest, "%s", GetRegName(Operand.Register));
+                    EmitString(Out, GetRegName(Operand.Register));
                 } break;
                 
                 case Operand_Memory:
@@ -91,28 +269,31 @@ static void PrintInstruction(instruction Instruction, FILE *Dest)
                     
                     if(Address.Flags & Address_ExplicitSegment)
                     {
-                        fprintf(Dest, "%u:%u", Address.ExplicitSegment, Address.Displacement);
+                        EmitU32(Out, Address.ExplicitSegment);
+                        EmitChar(Out, ':');
+                        EmitU32(Out, (u32)Address.Displacement);
                     }
                     else
                     {
                         if(Flags & Inst_Far)
                         {
-                            fprintf(Dest, "far ");
+                            EmitString(Out, "far ");
                         }
                         
                         if(Instruction.Operands[0].Type != Operand_Register)
                         {
-                            fprintf(Dest, "%s ", W ? "word" : "byte");
+                            EmitString(Out, W ? "word " : "byte ");
                         }
                         
                         if(Flags & Inst_Segment)
                         {
-                            fprintf(Dest, "%s:", GetRegName({Instruction.SegmentOverride, 0, 2}));
+                            EmitString(Out, GetRegName({Instruction.SegmentOverride, 0, 2}));
+                            EmitChar(Out, ':');
                         }
                         
-                        fprintf(Dest, "[");
-                        PrintEffectiveAddressExpression(Address, Dest);
-                        fprintf(Dest, "]");
+                        EmitChar(Out, '[');
+                        PrintEffectiveAddressExpression(Address, Out);
+                        EmitChar(Out, ']');
                     }
                 } break;
                 
@@ -121,11 +302,12 @@ static void PrintInstruction(instruction Instruction, FILE *Dest)
                     immediate Immediate = Operand.Immediate;
                     if(Immediate.Flags & Immediate_RelativeJumpDisplacement)
                     {
-                        fprintf(Dest, "$%+d", Immediate.Value + Instruction.Size);
+                        EmitChar(Out, '$');
+                        EmitS32(Out, Immediate.Value + Instruction.Size, true);
                     }
                     else
                     {
-                        fprintf(Dest, "%d", Immediate.Value);
+                        EmitS32(Out, Immediate.Value);
                     }
                 } break;
             }
@@ -133,46 +315,20 @@ static void PrintInstruction(instruction Instruction, FILE *Dest)
     }
 }
 
-static void PrintFlags(u32 Value, FILE *Dest)
+static void PrintFlags(u32 Value, text_buffer *Out)
 {
-    if(Value & Flag_CF) {fprintf(Dest, "C");}
-    if(Value & Flag_PF) {fprintf(Dest, "P");}
-    if(Value & Flag_AF) {fprintf(Dest, "A");}
-    if(Value & Flag_ZF) {fprintf(Dest, "Z");}
-    if(Value & Flag_SF) {fprintf(Dest, "S");}
-    if(Value & Flag_TF) {fprintf(Dest, "T");}
-    if(Value & Flag_IF) {fprintf(Dest, "I");}
-    if(Value & Flag_DF) {fprintf(Dest, "D");}
-    if(Value & Flag_OF) {fprintf(Dest, "O");}
+    if(Value & Flag_CF) {EmitChar(Out, 'C');}
+    if(Value & Flag_PF) {EmitChar(Out, 'P');}
+    if(Value & Flag_AF) {EmitChar(Out, 'A');}
+    if(Value & Flag_ZF) {EmitChar(Out, 'Z');}
+    if(Value & Flag_SF) {EmitChar(Out, 'S');}
+    if(Value & Flag_TF) {EmitChar(Out, 'T');}
+    if(Value & Flag_IF) {EmitChar(Out, 'I');}
+    if(Value & Flag_DF) {EmitChar(Out, 'D');}
+    if(Value & Flag_OF) {EmitChar(Out, 'O');}
 }
 
-static void PrintRegisters(register_state_8086 *Registers, FILE *Dest)
-{
-    for(u32 RegIndex = 0; RegIndex < ArrayCount(Registers->u16); ++RegIndex)
-    {
-        u16 Value = Registers->u16[RegIndex];
-        
-        register_access Access = {};
-        Access.Index = RegIndex;
-        Access.Count = 2;
-        char const *Name = GetRegName(Access);
-        if(Value && *Name)
-        {
-            fprintf(Dest, "%8s: ", Name);
-            if(RegIndex == FLAGS_REGISTER_8086)
-            {
-                PrintFlags(Value, Dest);
-            }
-            else
-            {
-                fprintf(Dest, "0x%04x (%u)", Value, Value);
-            }
-            fprintf(Dest, "\n");
-        }
-    }
-}
-
-static void PrintRegisterDifference(register_state_8086 *Old, register_state_8086 *New, FILE *Dest)
+static void PrintRegisterDifference(register_state_8086 *Old, register_state_8086 *New, text_buffer *Out)
 {
     for(u32 RegIndex = 0; RegIndex < ArrayCount(Old->u16); ++RegIndex)
     {
@@ -186,51 +342,45 @@ static void PrintRegisterDifference(register_state_8086 *Old, register_state_808
         
         if(OldVal != NewVal)
         {
-            fprintf(Dest, "%s:", Name);
+            EmitString(Out, Name);
+            EmitChar(Out, ':');
             if(RegIndex == FLAGS_REGISTER_8086)
             {
-                PrintFlags(OldVal, Dest);
-                fprintf(Dest, "->");
-                PrintFlags(NewVal, Dest);
+                PrintFlags(OldVal, Out);
+                EmitString(Out, "->");
+                PrintFlags(NewVal, Out);
             }
             else
             {
-                fprintf(Dest, "0x%x->0x%x", OldVal, NewVal);
+                EmitString(Out, "0x");
+                EmitHex(Out, OldVal);
+                EmitString(Out, "->0x");
+                EmitHex(Out, NewVal);
             }
-            fprintf(Dest, " ");
+            EmitChar(Out, ' ');
         }
     }
 }
 
-static void PrintClockInterval(instruction_clock_interval Clocks, FILE *Dest)
+static void PrintClockStep(instruction_clock_interval Clocks, instruction_clock_interval Accum, text_buffer *Out)
 {
-    if(Clocks.Min != Clocks.Max)
+    if(Accum.Min != Accum.Max)
     {
-        fprintf(Dest, "[%u,%u]", Clocks.Min, Clocks.Max);
+        EmitString(Out, "Clocks: +[");
+        EmitU32(Out, Clocks.Min);
+        EmitChar(Out, ',');
+        EmitU32(Out, Clocks.Max);
+        EmitString(Out, "] = [");
+        EmitU32(Out, Accum.Min);
+        EmitChar(Out, ',');
+        EmitU32(Out, Accum.Max);
+        EmitChar(Out, ']');
     }
     else
     {
-        fprintf(Dest, "%u", Clocks.Min);
-    }
-}
-
-static void ExplainTiming(instruction_timing Timing, instruction_clock_interval Clocks, FILE *Dest)
-{
-    if(Timing.Base.Min != Clocks.Min)
-    {
-        fprintf(Dest, " (");
-        PrintClockInterval(Timing.Base, Dest);
-        if(Timing.EAClocks)
-        {
-            fprintf(Dest, " + %uea", Timing.EAClocks);
-        }
-        
-        u32 Penalty = Clocks.Min - (Timing.Base.Min + Timing.EAClocks);
-        if(Penalty)
-        {
-            fprintf(Dest, " + %up", Penalty);
-        }
-        
-        fprintf(Dest, ")");
+        EmitString(Out, "Clocks: +");
+        EmitU32(Out, Clocks.Min);
+        EmitString(Out, " = ");
+        EmitU32(Out, Accum.Min);
     }
 }
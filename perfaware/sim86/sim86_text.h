@@ -10,4 +10,28 @@
    
    ======================================================================== */
 
-static void PrintInstruction(instruction Instruction, FILE *Dest);
+// NOTE: Text is formatted into Data and only handed to Dest with a single fwrite when Data fills up
+// or FlushText is called, so large traces don't pay for stdio locking and format parsing on every token.
+// A buffer with no Dest just keeps growing, so text can be collected in memory and written out later.
+struct text_buffer
+{
+    FILE *Dest;
+    u32 Capacity;
+    u32 Used;
+    char *Data;
+};
+
+static text_buffer AllocateTextBuffer(FILE *Dest, u32 Capacity);
+static void FlushText(text_buffer *Out);
+static void FreeTextBuffer(text_buffer *Out);
+
+static void EmitChar(text_buffer *Out, char Value);
+static void EmitString(text_buffer *Out, char const *String);
+static void EmitPaddedString(text_buffer *Out, char const *String, u32 Width);
+static void EmitU64(text_buffer *Out, u64 Value);
+static void EmitU32(text_buffer *Out, u32 Value);
+static void EmitS32(text_buffer *Out, s32 Value, b32 AlwaysSign = false);
+static void EmitHex(text_buffer *Out, u32 Value, u32 MinDigits = 1);
+static void EmitFormatted(text_buffer *Out, char const *Format, ...);
+
+static void PrintInstruction(instruction Instruction, text_buffer *Out);
@@ -0,0 +1,115 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: Text that only the simulator itself prints, for reports on a run that sim86_replay can't
+// reconstruct from a trace: the final registers, the bus model and where an instruction's clocks came from.
+
+static void PrintRegisters(register_state_8086 *Registers, text_buffer *Out)
+{
+    for(u32 RegIndex = 0; RegIndex < ArrayCount(Registers->u16); ++RegIndex)
+    {
+        u16 Value = Registers->u16[RegIndex];
+        
+        register_access Access = {};
+        Access.Index = RegIndex;
+        Access.Count = 2;
+        char const *Name = GetRegName(Access);
+        if(Value && *Name)
+        {
+            EmitPaddedString(Out, Name, 8);
+            EmitString(Out, ": ");
+            if(RegIndex == FLAGS_REGISTER_8086)
+            {
+                PrintFlags(Value, Out);
+            }
+            else
+            {
+                EmitString(Out, "0x");
+                EmitHex(Out, Value, 4);
+                EmitString(Out, " (");
+                EmitU32(Out, Value);
+                EmitChar(Out, ')');
+            }
+            EmitChar(Out, '\n');
+        }
+    }
+}
+
+static void PrintClockInterval(instruction_clock_interval Clocks, text_buffer *Out)
+{
+    if(Clocks.Min != Clocks.Max)
+    {
+        EmitChar(Out, '[');
+        EmitU32(Out, Clocks.Min);
+        EmitChar(Out, ',');
+        EmitU32(Out, Clocks.Max);
+        EmitChar(Out, ']');
+    }
+    else
+    {
+        EmitU32(Out, Clocks.Min);
+    }
+}
+
+static void PrintBusStep(bus_clocks Clocks, u64 Accum, b32 Explain, text_buffer *Out)
+{
+    EmitString(Out, "Bus: +");
+    EmitU32(Out, Clocks.Clocks);
+    EmitString(Out, " = ");
+    EmitU64(Out, Accum);
+    
+    // NOTE: q is time spent waiting on the prefetch queue, b is time spent waiting for a fetch to get off the bus
+    if(Explain && (Clocks.QueueWait || Clocks.BusWait))
+    {
+        EmitString(Out, " (");
+        if(Clocks.QueueWait)
+        {
+            EmitU32(Out, Clocks.QueueWait);
+            EmitChar(Out, 'q');
+        }
+        if(Clocks.QueueWait && Clocks.BusWait)
+        {
+            EmitString(Out, " + ");
+        }
+        if(Clocks.BusWait)
+        {
+            EmitU32(Out, Clocks.BusWait);
+            EmitChar(Out, 'b');
+        }
+        EmitChar(Out, ')');
+    }
+}
+
+static void ExplainTiming(instruction_timing Timing, instruction_clock_interval Clocks, text_buffer *Out)
+{
+    if(Timing.Base.Min != Clocks.Min)
+    {
+        EmitString(Out, " (");
+        PrintClockInterval(Timing.Base, Out);
+        if(Timing.EAClocks)
+        {
+            EmitString(Out, " + ");
+            EmitU32(Out, Timing.EAClocks);
+            EmitString(Out, "ea");
+        }
+        
+        u32 Penalty = Clocks.Min - (Timing.Base.Min + Timing.EAClocks);
+        if(Penalty)
+        {
+            EmitString(Out, " + ");
+            EmitU32(Out, Penalty);
+            EmitChar(Out, 'p');
+        }
+        
+        EmitChar(Out, ')');
+    }
+}
@@ -0,0 +1,127 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+#define TRACE_BUFFER_RECORD_COUNT (1 << 16)
+
+static trace_writer OpenTraceWriter(char const *FileName)
+{
+    trace_writer Result = {};
+    
+    FILE *Dest = fopen(FileName, "wb");
+    trace_record *Records = (trace_record *)malloc(TRACE_BUFFER_RECORD_COUNT*sizeof(trace_record));
+    if(Dest && Records)
+    {
+        trace_file_header Header = {};
+        Header.Magic = TRACE_MAGIC;
+        Header.Version = TRACE_VERSION;
+        Header.RecordSize = sizeof(trace_record);
+        if(fwrite(&Header, sizeof(Header), 1, Dest) == 1)
+        {
+            Result.Dest = Dest;
+            Result.Capacity = TRACE_BUFFER_RECORD_COUNT;
+            Result.Records = Records;
+        }
+    }
+    
+    if(!Result.Dest)
+    {
+        if(Dest) fclose(Dest);
+        free(Records);
+    }
+    
+    return Result;
+}
+
+static void FlushTrace(trace_writer *Writer)
+{
+    if(Writer->Used)
+    {
+        // NOTE: A failed write is remembered rather than reported right away, so tracing doesn't have to
+        // check after every instruction. CloseTraceWriter says whether everything made it to the file.
+        if(fwrite(Writer->Records, sizeof(trace_record), Writer->Used, Writer->Dest) != Writer->Used)
+        {
+            Writer->WriteFailed = true;
+        }
+        Writer->Used = 0;
+    }
+}
+
+static void BeginTraceSection(trace_writer *Writer)
+{
+    trace_record *Record = Writer->Records + Writer->Used;
+    *Record = {};
+    Record->Address = Writer->SectionCount++;
+    
+    if(++Writer->Used == Writer->Capacity)
+    {
+        FlushTrace(Writer);
+    }
+}
+
+static trace_record *BeginTraceRecord(trace_writer *Writer, segmented_access At, u32 InstructionSize)
+{
+    // NOTE: The record is filled in place in the buffer, and only counted once EndTraceRecord is called,
+    // so an instruction that turns out not to execute just leaves it to be overwritten.
+    trace_record *Record = Writer->Records + Writer->Used;
+    
+    Record->Address = GetAbsoluteAddressOf(At);
+    Record->InstructionSize = (u8)InstructionSize;
+    
+    // NOTE: The bytes are copied before the instruction runs, in case it overwrites itself
+    for(u32 ByteIndex = 0; ByteIndex < ArrayCount(Record->InstructionBytes); ++ByteIndex)
+    {
+        Record->InstructionBytes[ByteIndex] = (ByteIndex < InstructionSize) ? *AccessMemory(At, (u16)ByteIndex) : 0;
+    }
+    
+    return Record;
+}
+
+static void EndTraceRecord(trace_writer *Writer, trace_record *Record, segmented_access MainMemory,
+                           register_state_8086 *Registers, instruction_clock_interval Clocks, write_span Writes)
+{
+    Record->Clocks = Clocks;
+    
+    Record->WriteAddress = Writes.FirstAddress;
+    Record->WriteByteCount = Writes.OnePastLastAddress - Writes.FirstAddress;
+    for(u32 ByteIndex = 0; ByteIndex < ArrayCount(Record->WriteBytes); ++ByteIndex)
+    {
+        Record->WriteBytes[ByteIndex] = ((ByteIndex < Record->WriteByteCount) ?
+                                         MainMemory.Memory[(Writes.FirstAddress + ByteIndex) & MainMemory.Mask] : 0);
+    }
+    
+    memcpy(Record->Registers, Registers->u16 + 1, sizeof(Record->Registers));
+    
+    if(++Writer->Used == Writer->Capacity)
+    {
+        FlushTrace(Writer);
+    }
+}
+
+static b32 CloseTraceWriter(trace_writer *Writer)
+{
+    b32 Result = true;
+    
+    if(Writer->Dest)
+    {
+        FlushTrace(Writer);
+        if(fclose(Writer->Dest) != 0)
+        {
+            Writer->WriteFailed = true;
+        }
+        Result = !Writer->WriteFailed;
+    }
+    free(Writer->Records);
+    
+    *Writer = {};
+    
+    return Result;
+}
@@ -0,0 +1,29 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: Writes the trace files described in sim86_trace_format.h. Reading them back is up to sim86_replay.
+struct trace_writer
+{
+    FILE *Dest;
+    u32 Capacity;
+    u32 Used;
+    trace_record *Records;
+    u32 SectionCount;
+    b32 WriteFailed;
+};
+
+static trace_writer OpenTraceWriter(char const *FileName);
+static void BeginTraceSection(trace_writer *Writer);
+static trace_record *BeginTraceRecord(trace_writer *Writer, segmented_access At, u32 InstructionSize);
+static void EndTraceRecord(trace_writer *Writer, trace_record *Record, segmented_access MainMemory,
+                           register_state_8086 *Registers, instruction_clock_interval Clocks, write_span Writes);
+static b32 CloseTraceWriter(trace_writer *Writer);
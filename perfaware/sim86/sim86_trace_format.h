@@ -0,0 +1,50 @@
+/* ========================================================================
+
+   (C) Copyright 2023 by Molly Rocket, Inc., All Rights Reserved.
+   
+   This software is provided 'as-is', without any express or implied
+   warranty. In no event will the authors be held liable for any damages
+   arising from the use of this software.
+   
+   Please see https://computerenhance.com for more information
+   
+   ======================================================================== */
+
+// NOTE: A trace file is a trace_file_header followed by one fixed-size trace_record per executed instruction.
+// Nothing is formatted while tracing. sim86_replay turns the records back into text, summaries or diffs.
+//
+// When sim86 executes several files with the same -trace, each one starts a new section. A section starts
+// with a record whose InstructionSize is 0 (no instruction is that short) and whose Address is the
+// section's index. Everything else in it is zero.
+#define TRACE_MAGIC 0x54363853 // NOTE: "S86T"
+#define TRACE_VERSION 2
+
+struct trace_file_header
+{
+    u32 Magic;
+    u32 Version;
+    u32 RecordSize;
+    u32 Reserved;
+};
+
+struct trace_record
+{
+    u32 Address;
+    instruction_clock_interval Clocks;
+    
+    // NOTE: Every byte the instruction wrote is inside this range, but WriteBytes only holds the first 4 of them.
+    // That covers any single store. The rest of a longer write (a REP string op, or the flags, CS and IP an
+    // interrupt pushes) is not recorded, so -diff can't see differences past the fourth byte.
+    u32 WriteAddress;
+    u32 WriteByteCount;
+    
+    // NOTE: The whole register file (ax through flags) after the instruction executed. Storing all of it
+    // rather than just what changed keeps records fixed-size, and the changes fall out of comparing
+    // neighboring records.
+    u16 Registers[14];
+    
+    u8 WriteBytes[4];
+    u8 InstructionSize;
+    u8 InstructionBytes[11]; // NOTE: Only the first 11 bytes of longer instructions are kept
+};
+static_assert(sizeof(trace_record) == 64, "Trace records are expected to be 64 bytes");